@@ -11,6 +11,7 @@
 // ============================================================================
 #define UDP_PORT 5000
 #define TCP_PORT 6000
+#define STREAM_TCP_PORT 6001    // Lossless frame stream (alternative to UDP)
 
 // Default UDP destination (can be changed via TCP command)
 #define DEFAULT_UDP_DEST_IP_A   192
@@ -33,16 +34,154 @@
 // BRAM base address (connected to M_AXI_GP1)
 #define BRAM_BASE_ADDR          0x80000000
 
-// BRAM layout - matches FPGA configuration
+// BRAM layout - must match the bram_depth_words build parameter of the block design
+// (reported by the PL in STATUS_REG_12; START is refused if it differs). The
+// thresholds below scale with it.
 #define BYTES_PER_WORD          4           // 32-bit words
-#define BRAM_SIZE_WORDS         16384       // 16384 x 32-bit words (64KB)
-#define BRAM_SIZE_BYTES         (BRAM_SIZE_WORDS * BYTES_PER_WORD)   // 64KB
+#define BRAM_SIZE_WORDS         65536       // 65536 x 32-bit words (256KB)
+#define BRAM_SIZE_BYTES         (BRAM_SIZE_WORDS * BYTES_PER_WORD)   // 256KB
 
-// Packet size calculation based on channel_enable bits
+// ============================================================================
+// FRAME HISTORY CONFIGURATION
+// ============================================================================
+
+// Rolling history of the most recent frames in DDR (history.c): 64 MB holds about
+// 7.5 s at 30 kS/s with all channels of one port enabled
+#define HISTORY_SIZE_WORDS      (16 * 1024 * 1024)
+
+// ============================================================================
+// FORWARD ERROR CORRECTION
+// ============================================================================
+
+// With SET_FEC, every group of FEC group size frames (timestamps g*K to g*K+K-1) is
+// followed by a parity datagram: [magic low][FEC_MAGIC_HIGH][first timestamp low]
+// [first timestamp high][group size][frame mask][XOR of the frames' data words]. Bit
+// i of the mask says frame first + i was sent and is part of the XOR, so a receiver
+// can rebuild any one frame of the group that did not arrive.
+#define FEC_MAGIC_HIGH          0xCAFEFEC0
+#define FEC_HEADER_WORDS        6
+#define FEC_MAX_GROUP_SIZE      32          // One mask bit per frame
+
+// ============================================================================
+// TRANSMIT PACING
+// ============================================================================
+
+// Frames left in BRAM after a stall go out at no more than PACING_RATE_PERCENT of the
+// sample rate, with bursts of up to PACING_BURST_FRAMES, so catching up does not
+// overflow switch and host socket buffers (pacer.c). Once the backlog passes
+// PACING_OVERRIDE_WORDS the PL is about to overwrite unsent frames and the pacer
+// steps aside.
+#define PACING_RATE_PERCENT     300         // Default, SET_PACING changes it
+#define PACING_BURST_FRAMES     8
+#define PACING_MIN_RATE_PERCENT 110         // Below this a backlog would barely shrink
+#define PACING_MAX_BURST_FRAMES 256
+#define PACING_OVERRIDE_WORDS   (BRAM_SIZE_WORDS / 2)
+
+// ============================================================================
+// TRANSMIT FLOW CONTROL
+// ============================================================================
+
+// A frame goes out only when the GEM TX ring has room for it (lwIP's header pbuf
+// plus the PBUF_REF payload). A frame that cannot be sent for lack of descriptors
+// or lwIP buffers stays in BRAM and is tried again on the next main loop pass;
+// only once the backlog passes TX_DROP_BACKLOG_WORDS is it dropped to keep ahead
+// of the PL.
+#define TX_DESCRIPTORS_PER_FRAME 2
+#define TX_DROP_BACKLOG_WORDS   (BRAM_SIZE_WORDS * 3 / 4)
+#define TX_STOP_RETRIES         1000        // 1 us apart while draining at STOP
+
+// ============================================================================
+// MAIN LOOP SCHEDULER
+// ============================================================================
+
+// Main loop tasks in priority order (scheduler.c). Past SCHED_URGENT_WORDS of
+// backlog the drain gets a larger budget and commands and telemetry wait, for at
+// most SCHED_MAX_DEFER_US; a backlog past SCHED_DEADLINE_WORDS is a deadline miss.
+typedef enum {
+    TASK_STREAM_DRAIN,
+    TASK_ETHERNET_RX,
+    TASK_LWIP_TIMERS,
+    TASK_COMMANDS,
+    TASK_TELEMETRY,
+    SCHED_NUM_TASKS
+} sched_task_id_t;
+
+#define SCHED_URGENT_WORDS      (BRAM_SIZE_WORDS / 2)
+#define SCHED_DEADLINE_WORDS    (BRAM_SIZE_WORDS * 3 / 4)
+#define SCHED_MAX_DEFER_US      10000
+
+// ============================================================================
+// BUFFER HEADROOM
+// ============================================================================
+
+// The PL keeps high-water marks of its FIFO and of the BRAM words the PS has not
+// read yet (STATUS_REG_11, measured against the read pointer the PS publishes in
+// CTRL_REG_PS_READ). Each drain turn that finds a frame also counts the backlog in
+// a histogram of power-of-two bins: bin 0 is below BACKLOG_HIST_MIN_WORDS, bin n
+// starts at BACKLOG_HIST_MIN_WORDS << (n - 1), and the last bin holds everything
+// from there up (headroom.c).
+#define BACKLOG_HIST_BINS       12
+#define BACKLOG_HIST_MIN_WORDS  64          // Less than one frame of one port
+
+// ============================================================================
+// TELEMETRY
+// ============================================================================
+
+// SET_TELEMETRY has a telemetry_datagram_t pushed to a monitor at a fixed rate
+// (telemetry.c), so watching the board costs the same however many observers
+// there are. Without an address it goes to TELEMETRY_PORT on the UDP stream host.
+#define TELEMETRY_PORT          5001
+#define TELEMETRY_MAGIC_HIGH    0xCAFE7E1E
+#define TELEMETRY_MAX_RATE_HZ   100
+
+// ============================================================================
+// BRAM COPY AND BENCHMARK
+// ============================================================================
+
+// Frames are copied out of BRAM by one of the routines below, with the BRAM section
+// either strongly ordered (the boot mapping) or cacheable and invalidated before
+// each copy. A copy method is mapping * BRAM_COPY_NUM_ROUTINES + routine
+// (bram_copy.c). RUN_BENCHMARK times every method for every frame size, together
+// with the UDP send path and single register reads, and the fastest method becomes
+// the production copy path; the copies alone are also measured at startup
+// (benchmark.c).
+typedef enum {
+    BRAM_COPY_IN32,                 // Xil_In32 word by word
+    BRAM_COPY_MEMCPY,
+    BRAM_COPY_LDM,                  // LDM/STM, eight words at a time
+    BRAM_COPY_NEON,                 // vld1/vst1 of four D registers, eight words at a time
+    BRAM_COPY_NUM_ROUTINES
+} bram_copy_routine_t;
+
+typedef enum {
+    BRAM_MAP_UNCACHED,              // Strongly ordered
+    BRAM_MAP_CACHED,                // Normal write-through, invalidated before each copy
+    BRAM_NUM_MAPPINGS
+} bram_mapping_t;
+
+#define BRAM_COPY_NUM_METHODS   (BRAM_COPY_NUM_ROUTINES * BRAM_NUM_MAPPINGS)
+#define BENCH_NUM_SIZES         (CHANNELS_PER_PORT * PL_NUM_SPI_PORTS)  // Frame size per channel count
+#define BENCH_COPY_REPEATS      64          // Frames copied per method and size
+#define BENCH_NET_REPEATS       32          // pbufs and datagrams per size
+#define BENCH_REG_REPEATS       1024
+#define BENCH_UDP_PORT          9           // Discard port on the stream host
+
+// ============================================================================
+// HEADSTAGE PORTS
+// ============================================================================
+
+// Number of headstage SPI ports - must match the data_generator N_SPI_PORTS
+// build parameter (reported by the PL in STATUS_REG_10)
+#define PL_NUM_SPI_PORTS        1
+#define PL_NUM_CIPO_LINES       (2 * PL_NUM_SPI_PORTS)
+#define CHANNELS_PER_PORT       4           // CIPO0/CIPO1 x regular/DDR
+#define CHANNEL_ENABLE_ALL      (0xFFFFFFFFu >> (32 - CHANNELS_PER_PORT * PL_NUM_SPI_PORTS))
+
+// Packet size calculation based on channel_enable bits (4 per port)
 #define PACKET_HEADER_WORDS     4           // Magic number + timestamp
-#define MAX_PACKET_DATA_WORDS   70          // Maximum data words (all 4 channels enabled)
+#define MAX_PACKET_DATA_WORDS   (35 * CHANNELS_PER_PORT * PL_NUM_SPI_PORTS / 2) // All channels enabled (70 per port)
 #define MIN_PACKET_DATA_WORDS   18          // Minimum data words (1 channel enabled)
-#define MAX_WORDS_PER_PACKET    (PACKET_HEADER_WORDS + MAX_PACKET_DATA_WORDS) // 74 words
+#define MAX_WORDS_PER_PACKET    (PACKET_HEADER_WORDS + MAX_PACKET_DATA_WORDS) // 4 + 70 per port
 #define MIN_WORDS_PER_PACKET    (PACKET_HEADER_WORDS + MIN_PACKET_DATA_WORDS) // 22 words
 
 // ============================================================================
@@ -56,21 +195,29 @@
 #define CTRL_REG_0_OFFSET   (0 * 4)   // Enable transmission, reset timestamp, debug mode
 #define CTRL_REG_1_OFFSET   (1 * 4)   // Loop count
 #define CTRL_REG_2_OFFSET   (2 * 4)   // Phase select, channel enable
+#define CTRL_REG_3_OFFSET   (3 * 4)   // Inter-frame idle cycles (sample rate)
 #define CTRL_REG_MOSI_START_OFFSET  (CTRL_REG_0_OFFSET + (4 * 4)) // Offset for MOSI control words
-
-// Status register offsets
-#define STATUS_REG_0_OFFSET  (22 * 4)  // Dynamic status + counters
-#define STATUS_REG_1_OFFSET  (23 * 4)  // Reflected control parameters
-#define STATUS_REG_2_OFFSET  (24 * 4)  // Packets sent
-#define STATUS_REG_3_OFFSET  (25 * 4)  // Timestamp low [31:0]
-#define STATUS_REG_4_OFFSET  (26 * 4)  // Timestamp high [63:32]
-#define STATUS_REG_5_OFFSET  (27 * 4)  // Loop count (registered)
+// Per-port configuration (same layout as CTRL_REG_2) - port 0 is CTRL_REG_2,
+// ports 1 and up follow the MOSI control words (registers 22, 23, ...)
+#define CTRL_REG_PORT_OFFSET(p)     (((p) == 0) ? CTRL_REG_2_OFFSET : ((21 + (p)) * 4))
+#define CTRL_REG_PS_READ_OFFSET     ((21 + PL_NUM_SPI_PORTS) * 4)   // PS read pointer (words), after the ports
+#define PL_NUM_CTRL_REGS    (22 + PL_NUM_SPI_PORTS)   // 23 for a single port
+
+// Status register offsets (status registers follow the control registers)
+#define STATUS_REG_0_OFFSET  ((PL_NUM_CTRL_REGS + 0) * 4)   // Dynamic status + counters
+#define STATUS_REG_1_OFFSET  ((PL_NUM_CTRL_REGS + 1) * 4)   // Reflected control parameters
+#define STATUS_REG_2_OFFSET  ((PL_NUM_CTRL_REGS + 2) * 4)   // Packets sent
+#define STATUS_REG_3_OFFSET  ((PL_NUM_CTRL_REGS + 3) * 4)   // Timestamp low [31:0]
+#define STATUS_REG_4_OFFSET  ((PL_NUM_CTRL_REGS + 4) * 4)   // Timestamp high [63:32]
+#define STATUS_REG_5_OFFSET  ((PL_NUM_CTRL_REGS + 5) * 4)   // Loop count (registered)
 // Mirrored control registers in status space
-#define STATUS_REG_6_OFFSET  (28 * 4)  // Mirror of CTRL_REG_0 (enable, reset, etc.)
-#define STATUS_REG_7_OFFSET  (29 * 4)  // Mirror of CTRL_REG_1 (loop count)
-#define STATUS_REG_8_OFFSET  (30 * 4)  // Mirror of CTRL_REG_2 (phase select, debug mode)
-#define STATUS_REG_9_OFFSET  (31 * 4)  // Mirror of CTRL_REG_3 (reserved)
-#define STATUS_REG_10_OFFSET (32 * 4)  // BRAM write address + FIFO count (added by wrapper)
+#define STATUS_REG_6_OFFSET  ((PL_NUM_CTRL_REGS + 6) * 4)   // Mirror of CTRL_REG_0 (enable, reset, etc.)
+#define STATUS_REG_7_OFFSET  ((PL_NUM_CTRL_REGS + 7) * 4)   // Mirror of CTRL_REG_1 (loop count)
+#define STATUS_REG_8_OFFSET  ((PL_NUM_CTRL_REGS + 8) * 4)   // Mirror of CTRL_REG_2 (phase select, debug mode)
+#define STATUS_REG_9_OFFSET  ((PL_NUM_CTRL_REGS + 9) * 4)   // Mirror of CTRL_REG_3 (frame idle cycles)
+#define STATUS_REG_10_OFFSET ((PL_NUM_CTRL_REGS + 10) * 4)  // Port count + FIFO count + BRAM write address (added by wrapper)
+#define STATUS_REG_11_OFFSET ((PL_NUM_CTRL_REGS + 11) * 4)  // FIFO + unread BRAM high-water marks, cleared on read (added by wrapper)
+#define STATUS_REG_12_OFFSET ((PL_NUM_CTRL_REGS + 12) * 4)  // BRAM depth in words (added by wrapper)
 
 // Control register bits
 #define CTRL_ENABLE_TRANSMISSION (1 << 0)
@@ -79,10 +226,13 @@
 #define CTRL_PHASE0_MASK         (0xF << 0) // phase0 [3:0] in CTRL_REG_2
 #define CTRL_PHASE1_MASK         (0xF << 4) // phase1 [7:4] in CTRL_REG_2
 #define CTRL_CHANNEL_ENABLE_MASK (0xF << 8) // channel_enable [11:8] in CTRL_REG_2
+#define CTRL_PHASE0_HALF_STEP    (1 << 12)  // phase0 half step [12] in CTRL_REG_2
+#define CTRL_PHASE1_HALF_STEP    (1 << 13)  // phase1 half step [13] in CTRL_REG_2
 
 // Status register 0 bits (dynamic status + counters)
 #define STATUS_TRANSMISSION_ACTIVE   (1 << 0)
 #define STATUS_LOOP_LIMIT_REACHED    (1 << 1)
+#define STATUS_FRAME_IDLE            (1 << 2)
 #define STATUS_STATE_COUNTER_MASK    (0x7F << 3)  // [9:3] - 7 bits
 #define STATUS_STATE_COUNTER_SHIFT   3
 #define STATUS_CYCLE_COUNTER_MASK    (0x3F << 11) // [16:11] - 6 bits  
@@ -92,6 +242,8 @@
 #define STATUS_ENABLE_TRANSMISSION_REG  (1 << 0)
 #define STATUS_RESET_TIMESTAMP_REG      (1 << 1)
 #define STATUS_DEBUG_MODE_REG           (1 << 3)
+#define STATUS_PHASE0_HALF_STEP_REG     (1 << 4)
+#define STATUS_PHASE1_HALF_STEP_REG     (1 << 5)
 #define STATUS_PHASE0_REG_MASK          (0xF << 12) // [15:12] - 4 bits
 #define STATUS_PHASE0_REG_SHIFT         12
 #define STATUS_PHASE1_REG_MASK          (0xF << 16) // [19:16] - 4 bits
@@ -99,6 +251,24 @@
 #define STATUS_CHANNEL_ENABLE_REG_MASK  (0xF << 20) // [23:20] - 4 bits
 #define STATUS_CHANNEL_ENABLE_REG_SHIFT 20
 
+// Status register 10 bits (added by wrapper)
+#define STATUS_BRAM_ADDR_MASK           0x3FFFF     // [17:0] - 18 bits
+#define STATUS_FIFO_COUNT_SHIFT         18          // [26:18] - 9 bits
+#define STATUS_FIFO_COUNT_MASK          (0x1FF << STATUS_FIFO_COUNT_SHIFT)
+#define STATUS_NUM_SPI_PORTS_SHIFT      27          // [30:27] - 4 bits
+#define STATUS_NUM_SPI_PORTS_MASK       (0xF << STATUS_NUM_SPI_PORTS_SHIFT)
+
+// CIPO phase select - CIPO is sampled 8x per SCLK bit period, so a fine phase is
+// {4-bit phase, half step}. Fine phase 2k matches the 4x phase k.
+#define NUM_FINE_PHASES         24          // 8x phases 0-23
+
+// Sample rate - one frame is 80 states x 35 cycles of the PL clock, optionally
+// followed by an idle period of CTRL_REG_3 clocks
+#define PL_CLOCK_HZ             84000000
+#define PL_CLOCKS_PER_FRAME     (80 * 35)                           // 2800 clocks
+#define MAX_SAMPLE_RATE_HZ      (PL_CLOCK_HZ / PL_CLOCKS_PER_FRAME) // 30 kS/s
+#define MIN_SAMPLE_RATE_HZ      1000
+
 // ============================================================================
 // TCP RESPONSE PROTOCOL
 // ============================================================================
@@ -120,11 +290,40 @@
                                        (FIRMWARE_VERSION_PATCH << 8) | \
                                        FIRMWARE_VERSION_BUILD)
 
+// Command IDs (command table in network.c)
+#define CMD_START           0x01
+#define CMD_STOP            0x02
+#define CMD_RESET_TIMESTAMP 0x03
+#define CMD_SET_LOOP_COUNT  0x10
+#define CMD_SET_PHASE       0x11
+#define CMD_SET_DEBUG_MODE  0x12
+#define CMD_SET_CHANNEL_ENABLE 0x13
+#define CMD_SET_SAMPLE_RATE 0x14
+#define CMD_SET_FINE_PHASE  0x15
+#define CMD_SET_PORT_FINE_PHASE 0x16
+#define CMD_LOAD_CONVERT    0x20
+#define CMD_LOAD_INIT       0x21
+#define CMD_LOAD_CABLE_TEST 0x22
+#define CMD_FULL_CABLE_TEST 0x30
+#define CMD_GET_STATUS      0x40
+#define CMD_DUMP_BRAM       0x41
+#define CMD_READ_BRAM       0x42
+#define CMD_TRIGGER_CAPTURE 0x43
+#define CMD_RESEND_FRAMES   0x44
+#define CMD_RUN_BENCHMARK   0x45
+#define CMD_SET_UDP_DEST    0x50
+#define CMD_SET_UDP_STREAM  0x51
+#define CMD_SET_FEC         0x52
+#define CMD_SET_PACING      0x53
+#define CMD_SET_TELEMETRY   0x54
+#define CMD_TRANSACTION     0x60
+
 // Response status codes
 #define ACK_SUCCESS         0x06
 #define ACK_ERROR           0x15
+#define ACK_COMPLETE        0x04    // Completion notification of a deferred command
 
-// Status response structure (86 bytes total)
+// Status response structure (232 bytes total)
 typedef struct __attribute__((packed)) {
     // Version and identification (8 bytes)
     uint16_t version;
@@ -139,7 +338,7 @@ typedef struct __attribute__((packed)) {
     uint8_t  state_counter;
     uint8_t  cycle_counter;
     uint8_t  flags_pl;
-    uint8_t  reserved1;
+    uint8_t  phase_half_steps;  // Bit 0 = phase0 half step, bit 1 = phase1 half step
     
     // PS Software Status (28 bytes)
     uint32_t packets_received;
@@ -149,15 +348,17 @@ typedef struct __attribute__((packed)) {
     uint32_t ps_read_addr;
     uint32_t packet_size;
     uint8_t  flags_ps;
-    uint8_t  reserved2[3];
+    uint8_t  num_spi_ports;
+    uint8_t  reserved2[2];
     
     // Current Configuration (16 bytes)
     uint32_t loop_count;
     uint8_t  phase0;
     uint8_t  phase1;
-    uint8_t  channel_enable;
+    uint8_t  channel_enable;    // Port 0 only
     uint8_t  debug_mode;
-    uint32_t reserved3[2];
+    uint32_t sample_rate;       // Frames per second
+    uint32_t channel_enable_all; // All ports, 4 bits per port
     
     // UDP Stream Information (12 bytes)
     uint32_t udp_dest_ip;
@@ -165,8 +366,154 @@ typedef struct __attribute__((packed)) {
     uint16_t udp_packet_format;
     uint32_t udp_bytes_sent;
     
+    // TCP Frame Stream (12 bytes)
+    uint32_t tcp_stream_frames_sent;
+    uint32_t tcp_stream_frames_dropped;     // Skipped because the client fell too far behind
+    uint32_t tcp_stream_buffered_bytes;     // Written to lwIP, not yet acknowledged
+    
+    // Frame Resend (8 bytes)
+    uint32_t udp_frames_resent;
+    uint32_t udp_resend_misses;     // Requested frames no longer (or never) in the history
+    
+    // Forward Error Correction (8 bytes)
+    uint32_t fec_group_size;        // Frames per parity datagram, 0 = off
+    uint32_t fec_parity_sent;
+    
+    // Transmit Pacing (16 bytes)
+    uint16_t pacing_rate_percent;   // Peak send rate in percent of the sample rate, 0 = off
+    uint16_t pacing_burst_frames;
+    uint32_t pacing_delays;         // Times the pacer started holding frames back
+    uint32_t pacing_overrides;      // Frames sent early because BRAM was close to overrun
+    uint32_t max_burst_frames;      // Most frames sent back to back in one main loop pass
+    
+    // Transmit Flow Control (8 bytes)
+    uint32_t udp_tx_waits;          // Frames held in BRAM until the TX ring had room
+    uint32_t udp_tx_forced_drops;   // Frames dropped to avoid a BRAM overrun (also in udp_send_errors)
+    
+    // Main Loop Scheduler (22 bytes)
+    uint32_t sched_max_pass_us;     // Longest pass through all tasks
+    uint32_t sched_deadline_misses; // Times the backlog reached SCHED_DEADLINE_WORDS
+    uint32_t sched_budget_overruns; // Task turns longer than their time budget
+    uint16_t sched_task_max_us[SCHED_NUM_TASKS];    // Longest turn per task (sched_task_id_t order)
+    
+    // Telemetry (12 bytes)
+    uint32_t telemetry_dest_ip;     // Network byte order
+    uint16_t telemetry_dest_port;
+    uint16_t telemetry_rate_hz;     // 0 = off
+    uint32_t telemetry_sent;
+    
+    // Buffer Headroom (60 bytes)
+    uint32_t bram_backlog_max;      // Most BRAM words unread by the PS since START (PL high-water mark)
+    uint16_t fifo_count_max;        // Most PL FIFO entries since START
+    uint16_t reserved3;
+    uint32_t backlog_histogram[BACKLOG_HIST_BINS];  // Drain turns by the backlog they found
+    uint32_t bram_size_words;       // BRAM ring depth of the PL build (START needs BRAM_SIZE_WORDS)
+    
 } status_response_t;
 
+// Telemetry datagram (104 bytes) - totals, rates, and the errors and high-water
+// marks of the interval since the previous datagram
+typedef struct __attribute__((packed)) {
+    uint32_t magic_low;             // 0xDEADBEEF
+    uint32_t magic_high;            // TELEMETRY_MAGIC_HIGH
+    uint32_t sequence;              // Datagrams sent since SET_TELEMETRY
+    uint32_t interval_us;
+    uint64_t timestamp;             // PL timestamp
+    uint8_t  flags_pl;
+    uint8_t  flags_ps;
+    uint16_t reserved;
+    
+    // Totals (16 bytes)
+    uint32_t packets_received;
+    uint32_t udp_packets_sent;
+    uint32_t udp_bytes_sent;
+    uint32_t udp_frames_resent;
+    
+    // Rates over the interval (8 bytes)
+    uint32_t rx_frames_per_s;       // Frames read from BRAM
+    uint32_t tx_frames_per_s;       // Frames sent over UDP
+    
+    // High-water marks over the interval (24 bytes)
+    uint32_t max_backlog_words;     // Words in BRAM waiting for the PS (PL high-water mark)
+    uint16_t max_fifo_count;        // PL high-water mark
+    uint16_t reserved2;
+    uint32_t max_pass_us;
+    uint16_t task_max_us[SCHED_NUM_TASKS];
+    uint16_t reserved3;
+    
+    // Errors during the interval (28 bytes)
+    uint32_t errors;                // error_count
+    uint32_t udp_send_errors;
+    uint32_t udp_tx_forced_drops;
+    uint32_t udp_resend_misses;
+    uint32_t tcp_stream_frames_dropped;
+    uint32_t deadline_misses;
+    uint32_t budget_overruns;
+} telemetry_datagram_t;
+
+// Completion notification payload (24 bytes) - sent once a deferred command
+// (START, STOP, RESET_TIMESTAMP, DUMP_BRAM, FULL_CABLE_TEST) has been carried out
+typedef struct __attribute__((packed)) {
+    uint32_t cmd_id;
+    uint8_t  status;            // ACK_SUCCESS, or ACK_ERROR if there was nothing to do
+    uint8_t  stream_enabled;
+    uint16_t reserved;
+    uint64_t timestamp;         // START/FULL_CABLE_TEST: first timestamp of the new stream,
+                                // otherwise the PL timestamp when the command finished
+    uint32_t packets_received;
+    uint32_t detail;            // DUMP_BRAM: words dumped, RUN_BENCHMARK: copy method
+                                // selected, otherwise 0
+} completion_response_t;
+
+// TRIGGER_CAPTURE completion (40 bytes): the usual completion (timestamp = trigger
+// frame, detail = frames captured) followed by the capture layout, then on the
+// connection detail * packet_words raw words - the frames in order
+typedef struct __attribute__((packed)) {
+    completion_response_t completion;
+    uint64_t first_timestamp;   // Timestamp of the first captured frame
+    uint32_t packet_words;      // Words per frame
+    uint32_t pre_frames;        // Captured frames before the trigger frame
+} capture_response_t;
+
+// RUN_BENCHMARK completion: the usual completion (detail = the copy method now in
+// production) followed by the results. Times are timer ticks (timer_hz per second)
+// summed over the repeats; sizes are in channel count order.
+typedef struct __attribute__((packed)) {
+    completion_response_t completion;
+    uint32_t timer_hz;
+    uint8_t  num_sizes;             // BENCH_NUM_SIZES
+    uint8_t  num_methods;           // BRAM_COPY_NUM_METHODS
+    uint8_t  num_routines;          // BRAM_COPY_NUM_ROUTINES
+    uint8_t  selected_method;
+    uint16_t copy_repeats;
+    uint16_t net_repeats;
+    uint32_t reg_repeats;
+    uint32_t reg_read_ticks;        // AXI-Lite status register reads
+    uint32_t bram_read_ticks;       // Single BRAM word reads, strongly ordered
+    uint32_t send_failures;         // udp_sendto calls that did not return ERR_OK
+    uint16_t frame_words[BENCH_NUM_SIZES];
+    uint32_t copy_ticks[BENCH_NUM_SIZES][BRAM_COPY_NUM_METHODS];
+    uint32_t pbuf_ticks[BENCH_NUM_SIZES];   // pbuf_alloc (PBUF_REF) + pbuf_free
+    uint32_t send_ticks[BENCH_NUM_SIZES];   // udp_sendto
+} benchmark_response_t;
+
+// READ_BRAM: param2 = word_count | flags
+#define BRAM_READ_COUNT_MASK    0x0003FFFF
+#define BRAM_READ_SNAPSHOT      (1u << 31)  // Copy the range before sending it
+
+// RESEND_FRAMES: param1 = low 32 bits of the first timestamp, param2 = frame count
+#define MAX_RESEND_FRAMES       4096
+
+// READ_BRAM response header (24 bytes), followed on the connection by
+// word_count raw little-endian words
+typedef struct __attribute__((packed)) {
+    uint32_t start_addr;
+    uint32_t word_count;
+    uint32_t write_addr_before; // PL write address before and after the range was read;
+    uint32_t write_addr_after;  // words between the two may have been overwritten meanwhile
+    uint64_t timestamp;         // PL timestamp when the read started
+} bram_read_response_t;
+
 // Flag definitions
 #define STATUS_PL_TRANSMISSION_ACTIVE  (1 << 0)
 #define STATUS_PL_LOOP_LIMIT_REACHED   (1 << 1)
@@ -182,6 +529,7 @@ extern struct netif server_netif;
 extern struct udp_pcb *udp;
 extern volatile int stream_enabled;
 extern uint32_t packets_received_count;
+extern uint64_t stream_start_timestamp;
 
 // Command flags for main loop processing
 extern volatile int enable_streaming_flag;
@@ -193,6 +541,7 @@ extern volatile int cable_test_flag;
 extern uint32_t ps_read_address;              // Current PS read position (word address)
 extern uint32_t current_packet_size;          // Current expected packet size in 32-bit words
 extern uint32_t current_channel_enable;       // Current channel enable setting
+extern uint32_t current_sample_rate;          // Current frame rate in Hz
 
 // Packet validation tracking
 extern uint64_t expected_timestamp;
@@ -202,28 +551,36 @@ extern uint32_t timestamp_gaps;
 // UDP transmission
 extern uint32_t udp_packets_sent;
 extern uint32_t udp_send_errors;
+extern uint32_t udp_tx_waits;
+extern uint32_t udp_tx_forced_drops;
 
 // UDP configuration (can be changed via TCP command)
 extern uint32_t udp_dest_ip;      // Network byte order
 extern uint16_t udp_dest_port;
+extern int udp_stream_enabled;    // 0 = frames only go to the history
 
 // ============================================================================
 // CORE FUNCTIONS
 // ============================================================================
 
-// Streaming control
-void handle_enable_streaming(void);
-void handle_disable_streaming(void);
+// Streaming control - enable/disable return 0 if streaming already was in that state
+int handle_enable_streaming(void);
+int handle_disable_streaming(void);
 void handle_reset_timestamp(void);
 void process_command_flags(void);
 
 // Packet size calculation based on channel_enable
-uint32_t calculate_packet_size(int channel_enable);
-uint32_t calculate_data_words(int channel_enable);
+uint32_t calculate_packet_size(uint32_t channel_enable);
+uint32_t calculate_data_words(uint32_t channel_enable);
 void update_current_packet_size(void);
 
-// Main loop
-void network_maintenance_loop(void);
+// Main loop tasks (run by scheduler.c)
+uint32_t bram_backlog_words(void);
+uint32_t task_stream_drain(uint32_t max_frames);
+uint32_t task_ethernet_rx(uint32_t max_packets);
+uint32_t task_lwip_timers(uint32_t budget);
+uint32_t task_commands(uint32_t budget);
+uint32_t task_telemetry(uint32_t budget);
 
 // ============================================================================
 // PL CONTROL FUNCTIONS
@@ -234,8 +591,12 @@ void pl_set_transmission(int enable);
 void pl_reset_timestamp(void);
 void pl_set_loop_count(uint32_t loop_count);
 void pl_set_phase_select(int phase0, int phase1);
+void pl_set_fine_phase_select(int fine_phase0, int fine_phase1);
+void pl_set_port_fine_phase_select(int port, int fine_phase0, int fine_phase1);
 void pl_set_debug_mode(int enable);
-void pl_set_channel_enable(int channel_enable);
+void pl_set_channel_enable(uint32_t channel_enable);
+int pl_set_sample_rate(uint32_t sample_rate_hz);
+int is_valid_sample_rate(uint32_t sample_rate_hz);
 
 // Status reading
 uint64_t pl_get_timestamp(void);
@@ -243,14 +604,21 @@ int pl_is_transmission_active(void);
 uint32_t pl_get_packets_sent(void);
 int pl_is_loop_limit_reached(void);
 uint32_t pl_get_bram_write_address(void);
+uint32_t pl_get_fifo_count(void);
+uint32_t pl_get_num_spi_ports(void);
+uint32_t pl_get_bram_size_words(void);
 uint32_t pl_get_state_counter(void);
+void pl_set_ps_read_address(uint32_t address);
+void pl_take_high_water(uint32_t *fifo_count_max, uint32_t *bram_unread_max);
 uint32_t pl_get_cycle_counter(void);
 
 // Reflected control parameter reading
 uint32_t pl_get_current_loop_count(void);
 int pl_get_current_phase_select(int *phase0, int *phase1);
+void pl_get_current_fine_phase_select(int *fine_phase0, int *fine_phase1);
 int pl_get_current_debug_mode(void);
-int pl_get_current_channel_enable(void);
+uint32_t pl_get_current_channel_enable(void);
+uint32_t pl_get_current_sample_rate(void);
 uint32_t pl_get_current_control_flags(void);
 
 // Status display
@@ -276,10 +644,100 @@ extern const uint16_t initialization_cmd_sequence[35];
 extern const uint16_t cable_length_cmd_sequence[35];
 
 // ============================================================================
-// DEBUG FUNCTIONS
+// FRAME HISTORY FUNCTIONS
+// ============================================================================
+
+// Rolling history (implemented in history.c)
+void history_start(uint32_t packet_words);
+void history_store(const uint32_t *packet);
+uint64_t history_frames_stored(void);
+uint32_t history_capacity(void);
+uint32_t history_packet_size(void);
+
+// Triggered capture of [trigger - pre_frames, trigger + post_frames]; the trigger
+// frame is the newest frame stored (or the next one if none is)
+int history_trigger(uint32_t pre_frames, uint32_t post_frames);
+int history_capture_ready(void);
+void history_take_capture(capture_response_t *capture, uint64_t *first_frame);
+const uint32_t *history_frame_words(uint64_t frame, uint32_t *contiguous_words);
+
+// Timestamp of a stored frame, and the oldest frame still stored whose timestamp
+// is at least `timestamp` (0 if there is none)
+uint64_t history_frame_timestamp(uint64_t frame);
+int history_find_timestamp(uint64_t timestamp, uint64_t *frame);
+
+// RESET_TIMESTAMP: only frames from history_timestamp_epoch() on are searched
+void history_reset_timestamps(void);
+uint64_t history_timestamp_epoch(void);
+
+// ============================================================================
+// FORWARD ERROR CORRECTION FUNCTIONS
 // ============================================================================
 
-void benchmark_bram_reads(void);
+// XOR parity groups over the UDP stream (implemented in fec.c)
+int fec_configure(uint32_t group_size);
+void fec_frame_sent(const uint32_t *packet, uint32_t packet_words);
+void fec_flush(void);
+uint32_t fec_group_size(void);
+uint32_t fec_parity_sent(void);
+
+// ============================================================================
+// TRANSMIT PACING FUNCTIONS
+// ============================================================================
+
+// Token bucket on the global timer (implemented in pacer.c)
+int pacer_is_valid(uint32_t rate_percent, uint32_t burst_frames);
+int pacer_configure(uint32_t rate_percent, uint32_t burst_frames);
+void pacer_start(uint32_t sample_rate);
+int pacer_release(uint32_t backlog_words);
+void pacer_burst_done(uint32_t frames);
+void pacer_get_status(status_response_t *status);
+
+// ============================================================================
+// SCHEDULER FUNCTIONS
+// ============================================================================
+
+// Cooperative main loop (implemented in scheduler.c)
+void scheduler_run(void);
+void scheduler_reset_stats(void);
+void scheduler_get_status(status_response_t *status);
+void scheduler_take_interval(telemetry_datagram_t *telemetry);
+
+// ============================================================================
+// BUFFER HEADROOM FUNCTIONS
+// ============================================================================
+
+// PL high-water marks and the drain backlog histogram (implemented in headroom.c)
+void headroom_start(void);
+void headroom_record(uint32_t backlog_words);
+void headroom_get_status(status_response_t *status);
+void headroom_take_interval(telemetry_datagram_t *telemetry);
+
+// ============================================================================
+// TELEMETRY FUNCTIONS
+// ============================================================================
+
+// Periodic telemetry datagram (implemented in telemetry.c); ip 0 follows the UDP
+// stream destination, port 0 selects TELEMETRY_PORT
+int telemetry_is_valid(uint32_t ip, uint16_t port, uint32_t rate_hz);
+int telemetry_configure(uint32_t ip, uint16_t port, uint32_t rate_hz);
+int telemetry_poll(void);
+void telemetry_get_status(status_response_t *status);
+
+// ============================================================================
+// BRAM COPY AND BENCHMARK
+// ============================================================================
+
+// Copy word_count words from BRAM word start_addr, wrapping at the end of BRAM
+void bram_copy_words(uint32_t *dest, uint32_t start_addr, uint32_t word_count);
+void bram_copy_run(uint32_t method, uint32_t *dest, uint32_t start_addr, uint32_t word_count);
+void bram_copy_select(uint32_t method);
+uint32_t bram_copy_selected(void);
+const char *bram_copy_method_name(uint32_t method);
+
+void benchmark_select_copy(void);
+void benchmark_run(void);
+const benchmark_response_t *benchmark_take_results(void);
 
 // ============================================================================
 // NETWORK FUNCTIONS
@@ -289,6 +747,7 @@ void benchmark_bram_reads(void);
 uint32_t sys_now(void);
 void start_tcp_server(void);
 void udp_stream_init(void);
+int udp_tx_ready(void);
 
 // UDP destination configuration
 int udp_reconfigure_destination(uint32_t new_ip, uint16_t new_port);
@@ -297,4 +756,24 @@ int is_valid_udp_dest(uint32_t ip, uint16_t port);
 // Status data collection
 void collect_status_data(status_response_t* status);
 
+// Completion notifications for deferred commands
+void notify_command_complete(uint32_t cmd_id, uint8_t status, uint64_t timestamp, uint32_t detail);
+
+// Sends a triggered capture once its window is complete and the connection is free
+void poll_history_capture(void);
+
+// Sends the RUN_BENCHMARK results once the run is done and the connection is free
+void poll_benchmark(void);
+
+// Applies and answers a complete TRANSACTION
+void poll_transaction(void);
+
+// Lossless frame stream on STREAM_TCP_PORT
+void start_stream_server(void);
+void poll_tcp_stream(void);
+void tcp_stream_history_restart(void);
+
+// Resends frames requested with RESEND_FRAMES while the live stream is idle
+void poll_frame_resend(void);
+
 #endif // MAIN_H
\ No newline at end of file
@@ -0,0 +1,205 @@
+#include "main.h"
+#include <string.h>
+#include "xil_io.h"
+#include "lwip/udp.h"
+#include "shared_print.h"
+
+// ============================================================================
+// BENCHMARK
+// ============================================================================
+
+// Runs with the stream stopped, from the main loop, so nothing else touches BRAM
+// or the TX ring meanwhile. For each frame size, from one enabled channel to all
+// of them, every copy method copies BENCH_COPY_REPEATS successive frames out of
+// BRAM after one untimed copy (which also moves BRAM to the method's mapping, so
+// the whole-BRAM invalidate is not counted). The send path is timed in two parts:
+// a PBUF_REF pbuf allocated and freed, and udp_sendto of that size to the discard
+// port of the stream host, waiting untimed for TX ring room before each send. The
+// method with the lowest copy time summed over all sizes becomes the production
+// copy path.
+
+#define BENCH_TX_WAIT_US    10000       // Per datagram, before it counts as a failure
+
+static uint32_t bench_buffer[MAX_WORDS_PER_PACKET] __attribute__((aligned(64)));  // Sent as PBUF_REF
+static benchmark_response_t results;
+static int results_ready = 0;
+
+static uint32_t ticks_since(XTime start) {
+    XTime now;
+    XTime_GetTime(&now);
+    return (uint32_t)(now - start);
+}
+
+static uint32_t ns_per_op(uint32_t ticks, uint32_t ops) {
+    return (uint32_t)((uint64_t)ticks * 1000000000ull / COUNTS_PER_SECOND / ops);
+}
+
+// Fills frame_words and copy_ticks; returns the fastest method
+static uint32_t measure_copies(benchmark_response_t *r) {
+    uint64_t total[BRAM_COPY_NUM_METHODS] = {0};
+
+    for (uint32_t size = 0; size < BENCH_NUM_SIZES; size++) {
+        uint32_t words = calculate_packet_size(CHANNEL_ENABLE_ALL >> (BENCH_NUM_SIZES - 1 - size));
+        r->frame_words[size] = (uint16_t)words;
+
+        for (uint32_t method = 0; method < BRAM_COPY_NUM_METHODS; method++) {
+            bram_copy_run(method, bench_buffer, 0, words);
+
+            uint32_t addr = 0;
+            XTime start;
+            XTime_GetTime(&start);
+            for (uint32_t i = 0; i < BENCH_COPY_REPEATS; i++) {
+                bram_copy_run(method, bench_buffer, addr, words);
+                addr = (addr + words) % BRAM_SIZE_WORDS;
+            }
+            r->copy_ticks[size][method] = ticks_since(start);
+            total[method] += r->copy_ticks[size][method];
+        }
+    }
+
+    uint32_t fastest = 0;
+    for (uint32_t method = 1; method < BRAM_COPY_NUM_METHODS; method++) {
+        if (total[method] < total[fastest]) {
+            fastest = method;
+        }
+    }
+    return fastest;
+}
+
+static void measure_register_reads(benchmark_response_t *r) {
+    volatile uint32_t sink;
+    XTime start;
+
+    XTime_GetTime(&start);
+    for (uint32_t i = 0; i < BENCH_REG_REPEATS; i++) {
+        sink = Xil_In32(PL_CTRL_BASE_ADDR + STATUS_REG_10_OFFSET);
+    }
+    r->reg_read_ticks = ticks_since(start);
+
+    bram_copy_run(BRAM_COPY_IN32, bench_buffer, 0, 1);     // Strongly ordered again
+    XTime_GetTime(&start);
+    for (uint32_t i = 0; i < BENCH_REG_REPEATS; i++) {
+        sink = Xil_In32(BRAM_BASE_ADDR + (i % BRAM_SIZE_WORDS) * 4);
+    }
+    r->bram_read_ticks = ticks_since(start);
+    (void)sink;
+}
+
+static int wait_tx_ready(void) {
+    XTime start;
+    XTime_GetTime(&start);
+    while (!udp_tx_ready()) {
+        if (ticks_since(start) > (uint32_t)(COUNTS_PER_SECOND / 1000000 * BENCH_TX_WAIT_US)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void measure_send_path(benchmark_response_t *r) {
+    ip_addr_t addr;
+    addr.addr = udp_dest_ip;
+
+    for (uint32_t size = 0; size < BENCH_NUM_SIZES; size++) {
+        uint16_t bytes = r->frame_words[size] * BYTES_PER_WORD;
+
+        XTime start;
+        XTime_GetTime(&start);
+        for (uint32_t i = 0; i < BENCH_NET_REPEATS; i++) {
+            struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, bytes, PBUF_REF);
+            if (p != NULL) {
+                pbuf_free(p);
+            }
+        }
+        r->pbuf_ticks[size] = ticks_since(start);
+
+        r->send_ticks[size] = 0;
+        for (uint32_t i = 0; i < BENCH_NET_REPEATS; i++) {
+            struct pbuf *p = wait_tx_ready() ? pbuf_alloc(PBUF_TRANSPORT, bytes, PBUF_REF) : NULL;
+            if (p == NULL) {
+                r->send_failures++;
+                continue;
+            }
+            p->payload = (void *)bench_buffer;
+            XTime_GetTime(&start);
+            err_t err = udp_sendto(udp, p, &addr, BENCH_UDP_PORT);
+            r->send_ticks[size] += ticks_since(start);
+            pbuf_free(p);
+            if (err != ERR_OK) {
+                r->send_failures++;
+            }
+        }
+    }
+}
+
+// Copies only, at startup: production starts on the fastest method
+void benchmark_select_copy(void) {
+    benchmark_response_t r;
+    bram_copy_select(measure_copies(&r));
+    send_message("BRAM copy: %s\r\n", bram_copy_method_name(bram_copy_selected()));
+}
+
+void benchmark_run(void) {
+    memset(&results, 0, sizeof(results));
+    results.completion.cmd_id = CMD_RUN_BENCHMARK;
+    results.timer_hz = COUNTS_PER_SECOND;
+    results.num_sizes = BENCH_NUM_SIZES;
+    results.num_methods = BRAM_COPY_NUM_METHODS;
+    results.num_routines = BRAM_COPY_NUM_ROUTINES;
+    results.copy_repeats = BENCH_COPY_REPEATS;
+    results.net_repeats = BENCH_NET_REPEATS;
+    results.reg_repeats = BENCH_REG_REPEATS;
+
+    if (stream_enabled) {
+        send_message("Benchmark: stop the stream first\r\n");
+        results.completion.status = ACK_ERROR;
+    } else {
+        send_message("\r\n=== BENCHMARK ===\r\n");
+        uint32_t fastest = measure_copies(&results);
+        measure_register_reads(&results);
+        measure_send_path(&results);
+        bram_copy_select(fastest);
+        results.completion.status = ACK_SUCCESS;
+
+        send_message("Copy, ns per frame:\r\n  words");
+        for (uint32_t method = 0; method < BRAM_COPY_NUM_METHODS; method++) {
+            send_message(" %14s", bram_copy_method_name(method));
+        }
+        send_message("\r\n");
+        for (uint32_t size = 0; size < BENCH_NUM_SIZES; size++) {
+            send_message("  %5u", results.frame_words[size]);
+            for (uint32_t method = 0; method < BRAM_COPY_NUM_METHODS; method++) {
+                send_message(" %14u", ns_per_op(results.copy_ticks[size][method], BENCH_COPY_REPEATS));
+            }
+            send_message("\r\n");
+        }
+        send_message("Send, ns per frame (pbuf / udp_sendto):\r\n");
+        for (uint32_t size = 0; size < BENCH_NUM_SIZES; size++) {
+            send_message("  %5u %8u %8u\r\n", results.frame_words[size],
+                         ns_per_op(results.pbuf_ticks[size], BENCH_NET_REPEATS),
+                         ns_per_op(results.send_ticks[size], BENCH_NET_REPEATS));
+        }
+        send_message("Send failures: %u\r\n", results.send_failures);
+        send_message("Register read: %u ns, BRAM word read: %u ns\r\n",
+                     ns_per_op(results.reg_read_ticks, BENCH_REG_REPEATS),
+                     ns_per_op(results.bram_read_ticks, BENCH_REG_REPEATS));
+        send_message("BRAM copy: %s\r\n", bram_copy_method_name(bram_copy_selected()));
+        send_message("=================\r\n\r\n");
+    }
+
+    results.selected_method = (uint8_t)bram_copy_selected();
+    results.completion.stream_enabled = stream_enabled ? 1 : 0;
+    results.completion.timestamp = pl_get_timestamp();
+    results.completion.packets_received = packets_received_count;
+    results.completion.detail = bram_copy_selected();
+    results_ready = 1;
+}
+
+// The results of the last run, once; NULL if there is no new run
+const benchmark_response_t *benchmark_take_results(void) {
+    if (!results_ready) {
+        return NULL;
+    }
+    results_ready = 0;
+    return &results;
+}
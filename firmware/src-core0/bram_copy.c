@@ -0,0 +1,128 @@
+#include "main.h"
+#include <string.h>
+#include "xil_io.h"
+#include "xil_cache.h"
+#include "xil_mmu.h"
+
+// ============================================================================
+// BRAM COPY
+// ============================================================================
+
+// Every frame, READ_BRAM and DUMP_BRAM read BRAM through bram_copy_words. The boot
+// translation table maps the BRAM section strongly ordered, so each access goes out
+// over M_AXI_GP1 on its own; the routines differ in how many words they move per
+// bus transaction. With the section mapped cacheable (write-through, so there is
+// never dirty data to lose) the PL writes around the cache, and each range is
+// invalidated right before it is copied. The mapping only changes when a method
+// with the other mapping is run, so switching costs nothing per frame.
+//
+// LDM and NEON move eight words (one cache line) per iteration from word aligned
+// addresses, which both allow on strongly ordered memory, and finish the tail with
+// single reads.
+
+static const char *const method_names[BRAM_COPY_NUM_METHODS] = {
+    "in32", "memcpy", "ldm", "neon",
+    "cached-in32", "cached-memcpy", "cached-ldm", "cached-neon",
+};
+
+static uint32_t selected_method = BRAM_COPY_MEMCPY;     // Until benchmark_select_copy
+static bram_mapping_t current_mapping = BRAM_MAP_UNCACHED;
+
+static void set_mapping(bram_mapping_t mapping) {
+    if (mapping == current_mapping) {
+        return;
+    }
+    // BRAM_MAX_WORDS fits in the one 1 MB section at BRAM_BASE_ADDR
+    Xil_SetTlbAttributes(BRAM_BASE_ADDR, (mapping == BRAM_MAP_CACHED) ? NORM_WT_CACHE : STRONG_ORDERED);
+    Xil_DCacheInvalidateRange(BRAM_BASE_ADDR, BRAM_SIZE_BYTES);
+    current_mapping = mapping;
+}
+
+static void copy_in32(uint32_t *dest, uint32_t src, uint32_t word_count) {
+    for (uint32_t i = 0; i < word_count; i++) {
+        dest[i] = Xil_In32(src + i * 4);
+    }
+}
+
+static void copy_ldm(uint32_t *dest, uint32_t src, uint32_t word_count) {
+    uint32_t *s = (uint32_t *)src;
+    uint32_t lines = word_count / 8;
+    while (lines--) {
+        __asm__ volatile (
+            "ldmia %0!, {r3-r10}\n\t"
+            "stmia %1!, {r3-r10}"
+            : "+r" (s), "+r" (dest)
+            :
+            : "r3", "r4", "r5", "r6", "r7", "r8", "r9", "r10", "memory");
+    }
+    copy_in32(dest, (uint32_t)s, word_count % 8);
+}
+
+__attribute__((target("fpu=neon")))
+static void copy_neon(uint32_t *dest, uint32_t src, uint32_t word_count) {
+    uint32_t *s = (uint32_t *)src;
+    uint32_t lines = word_count / 8;
+    while (lines--) {
+        __asm__ volatile (
+            "vld1.32 {d0-d3}, [%0]!\n\t"
+            "vst1.32 {d0-d3}, [%1]!"
+            : "+r" (s), "+r" (dest)
+            :
+            : "d0", "d1", "d2", "d3", "memory");
+    }
+    copy_in32(dest, (uint32_t)s, word_count % 8);
+}
+
+static void copy_range(bram_copy_routine_t routine, uint32_t *dest, uint32_t start_addr, uint32_t word_count) {
+    uint32_t src = BRAM_BASE_ADDR + start_addr * 4;
+    if (current_mapping == BRAM_MAP_CACHED) {
+        Xil_DCacheInvalidateRange(src, word_count * 4);
+    }
+    switch (routine) {
+        case BRAM_COPY_IN32:
+            copy_in32(dest, src, word_count);
+            break;
+        case BRAM_COPY_LDM:
+            copy_ldm(dest, src, word_count);
+            break;
+        case BRAM_COPY_NEON:
+            copy_neon(dest, src, word_count);
+            break;
+        case BRAM_COPY_MEMCPY:
+        default:
+            memcpy(dest, (void*)src, word_count * 4);
+            break;
+    }
+}
+
+void bram_copy_run(uint32_t method, uint32_t *dest, uint32_t start_addr, uint32_t word_count) {
+    bram_copy_routine_t routine = (bram_copy_routine_t)(method % BRAM_COPY_NUM_ROUTINES);
+    set_mapping((bram_mapping_t)(method / BRAM_COPY_NUM_ROUTINES));
+
+    if ((start_addr + word_count) <= BRAM_SIZE_WORDS) {
+        copy_range(routine, dest, start_addr, word_count);
+    } else {
+        uint32_t first_part = BRAM_SIZE_WORDS - start_addr;
+        copy_range(routine, dest, start_addr, first_part);
+        copy_range(routine, &dest[first_part], 0, word_count - first_part);
+    }
+}
+
+void bram_copy_words(uint32_t *dest, uint32_t start_addr, uint32_t word_count) {
+    bram_copy_run(selected_method, dest, start_addr, word_count);
+}
+
+void bram_copy_select(uint32_t method) {
+    if (method < BRAM_COPY_NUM_METHODS) {
+        selected_method = method;
+        set_mapping((bram_mapping_t)(method / BRAM_COPY_NUM_ROUTINES));
+    }
+}
+
+uint32_t bram_copy_selected(void) {
+    return selected_method;
+}
+
+const char *bram_copy_method_name(uint32_t method) {
+    return (method < BRAM_COPY_NUM_METHODS) ? method_names[method] : "unknown";
+}
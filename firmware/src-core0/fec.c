@@ -0,0 +1,123 @@
+#include "main.h"
+#include <string.h>
+#include "lwip/udp.h"
+#include "sleep.h"
+#include "shared_print.h"
+
+// ============================================================================
+// FORWARD ERROR CORRECTION
+// ============================================================================
+
+// Frames sent over UDP are XORed into the parity of their group as they go out. The
+// parity datagram follows the last frame of the group, or goes out early when the
+// next frame belongs to a later group (frames lost to a BRAM overrun) or the stream
+// stops. A receiver therefore waits at most group_size frame periods for it, and
+// the stream grows by one datagram in group_size.
+
+static uint32_t fec_parity[FEC_HEADER_WORDS + MAX_PACKET_DATA_WORDS] __attribute__((aligned(64)));
+static uint32_t group_size = 0;             // 0 = off
+static uint32_t group_packet_words = 0;     // Packet size of the group being built
+static uint64_t group_first = 0;            // Timestamp of the first frame of the group
+static uint32_t group_mask = 0;             // Frames XORed in so far
+static uint32_t parity_sent = 0;
+
+// The parity is dropped (and counted in udp_send_errors) when the TX ring has no
+// room, so it never holds up the frames behind it
+static void send_parity(void) {
+    if (group_mask == 0) {
+        return;
+    }
+    if (!udp_tx_ready()) {
+        udp_send_errors++;
+        group_mask = 0;
+        return;
+    }
+
+    fec_parity[0] = 0xDEADBEEF;
+    fec_parity[1] = FEC_MAGIC_HIGH;
+    fec_parity[2] = (uint32_t)group_first;
+    fec_parity[3] = (uint32_t)(group_first >> 32);
+    fec_parity[4] = group_size;
+    fec_parity[5] = group_mask;
+
+    uint32_t parity_bytes = (FEC_HEADER_WORDS + group_packet_words - PACKET_HEADER_WORDS) * BYTES_PER_WORD;
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, parity_bytes, PBUF_REF);
+    if (p != NULL) {
+        p->payload = (void *)fec_parity;
+        ip_addr_t dest_ip;
+        dest_ip.addr = udp_dest_ip;
+        if (udp_sendto(udp, p, &dest_ip, udp_dest_port) == ERR_OK) {
+            parity_sent++;
+        } else {
+            udp_send_errors++;
+        }
+        pbuf_free(p);
+    } else {
+        udp_send_errors++;
+    }
+    group_mask = 0;
+}
+
+int fec_configure(uint32_t size) {
+    if ((size == 1) || (size > FEC_MAX_GROUP_SIZE)) {
+        return 0;
+    }
+    group_mask = 0;                 // A partial group under the old size is dropped
+    group_size = size;
+    parity_sent = 0;
+    if (size) {
+        send_message("FEC: one parity datagram per %u frames\r\n", size);
+    } else {
+        send_message("FEC: off\r\n");
+    }
+    return 1;
+}
+
+void fec_frame_sent(const uint32_t *packet, uint32_t packet_words) {
+    if (group_size == 0) {
+        return;
+    }
+
+    uint64_t timestamp = ((uint64_t)packet[3] << 32) | packet[2];
+    if ((group_mask != 0) &&
+        ((timestamp < group_first) || (timestamp - group_first >= group_size) ||
+         (packet_words != group_packet_words))) {
+        send_parity();
+    }
+
+    uint32_t data_words = packet_words - PACKET_HEADER_WORDS;
+    const uint32_t *data = &packet[PACKET_HEADER_WORDS];
+    uint32_t *parity = &fec_parity[FEC_HEADER_WORDS];
+    if (group_mask == 0) {
+        group_first = timestamp - (timestamp % group_size);
+        group_packet_words = packet_words;
+        memcpy(parity, data, data_words * BYTES_PER_WORD);
+    } else {
+        for (uint32_t i = 0; i < data_words; i++) {
+            parity[i] ^= data[i];
+        }
+    }
+
+    uint32_t index = (uint32_t)(timestamp - group_first);
+    group_mask |= 1u << index;
+    if (index == group_size - 1) {
+        send_parity();
+    }
+}
+
+// The last group of a stream is sent as it is when streaming stops, once the TX
+// ring has room after the final frames
+void fec_flush(void) {
+    for (uint32_t retries = 0; (group_mask != 0) && !udp_tx_ready() && (retries < TX_STOP_RETRIES); retries++) {
+        usleep(1);
+    }
+    send_parity();
+}
+
+uint32_t fec_group_size(void) {
+    return group_size;
+}
+
+uint32_t fec_parity_sent(void) {
+    return parity_sent;
+}
@@ -0,0 +1,71 @@
+#include "main.h"
+#include <string.h>
+
+// ============================================================================
+// BUFFER HEADROOM
+// ============================================================================
+
+// The PL high-water marks clear when read, so this file is their only reader: each
+// read is folded into the maxima since START (GET_STATUS) and into the maxima since
+// the previous telemetry datagram, and neither observer resets the other's. The
+// histogram counts drain turns that found at least one frame, so an idle loop does
+// not swamp it; it restarts with the stream.
+
+static uint32_t fifo_max = 0;
+static uint32_t backlog_max = 0;
+static uint32_t interval_fifo_max = 0;
+static uint32_t interval_backlog_max = 0;
+static uint32_t histogram[BACKLOG_HIST_BINS];
+
+static void poll_high_water(void) {
+    uint32_t fifo_count, unread;
+    pl_take_high_water(&fifo_count, &unread);
+    if (fifo_count > fifo_max) {
+        fifo_max = fifo_count;
+    }
+    if (unread > backlog_max) {
+        backlog_max = unread;
+    }
+    if (fifo_count > interval_fifo_max) {
+        interval_fifo_max = fifo_count;
+    }
+    if (unread > interval_backlog_max) {
+        interval_backlog_max = unread;
+    }
+}
+
+static uint32_t histogram_bin(uint32_t backlog_words) {
+    if (backlog_words < BACKLOG_HIST_MIN_WORDS) {
+        return 0;
+    }
+    uint32_t bin = 1 + (31 - __builtin_clz(backlog_words / BACKLOG_HIST_MIN_WORDS));
+    return (bin < BACKLOG_HIST_BINS) ? bin : BACKLOG_HIST_BINS - 1;
+}
+
+void headroom_start(void) {
+    poll_high_water();              // Clears the PL marks
+    fifo_max = 0;
+    backlog_max = 0;
+    interval_fifo_max = 0;
+    interval_backlog_max = 0;
+    memset(histogram, 0, sizeof(histogram));
+}
+
+void headroom_record(uint32_t backlog_words) {
+    histogram[histogram_bin(backlog_words)]++;
+}
+
+void headroom_get_status(status_response_t *status) {
+    poll_high_water();
+    status->bram_backlog_max = backlog_max;
+    status->fifo_count_max = (uint16_t)fifo_max;
+    memcpy(status->backlog_histogram, histogram, sizeof(histogram));
+}
+
+void headroom_take_interval(telemetry_datagram_t *telemetry) {
+    poll_high_water();
+    telemetry->max_backlog_words = interval_backlog_max;
+    telemetry->max_fifo_count = (uint16_t)interval_fifo_max;
+    interval_backlog_max = 0;
+    interval_fifo_max = 0;
+}
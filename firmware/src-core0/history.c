@@ -0,0 +1,170 @@
+#include "main.h"
+#include <string.h>
+#include "shared_print.h"
+
+// ============================================================================
+// FRAME HISTORY
+// ============================================================================
+
+// Every frame drained from BRAM is also copied into a ring in DDR, so the last
+// seconds of data can be sent on request even while the UDP stream is off. The
+// packet size is fixed for a stream, so frame n lives in slot n % history_slots.
+
+static uint32_t history_buffer[HISTORY_SIZE_WORDS] __attribute__((aligned(64)));
+static uint32_t history_packet_words = MAX_WORDS_PER_PACKET;
+static uint32_t history_slots = HISTORY_SIZE_WORDS / MAX_WORDS_PER_PACKET;
+static uint32_t history_write_slot = 0;
+static uint64_t history_frames = 0;         // Frames stored since the stream started
+static uint64_t history_epoch = 0;          // First frame since the timestamp was last reset
+
+// Capture waiting for its post-trigger frames
+static struct {
+    int armed;
+    uint64_t trigger_frame;
+    uint64_t first_frame;
+    uint64_t end_frame;                     // One past the last frame of the window
+} capture;
+
+void history_start(uint32_t packet_words) {
+    history_packet_words = packet_words;
+    history_slots = HISTORY_SIZE_WORDS / packet_words;
+    history_write_slot = 0;
+    history_frames = 0;
+    history_epoch = 0;
+    capture.armed = 0;
+    send_message("History: %u frames of %u words\r\n", history_slots, packet_words);
+}
+
+void history_store(const uint32_t *packet) {
+    memcpy(&history_buffer[history_write_slot * history_packet_words], packet,
+           history_packet_words * BYTES_PER_WORD);
+    if (++history_write_slot == history_slots) {
+        history_write_slot = 0;
+    }
+    history_frames++;
+}
+
+// Timestamps start again from zero, so frames stored until now can no longer be
+// found by timestamp (captures and the TCP stream go by frame and are unaffected)
+void history_reset_timestamps(void) {
+    history_epoch = history_frames;
+}
+
+uint64_t history_timestamp_epoch(void) {
+    return history_epoch;
+}
+
+uint64_t history_frames_stored(void) {
+    return history_frames;
+}
+
+uint32_t history_capacity(void) {
+    return history_slots;
+}
+
+uint32_t history_packet_size(void) {
+    return history_packet_words;
+}
+
+// The window may take at most half the ring, so the frames being sent stay in
+// the ring for as long as it takes to record the other half
+int history_trigger(uint32_t pre_frames, uint32_t post_frames) {
+    if (!stream_enabled || capture.armed) {
+        return 0;
+    }
+    if ((uint64_t)pre_frames + post_frames + 1 > history_slots / 2) {
+        return 0;
+    }
+
+    uint64_t trigger_frame = (history_frames > 0) ? history_frames - 1 : 0;
+    uint64_t available = trigger_frame;     // Older frames still in the ring
+    if (available > history_slots - 1) {
+        available = history_slots - 1;
+    }
+    capture.trigger_frame = trigger_frame;
+    capture.first_frame = trigger_frame - ((pre_frames < available) ? pre_frames : available);
+    capture.end_frame = trigger_frame + 1 + post_frames;
+    capture.armed = 1;
+    return 1;
+}
+
+// Complete once the post-trigger frames are stored, or cut short by STOP
+int history_capture_ready(void) {
+    if (!capture.armed) {
+        return 0;
+    }
+    if (history_frames >= capture.end_frame) {
+        return 1;
+    }
+    if (!stream_enabled) {
+        capture.end_frame = history_frames;
+        return 1;
+    }
+    return 0;
+}
+
+void history_take_capture(capture_response_t *response, uint64_t *first_frame) {
+    uint32_t frame_count = 0;
+    if (capture.end_frame > capture.first_frame) {
+        frame_count = (uint32_t)(capture.end_frame - capture.first_frame);
+    }
+
+    memset(response, 0, sizeof(capture_response_t));
+    response->completion.cmd_id = CMD_TRIGGER_CAPTURE;
+    response->completion.status = ACK_SUCCESS;
+    response->completion.stream_enabled = stream_enabled ? 1 : 0;
+    response->completion.packets_received = packets_received_count;
+    response->completion.detail = frame_count;
+    response->packet_words = history_packet_words;
+    response->pre_frames = (uint32_t)(capture.trigger_frame - capture.first_frame);
+
+    if (frame_count > 0) {
+        const uint32_t *first = history_frame_words(capture.first_frame, NULL);
+        response->first_timestamp = ((uint64_t)first[3] << 32) | first[2];
+        if (capture.end_frame > capture.trigger_frame) {
+            const uint32_t *trigger = history_frame_words(capture.trigger_frame, NULL);
+            response->completion.timestamp = ((uint64_t)trigger[3] << 32) | trigger[2];
+        }
+    }
+
+    *first_frame = capture.first_frame;
+    capture.armed = 0;
+}
+
+uint64_t history_frame_timestamp(uint64_t frame) {
+    const uint32_t *words = history_frame_words(frame, NULL);
+    return ((uint64_t)words[3] << 32) | words[2];
+}
+
+// Timestamps rise through the ring from the last timestamp reset on (frames lost to
+// a BRAM overrun leave gaps), so a binary search over those frames finds the one to
+// start from
+int history_find_timestamp(uint64_t timestamp, uint64_t *frame) {
+    uint64_t low = (history_frames > history_slots) ? history_frames - history_slots : 0;
+    if (low < history_epoch) {
+        low = history_epoch;
+    }
+    uint64_t high = history_frames;
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (history_frame_timestamp(mid) < timestamp) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == history_frames) {
+        return 0;
+    }
+    *frame = low;
+    return 1;
+}
+
+// Frame `frame` and the number of words from its start to the end of the ring
+const uint32_t *history_frame_words(uint64_t frame, uint32_t *contiguous_words) {
+    uint32_t slot = (uint32_t)(frame % history_slots);
+    if (contiguous_words) {
+        *contiguous_words = (history_slots - slot) * history_packet_words;
+    }
+    return &history_buffer[slot * history_packet_words];
+}
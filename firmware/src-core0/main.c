@@ -16,6 +16,7 @@ struct netif server_netif;
 struct udp_pcb *udp;
 volatile int stream_enabled = 0;
 uint32_t packets_received_count = 0;
+uint64_t stream_start_timestamp = 0;        // First timestamp of the current stream
 
 // Command flags for main loop processing
 volatile int enable_streaming_flag = 0;
@@ -25,8 +26,9 @@ volatile int cable_test_flag = 0;
 
 // BRAM state tracking
 uint32_t ps_read_address = 0;              // Current PS read position (word address)
-uint32_t current_packet_size = 74;         // Current expected packet size in 32-bit words (default to max)
-uint32_t current_channel_enable = 0x0F;    // Current channel enable setting (default all channels)
+uint32_t current_packet_size = MAX_WORDS_PER_PACKET; // Current expected packet size in 32-bit words (default to max)
+uint32_t current_channel_enable = CHANNEL_ENABLE_ALL; // Current channel enable setting (default all channels)
+uint32_t current_sample_rate = MAX_SAMPLE_RATE_HZ; // Current frame rate in Hz (default 30 kS/s)
 
 // Packet validation tracking
 uint32_t error_count = 0;
@@ -34,9 +36,12 @@ uint32_t error_count = 0;
 // UDP transmission
 uint32_t udp_packets_sent = 0;
 uint32_t udp_send_errors = 0;
+uint32_t udp_tx_waits = 0;
+uint32_t udp_tx_forced_drops = 0;
 // UDP configuration (can be changed via TCP command)
 uint32_t udp_dest_ip = 0;      // Will be initialized in main()
 uint16_t udp_dest_port = DEFAULT_UDP_DEST_PORT;
+int udp_stream_enabled = 1;    // Cleared to only record frames into the history
 
 // Pre-allocated packet buffer for UDP (sized for maximum packet)
 // Use __attribute__((aligned(64))) to align to cache line boundary for optimal performance
@@ -46,18 +51,17 @@ static uint32_t udp_packet_buffer[MAX_WORDS_PER_PACKET] __attribute__((aligned(6
 // PACKET SIZE CALCULATION FUNCTIONS
 // ============================================================================
 
-uint32_t calculate_data_words(int channel_enable) {
+uint32_t calculate_data_words(uint32_t channel_enable) {
     int num_channels = 0;
     
-    // Count enabled channels
-    if (channel_enable & 0x01) num_channels++; // CIPO0 regular
-    if (channel_enable & 0x02) num_channels++; // CIPO0 DDR
-    if (channel_enable & 0x04) num_channels++; // CIPO1 regular  
-    if (channel_enable & 0x08) num_channels++; // CIPO1 DDR
+    // Count enabled channels - per port: CIPO0 regular, CIPO0 DDR, CIPO1 regular, CIPO1 DDR
+    for (int bit = 0; bit < CHANNELS_PER_PORT * PL_NUM_SPI_PORTS; bit++) {
+        if (channel_enable & (1u << bit)) num_channels++;
+    }
     
     if (num_channels == 0) {
         send_message("WARNING: No channels enabled, defaulting to all channels\r\n");
-        return 70; // Default to maximum (4 channels × 35 cycles ÷ 2)
+        return MAX_PACKET_DATA_WORDS; // Default to maximum (4 channels per port × 35 cycles ÷ 2)
     }
     
     // Calculate 32-bit words needed for the data
@@ -70,7 +74,7 @@ uint32_t calculate_data_words(int channel_enable) {
     return data_32bit_words;
 }
 
-uint32_t calculate_packet_size(int channel_enable) {
+uint32_t calculate_packet_size(uint32_t channel_enable) {
     return PACKET_HEADER_WORDS + calculate_data_words(channel_enable);
 }
 
@@ -84,6 +88,14 @@ void update_current_packet_size(void) {
         send_message("Updated packet size: channel_enable=0x%X, packet_size=%u words (%u bytes)\r\n",
                      current_channel_enable, current_packet_size, current_packet_size * 4);
     }
+
+    uint32_t new_sample_rate = pl_get_current_sample_rate();
+
+    if (new_sample_rate != current_sample_rate) {
+        current_sample_rate = new_sample_rate;
+        send_message("Updated sample rate: %u Hz (%u bytes/s)\r\n",
+                     current_sample_rate, current_sample_rate * current_packet_size * 4);
+    }
 }
 
 // ============================================================================
@@ -106,18 +118,29 @@ static int packets_available(void) {
   return n_words_available / current_packet_size;  // Use variable packet size
 }
 
-// Read and validate one packet directly from BRAM with UDP transmission
-static int process_packet_from_bram(void) {
-  // Calculate BRAM address (no copying - read directly)
-  uint32_t magic_low_offset = ps_read_address; // should always be smaller than BRAM_SIZE_WORDS!!!
-  uint32_t magic_high_offset = (ps_read_address + 1) % BRAM_SIZE_WORDS;
+static uint32_t published_read_address = 0;
+
+// The PL measures the unread BRAM words against the last address published here
+static void publish_read_address(void) {
+  if (ps_read_address != published_read_address) {
+    pl_set_ps_read_address(ps_read_address);
+    published_read_address = ps_read_address;
+  }
+}
+
+// process_packet_from_bram() could not send the frame yet; it stays in BRAM
+#define PACKET_RETRY (-1)
+
+static int retry_pending = 0;   // The frame at ps_read_address is already copied and in the history
 
-  // Read packet header from BRAM
-  uint32_t magic_low = Xil_In32(BRAM_BASE_ADDR + (magic_low_offset * 4));
-  uint32_t magic_high = Xil_In32(BRAM_BASE_ADDR + (magic_high_offset * 4));
+// Copy the packet at ps_read_address into udp_packet_buffer and validate it
+static int copy_packet_from_bram(void) {
+  // The whole frame in one copy: the magic is checked in the copy, which saves two
+  // single reads from BRAM and sees the same data the copy does
+  bram_copy_words(udp_packet_buffer, ps_read_address, current_packet_size);
 
   // Reconstruct 64-bit magic number
-  uint64_t magic = ((uint64_t)magic_high << 32) | magic_low;
+  uint64_t magic = ((uint64_t)udp_packet_buffer[1] << 32) | udp_packet_buffer[0];
 
   // Validate magic number
   if (magic != 0xCAFEBABEDEADBEEF) {
@@ -132,59 +155,64 @@ static int process_packet_from_bram(void) {
   // TODO: If we are in an error state, we could track how long we stay there
   //    by measuring the timestamp gap when we recover.
 
-  // UDP transmission (always enabled) - zero-copy with pre-allocated buffer
-  // Copy variable sized packet data to pre-allocated buffer.
-  // TODO: Consider replacing with memcpy
-  
-  /*
-  // Unoptimized copy
-  for (int i = 0; i < current_packet_size; i++) {
-    uint32_t word_offset = (ps_read_address + i) % BRAM_SIZE_WORDS;
-    uint32_t safe_addr = BRAM_BASE_ADDR + (word_offset * 4);
-    udp_packet_buffer[i] = Xil_In32(safe_addr);
+  // Into the rolling history, whether or not the frame goes out over UDP
+  history_store(udp_packet_buffer);
+  return 1;
+}
+
+// Send udp_packet_buffer; ERR_MEM also when the TX ring has no room for it
+static err_t send_packet_buffer(void) {
+  if (!udp_tx_ready()) {
+    return ERR_MEM;
   }
-  */
-    // Copy packet data using optimized memcpy
-    if ((ps_read_address + current_packet_size) <= BRAM_SIZE_WORDS) {
-        // No wrap - single memcpy
-        memcpy(udp_packet_buffer,
-               (void*)(BRAM_BASE_ADDR + ps_read_address * 4),
-               current_packet_size * 4);
-    } else {
-        // Handle wrap with two memcpys
-        uint32_t first_part = BRAM_SIZE_WORDS - ps_read_address;
-        memcpy(udp_packet_buffer,
-               (void*)(BRAM_BASE_ADDR + ps_read_address * 4),
-               first_part * 4);
-        memcpy(&udp_packet_buffer[first_part],
-               (void*)BRAM_BASE_ADDR,
-               (current_packet_size - first_part) * 4);
-    }  
-  
+
   // Create pbuf that references our buffer directly (zero-copy!)
   uint32_t packet_bytes = current_packet_size * BYTES_PER_WORD;
   struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, packet_bytes, PBUF_REF);
-  if (p != NULL) {
-    // Point pbuf payload directly to our buffer (zero-copy!)
-    p->payload = (void*)udp_packet_buffer;
-
-    // Send using udp_sendto (no connect required)
-    ip_addr_t dest_ip;
-    dest_ip.addr = udp_dest_ip;
-    err_t result = udp_sendto(udp, p, &dest_ip, udp_dest_port);
-    // err_t result = udp_send(udp, p);
-    
+  if (p == NULL) {
+    return ERR_MEM;
+  }
+  // Point pbuf payload directly to our buffer (zero-copy!)
+  p->payload = (void*)udp_packet_buffer;
+
+  // Send using udp_sendto (no connect required)
+  ip_addr_t dest_ip;
+  dest_ip.addr = udp_dest_ip;
+  err_t result = udp_sendto(udp, p, &dest_ip, udp_dest_port);
+
+  // Free pbuf (this won't free our buffer since it's PBUF_REF)
+  pbuf_free(p);
+  return result;
+}
+
+// Read and validate one packet directly from BRAM with UDP transmission. A frame
+// that cannot be sent for lack of TX descriptors or lwIP buffers stays in BRAM
+// (PACKET_RETRY) when may_retry is set, and is dropped otherwise.
+static int process_packet_from_bram(int may_retry) {
+  int retrying = retry_pending;
+  if (!retrying && !copy_packet_from_bram()) {
+    return 0;
+  }
+  retry_pending = 0;
+
+  if (udp_stream_enabled) {
+    err_t result = send_packet_buffer();
+    int transient = (result == ERR_MEM) || (result == ERR_BUF);
     if (result == ERR_OK) {
       udp_packets_sent++;
+      fec_frame_sent(udp_packet_buffer, current_packet_size);
+    } else if (transient && may_retry) {
+      if (!retrying) {
+        udp_tx_waits++;
+      }
+      retry_pending = 1;
+      return PACKET_RETRY;
     } else {
-      send_message("UDP Send Error: %d\r\n", result);
+      if (transient) {
+        udp_tx_forced_drops++;
+      }
       udp_send_errors++; // ERROR TO TRACK
     }
-    
-    // Free pbuf (this won't free our buffer since it's PBUF_REF)
-    pbuf_free(p);
-  } else {
-    udp_send_errors++;
   }
   
   // Update read pointer with variable packet size
@@ -198,20 +226,36 @@ static int process_packet_from_bram(void) {
 // STREAMING CONTROL
 // ============================================================================
 
-void handle_enable_streaming(void) {
+int handle_enable_streaming(void) {
   if (stream_enabled) {
     send_message("Streaming already enabled\r\n");
-    return;
+    return 0;
+  }
+  // The ring arithmetic and read address use BRAM_SIZE_WORDS; with another depth
+  // the PS would read frames from the wrong place
+  if (pl_get_bram_size_words() != BRAM_SIZE_WORDS) {
+    send_message("ERROR: PL built with a %u word BRAM, firmware expects %u - not streaming\r\n",
+                 pl_get_bram_size_words(), BRAM_SIZE_WORDS);
+    return 0;
   }
 
     // Update packet size before starting streaming
     update_current_packet_size();
+  tcp_stream_history_restart();
+  history_start(current_packet_size);
+  pacer_start(current_sample_rate);
+  scheduler_reset_stats();
+  publish_read_address();
+  headroom_start();
   
   // Reset state
   packets_received_count = 0;
   error_count = 0;
   udp_packets_sent = 0;
   udp_send_errors = 0;
+  udp_tx_waits = 0;
+  udp_tx_forced_drops = 0;
+  retry_pending = 0;
   
   // Reset PL
   pl_set_transmission(0);
@@ -220,25 +264,45 @@ void handle_enable_streaming(void) {
   usleep(1000);
   
   // Enable streaming
+  stream_start_timestamp = pl_get_timestamp();
   stream_enabled = 1;
   pl_set_transmission(1);
   
-  send_message("BRAM streaming STARTED (packet size: %u words)\r\n", current_packet_size);
+  send_message("BRAM streaming STARTED (packet size: %u words, %u Hz)\r\n",
+               current_packet_size, current_sample_rate);
+  return 1;
 }
 
-void handle_disable_streaming(void) {
+int handle_disable_streaming(void) {
   if (!stream_enabled) {
     send_message("Streaming already disabled\r\n");
-    return;
+    return 0;
   }
   
-  stream_enabled = 0;
+  // The PL finishes the frame in progress (at most two frame periods); send it and
+  // everything still in BRAM so the stream ends on a whole, delivered frame
   pl_set_transmission(0);
+  uint32_t timeout_us = 2 * (1000000 / current_sample_rate) + 100;
+  while (pl_is_transmission_active() && timeout_us > 0) {
+    usleep(1);
+    timeout_us--;
+  }
+  uint32_t retries = 0;
+  while (packets_available() > 0) {
+    if (process_packet_from_bram(retries < TX_STOP_RETRIES) == PACKET_RETRY) {
+      retries++;
+      usleep(1);
+    }
+    publish_read_address();
+  }
+  fec_flush();
+  stream_enabled = 0;
   
   send_message("BRAM streaming STOPPED\r\n");
   send_message("Summary: %u packets processed, %u errors\r\n",
        packets_received_count, error_count);
   send_message("UDP: %u packets sent, %u errors\r\n", udp_packets_sent, udp_send_errors);
+  return 1;
 }
 
 void handle_reset_timestamp(void) {
@@ -247,25 +311,42 @@ void handle_reset_timestamp(void) {
   udp_packets_sent = 0;
   udp_send_errors = 0;
   pl_reset_timestamp();
+  history_reset_timestamps();
   send_message("Timestamp and counters RESET\r\n");
 }
 
+// The PL starts transmitting at the next frame boundary. Wait for that (at most two
+// frame periods) so a START completion means the first frame is on its way.
+static void wait_for_first_frame(void) {
+  uint32_t timeout_us = 2 * (1000000 / current_sample_rate) + 100;
+  while (!pl_is_transmission_active() && !pl_is_loop_limit_reached() && timeout_us > 0) {
+    usleep(1);
+    timeout_us--;
+  }
+}
+
+// Deferred commands from TCP are completed with notify_command_complete() once the
+// work is done (flags set from the debug console have no pending completion)
 void process_command_flags(void) {
   if (command_flags->enable_streaming_flag) {
     command_flags->enable_streaming_flag = 0;
-    handle_enable_streaming();
+    uint8_t status = handle_enable_streaming() ? ACK_SUCCESS : ACK_ERROR;
+    wait_for_first_frame();
+    notify_command_complete(CMD_START, status, stream_start_timestamp, 0);
     command_flags->lock = 0;
   }
   
   if (command_flags->disable_streaming_flag) {
     command_flags->disable_streaming_flag = 0;
-    handle_disable_streaming();
+    uint8_t status = handle_disable_streaming() ? ACK_SUCCESS : ACK_ERROR;
+    notify_command_complete(CMD_STOP, status, pl_get_timestamp(), 0);
     command_flags->lock = 0;
   }
   
   if (command_flags->reset_timestamp_flag) {
     command_flags->reset_timestamp_flag = 0;
     handle_reset_timestamp();
+    notify_command_complete(CMD_RESET_TIMESTAMP, ACK_SUCCESS, pl_get_timestamp(), 0);
     command_flags->lock = 0;
   }
 
@@ -277,32 +358,107 @@ void process_command_flags(void) {
 
   if (command_flags->bram_benchmark_flag) {
     command_flags->bram_benchmark_flag = 0;
-    benchmark_bram_reads();
+    benchmark_run();
     command_flags->lock = 0;
   }
 
   if (command_flags->dump_bram_flag) {
     command_flags->dump_bram_flag = 0;
     pl_dump_bram_data(command_flags->start_bram_addr, command_flags->word_count);
+    notify_command_complete(CMD_DUMP_BRAM, ACK_SUCCESS, pl_get_timestamp(), command_flags->word_count);
     command_flags->lock = 0;
   }
 
   if (command_flags->cable_test_flag) {
     command_flags->cable_test_flag = 0;
     pl_run_full_cable_test();
-    handle_enable_streaming();
+    uint8_t status = handle_enable_streaming() ? ACK_SUCCESS : ACK_ERROR;
+    wait_for_first_frame();
+    notify_command_complete(CMD_FULL_CABLE_TEST, status, stream_start_timestamp, 0);
     command_flags->lock = 0;
   }
 }
 
-// Network maintenance loop
-void network_maintenance_loop(void) {
-  static uint32_t counter = 0;
-  counter++;
-  
-  xemacif_input(&server_netif);
+// ============================================================================
+// SCHEDULER TASKS
+// ============================================================================
+
+// Each task does at most `budget` units of work per turn and returns how many it
+// did; scheduler.c decides the order and the budgets
+
+uint32_t bram_backlog_words(void) {
+  packets_available();
+  return n_words_available;
+}
+
+// Process the available packets with direct BRAM access and UDP transmission, as
+// fast as the pacer lets a backlog go out, then tell the PL how far the PS has read
+uint32_t task_stream_drain(uint32_t max_frames) {
+  uint32_t burst = 0;
+  if (stream_enabled) {
+    if (packets_available() > 0) {
+      headroom_record(n_words_available);
+    }
+    while ((burst < max_frames) && (packets_available() > 0) && pacer_release(n_words_available)) {
+      if (process_packet_from_bram(n_words_available < TX_DROP_BACKLOG_WORDS) == PACKET_RETRY) {
+        break;    // Service the network, then try the same frame again
+      }
+      burst++;
+    }
+    pacer_burst_done(burst);
+    publish_read_address();
+  }
+
+  // Retransmissions only go out once the live frames have all been sent, never ahead
+  // of a frame the pacer or a PACKET_RETRY left in BRAM
+  if (!stream_enabled || (packets_available() == 0)) {
+    poll_frame_resend();
+  }
+  return burst;
+}
+
+// xemacif_input() hands one received packet to lwIP per call
+uint32_t task_ethernet_rx(uint32_t max_packets) {
+  uint32_t packets = 0;
+  while ((packets < max_packets) && xemacif_input(&server_netif)) {
+    packets++;
+  }
+  return packets;
+}
+
+uint32_t task_lwip_timers(uint32_t budget) {
+  (void)budget;
   sys_check_timeouts();
+  return 1;
+}
+
+uint32_t task_commands(uint32_t budget) {
+  (void)budget;
   process_command_flags();
+  poll_transaction();
+  poll_history_capture();
+  poll_benchmark();
+  poll_tcp_stream();
+  return 1;
+}
+
+// Periodic status (once per second of data)
+uint32_t task_telemetry(uint32_t budget) {
+  static uint32_t reported_count = 0;
+  uint32_t done = telemetry_poll();
+  (void)budget;
+  if (!stream_enabled || (packets_received_count < reported_count)) {
+    reported_count = 0;     // A new stream started
+    return done;
+  }
+  if (packets_received_count - reported_count < current_sample_rate) {
+    return done;
+  }
+  reported_count = packets_received_count - (packets_received_count % current_sample_rate);
+  send_message("Processed %u packets, %u errors, %u nwa, UDP: %u sent/%u errors\r\n",
+       packets_received_count, error_count, n_words_available,
+       udp_packets_sent, udp_send_errors);
+  return done + 1;
 }
 
 // ============================================================================
@@ -369,6 +525,14 @@ int main() {
   send_message("System ready. Commands: start, stop, reset_timestamp, status\r\n");
   
   // Initialize PL
+  if (pl_get_num_spi_ports() != PL_NUM_SPI_PORTS) {
+    send_message("WARNING: PL built with %u SPI ports, firmware expects %u\r\n",
+                 pl_get_num_spi_ports(), PL_NUM_SPI_PORTS);
+  }
+  if (pl_get_bram_size_words() != BRAM_SIZE_WORDS) {
+    send_message("WARNING: PL built with a %u word BRAM, firmware expects %u - START will be refused\r\n",
+                 pl_get_bram_size_words(), BRAM_SIZE_WORDS);
+  }
   pl_set_transmission(0);
   pl_set_loop_count(0);
     
@@ -376,34 +540,20 @@ int main() {
   update_current_packet_size();
 
   start_tcp_server();
+  start_stream_server();
   
   // Initialize UDP (always enabled)
   udp_stream_init();
 
-  // benchmark_bram_reads();
+  // Measure the BRAM copy methods and stream with the fastest
+  benchmark_select_copy();
 
   pl_set_copi_commands(initialization_cmd_sequence);
   
   send_message("debug> ");
   
   // Main event loop
-  while (1) {
-    network_maintenance_loop();
-    
-    if (stream_enabled) {
-      // Process all available packets with direct BRAM access and UDP transmission
-      while (packets_available() > 0) { 
-        process_packet_from_bram();
-        
-        // Periodic status (every 30k packets)
-        if (packets_received_count % 30000 == 0) {
-          send_message("Processed %u packets, %u errors, %u nwa, UDP: %u sent/%u errors\r\n",
-               packets_received_count, error_count, n_words_available,
-               udp_packets_sent, udp_send_errors);
-        }
-      }
-    }
-  }
+  scheduler_run();
   
   cleanup_platform();
   return 0;
@@ -3,6 +3,8 @@
 #include "lwip/tcp.h"
 #include "lwip/udp.h"
 #include "lwip/timeouts.h"
+#include "lwip/sys.h"
+#include "netif/xemacpsif.h"
 #include "sleep.h"
 #include <string.h>
 #include <stdio.h>
@@ -23,37 +25,113 @@ ID   | Command          | Param1              | Param2
 0x10 | SET_LOOP_COUNT   | loop_count          | unused
 0x11 | SET_PHASE        | phase0              | phase1
 0x12 | SET_DEBUG_MODE   | enable (0/1)        | unused
-0x13 | SET_CHANNEL_ENABLE | 4 bits            | unused
+0x13 | SET_CHANNEL_ENABLE | 4 bits per port  | unused
+0x14 | SET_SAMPLE_RATE  | rate_hz             | unused
+0x15 | SET_FINE_PHASE   | fine_phase0 (0-23)  | fine_phase1 (0-23)
+0x16 | SET_PORT_FINE_PHASE | port            | fine_phase0 + (fine_phase1 << 8)
 0x20 | LOAD_CONVERT     | unused              | unused
 0x21 | LOAD_INIT        | unused              | unused  
 0x22 | LOAD_CABLE_TEST  | unused              | unused
 0x30 | FULL_CABLE_TEST  | unused              | unused
 0x40 | GET_STATUS       | unused              | unused
 0x41 | DUMP_BRAM        | start_addr          | word_count
+0x42 | READ_BRAM        | start_addr          | word_count | flags
+0x43 | TRIGGER_CAPTURE  | pre_frames          | post_frames
+0x44 | RESEND_FRAMES    | first_timestamp     | frame_count
 0x50 | SET_UDP_DEST     | ip_addr             | port
+0x51 | SET_UDP_STREAM   | enable (0/1)        | unused
+0x52 | SET_FEC          | group_size (0=off)  | unused
+0x53 | SET_PACING       | rate_percent (0=off)| burst_frames (0=default)
+0x54 | SET_TELEMETRY    | ip_addr (0=stream)  | port + (rate_hz << 16)
+0x60 | TRANSACTION      | command_count       | unused
+
+TRANSACTION is followed by command_count (1-16) complete commands. The firmware
+collects all of them, then at one point of the main loop validates every one
+before applying any and applies them in order (START/STOP/RESET_TIMESTAMP
+included, so a "configure then start" sequence cannot be split by other work).
+The sub-commands' ack_ids are ignored; the transaction is answered once with a 5-byte header and one
+status byte per sub-command (ACK_SUCCESS or ACK_ERROR as it was applied, or 0 =
+valid but not applied because another sub-command was rejected); the header status
+is ACK_SUCCESS only if every sub-command succeeded. Validation follows the stream
+state the earlier sub-commands leave behind: START is rejected while streaming,
+STOP while stopped, and SET_SAMPLE_RATE unless the stream is stopped at that point.
+START/STOP/RESET_TIMESTAMP are finished before the transaction is answered, so they
+send no completion notification; their status byte is the completion status.
+Commands received behind a transaction are held until it has been answered.
+GET_STATUS, DUMP_BRAM, FULL_CABLE_TEST and nested transactions are not allowed
+inside a transaction.
+
+START, STOP, RESET_TIMESTAMP, DUMP_BRAM and FULL_CABLE_TEST are carried out later by
+the main loop. Their ACK only means "accepted"; once the work is done the firmware
+sends a completion notification with the command's ack_id:
+[ack_id high][ack_id low][ACK_COMPLETE][len high][len low][completion_response_t]
+
+READ_BRAM sends word_count (1 to BRAM_SIZE_WORDS) words starting at start_addr
+(wrapping at the end of BRAM) in binary: a 5-byte header with a bram_read_response_t,
+then the words themselves - up to BRAM_SIZE_BYTES, streamed from the sent callback as the send
+buffer drains. With BRAM_READ_SNAPSHOT the range is copied first, so the data is what
+BRAM held at one instant rather than whatever the PL has written by the time each
+chunk goes out. Commands received during the transfer, and completion notifications,
+are held back until the last word has been queued.
+
+TRIGGER_CAPTURE asks for the frames from pre_frames before the newest frame in the
+DDR history to post_frames after it (the window may take at most half the history).
+It is ACKed at once; when the last post-trigger frame has been recorded (or STOP cut
+the window short) the completion is sent as a capture_response_t followed by the
+frames, over the same bulk path as READ_BRAM. One capture can be armed at a time.
+SET_UDP_STREAM 0 stops the UDP datagrams while frames keep going into the history,
+so only the captured windows cross the network.
+
+RESEND_FRAMES is a NACK for datagrams lost on the way to the host: the frames with
+timestamps first_timestamp to first_timestamp + frame_count - 1 (1 to
+MAX_RESEND_FRAMES; param1 holds the low 32 bits, the high bits are those of the
+newest frame) are sent again from the DDR history as ordinary UDP datagrams. They
+go out a few at a time, only while no live frame is waiting in BRAM, so a burst of
+requests cannot delay the stream. ACK_SUCCESS means the range was queued (at least
+its first frame is still in the history); frames missing from the history are
+skipped and counted in udp_resend_misses. RESET_TIMESTAMP drops the frames stored
+before it from the search, and any resend still queued. Receivers recognise a
+resent frame by its timestamp being older than the newest one they have seen.
+
+SET_FEC 2-32 adds an XOR parity datagram after every group_size frames (see
+FEC_MAGIC_HIGH in main.h), enough for the receiver to rebuild one lost frame per
+group without a round trip; SET_FEC 0 turns it off. A parity datagram that finds
+the TX ring full is dropped rather than held, like a lost datagram.
+
+SET_PACING limits how fast a backlog of frames in BRAM goes out after a stall, in
+percent of the sample rate (at least 110), with bursts of up to burst_frames
+(1-256). The default is 300% in bursts of 8; SET_PACING 0 sends backlogs at line
+rate. Pacing gives way when BRAM is half full.
+
+SET_TELEMETRY sends a telemetry_datagram_t (TELEMETRY_MAGIC_HIGH) rate_hz times a
+second (1-100, 0 = off) to ip_addr:port; ip_addr 0 is the UDP stream host and
+port 0 is TELEMETRY_PORT. It carries what a monitor would otherwise poll
+GET_STATUS for - counters, frame rates, errors since the previous datagram, and
+the highest BRAM backlog, PL FIFO count and main loop times in between - at a
+cost that does not grow with the number of monitors listening.
+
+Frame stream (STREAM_TCP_PORT):
+A client connected to this port receives every frame from the DDR history as a
+plain byte stream of back-to-back packets (no framing beyond the packet header),
+starting with the newest frame when it connects. TCP retransmits what the
+network loses, so a recording made this way has no gaps unless the client falls
+more than half the history behind; the skipped frames are then counted in
+tcp_stream_frames_dropped. START restarts the history, so a client with data not
+yet acknowledged by then is disconnected (the data is sent from the history without
+a copy); a client that has caught up carries on with the new stream. Data sent to
+this port is ignored. Only one stream client is served; a new connection replaces
+the old one.
 */
 
 #define CMD_MAGIC           0xDEADBEEF
 #define CMD_PACKET_SIZE     20
 
-#define CMD_START           0x01
-#define CMD_STOP            0x02
-#define CMD_RESET_TIMESTAMP 0x03
-#define CMD_SET_LOOP_COUNT  0x10
-#define CMD_SET_PHASE       0x11
-#define CMD_SET_DEBUG_MODE  0x12
-#define CMD_SET_CHANNEL_ENABLE 0x13
-#define CMD_LOAD_CONVERT    0x20
-#define CMD_LOAD_INIT       0x21
-#define CMD_LOAD_CABLE_TEST 0x22
-#define CMD_FULL_CABLE_TEST 0x30
-#define CMD_GET_STATUS      0x40
-#define CMD_DUMP_BRAM       0x41
-#define CMD_SET_UDP_DEST    0x50
-
-
-#define ACK_SUCCESS         0x06
-#define ACK_ERROR           0x15
+#define MAX_TRANSACTION_COMMANDS 16
+#define MAX_PENDING_COMPLETIONS  8
+#define BRAM_READ_CHUNK_WORDS    1024       // Largest single tcp_write of a READ_BRAM transfer
+#define STREAM_MAX_WRITE_BYTES   0xFFFF     // tcp_write length is a u16_t
+#define MAX_RESEND_REQUESTS      16
+#define RESEND_FRAMES_PER_POLL   8          // Resent datagrams per main loop pass
 
 typedef struct {
     uint32_t magic;
@@ -67,6 +145,71 @@ typedef struct {
 static uint8_t recv_buffer[CMD_PACKET_SIZE];
 static uint16_t recv_buffer_pos = 0;
 
+// Connection that receives completion notifications, and the deferred commands
+// still waiting for theirs
+static struct tcp_pcb *command_pcb = NULL;
+static struct {
+    uint32_t cmd_id;
+    uint32_t ack_id;
+    uint8_t done;                       // Carried out, notification not sent yet
+    completion_response_t completion;
+} pending_completions[MAX_PENDING_COMPLETIONS];
+static uint32_t num_pending_completions = 0;
+static uint8_t completion_status = ACK_SUCCESS;    // Of the last deferred command carried out
+
+// Bulk transfer (READ_BRAM data or a capture) in progress, pcb is NULL when idle
+static struct {
+    struct tcp_pcb *pcb;
+    const char *name;
+    const uint32_t *base;       // Memory sent from, wrapping at size_words; NULL = live BRAM
+    uint32_t size_words;
+    uint32_t next_addr;
+    uint32_t words_left;
+    uint32_t words_sent;
+} bulk;
+static uint32_t bram_snapshot[BRAM_SIZE_WORDS] __attribute__((aligned(64)));
+static uint32_t bram_read_chunk[BRAM_READ_CHUNK_WORDS] __attribute__((aligned(64)));
+
+// Command bytes received while a bulk transfer is in progress or a transaction is
+// waiting for the main loop. They are not passed to tcp_recved until processed, so
+// the window keeps this from overflowing.
+static uint8_t deferred_rx[TCP_WND];
+static uint32_t deferred_rx_len = 0;
+
+// Transaction being collected (commands following a TRANSACTION header)
+static cmd_packet_t transaction_cmds[MAX_TRANSACTION_COMMANDS];
+static uint32_t transaction_count = 0;     // Sub-commands expected, 0 = no transaction open
+static uint32_t transaction_received = 0;
+static uint32_t transaction_ack_id = 0;
+static int transaction_ready = 0;          // Complete, waiting for poll_transaction
+
+// TRIGGER_CAPTURE waiting for its window (the capture itself is kept in history.c)
+static int capture_pending = 0;
+static uint32_t capture_ack_id = 0;
+
+// RUN_BENCHMARK waiting for the main loop to run it (benchmark.c)
+static int benchmark_pending = 0;
+static uint32_t benchmark_ack_id = 0;
+
+// Frame stream client. Frames are written straight from the history ring without
+// copying, so everything not yet acknowledged must stay in the ring.
+static struct tcp_pcb *stream_pcb = NULL;
+static uint64_t stream_next_frame = 0;          // Next history frame to write
+static uint32_t stream_frames_sent = 0;
+static uint32_t stream_frames_dropped = 0;
+static uint32_t stream_buffered_bytes = 0;      // Written, not yet acknowledged
+
+// RESEND_FRAMES ranges waiting to go out, oldest first
+static struct {
+    uint64_t next_frame;                        // History frame to send next
+    uint64_t end_timestamp;                     // One past the last requested timestamp
+    uint32_t frames_left;
+} resend_queue[MAX_RESEND_REQUESTS];
+static uint32_t resend_head = 0;
+static uint32_t resend_count = 0;
+static uint32_t udp_frames_resent = 0;
+static uint32_t udp_resend_misses = 0;
+
 uint32_t sys_now(void) {
     XTime now;
     XTime_GetTime(&now);
@@ -119,6 +262,109 @@ void udp_stream_init() {
                  ip4addr_ntoa(&dest_ip), udp_dest_port);
 }
 
+// Whether the TX ring can take another frame. Descriptors the GEM has finished with
+// are normally reclaimed by the TX interrupt; when the ring looks full, reclaim them
+// here before giving up.
+int udp_tx_ready(void) {
+    struct xemac_s *xemac = (struct xemac_s *)server_netif.state;
+    xemacpsif_s *xemacpsif = (xemacpsif_s *)xemac->state;
+    if (is_tx_space_available(xemacpsif) >= TX_DESCRIPTORS_PER_FRAME) {
+        return 1;
+    }
+
+    SYS_ARCH_DECL_PROTECT(lev);
+    SYS_ARCH_PROTECT(lev);
+    process_sent_bds(xemacpsif, &XEmacPs_GetTxRing(&xemacpsif->emacps));
+    SYS_ARCH_UNPROTECT(lev);
+    return is_tx_space_available(xemacpsif) >= TX_DESCRIPTORS_PER_FRAME;
+}
+
+// ============================================================================
+// FRAME RESEND
+// ============================================================================
+
+static int queue_frame_resend(uint32_t first_timestamp_low, uint32_t frame_count) {
+    uint64_t stored = history_frames_stored();
+    if ((frame_count == 0) || (frame_count > MAX_RESEND_FRAMES) ||
+        (resend_count == MAX_RESEND_REQUESTS) || (stored == 0)) {
+        return 0;
+    }
+
+    // Widen to 64 bits from the newest frame; a range just before a 2^32 boundary
+    // belongs to the previous epoch
+    uint64_t newest = history_frame_timestamp(stored - 1);
+    uint64_t first = (newest & 0xFFFFFFFF00000000ULL) | first_timestamp_low;
+    if ((first > newest) && (first >= 0x100000000ULL)) {
+        first -= 0x100000000ULL;
+    }
+
+    uint64_t frame;
+    if (!history_find_timestamp(first, &frame) || (history_frame_timestamp(frame) >= first + frame_count)) {
+        udp_resend_misses += frame_count;
+        return 0;
+    }
+    udp_resend_misses += (uint32_t)(history_frame_timestamp(frame) - first);
+
+    uint32_t slot = (resend_head + resend_count) % MAX_RESEND_REQUESTS;
+    resend_queue[slot].next_frame = frame;
+    resend_queue[slot].end_timestamp = first + frame_count;
+    resend_queue[slot].frames_left = frame_count - (uint32_t)(history_frame_timestamp(frame) - first);
+    resend_count++;
+    return 1;
+}
+
+// Returns 0 if no pbuf was available; send errors count like those of live frames
+static int resend_frame(uint64_t frame) {
+    uint32_t packet_bytes = history_packet_size() * BYTES_PER_WORD;
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, packet_bytes, PBUF_REF);
+    if (p == NULL) {
+        return 0;
+    }
+    p->payload = (void *)history_frame_words(frame, NULL);
+
+    ip_addr_t dest_ip;
+    dest_ip.addr = udp_dest_ip;
+    if (udp_sendto(udp, p, &dest_ip, udp_dest_port) == ERR_OK) {
+        udp_frames_resent++;
+    } else {
+        udp_send_errors++;
+    }
+    pbuf_free(p);
+    return 1;
+}
+
+void poll_frame_resend(void) {
+    uint32_t budget = RESEND_FRAMES_PER_POLL;
+
+    while ((resend_count > 0) && (budget > 0)) {
+        uint64_t stored = history_frames_stored();
+        uint32_t slots = history_capacity();
+        uint64_t *frame = &resend_queue[resend_head].next_frame;
+
+        // Sent in full, overwritten by newer frames, or the history or the timestamp
+        // was restarted
+        int done = (resend_queue[resend_head].frames_left == 0) || (*frame >= stored) ||
+                   (stored - *frame >= slots) || (*frame < history_timestamp_epoch());
+        if (!done) {
+            uint64_t timestamp = history_frame_timestamp(*frame);
+            done = timestamp >= resend_queue[resend_head].end_timestamp;
+        }
+        if (done) {
+            udp_resend_misses += resend_queue[resend_head].frames_left;
+            resend_head = (resend_head + 1) % MAX_RESEND_REQUESTS;
+            resend_count--;
+            continue;
+        }
+
+        if (!udp_tx_ready() || !resend_frame(*frame)) {
+            break;  // TX ring full or out of pbufs - try again on the next pass
+        }
+        (*frame)++;
+        resend_queue[resend_head].frames_left--;
+        budget--;
+    }
+}
+
 // ============================================================================
 // STATUS DATA COLLECTION
 // ============================================================================
@@ -154,6 +400,7 @@ void collect_status_data(status_response_t* status) {
     status->udp_send_errors = udp_send_errors;
     status->ps_read_addr = ps_read_address;
     status->packet_size = current_packet_size;
+    status->num_spi_ports = PL_NUM_SPI_PORTS;
     
     // PS Flags
     status->flags_ps = 0;
@@ -167,8 +414,14 @@ void collect_status_data(status_response_t* status) {
     pl_get_current_phase_select(&phase0, &phase1);
     status->phase0 = phase0;
     status->phase1 = phase1;
-    status->channel_enable = pl_get_current_channel_enable();
+    int fine_phase0, fine_phase1;
+    pl_get_current_fine_phase_select(&fine_phase0, &fine_phase1);
+    status->phase_half_steps = (fine_phase0 & 1) | ((fine_phase1 & 1) << 1);
+    uint32_t channel_enable = pl_get_current_channel_enable();
+    status->channel_enable = channel_enable & 0xF;
+    status->channel_enable_all = channel_enable;
     status->debug_mode = pl_get_current_debug_mode();
+    status->sample_rate = pl_get_current_sample_rate();
     
     // UDP Stream Information
     status->udp_dest_ip = udp_dest_ip;
@@ -176,9 +429,38 @@ void collect_status_data(status_response_t* status) {
     status->udp_packet_format = UDP_PACKET_FORMAT_V1;
     status->udp_bytes_sent = udp_packets_sent * current_packet_size * 4;
     
+    // TCP Frame Stream
+    status->tcp_stream_frames_sent = stream_frames_sent;
+    status->tcp_stream_frames_dropped = stream_frames_dropped;
+    status->tcp_stream_buffered_bytes = stream_buffered_bytes;
+    
+    // Frame Resend
+    status->udp_frames_resent = udp_frames_resent;
+    status->udp_resend_misses = udp_resend_misses;
+    
+    // Forward Error Correction
+    status->fec_group_size = fec_group_size();
+    status->fec_parity_sent = fec_parity_sent();
+    
+    // Transmit Pacing
+    pacer_get_status(status);
+    
+    // Transmit Flow Control
+    status->udp_tx_waits = udp_tx_waits;
+    status->udp_tx_forced_drops = udp_tx_forced_drops;
+    
+    // Main Loop Scheduler
+    scheduler_get_status(status);
+    
+    // Telemetry
+    telemetry_get_status(status);
+    
+    // Buffer Headroom, against the depth the PL was built with (STATUS_REG_12)
+    headroom_get_status(status);
+    status->bram_size_words = pl_get_bram_size_words();
+    
     // Get FIFO count
-    uint32_t status10 = Xil_In32(PL_CTRL_BASE_ADDR + STATUS_REG_10_OFFSET);
-    status->fifo_count = (status10 >> 14) & 0x1FF;
+    status->fifo_count = pl_get_fifo_count();
 }
 
 // ============================================================================
@@ -212,13 +494,371 @@ static void send_response(struct tcp_pcb *tpcb, uint32_t ack_id, uint8_t status,
     tcp_output(tpcb);
 }
 
+static void expect_completion(uint32_t cmd_id, uint32_t ack_id) {
+    if (num_pending_completions == MAX_PENDING_COMPLETIONS) {
+        // Drop the oldest - its client will time out rather than wait forever
+        memmove(&pending_completions[0], &pending_completions[1],
+                (MAX_PENDING_COMPLETIONS - 1) * sizeof(pending_completions[0]));
+        num_pending_completions--;
+    }
+    pending_completions[num_pending_completions].cmd_id = cmd_id;
+    pending_completions[num_pending_completions].ack_id = ack_id;
+    pending_completions[num_pending_completions].done = 0;
+    num_pending_completions++;
+}
+
+// Send the notifications of every command that has been carried out, unless a
+// bulk transfer owns the connection (it flushes them when it finishes)
+static void flush_completions(void) {
+    if (bulk.pcb) {
+        return;
+    }
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < num_pending_completions; i++) {
+        if (!pending_completions[i].done) {
+            pending_completions[kept++] = pending_completions[i];
+        } else if (command_pcb) {
+            send_response(command_pcb, pending_completions[i].ack_id, ACK_COMPLETE,
+                          &pending_completions[i].completion, sizeof(completion_response_t));
+        }
+    }
+    num_pending_completions = kept;
+}
+
+// Called by the main loop when a deferred command has been carried out. Every
+// pending command of that kind is completed (the flags coalesce repeats).
+void notify_command_complete(uint32_t cmd_id, uint8_t status, uint64_t timestamp, uint32_t detail) {
+    completion_response_t completion;
+    completion.cmd_id = cmd_id;
+    completion.status = status;
+    completion.stream_enabled = stream_enabled ? 1 : 0;
+    completion.reserved = 0;
+    completion.timestamp = timestamp;
+    completion.packets_received = packets_received_count;
+    completion.detail = detail;
+    completion_status = status;
+
+    for (uint32_t i = 0; i < num_pending_completions; i++) {
+        if ((pending_completions[i].cmd_id == cmd_id) && !pending_completions[i].done) {
+            pending_completions[i].completion = completion;
+            pending_completions[i].done = 1;
+        }
+    }
+    flush_completions();
+}
+
+// ============================================================================
+// BULK TRANSFERS (READ_BRAM, TRIGGER_CAPTURE)
+// ============================================================================
+
+static uint16_t consume_commands(struct tcp_pcb *tpcb, const uint8_t *data, uint16_t len);
+
+// Hand commands that arrived during a transfer to the command parser. A READ_BRAM
+// among them starts a new transfer and holds back the rest again.
+static void release_deferred_commands(struct tcp_pcb *tpcb) {
+    uint16_t consumed = consume_commands(tpcb, deferred_rx, deferred_rx_len);
+    if (consumed > 0) {
+        memmove(deferred_rx, &deferred_rx[consumed], deferred_rx_len - consumed);
+        deferred_rx_len -= consumed;
+        tcp_recved(tpcb, consumed);
+    }
+}
+
+// Queue as much of the transfer as the send buffer takes. Called when the transfer
+// starts and from the sent callback as the client acknowledges data. Once the
+// last word is queued the connection is released for other responses.
+static void bulk_pump(void) {
+    struct tcp_pcb *tpcb = bulk.pcb;
+    if (!tpcb) {
+        return;
+    }
+
+    while (bulk.words_left > 0) {
+        uint32_t words = tcp_sndbuf(tpcb) / BYTES_PER_WORD;
+        if (words > bulk.words_left) words = bulk.words_left;
+        if (words > BRAM_READ_CHUNK_WORDS) words = BRAM_READ_CHUNK_WORDS;
+
+        const uint32_t *src;
+        if (bulk.base) {
+            if (words > bulk.size_words - bulk.next_addr) words = bulk.size_words - bulk.next_addr;
+            src = &bulk.base[bulk.next_addr];
+        } else {
+            bram_copy_words(bram_read_chunk, bulk.next_addr, words);
+            src = bram_read_chunk;
+        }
+        if (words == 0) {
+            break;
+        }
+
+        u8_t flags = TCP_WRITE_FLAG_COPY;
+        if (words < bulk.words_left) {
+            flags |= TCP_WRITE_FLAG_MORE;
+        }
+        if (tcp_write(tpcb, src, words * BYTES_PER_WORD, flags) != ERR_OK) {
+            break;  // Out of segments - retried from the sent callback
+        }
+        bulk.next_addr = (bulk.next_addr + words) % bulk.size_words;
+        bulk.words_left -= words;
+        bulk.words_sent += words;
+    }
+    tcp_output(tpcb);
+
+    if (bulk.words_left == 0) {
+        send_message("Binary Command: %s sent %u words\r\n", bulk.name, bulk.words_sent);
+        bulk.pcb = NULL;
+        flush_completions();
+    }
+}
+
+static void start_bulk(struct tcp_pcb *tpcb, const char *name, const uint32_t *base,
+                       uint32_t size_words, uint32_t start_addr, uint32_t word_count) {
+    bulk.pcb = tpcb;
+    bulk.name = name;
+    bulk.base = base;
+    bulk.size_words = size_words;
+    bulk.next_addr = start_addr;
+    bulk.words_left = word_count;
+    bulk.words_sent = 0;
+    bulk_pump();
+}
+
+static void start_bram_read(struct tcp_pcb *tpcb, cmd_packet_t *cmd) {
+    uint32_t start_addr = cmd->param1;
+    uint32_t word_count = cmd->param2 & BRAM_READ_COUNT_MASK;
+    int snapshot = (cmd->param2 & BRAM_READ_SNAPSHOT) ? 1 : 0;
+
+    if ((start_addr >= BRAM_SIZE_WORDS) || (word_count == 0) || (word_count > BRAM_SIZE_WORDS)) {
+        send_response(tpcb, cmd->ack_id, ACK_ERROR, NULL, 0);
+        send_message("Binary Command: READ_BRAM FAILED (%u words at %u)\r\n", word_count, start_addr);
+        return;
+    }
+
+    bram_read_response_t header;
+    header.start_addr = start_addr;
+    header.word_count = word_count;
+    header.timestamp = pl_get_timestamp();
+    header.write_addr_before = pl_get_bram_write_address();
+    if (snapshot) {
+        bram_copy_words(bram_snapshot, start_addr, word_count);
+        header.write_addr_after = pl_get_bram_write_address();
+    } else {
+        header.write_addr_after = header.write_addr_before;    // Not known up front
+    }
+    send_response(tpcb, cmd->ack_id, ACK_SUCCESS, &header, sizeof(header));
+
+    send_message("Binary Command: READ_BRAM %u words at %u%s\r\n",
+                word_count, start_addr, snapshot ? " (snapshot)" : "");
+    if (snapshot) {
+        start_bulk(tpcb, "READ_BRAM", bram_snapshot, BRAM_SIZE_WORDS, 0, word_count);
+    } else {
+        start_bulk(tpcb, "READ_BRAM", NULL, BRAM_SIZE_WORDS, start_addr, word_count);
+    }
+}
+
+// Called by the main loop: sends the capture of an armed TRIGGER_CAPTURE as its
+// completion once the window is recorded and no other transfer is in progress
+void poll_history_capture(void) {
+    if (bulk.pcb || !history_capture_ready()) {
+        return;
+    }
+
+    capture_response_t capture;
+    uint64_t first_frame;
+    history_take_capture(&capture, &first_frame);
+    if (!capture_pending || !command_pcb) {
+        return;     // The connection that asked for it has gone
+    }
+    capture_pending = 0;
+    send_response(command_pcb, capture_ack_id, ACK_COMPLETE, &capture, sizeof(capture));
+
+    send_message("Binary Command: TRIGGER_CAPTURE %u frames (%u before the trigger)\r\n",
+                capture.completion.detail, capture.pre_frames);
+    if (capture.completion.detail > 0) {
+        uint32_t ring_words;
+        const uint32_t *ring = history_frame_words(0, &ring_words);
+        const uint32_t *first = history_frame_words(first_frame, NULL);
+        start_bulk(command_pcb, "TRIGGER_CAPTURE", ring, ring_words, (uint32_t)(first - ring),
+                   capture.completion.detail * capture.packet_words);
+    }
+}
+
+// Called by the main loop: sends the results of RUN_BENCHMARK as its completion
+// once the run is done and no transfer is in progress
+void poll_benchmark(void) {
+    if (bulk.pcb) {
+        return;
+    }
+    const benchmark_response_t *results = benchmark_take_results();
+    if (!results || !benchmark_pending || !command_pcb) {
+        return;     // A console run, or the connection that asked for it has gone
+    }
+    benchmark_pending = 0;
+    send_response(command_pcb, benchmark_ack_id, ACK_COMPLETE, results, sizeof(*results));
+    send_message("Binary Command: RUN_BENCHMARK done (%u bytes)\r\n", sizeof(*results));
+}
+
 // ============================================================================
 // TCP COMMAND PROCESSING
 // ============================================================================
 
-static void process_command(struct tcp_pcb *tpcb, cmd_packet_t *cmd) {
+static uint8_t process_command(struct tcp_pcb *tpcb, cmd_packet_t *cmd);
+
+// Same checks as process_command, without side effects. *streaming follows the
+// stream state the commands before this one will have left behind.
+static uint8_t validate_transaction_command(const cmd_packet_t *cmd, int *streaming) {
+    switch (cmd->cmd_id) {
+        case CMD_START:
+            if (*streaming || (pl_get_bram_size_words() != BRAM_SIZE_WORDS)) {
+                return ACK_ERROR;
+            }
+            *streaming = 1;
+            return ACK_SUCCESS;
+
+        case CMD_STOP:
+            if (!*streaming) {
+                return ACK_ERROR;
+            }
+            *streaming = 0;
+            return ACK_SUCCESS;
+
+        case CMD_RESET_TIMESTAMP:
+        case CMD_SET_LOOP_COUNT:
+        case CMD_SET_PHASE:
+        case CMD_SET_CHANNEL_ENABLE:
+        case CMD_SET_DEBUG_MODE:
+        case CMD_SET_UDP_STREAM:
+        case CMD_LOAD_CONVERT:
+        case CMD_LOAD_INIT:
+        case CMD_LOAD_CABLE_TEST:
+            return ACK_SUCCESS;
+
+        case CMD_SET_FINE_PHASE:
+            return ((cmd->param1 < NUM_FINE_PHASES) && (cmd->param2 < NUM_FINE_PHASES)) ?
+                   ACK_SUCCESS : ACK_ERROR;
+
+        case CMD_SET_PORT_FINE_PHASE:
+            return ((cmd->param1 < PL_NUM_SPI_PORTS) &&
+                    ((cmd->param2 & 0xFF) < NUM_FINE_PHASES) &&
+                    (((cmd->param2 >> 8) & 0xFF) < NUM_FINE_PHASES)) ? ACK_SUCCESS : ACK_ERROR;
+
+        case CMD_SET_SAMPLE_RATE:
+            return (is_valid_sample_rate(cmd->param1) && !*streaming) ? ACK_SUCCESS : ACK_ERROR;
+
+        case CMD_SET_FEC:
+            return ((cmd->param1 != 1) && (cmd->param1 <= FEC_MAX_GROUP_SIZE)) ? ACK_SUCCESS : ACK_ERROR;
+
+        case CMD_SET_PACING:
+            return pacer_is_valid(cmd->param1, cmd->param2) ? ACK_SUCCESS : ACK_ERROR;
+
+        case CMD_SET_TELEMETRY:
+            return telemetry_is_valid(htonl(cmd->param1), cmd->param2 & 0xFFFF, cmd->param2 >> 16) ?
+                   ACK_SUCCESS : ACK_ERROR;
+
+        case CMD_SET_UDP_DEST:
+            return is_valid_udp_dest(htonl(cmd->param1), cmd->param2 & 0xFFFF) ?
+                   ACK_SUCCESS : ACK_ERROR;
+
+        default:
+            return ACK_ERROR;   // Commands with data responses, long-running or unknown commands
+    }
+}
+
+// Validation and application happen at the same point of the main loop, after the
+// commands received before the transaction, so a transaction that passes
+// validation is applied in full
+static void run_transaction(struct tcp_pcb *tpcb) {
+    uint8_t results[MAX_TRANSACTION_COMMANDS];
+    uint8_t status = ACK_SUCCESS;
+
+    // Commands received before the transaction come first
+    process_command_flags();
+    int streaming = stream_enabled;
+
+    for (uint32_t i = 0; i < transaction_count; i++) {
+        results[i] = validate_transaction_command(&transaction_cmds[i], &streaming);
+        if (results[i] != ACK_SUCCESS) {
+            status = ACK_ERROR;
+        }
+    }
+
+    if (status == ACK_SUCCESS) {
+        for (uint32_t i = 0; i < transaction_count; i++) {
+            // START/STOP/RESET_TIMESTAMP are carried out here, in order, and report
+            // their completion status through notify_command_complete
+            completion_status = process_command(NULL, &transaction_cmds[i]);
+            process_command_flags();
+            results[i] = completion_status;
+            if (results[i] != ACK_SUCCESS) {
+                status = ACK_ERROR;
+            }
+        }
+        send_message("Binary Command: TRANSACTION applied %u commands\r\n", transaction_count);
+    } else {
+        for (uint32_t i = 0; i < transaction_count; i++) {
+            if (results[i] == ACK_SUCCESS) {
+                results[i] = 0;         // Valid but not applied
+            }
+        }
+        send_message("Binary Command: TRANSACTION REJECTED\r\n");
+    }
+
+    send_response(tpcb, transaction_ack_id, status, results, transaction_count);
+    transaction_count = 0;
+    transaction_received = 0;
+}
+
+// Runs a complete transaction from the main loop rather than the receive callback
+// (STOP drains BRAM and START waits for the first frame), then hands the commands
+// that arrived behind it to the parser
+void poll_transaction(void) {
+    if (!transaction_ready || !command_pcb) {
+        return;
+    }
+    run_transaction(command_pcb);
+    transaction_ready = 0;
+    if (!bulk.pcb && (deferred_rx_len > 0)) {
+        release_deferred_commands(command_pcb);
+    }
+}
+
+// Commands are held back while a bulk transfer owns the connection or a complete
+// transaction waits for the main loop
+static int commands_held(void) {
+    return (bulk.pcb != NULL) || transaction_ready;
+}
+
+// Entry point for every complete command: sub-commands of an open transaction are
+// collected, everything else is processed directly
+static void handle_command(struct tcp_pcb *tpcb, cmd_packet_t *cmd) {
+    if (transaction_count > 0) {
+        transaction_cmds[transaction_received++] = *cmd;
+        if (transaction_received == transaction_count) {
+            transaction_ready = 1;
+        }
+        return;
+    }
+    process_command(tpcb, cmd);
+}
+
+// tpcb is NULL for commands applied as part of a transaction (no individual ACK).
+// Returns the status the command was (or would have been) ACKed with.
+static uint8_t process_command(struct tcp_pcb *tpcb, cmd_packet_t *cmd) {
     uint8_t status = ACK_SUCCESS;
     
+    switch (cmd->cmd_id) {
+        case CMD_START:
+        case CMD_STOP:
+        case CMD_RESET_TIMESTAMP:
+        case CMD_DUMP_BRAM:
+        case CMD_FULL_CABLE_TEST:
+            if (tpcb) {
+                expect_completion(cmd->cmd_id, cmd->ack_id);
+            }
+            break;
+        default:
+            break;
+    }
+
     switch (cmd->cmd_id) {
         case CMD_START:
             command_flags->enable_streaming_flag = 1;
@@ -246,9 +886,44 @@ static void process_command(struct tcp_pcb *tpcb, cmd_packet_t *cmd) {
                         cmd->param1 & 0xFF, cmd->param2 & 0xFF);
             break;
 
+        case CMD_SET_FINE_PHASE:
+            if ((cmd->param1 < NUM_FINE_PHASES) && (cmd->param2 < NUM_FINE_PHASES)) {
+                pl_set_fine_phase_select(cmd->param1, cmd->param2);
+                send_message("Binary Command: SET_FINE_PHASE %u %u\r\n",
+                            cmd->param1, cmd->param2);
+            } else {
+                status = ACK_ERROR;
+                send_message("Binary Command: SET_FINE_PHASE FAILED\r\n");
+            }
+            break;
+
+        case CMD_SET_PORT_FINE_PHASE: {
+            uint32_t fine_phase0 = cmd->param2 & 0xFF;
+            uint32_t fine_phase1 = (cmd->param2 >> 8) & 0xFF;
+            if ((cmd->param1 < PL_NUM_SPI_PORTS) &&
+                (fine_phase0 < NUM_FINE_PHASES) && (fine_phase1 < NUM_FINE_PHASES)) {
+                pl_set_port_fine_phase_select(cmd->param1, fine_phase0, fine_phase1);
+                send_message("Binary Command: SET_PORT_FINE_PHASE %u %u %u\r\n",
+                            cmd->param1, fine_phase0, fine_phase1);
+            } else {
+                status = ACK_ERROR;
+                send_message("Binary Command: SET_PORT_FINE_PHASE FAILED\r\n");
+            }
+            break;
+        }
+
         case CMD_SET_CHANNEL_ENABLE:
-            pl_set_channel_enable(cmd->param1 & 0xF);
-            send_message("Binary Command: SET_CHANNEL_ENABLE 0x%X\r\n", cmd->param1 & 0xF);
+            pl_set_channel_enable(cmd->param1 & CHANNEL_ENABLE_ALL);
+            send_message("Binary Command: SET_CHANNEL_ENABLE 0x%X\r\n", cmd->param1 & CHANNEL_ENABLE_ALL);
+            break;
+
+        case CMD_SET_SAMPLE_RATE:
+            if (pl_set_sample_rate(cmd->param1)) {
+                send_message("Binary Command: SET_SAMPLE_RATE %u\r\n", cmd->param1);
+            } else {
+                status = ACK_ERROR;
+                send_message("Binary Command: SET_SAMPLE_RATE FAILED\r\n");
+            }
             break;
 
         case CMD_SET_DEBUG_MODE:
@@ -276,6 +951,32 @@ static void process_command(struct tcp_pcb *tpcb, cmd_packet_t *cmd) {
             send_message("Binary Command: FULL_CABLE_TEST\r\n");
             break;
 
+        case CMD_SET_UDP_STREAM:
+            udp_stream_enabled = cmd->param1 ? 1 : 0;
+            send_message("Binary Command: SET_UDP_STREAM %u\r\n", udp_stream_enabled);
+            break;
+
+        case CMD_SET_FEC:
+            if (!fec_configure(cmd->param1)) {
+                status = ACK_ERROR;
+                send_message("Binary Command: SET_FEC FAILED (%u)\r\n", cmd->param1);
+            }
+            break;
+
+        case CMD_SET_PACING:
+            if (!pacer_configure(cmd->param1, cmd->param2)) {
+                status = ACK_ERROR;
+                send_message("Binary Command: SET_PACING FAILED (%u, %u)\r\n", cmd->param1, cmd->param2);
+            }
+            break;
+
+        case CMD_SET_TELEMETRY:
+            if (!telemetry_configure(htonl(cmd->param1), cmd->param2 & 0xFFFF, cmd->param2 >> 16)) {
+                status = ACK_ERROR;
+                send_message("Binary Command: SET_TELEMETRY FAILED (%u Hz)\r\n", cmd->param2 >> 16);
+            }
+            break;
+
         case CMD_SET_UDP_DEST: {
             uint32_t new_ip = cmd->param1;
             uint16_t new_port = cmd->param2 & 0xFFFF;
@@ -303,9 +1004,56 @@ static void process_command(struct tcp_pcb *tpcb, cmd_packet_t *cmd) {
                          &status_data, sizeof(status_data));
             send_message("Binary Command: GET_STATUS (sent %d bytes)\r\n",
                         sizeof(status_data));
-            return;  // Early return - don't call send_ack
+            return ACK_SUCCESS;  // Early return - don't call send_ack
         }
             
+        case CMD_TRANSACTION:
+            if ((cmd->param1 > 0) && (cmd->param1 <= MAX_TRANSACTION_COMMANDS)) {
+                transaction_count = cmd->param1;
+                transaction_received = 0;
+                transaction_ack_id = cmd->ack_id;
+                return ACK_SUCCESS;  // Answered once all sub-commands have arrived
+            }
+            send_response(tpcb, cmd->ack_id, ACK_ERROR, NULL, 0);
+            send_message("Binary Command: TRANSACTION FAILED (%u commands)\r\n", cmd->param1);
+            return ACK_ERROR;
+
+        case CMD_READ_BRAM:
+            start_bram_read(tpcb, cmd);
+            return ACK_SUCCESS;  // Answered with the data
+
+        case CMD_TRIGGER_CAPTURE:
+            if (tpcb && history_trigger(cmd->param1, cmd->param2)) {
+                capture_pending = 1;
+                capture_ack_id = cmd->ack_id;
+                send_message("Binary Command: TRIGGER_CAPTURE -%u +%u frames\r\n",
+                            cmd->param1, cmd->param2);
+            } else {
+                status = ACK_ERROR;
+                send_message("Binary Command: TRIGGER_CAPTURE FAILED\r\n");
+            }
+            break;
+
+        case CMD_RUN_BENCHMARK:
+            if (tpcb && !stream_enabled && !benchmark_pending) {
+                benchmark_pending = 1;
+                benchmark_ack_id = cmd->ack_id;
+                command_flags->bram_benchmark_flag = 1;
+                send_message("Binary Command: RUN_BENCHMARK\r\n");
+            } else {
+                status = ACK_ERROR;
+                send_message("Binary Command: RUN_BENCHMARK FAILED\r\n");
+            }
+            break;
+
+        case CMD_RESEND_FRAMES:
+            if (!queue_frame_resend(cmd->param1, cmd->param2)) {
+                status = ACK_ERROR;
+                send_message("Binary Command: RESEND_FRAMES FAILED (%u frames from %u)\r\n",
+                            cmd->param2, cmd->param1);
+            }
+            break;
+
         case CMD_DUMP_BRAM:
             command_flags->dump_bram_flag = 1;
             command_flags->start_bram_addr = cmd->param1;
@@ -320,78 +1068,138 @@ static void process_command(struct tcp_pcb *tpcb, cmd_packet_t *cmd) {
             break;
     }
     
-    send_ack(tpcb, cmd->ack_id, status);
+    if (tpcb) {
+        send_ack(tpcb, cmd->ack_id, status);
+    }
+    return status;
 }
 
 // ============================================================================
 // TCP CALLBACKS
 // ============================================================================
 
+// Parse and handle complete commands, keeping a partial one in recv_buffer. Stops
+// early when a command starts a READ_BRAM transfer or completes a transaction;
+// returns the bytes consumed.
+static uint16_t consume_commands(struct tcp_pcb *tpcb, const uint8_t *data, uint16_t len) {
+    uint16_t pos = 0;
+
+    while ((pos < len) && !commands_held()) {
+        // Continue an incomplete command, or start one that is cut off
+        if ((recv_buffer_pos > 0) || (len - pos < CMD_PACKET_SIZE)) {
+            uint16_t bytes_needed = CMD_PACKET_SIZE - recv_buffer_pos;
+            uint16_t bytes_available = (len - pos) < bytes_needed ? (len - pos) : bytes_needed;
+
+            memcpy(&recv_buffer[recv_buffer_pos], &data[pos], bytes_available);
+            recv_buffer_pos += bytes_available;
+            pos += bytes_available;
+
+            if (recv_buffer_pos == CMD_PACKET_SIZE) {
+                cmd_packet_t *cmd = (cmd_packet_t *)recv_buffer;
+                recv_buffer_pos = 0;
+                if (cmd->magic == CMD_MAGIC) {
+                    handle_command(tpcb, cmd);
+                }
+            }
+            continue;
+        }
+
+        // Process complete commands directly from the TCP buffer
+        cmd_packet_t *cmd = (cmd_packet_t *)&data[pos];
+        if (cmd->magic == CMD_MAGIC) {
+            pos += CMD_PACKET_SIZE;
+            handle_command(tpcb, cmd);
+        } else {
+            // Skip bad data and look for next magic
+            pos++;
+        }
+    }
+    return pos;
+}
+
+static void reset_connection_state(void) {
+    recv_buffer_pos = 0;
+    transaction_count = 0;
+    transaction_ready = 0;
+    num_pending_completions = 0;
+    capture_pending = 0;
+    benchmark_pending = 0;
+    bulk.pcb = NULL;
+    deferred_rx_len = 0;
+}
+
 err_t tcp_recv_cb(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err) {
     (void)arg;
     (void)err;
     
     if (!p) {
         tcp_close(tpcb);
-        recv_buffer_pos = 0;
+        if (command_pcb == tpcb) {
+            command_pcb = NULL;
+            reset_connection_state();
+        }
         return ERR_OK;
     }
     
-    uint8_t *data = (uint8_t *)p->payload;
-    uint16_t data_len = p->len;
-    uint16_t data_pos = 0;
-    
-    // First, handle any incomplete command from previous packet
-    if (recv_buffer_pos > 0) {
-        uint16_t bytes_needed = CMD_PACKET_SIZE - recv_buffer_pos;
-        uint16_t bytes_available = data_len < bytes_needed ? data_len : bytes_needed;
-        
-        memcpy(&recv_buffer[recv_buffer_pos], data, bytes_available);
-        recv_buffer_pos += bytes_available;
-        data_pos += bytes_available;
-        
-        // Check if we now have a complete command
-        if (recv_buffer_pos == CMD_PACKET_SIZE) {
-            cmd_packet_t *cmd = (cmd_packet_t *)recv_buffer;
-            if (cmd->magic == CMD_MAGIC) {
-                process_command(tpcb, cmd);
-            }
-            recv_buffer_pos = 0;  // Reset for next incomplete command
+    for (struct pbuf *q = p; q != NULL; q = q->next) {
+        uint8_t *data = (uint8_t *)q->payload;
+        uint16_t data_len = q->len;
+        uint16_t consumed = 0;
+
+        // Commands queued behind a READ_BRAM transfer or a transaction keep their order
+        if (!commands_held() && (deferred_rx_len == 0)) {
+            consumed = consume_commands(tpcb, data, data_len);
+            tcp_recved(tpcb, consumed);
         }
-    }
-    
-    // Process complete commands directly from TCP buffer
-    while (data_pos + CMD_PACKET_SIZE <= data_len) {
-        cmd_packet_t *cmd = (cmd_packet_t *)&data[data_pos];
-        if (cmd->magic == CMD_MAGIC) {
-            process_command(tpcb, cmd);
-            data_pos += CMD_PACKET_SIZE;
-        } else {
-            // Skip bad data and look for next magic
-            data_pos++;
+        if (consumed < data_len) {
+            memcpy(&deferred_rx[deferred_rx_len], &data[consumed], data_len - consumed);
+            deferred_rx_len += data_len - consumed;
         }
     }
-    
-    // Copy any remaining partial command to recv_buffer
-    uint16_t remaining_bytes = data_len - data_pos;
-    if (remaining_bytes > 0) {
-        memcpy(recv_buffer, &data[data_pos], remaining_bytes);
-        recv_buffer_pos = remaining_bytes;
+    if (!commands_held() && (deferred_rx_len > 0)) {
+        release_deferred_commands(tpcb);
     }
     
-    tcp_recved(tpcb, p->len);
     pbuf_free(p);
     return ERR_OK;
 }
 
+// Acknowledged data frees send buffer space for a READ_BRAM transfer
+static err_t tcp_sent_cb(void *arg, struct tcp_pcb *tpcb, u16_t len) {
+    (void)arg;
+    (void)len;
+
+    if (bulk.pcb == tpcb) {
+        bulk_pump();
+    }
+    if (!commands_held() && (deferred_rx_len > 0)) {
+        release_deferred_commands(tpcb);
+    }
+    return ERR_OK;
+}
+
+// The pcb (passed as arg) has already been freed by lwIP
+static void tcp_err_cb(void *arg, err_t err) {
+    (void)err;
+
+    if (command_pcb == arg) {
+        command_pcb = NULL;
+        reset_connection_state();
+    }
+}
+
 err_t tcp_accept_cb(void *arg, struct tcp_pcb *newpcb, err_t err) {
     (void)arg;
     (void)err;
     
     // Reset receive buffer for new connection
-    recv_buffer_pos = 0;
+    reset_connection_state();
+    command_pcb = newpcb;
     
+    tcp_arg(newpcb, newpcb);
     tcp_recv(newpcb, tcp_recv_cb);
+    tcp_sent(newpcb, tcp_sent_cb);
+    tcp_err(newpcb, tcp_err_cb);
     send_message("Binary TCP connection established\r\n");
     return ERR_OK;
 }
@@ -409,3 +1217,160 @@ void start_tcp_server() {
     send_message("Binary TCP command server started on port %d\r\n", TCP_PORT);
     send_message("Commands use 20-byte binary format with magic 0xDEADBEEF\r\n");
 }
+
+// ============================================================================
+// TCP FRAME STREAM
+// ============================================================================
+
+// Write the frames recorded since the last call, as far as the send buffer allows.
+// Called by the main loop and from the sent callback as the client acknowledges.
+// Returns 0 if it aborted the connection, which the sent callback must report to
+// lwIP as ERR_ABRT.
+static int stream_write(void) {
+    struct tcp_pcb *tpcb = stream_pcb;
+    if (!tpcb) {
+        return 1;
+    }
+
+    uint64_t stored = history_frames_stored();
+    uint32_t slots = history_capacity();
+    uint32_t packet_words = history_packet_size();
+    uint32_t frame_bytes = packet_words * BYTES_PER_WORD;
+
+    // Unacknowledged frames about to be overwritten cannot be retransmitted
+    uint64_t oldest_unacked = stream_next_frame - stream_buffered_bytes / frame_bytes;
+    if (stored - oldest_unacked > (uint64_t)slots * 3 / 4) {
+        send_message("TCP stream: client stalled, closing connection\r\n");
+        stream_pcb = NULL;
+        tcp_abort(tpcb);
+        return 0;
+    }
+
+    // Fallen too far behind: skip to the newest frame
+    if (stored - stream_next_frame > slots / 2) {
+        stream_frames_dropped += (uint32_t)(stored - stream_next_frame);
+        stream_next_frame = stored;
+    }
+
+    int written = 0;
+    while (stream_next_frame < stored) {
+        uint32_t contiguous_words;
+        const uint32_t *src = history_frame_words(stream_next_frame, &contiguous_words);
+
+        uint64_t frames = stored - stream_next_frame;
+        uint32_t max_bytes = tcp_sndbuf(tpcb);
+        if (max_bytes > STREAM_MAX_WRITE_BYTES) max_bytes = STREAM_MAX_WRITE_BYTES;
+        if (frames > contiguous_words / packet_words) frames = contiguous_words / packet_words;
+        if (frames > max_bytes / frame_bytes) frames = max_bytes / frame_bytes;
+        if (frames == 0) {
+            break;
+        }
+
+        uint32_t bytes = (uint32_t)frames * frame_bytes;
+        if (tcp_write(tpcb, src, bytes, TCP_WRITE_FLAG_MORE) != ERR_OK) {
+            break;  // Out of segments - retried from the sent callback
+        }
+        stream_next_frame += frames;
+        stream_frames_sent += (uint32_t)frames;
+        stream_buffered_bytes += bytes;
+        written = 1;
+    }
+    if (written) {
+        tcp_output(tpcb);
+    }
+    return 1;
+}
+
+void poll_tcp_stream(void) {
+    stream_write();
+}
+
+// Called by START before the history ring is restarted. Segments still waiting for
+// their acknowledgement point into the ring and would be retransmitted with the new
+// stream's frames, so a client with data in flight is disconnected; an idle one
+// carries on from the first frame of the new stream.
+void tcp_stream_history_restart(void) {
+    struct tcp_pcb *tpcb = stream_pcb;
+    if (!tpcb) {
+        return;
+    }
+    if (stream_buffered_bytes > 0) {
+        send_message("TCP stream: %u bytes unacknowledged at START, closing connection\r\n",
+                     stream_buffered_bytes);
+        stream_pcb = NULL;
+        tcp_abort(tpcb);
+        return;
+    }
+    stream_next_frame = 0;
+}
+
+static err_t stream_recv_cb(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err) {
+    (void)arg;
+    (void)err;
+
+    if (!p) {
+        if (stream_pcb == tpcb) {
+            stream_pcb = NULL;
+            send_message("TCP stream: client disconnected\r\n");
+        }
+        tcp_close(tpcb);
+        return ERR_OK;
+    }
+    tcp_recved(tpcb, p->tot_len);
+    pbuf_free(p);
+    return ERR_OK;
+}
+
+static err_t stream_sent_cb(void *arg, struct tcp_pcb *tpcb, u16_t len) {
+    (void)arg;
+
+    if (stream_pcb != tpcb) {
+        return ERR_OK;
+    }
+    stream_buffered_bytes -= (len < stream_buffered_bytes) ? len : stream_buffered_bytes;
+    return stream_write() ? ERR_OK : ERR_ABRT;
+}
+
+static void stream_err_cb(void *arg, err_t err) {
+    (void)err;
+
+    if (stream_pcb == arg) {
+        stream_pcb = NULL;
+    }
+}
+
+static err_t stream_accept_cb(void *arg, struct tcp_pcb *newpcb, err_t err) {
+    (void)arg;
+    (void)err;
+
+    if (stream_pcb) {
+        struct tcp_pcb *old = stream_pcb;
+        stream_pcb = NULL;
+        tcp_abort(old);
+    }
+    stream_pcb = newpcb;
+    stream_next_frame = history_frames_stored();
+    stream_frames_sent = 0;
+    stream_frames_dropped = 0;
+    stream_buffered_bytes = 0;
+
+    tcp_arg(newpcb, newpcb);
+    tcp_recv(newpcb, stream_recv_cb);
+    tcp_sent(newpcb, stream_sent_cb);
+    tcp_err(newpcb, stream_err_cb);
+    send_message("TCP stream: client connected\r\n");
+    return ERR_OK;
+}
+
+void start_stream_server(void) {
+    struct tcp_pcb *pcb = tcp_new();
+    if (!pcb) {
+        send_message("ERROR: Could not create TCP stream PCB\r\n");
+        return;
+    }
+
+    tcp_bind(pcb, IP_ADDR_ANY, STREAM_TCP_PORT);
+    pcb = tcp_listen(pcb);
+    tcp_accept(pcb, stream_accept_cb);
+    send_message("TCP frame stream server started on port %d\r\n", STREAM_TCP_PORT);
+}
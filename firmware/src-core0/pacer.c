@@ -0,0 +1,107 @@
+#include "main.h"
+#include "shared_print.h"
+
+// ============================================================================
+// TRANSMIT PACING
+// ============================================================================
+
+// A token bucket measured in global timer counts: the bucket fills with elapsed
+// time, each frame costs one frame interval at the paced rate, and the bucket holds
+// at most burst_frames of them. In steady state the PL writes one frame per sample
+// period, below the paced rate, so the pacer only holds frames back while a backlog
+// drains.
+
+static uint32_t rate_percent = PACING_RATE_PERCENT;     // 0 = off
+static uint32_t burst_frames = PACING_BURST_FRAMES;
+static uint64_t frame_cost = 0;         // Timer counts per frame at the paced rate
+static uint64_t credit = 0;             // Timer counts available, at most burst * cost
+static XTime last_refill = 0;
+static int holding = 0;                 // A frame is being held back
+
+static uint32_t pacing_delays = 0;
+static uint32_t pacing_overrides = 0;
+static uint32_t max_burst_frames = 0;
+
+int pacer_is_valid(uint32_t rate, uint32_t burst) {
+    return ((rate == 0) || ((rate >= PACING_MIN_RATE_PERCENT) && (rate <= 0xFFFF))) &&
+           (burst <= PACING_MAX_BURST_FRAMES);
+}
+
+// A burst of 0 selects the default
+int pacer_configure(uint32_t rate, uint32_t burst) {
+    if (!pacer_is_valid(rate, burst)) {
+        return 0;
+    }
+    if (burst == 0) {
+        burst = PACING_BURST_FRAMES;
+    }
+    rate_percent = rate;
+    burst_frames = burst;
+    if (stream_enabled) {
+        pacer_start(current_sample_rate);
+    }
+    if (rate) {
+        send_message("Pacing: %u%% of the sample rate, bursts of %u frames\r\n", rate, burst);
+    } else {
+        send_message("Pacing: off\r\n");
+    }
+    return 1;
+}
+
+// The bucket starts full, so the first frames of a stream are not held back
+void pacer_start(uint32_t sample_rate) {
+    if (rate_percent) {
+        frame_cost = (uint64_t)COUNTS_PER_SECOND * 100 / ((uint64_t)sample_rate * rate_percent);
+    }
+    credit = frame_cost * burst_frames;
+    XTime_GetTime(&last_refill);
+    holding = 0;
+    pacing_delays = 0;
+    pacing_overrides = 0;
+    max_burst_frames = 0;
+}
+
+// Whether the next frame may go out now, given the words waiting in BRAM
+int pacer_release(uint32_t backlog_words) {
+    if (rate_percent == 0) {
+        return 1;
+    }
+
+    XTime now;
+    XTime_GetTime(&now);
+    credit += now - last_refill;
+    last_refill = now;
+    if (credit > frame_cost * burst_frames) {
+        credit = frame_cost * burst_frames;
+    }
+
+    if (credit >= frame_cost) {
+        credit -= frame_cost;
+        holding = 0;
+        return 1;
+    }
+    if (backlog_words >= PACING_OVERRIDE_WORDS) {
+        pacing_overrides++;
+        holding = 0;
+        return 1;
+    }
+    if (!holding) {
+        pacing_delays++;
+        holding = 1;
+    }
+    return 0;
+}
+
+void pacer_burst_done(uint32_t frames) {
+    if (frames > max_burst_frames) {
+        max_burst_frames = frames;
+    }
+}
+
+void pacer_get_status(status_response_t *status) {
+    status->pacing_rate_percent = (uint16_t)rate_percent;
+    status->pacing_burst_frames = (uint16_t)burst_frames;
+    status->pacing_delays = pacing_delays;
+    status->pacing_overrides = pacing_overrides;
+    status->max_burst_frames = max_burst_frames;
+}
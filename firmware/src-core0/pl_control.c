@@ -45,6 +45,7 @@ void pl_set_phase_select(int phase0, int phase1) {
     uint32_t ctrl_reg_2 = Xil_In32(PL_CTRL_BASE_ADDR + CTRL_REG_2_OFFSET);
     
     ctrl_reg_2 &= ~(CTRL_PHASE0_MASK | CTRL_PHASE1_MASK); // Clear existing phase bits
+    ctrl_reg_2 &= ~(CTRL_PHASE0_HALF_STEP | CTRL_PHASE1_HALF_STEP);
     
     ctrl_reg_2 |= ((phase0 & 0xF) << 0); // Set phase0 bits [3:0]
     ctrl_reg_2 |= ((phase1 & 0xF) << 4); // Set phase1 bits [7:4]
@@ -52,6 +53,33 @@ void pl_set_phase_select(int phase0, int phase1) {
     send_message("PL phase select set to phase0=%d, phase1=%d\r\n", phase0, phase1);
 }
 
+// Fine phases are in 1/8 SCLK bit periods (0-23)
+void pl_set_fine_phase_select(int fine_phase0, int fine_phase1) {
+    pl_set_port_fine_phase_select(0, fine_phase0, fine_phase1);
+}
+
+// Each port has its own phase select register with the CTRL_REG_2 layout
+void pl_set_port_fine_phase_select(int port, int fine_phase0, int fine_phase1) {
+    if (port < 0 || port >= PL_NUM_SPI_PORTS) {
+        send_message("ERROR: Invalid SPI port %d\r\n", port);
+        return;
+    }
+
+    uint32_t reg_offset = CTRL_REG_PORT_OFFSET(port);
+    uint32_t ctrl_reg = Xil_In32(PL_CTRL_BASE_ADDR + reg_offset);
+    
+    ctrl_reg &= ~(CTRL_PHASE0_MASK | CTRL_PHASE1_MASK); // Clear existing phase bits
+    ctrl_reg &= ~(CTRL_PHASE0_HALF_STEP | CTRL_PHASE1_HALF_STEP);
+    
+    ctrl_reg |= (((fine_phase0 >> 1) & 0xF) << 0); // Set phase0 bits [3:0]
+    ctrl_reg |= (((fine_phase1 >> 1) & 0xF) << 4); // Set phase1 bits [7:4]
+    if (fine_phase0 & 1) ctrl_reg |= CTRL_PHASE0_HALF_STEP;
+    if (fine_phase1 & 1) ctrl_reg |= CTRL_PHASE1_HALF_STEP;
+    Xil_Out32(PL_CTRL_BASE_ADDR + reg_offset, ctrl_reg);
+    send_message("PL port %d fine phase select set to phase0=%d, phase1=%d\r\n",
+                 port, fine_phase0, fine_phase1);
+}
+
 void pl_set_debug_mode(int enable) {
     uint32_t ctrl_reg_0 = Xil_In32(PL_CTRL_BASE_ADDR + CTRL_REG_0_OFFSET);
     
@@ -66,14 +94,48 @@ void pl_set_debug_mode(int enable) {
     Xil_Out32(PL_CTRL_BASE_ADDR + CTRL_REG_0_OFFSET, ctrl_reg_0);
 }
 
-void pl_set_channel_enable(int channel_enable) {
-    uint32_t ctrl_reg_2 = Xil_In32(PL_CTRL_BASE_ADDR + CTRL_REG_2_OFFSET);
-    
-    ctrl_reg_2 &= ~CTRL_CHANNEL_ENABLE_MASK; // Clear existing channel enable bits
-    ctrl_reg_2 |= ((channel_enable & 0xF) << 8); // Set channel enable bits [11:8]
-    
-    Xil_Out32(PL_CTRL_BASE_ADDR + CTRL_REG_2_OFFSET, ctrl_reg_2);
-    send_message("PL channel enable set to 0x%X\r\n", channel_enable & 0xF);
+// channel_enable holds 4 bits per port, port 0 in the low nibble
+void pl_set_channel_enable(uint32_t channel_enable) {
+    channel_enable &= CHANNEL_ENABLE_ALL;
+
+    for (int port = 0; port < PL_NUM_SPI_PORTS; port++) {
+        uint32_t reg_offset = CTRL_REG_PORT_OFFSET(port);
+        uint32_t ctrl_reg = Xil_In32(PL_CTRL_BASE_ADDR + reg_offset);
+        
+        ctrl_reg &= ~CTRL_CHANNEL_ENABLE_MASK; // Clear existing channel enable bits
+        ctrl_reg |= (((channel_enable >> (CHANNELS_PER_PORT * port)) & 0xF) << 8); // Set channel enable bits [11:8]
+        
+        Xil_Out32(PL_CTRL_BASE_ADDR + reg_offset, ctrl_reg);
+    }
+    send_message("PL channel enable set to 0x%X\r\n", channel_enable);
+}
+
+// Supported rates divide the PL clock into a whole number of clocks per frame,
+// no shorter than the 2800-clock SPI sequence itself
+int is_valid_sample_rate(uint32_t sample_rate_hz) {
+    if (sample_rate_hz < MIN_SAMPLE_RATE_HZ) return 0;
+    if (sample_rate_hz > MAX_SAMPLE_RATE_HZ) return 0;
+    if ((PL_CLOCK_HZ % sample_rate_hz) != 0) return 0;
+    return 1;
+}
+
+int pl_set_sample_rate(uint32_t sample_rate_hz) {
+    if (!is_valid_sample_rate(sample_rate_hz)) {
+        send_message("ERROR: Unsupported sample rate %u Hz\r\n", sample_rate_hz);
+        return 0;
+    }
+
+    // The PL only latches the idle period while transmission is stopped
+    if (pl_is_transmission_active()) {
+        send_message("ERROR: Cannot change sample rate while transmission is active\r\n");
+        return 0;
+    }
+
+    uint32_t idle_cycles = (PL_CLOCK_HZ / sample_rate_hz) - PL_CLOCKS_PER_FRAME;
+    Xil_Out32(PL_CTRL_BASE_ADDR + CTRL_REG_3_OFFSET, idle_cycles);
+    send_message("PL sample rate set to %u Hz (%u idle cycles per frame)\r\n",
+                 sample_rate_hz, idle_cycles);
+    return 1;
 }
 
 // ============================================================================
@@ -112,12 +174,36 @@ uint32_t pl_get_cycle_counter(void) {
 
 uint32_t pl_get_bram_write_address(void) {
     uint32_t status10 = Xil_In32(PL_CTRL_BASE_ADDR + STATUS_REG_10_OFFSET);
-    return status10 & 0x3FFF;  // Extract 14-bit BRAM address (0 to 16383)
+    return status10 & STATUS_BRAM_ADDR_MASK;  // Extract 18-bit BRAM address (0 to BRAM_SIZE_WORDS - 1)
+}
+
+uint32_t pl_get_fifo_count(void) {
+    uint32_t status10 = Xil_In32(PL_CTRL_BASE_ADDR + STATUS_REG_10_OFFSET);
+    return (status10 & STATUS_FIFO_COUNT_MASK) >> STATUS_FIFO_COUNT_SHIFT;  // Extract 9-bit FIFO count
+}
+
+// The PL measures the unread BRAM words against this pointer
+void pl_set_ps_read_address(uint32_t address) {
+    Xil_Out32(PL_CTRL_BASE_ADDR + CTRL_REG_PS_READ_OFFSET, address);
+}
+
+// High-water marks since the previous call - reading STATUS_REG_11 clears them, so
+// headroom.c is their only reader
+void pl_take_high_water(uint32_t *fifo_count_max, uint32_t *bram_unread_max) {
+    uint32_t status11 = Xil_In32(PL_CTRL_BASE_ADDR + STATUS_REG_11_OFFSET);
+    *fifo_count_max = (status11 & STATUS_FIFO_COUNT_MASK) >> STATUS_FIFO_COUNT_SHIFT;
+    *bram_unread_max = status11 & STATUS_BRAM_ADDR_MASK;
 }
 
-static uint32_t pl_get_fifo_count(void) {
+// Number of SPI ports the PL was built with (N_SPI_PORTS)
+uint32_t pl_get_num_spi_ports(void) {
     uint32_t status10 = Xil_In32(PL_CTRL_BASE_ADDR + STATUS_REG_10_OFFSET);
-    return (status10 >> 14) & 0x1FF;  // Extract 9-bit FIFO count
+    return (status10 & STATUS_NUM_SPI_PORTS_MASK) >> STATUS_NUM_SPI_PORTS_SHIFT;
+}
+
+// BRAM ring depth the PL was built with (BRAM_DEPTH_WORDS), in 32-bit words
+uint32_t pl_get_bram_size_words(void) {
+    return Xil_In32(PL_CTRL_BASE_ADDR + STATUS_REG_12_OFFSET);
 }
 
 // ============================================================================
@@ -135,14 +221,34 @@ int pl_get_current_phase_select(int *phase0, int *phase1) {
     return (status1 & STATUS_DEBUG_MODE_REG) ? 1 : 0;   // Return debug mode status for fun
 }
 
+void pl_get_current_fine_phase_select(int *fine_phase0, int *fine_phase1) {
+    uint32_t status1 = Xil_In32(PL_CTRL_BASE_ADDR + STATUS_REG_1_OFFSET);
+    *fine_phase0 = (((status1 & STATUS_PHASE0_REG_MASK) >> STATUS_PHASE0_REG_SHIFT) << 1) |
+                   ((status1 & STATUS_PHASE0_HALF_STEP_REG) ? 1 : 0);
+    *fine_phase1 = (((status1 & STATUS_PHASE1_REG_MASK) >> STATUS_PHASE1_REG_SHIFT) << 1) |
+                   ((status1 & STATUS_PHASE1_HALF_STEP_REG) ? 1 : 0);
+}
+
 int pl_get_current_debug_mode(void) {
     uint32_t status1 = Xil_In32(PL_CTRL_BASE_ADDR + STATUS_REG_1_OFFSET);
     return (status1 & STATUS_DEBUG_MODE_REG) ? 1 : 0;
 }
 
-int pl_get_current_channel_enable(void) {
+// Port 0 comes from the registered status, ports 1 and up from their control registers
+uint32_t pl_get_current_channel_enable(void) {
     uint32_t status1 = Xil_In32(PL_CTRL_BASE_ADDR + STATUS_REG_1_OFFSET);
-    return (status1 & STATUS_CHANNEL_ENABLE_REG_MASK) >> STATUS_CHANNEL_ENABLE_REG_SHIFT;
+    uint32_t channel_enable = (status1 & STATUS_CHANNEL_ENABLE_REG_MASK) >> STATUS_CHANNEL_ENABLE_REG_SHIFT;
+
+    for (int port = 1; port < PL_NUM_SPI_PORTS; port++) {
+        uint32_t ctrl_reg = Xil_In32(PL_CTRL_BASE_ADDR + CTRL_REG_PORT_OFFSET(port));
+        channel_enable |= ((ctrl_reg & CTRL_CHANNEL_ENABLE_MASK) >> 8) << (CHANNELS_PER_PORT * port);
+    }
+    return channel_enable;
+}
+
+uint32_t pl_get_current_sample_rate(void) {
+    uint32_t idle_cycles = Xil_In32(PL_CTRL_BASE_ADDR + STATUS_REG_9_OFFSET);
+    return PL_CLOCK_HZ / (PL_CLOCKS_PER_FRAME + idle_cycles);
 }
 
 // uint32_t pl_get_current_control_0_flags(void) {
@@ -168,6 +274,8 @@ void pl_print_status(void) {
     send_message("Timestamp: %llu\r\n", pl_get_timestamp());
     send_message("BRAM write address: %u\r\n", pl_get_bram_write_address());
     send_message("FIFO count: %u\r\n", pl_get_fifo_count());
+    send_message("SPI ports: %u\r\n", pl_get_num_spi_ports());
+    send_message("BRAM depth: %u words\r\n", pl_get_bram_size_words());
 
     
     uint32_t status6 = Xil_In32(PL_CTRL_BASE_ADDR + STATUS_REG_6_OFFSET);
@@ -181,9 +289,19 @@ void pl_print_status(void) {
     
     int phase0, phase1;
     pl_get_current_phase_select(&phase0, &phase1);
-    send_message("  Phase select: CIPO0=%d, CIPO1=%d\r\n", phase0, phase1);
+    int fine_phase0, fine_phase1;
+    pl_get_current_fine_phase_select(&fine_phase0, &fine_phase1);
+    send_message("  Phase select: CIPO0=%d, CIPO1=%d (fine %d, %d)\r\n",
+                 phase0, phase1, fine_phase0, fine_phase1);
+    for (int port = 1; port < PL_NUM_SPI_PORTS; port++) {
+        uint32_t ctrl_reg = Xil_In32(PL_CTRL_BASE_ADDR + CTRL_REG_PORT_OFFSET(port));
+        send_message("  Port %d fine phase select: CIPO0=%d, CIPO1=%d\r\n", port,
+                     (int)(((ctrl_reg & CTRL_PHASE0_MASK) << 1) | ((ctrl_reg & CTRL_PHASE0_HALF_STEP) ? 1 : 0)),
+                     (int)((((ctrl_reg & CTRL_PHASE1_MASK) >> 4) << 1) | ((ctrl_reg & CTRL_PHASE1_HALF_STEP) ? 1 : 0)));
+    }
     send_message("  Debug mode: %s\r\n", pl_get_current_debug_mode() ? "ENABLED (dummy data)" : "DISABLED (real CIPO)");
     send_message("  Channel enable: 0x%X\r\n", pl_get_current_channel_enable());    
+    send_message("  Sample rate: %u Hz\r\n", pl_get_current_sample_rate());
 
     send_message("================================\r\n");
 }
@@ -193,7 +311,8 @@ void pl_dump_bram_data(uint32_t start_addr, uint32_t word_count) {
     send_message("BRAM dump starting at address %u:\r\n", start_addr);
     for (uint32_t i = 0; i < word_count; i++) {
         uint32_t addr = (start_addr + i) % BRAM_SIZE_WORDS;
-        uint32_t data = Xil_In32(BRAM_BASE_ADDR + addr * 4);
+        uint32_t data;
+        bram_copy_words(&data, addr, 1);
         send_message("%u: 0x%08X - 0x%08X\r\n", i, BRAM_BASE_ADDR + addr * 4, data);
     }
 }
@@ -372,11 +491,11 @@ void pl_run_full_cable_test(void) {
     // Step 3: Generate cable test packets for all phase combinations
     send_message("Generating cable test packets...\r\n");
     
-    for (int phase = 0; phase < 16; phase++) {  // Vary phase from 0-15
-        send_message("Testing phase0=%d, phase1=%d\r\n", phase, phase);
+    for (int phase = 0; phase < NUM_FINE_PHASES; phase++) {  // Vary fine phase from 0-23
+        send_message("Testing fine phase0=%d, phase1=%d\r\n", phase, phase);
         
         // Set phase values
-        pl_set_phase_select(phase, phase);
+        pl_set_fine_phase_select(phase, phase);
         usleep(10000);  // 10ms delay for settings to take effect
         
         // Acquire one packet
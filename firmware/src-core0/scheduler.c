@@ -0,0 +1,132 @@
+#include "main.h"
+
+// ============================================================================
+// MAIN LOOP SCHEDULER
+// ============================================================================
+
+// Core0 runs its tasks cooperatively, in priority order, once per pass. Each task
+// gets a work budget per turn (frames, received packets) and a time budget it is
+// expected to finish in; tasks are never preempted, so a turn past its time budget
+// is only counted. BRAM occupancy sets the mode: with more than SCHED_URGENT_WORDS
+// waiting, the drain takes a larger share, ethernet RX is cut to one packet per
+// pass (enough to keep TCP ACKs and commands moving) and commands and telemetry
+// wait until the backlog is down, or SCHED_MAX_DEFER_US have passed.
+
+typedef struct {
+    uint32_t (*run)(uint32_t budget);
+    uint32_t work_budget;           // Per turn
+    uint32_t urgent_budget;         // Per turn while the backlog is urgent, 0 = wait
+    uint32_t time_budget_us;
+} sched_task_t;
+
+// 885 frames of one port fill BRAM in 29.5 ms at 30 kS/s, so a normal pass stays
+// well under the 14.8 ms before the backlog turns urgent
+static const sched_task_t tasks[SCHED_NUM_TASKS] = {
+    [TASK_STREAM_DRAIN] = { task_stream_drain, 64, 256, 1000 },
+    [TASK_ETHERNET_RX]  = { task_ethernet_rx,  16, 1,   500 },
+    [TASK_LWIP_TIMERS]  = { task_lwip_timers,  1,  1,   200 },
+    [TASK_COMMANDS]     = { task_commands,     1,  0,   2000 },
+    [TASK_TELEMETRY]    = { task_telemetry,    1,  0,   500 },
+};
+
+static uint32_t task_max_us[SCHED_NUM_TASKS];
+static uint32_t max_pass_us = 0;
+static uint32_t deadline_misses = 0;
+static uint32_t budget_overruns = 0;
+
+// Maxima since the last telemetry datagram
+static uint32_t interval_task_max_us[SCHED_NUM_TASKS];
+static uint32_t interval_max_pass_us = 0;
+
+static uint32_t elapsed_us(XTime start, XTime end) {
+    return (uint32_t)((end - start) * 1000000 / COUNTS_PER_SECOND);
+}
+
+static void run_task(sched_task_id_t id, uint32_t budget) {
+    XTime start, end;
+    XTime_GetTime(&start);
+    tasks[id].run(budget);
+    XTime_GetTime(&end);
+
+    uint32_t us = elapsed_us(start, end);
+    if (us > task_max_us[id]) {
+        task_max_us[id] = us;
+    }
+    if (us > interval_task_max_us[id]) {
+        interval_task_max_us[id] = us;
+    }
+    if (us > tasks[id].time_budget_us) {
+        budget_overruns++;
+    }
+}
+
+void scheduler_run(void) {
+    int deferring = 0;              // Lower priority tasks are waiting for the drain
+    int missed = 0;                 // The backlog is past the deadline level
+    XTime deferred_since = 0;
+
+    while (1) {
+        XTime pass_start, pass_end;
+        XTime_GetTime(&pass_start);
+
+        uint32_t backlog = stream_enabled ? bram_backlog_words() : 0;
+        if ((backlog >= SCHED_DEADLINE_WORDS) && !missed) {
+            deadline_misses++;
+        }
+        missed = (backlog >= SCHED_DEADLINE_WORDS);
+
+        int urgent = (backlog >= SCHED_URGENT_WORDS);
+        if (!urgent) {
+            deferring = 0;
+        } else if (!deferring) {
+            deferring = 1;
+            deferred_since = pass_start;
+        } else if (elapsed_us(deferred_since, pass_start) > SCHED_MAX_DEFER_US) {
+            urgent = 0;             // One normal pass, then wait again
+            deferred_since = pass_start;
+        }
+
+        for (int id = 0; id < SCHED_NUM_TASKS; id++) {
+            uint32_t budget = urgent ? tasks[id].urgent_budget : tasks[id].work_budget;
+            if (budget > 0) {
+                run_task((sched_task_id_t)id, budget);
+            }
+        }
+
+        XTime_GetTime(&pass_end);
+        uint32_t us = elapsed_us(pass_start, pass_end);
+        if (us > max_pass_us) {
+            max_pass_us = us;
+        }
+        if (us > interval_max_pass_us) {
+            interval_max_pass_us = us;
+        }
+    }
+}
+
+void scheduler_reset_stats(void) {
+    for (int id = 0; id < SCHED_NUM_TASKS; id++) {
+        task_max_us[id] = 0;
+    }
+    max_pass_us = 0;
+    deadline_misses = 0;
+    budget_overruns = 0;
+}
+
+void scheduler_get_status(status_response_t *status) {
+    status->sched_max_pass_us = max_pass_us;
+    status->sched_deadline_misses = deadline_misses;
+    status->sched_budget_overruns = budget_overruns;
+    for (int id = 0; id < SCHED_NUM_TASKS; id++) {
+        status->sched_task_max_us[id] = (task_max_us[id] > 0xFFFF) ? 0xFFFF : (uint16_t)task_max_us[id];
+    }
+}
+
+void scheduler_take_interval(telemetry_datagram_t *telemetry) {
+    telemetry->max_pass_us = interval_max_pass_us;
+    interval_max_pass_us = 0;
+    for (int id = 0; id < SCHED_NUM_TASKS; id++) {
+        telemetry->task_max_us[id] = (interval_task_max_us[id] > 0xFFFF) ? 0xFFFF : (uint16_t)interval_task_max_us[id];
+        interval_task_max_us[id] = 0;
+    }
+}
@@ -0,0 +1,143 @@
+#include "main.h"
+#include <string.h>
+#include "lwip/udp.h"
+#include "shared_print.h"
+
+// ============================================================================
+// TELEMETRY
+// ============================================================================
+
+// The datagram is built from collect_status_data, the snapshot GET_STATUS sends,
+// without the console dump that GET_STATUS also does. Totals go out as they are,
+// errors as the change since the previous datagram (a counter that went down was
+// reset by START and counts from zero again), and the BRAM backlog, PL FIFO and
+// main loop times as maxima over the interval (the first two are the PL high-water
+// marks, headroom.c). The telemetry task has the lowest
+// priority, so while a backlog drains the datagram comes late instead of delaying
+// the stream, and the next one is due a full period after it.
+
+static telemetry_datagram_t datagram __attribute__((aligned(64)));   // Sent as PBUF_REF
+static uint32_t rate_hz = 0;                // 0 = off
+static uint32_t dest_ip = 0;                // Network byte order, 0 = UDP stream host
+static uint16_t dest_port = TELEMETRY_PORT;
+static uint64_t period = 0;                 // Timer counts between datagrams
+static XTime next_due = 0;
+static XTime last_sent = 0;
+static uint32_t sequence = 0;
+
+// Status at the previous datagram, for the error deltas
+static status_response_t last;
+
+static uint32_t delta(uint32_t now, uint32_t before) {
+    return (now >= before) ? now - before : now;
+}
+
+static uint32_t per_second(uint32_t count, uint32_t interval_us) {
+    return interval_us ? (uint32_t)((uint64_t)count * 1000000 / interval_us) : 0;
+}
+
+int telemetry_is_valid(uint32_t ip, uint16_t port, uint32_t rate) {
+    if (rate > TELEMETRY_MAX_RATE_HZ) {
+        return 0;
+    }
+    return (rate == 0) || (ip == 0) || is_valid_udp_dest(ip, port ? port : TELEMETRY_PORT);
+}
+
+int telemetry_configure(uint32_t ip, uint16_t port, uint32_t rate) {
+    if (!telemetry_is_valid(ip, port, rate)) {
+        return 0;
+    }
+    rate_hz = rate;
+    dest_ip = ip;
+    dest_port = port ? port : TELEMETRY_PORT;
+    sequence = 0;
+    if (rate == 0) {
+        send_message("Telemetry: off\r\n");
+        return 1;
+    }
+
+    period = COUNTS_PER_SECOND / rate;
+    collect_status_data(&last);
+    scheduler_take_interval(&datagram);     // Maxima from before this point do not count
+    headroom_take_interval(&datagram);
+    XTime_GetTime(&last_sent);
+    next_due = last_sent + period;
+
+    ip_addr_t addr;
+    addr.addr = ip;
+    send_message("Telemetry: %u Hz to %s:%u\r\n", rate, ip ? ip4addr_ntoa(&addr) : "stream host", dest_port);
+    return 1;
+}
+
+// Sends the datagram once it is due; returns 1 if one went out
+int telemetry_poll(void) {
+    if (rate_hz == 0) {
+        return 0;
+    }
+    XTime now;
+    XTime_GetTime(&now);
+    if ((now < next_due) || !udp_tx_ready()) {
+        return 0;                   // A full TX ring belongs to the stream, try next pass
+    }
+
+    status_response_t status;
+    collect_status_data(&status);
+    uint32_t interval_us = (uint32_t)((now - last_sent) * 1000000 / COUNTS_PER_SECOND);
+    uint32_t received = delta(status.packets_received, last.packets_received);
+    uint32_t sent = delta(status.udp_packets_sent, last.udp_packets_sent);
+
+    memset(&datagram, 0, sizeof(datagram));
+    datagram.magic_low = 0xDEADBEEF;
+    datagram.magic_high = TELEMETRY_MAGIC_HIGH;
+    datagram.sequence = sequence;
+    datagram.interval_us = interval_us;
+    datagram.timestamp = status.timestamp;
+    datagram.flags_pl = status.flags_pl;
+    datagram.flags_ps = status.flags_ps;
+
+    datagram.packets_received = status.packets_received;
+    datagram.udp_packets_sent = status.udp_packets_sent;
+    datagram.udp_bytes_sent = status.udp_bytes_sent;
+    datagram.udp_frames_resent = status.udp_frames_resent;
+
+    datagram.rx_frames_per_s = per_second(received, interval_us);
+    datagram.tx_frames_per_s = per_second(sent, interval_us);
+
+    headroom_take_interval(&datagram);
+    scheduler_take_interval(&datagram);
+
+    datagram.errors = delta(status.error_count, last.error_count);
+    datagram.udp_send_errors = delta(status.udp_send_errors, last.udp_send_errors);
+    datagram.udp_tx_forced_drops = delta(status.udp_tx_forced_drops, last.udp_tx_forced_drops);
+    datagram.udp_resend_misses = delta(status.udp_resend_misses, last.udp_resend_misses);
+    datagram.tcp_stream_frames_dropped = delta(status.tcp_stream_frames_dropped, last.tcp_stream_frames_dropped);
+    datagram.deadline_misses = delta(status.sched_deadline_misses, last.sched_deadline_misses);
+    datagram.budget_overruns = delta(status.sched_budget_overruns, last.sched_budget_overruns);
+
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, sizeof(datagram), PBUF_REF);
+    if (p != NULL) {
+        p->payload = (void *)&datagram;
+        ip_addr_t addr;
+        addr.addr = dest_ip ? dest_ip : udp_dest_ip;
+        if (udp_sendto(udp, p, &addr, dest_port) == ERR_OK) {
+            sequence++;
+        }
+        pbuf_free(p);
+    }
+
+    // Intervals restart even if the send failed, so every datagram covers one period
+    last = status;
+    last_sent = now;
+    next_due += period;
+    if (next_due <= now) {
+        next_due = now + period;    // Came late: no catch-up burst
+    }
+    return 1;
+}
+
+void telemetry_get_status(status_response_t *status) {
+    status->telemetry_dest_ip = dest_ip ? dest_ip : udp_dest_ip;
+    status->telemetry_dest_port = dest_port;
+    status->telemetry_rate_hz = (uint16_t)rate_hz;
+    status->telemetry_sent = sequence;
+}
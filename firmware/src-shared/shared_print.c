@@ -92,7 +92,7 @@ void process_serial_command(const char* cmd) {
         command_flags->pl_print_flag = 1;
         
     } else if (strncmp(cmd, "benchmark", 9) == 0) {
-        xil_printf("Serial command: Running BRAM benchmark\r\n");
+        xil_printf("Serial command: Running benchmark\r\n");
         command_flags->bram_benchmark_flag = 1;
         
     } else if (strncmp(cmd, "dump", 4) == 0) {
@@ -110,7 +110,7 @@ void process_serial_command(const char* cmd) {
         xil_printf("  stop     - Stop data transmission\r\n");
         xil_printf("  reset    - Reset timestamp and counters\r\n");
         xil_printf("  status   - Show system status\r\n");
-        xil_printf("  benchmark - Run BRAM read performance test\r\n");
+        xil_printf("  benchmark - Time BRAM copies, the UDP send path and register reads\r\n");
         xil_printf("  dump [start] [count] - Dump BRAM contents\r\n");
         xil_printf("  help     - Show this help\r\n");
         command_flags->lock = 0;
@@ -64,6 +64,12 @@ if { $list_projs eq "" } {
 variable design_name
 set design_name design_1
 
+# BRAM ring depth in 32-bit words: a power of 2 (it is also the AXI address range),
+# at most 131072 on the XC7Z020. Must match BRAM_SIZE_WORDS in firmware/include/main.h,
+# which the firmware checks against status register 12 at startup.
+variable bram_depth_words
+set bram_depth_words 65536
+
 # If you do not already have an existing IP Integrator design open,
 # you can create a design using the following command:
 #    create_bd_design $design_name
@@ -206,6 +212,14 @@ proc create_root_design { parentCell } {
 
   variable script_folder
   variable design_name
+  variable bram_depth_words
+
+  if { $bram_depth_words < 1024 || $bram_depth_words > 131072 || ($bram_depth_words & ($bram_depth_words - 1)) != 0 } {
+     catch {common::send_gid_msg -ssname BD::TCL -id 2090 -severity "ERROR" "bram_depth_words <$bram_depth_words> must be a power of 2 from 1024 to 131072."}
+     return 1
+  }
+  set bram_size_bytes [expr {$bram_depth_words * 4}]
+  set bram_addr_width [string length [format %b [expr {$bram_size_bytes - 1}]]]
 
   if { $parentCell eq "" } {
      set parentCell [get_bd_cells /]
@@ -640,7 +654,13 @@ proc create_root_design { parentCell } {
      catch {common::send_gid_msg -ssname BD::TCL -id 2096 -severity "ERROR" "Unable to referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
      return 1
    }
-  
+  set_property -dict [list \
+    CONFIG.ADDR_WIDTH $bram_addr_width \
+    CONFIG.DEPTH $bram_depth_words \
+  ] $simple_dual_port_bram
+  set_property CONFIG.MEM_SIZE $bram_size_bytes [get_bd_intf_pins simple_dual_port_bram/BRAM_PORTB]
+
+
   # Create instance: axi_bram_ctrl_0, and set properties
   set axi_bram_ctrl_0 [ create_bd_cell -type ip -vlnv xilinx.com:ip:axi_bram_ctrl:4.1 axi_bram_ctrl_0 ]
   set_property CONFIG.SINGLE_PORT_BRAM {1} $axi_bram_ctrl_0
@@ -681,7 +701,12 @@ proc create_root_design { parentCell } {
      catch {common::send_gid_msg -ssname BD::TCL -id 2096 -severity "ERROR" "Unable to referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
      return 1
    }
-  
+  set_property -dict [list \
+    CONFIG.BRAM_ADDR_WIDTH $bram_addr_width \
+    CONFIG.BRAM_DEPTH_WORDS $bram_depth_words \
+  ] $data_generator
+
+
   # Create instance: intan_spi_lvds_buffer_0, and set properties
   set block_name intan_spi_lvds_buffer
   set block_cell_name intan_spi_lvds_buffer_0
@@ -729,6 +754,8 @@ proc create_root_design { parentCell } {
   connect_bd_net -net data_generator_bram_0_status_regs_pl  [get_bd_pins data_generator/status_regs_pl] \
   [get_bd_pins axi_lite_registers/status_regs_pl] \
   [get_bd_pins led_status_controller/status_regs_pl]
+  connect_bd_net -net axi_lite_registers_status_read_pl  [get_bd_pins axi_lite_registers/status_read_pl] \
+  [get_bd_pins data_generator/status_read_pl]
   connect_bd_net -net led_status_controller_0_led0  [get_bd_pins led_status_controller/led0] \
   [get_bd_ports led0]
   connect_bd_net -net led_status_controller_0_led1  [get_bd_pins led_status_controller/led1] \
@@ -755,7 +782,7 @@ proc create_root_design { parentCell } {
   [get_bd_pins proc_sys_reset_175MHz/ext_reset_in]
 
   # Create address segments
-  assign_bd_address -offset 0x80000000 -range 0x00010000 -target_address_space [get_bd_addr_spaces processing_system7_0/Data] [get_bd_addr_segs axi_bram_ctrl_0/S_AXI/Mem0] -force
+  assign_bd_address -offset 0x80000000 -range $bram_size_bytes -target_address_space [get_bd_addr_spaces processing_system7_0/Data] [get_bd_addr_segs axi_bram_ctrl_0/S_AXI/Mem0] -force
   assign_bd_address -offset 0x40000000 -range 0x00010000 -with_name SEG_axi_lite_registers_0_reg0 -target_address_space [get_bd_addr_spaces processing_system7_0/Data] [get_bd_addr_segs axi_lite_registers/s_axi/reg0] -force
 
 
@@ -0,0 +1,60 @@
+`timescale 1ns / 1ps
+//////////////////////////////////////////////////////////////////////////////////
+// Module Name:    IDDR (simulation model)
+// Description:    Behavioral stand-in for the Xilinx 7-series IDDR primitive so the
+//                 data generator can be simulated without the unisim library.
+//                 Only DDR_CLK_EDGE = "SAME_EDGE_PIPELINED" is modelled: the sample
+//                 taken on a rising edge and the sample taken on the following
+//                 falling edge are presented together on Q1/Q2 at the next rising
+//                 edge, so logic clocked by C sees them two clocks after the first
+//                 sample was taken. R and S are synchronous (SRTYPE = "SYNC").
+//
+//                 Never add this file to the Vivado project - synthesis must use
+//                 the real primitive.
+//////////////////////////////////////////////////////////////////////////////////
+module IDDR #(
+    parameter DDR_CLK_EDGE = "SAME_EDGE_PIPELINED",
+    parameter INIT_Q1 = 1'b0,
+    parameter INIT_Q2 = 1'b0,
+    parameter SRTYPE = "SYNC"
+)(
+    output reg Q1,
+    output reg Q2,
+    input wire C,
+    input wire CE,
+    input wire D,
+    input wire R,
+    input wire S
+);
+
+    reg rise_sample = INIT_Q1;   // Captured on the rising edge
+    reg fall_sample = INIT_Q2;   // Captured on the falling edge
+
+    initial begin
+        Q1 = INIT_Q1;
+        Q2 = INIT_Q2;
+    end
+
+    always @(posedge C) begin
+        if (R) begin
+            rise_sample <= 1'b0;
+            Q1 <= 1'b0;
+            Q2 <= 1'b0;
+        end else if (S) begin
+            rise_sample <= 1'b1;
+            Q1 <= 1'b1;
+            Q2 <= 1'b1;
+        end else if (CE) begin
+            rise_sample <= D;
+            Q1 <= rise_sample;
+            Q2 <= fall_sample;
+        end
+    end
+
+    always @(negedge C) begin
+        if (CE) begin
+            fall_sample <= D;
+        end
+    end
+
+endmodule
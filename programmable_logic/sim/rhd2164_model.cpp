@@ -0,0 +1,134 @@
+// rhd2164_model.cpp
+// Bit-level model of an Intan RHD2164 (see rhd2164_model.h)
+
+#include "rhd2164_model.h"
+
+namespace {
+
+// ROM register contents (RHD2000 series datasheet, register 40-63)
+constexpr int ROM_COMPANY_NAME = 40;   // 40-44: "INTAN"
+constexpr int ROM_MISO_MARKER = 59;    // Different on MISO A and B for DDR chips
+constexpr int ROM_DIE_REVISION = 60;
+constexpr int ROM_UNIPOLAR = 61;
+constexpr int ROM_NUM_AMPLIFIERS = 62;
+constexpr int ROM_CHIP_ID = 63;
+
+constexpr uint16_t MISO_MARKER_A = 0x35;   // 53
+constexpr uint16_t MISO_MARKER_B = 0x3A;   // 58
+constexpr uint16_t CHIP_ID_RHD2164 = 4;
+
+// MISO edges older than this are never looked up again
+constexpr double MISO_HISTORY_NS = 2000.0;
+
+} // namespace
+
+Rhd2164Model::Rhd2164Model(int chip_index, double miso_delay_ns)
+    : chip_index_(chip_index), miso_delay_ns_(miso_delay_ns) {
+    const char company[] = "INTAN";
+    for (int i = 0; i < 5; i++) {
+        registers_[ROM_COMPANY_NAME + i] = static_cast<uint16_t>(company[i]);
+    }
+    registers_[ROM_MISO_MARKER] = MISO_MARKER_A;
+    registers_[ROM_DIE_REVISION] = 0;
+    registers_[ROM_UNIPOLAR] = 1;
+    registers_[ROM_NUM_AMPLIFIERS] = 64;
+    registers_[ROM_CHIP_ID] = CHIP_ID_RHD2164;
+    miso_edges_.emplace_back(-1.0e9, false);
+}
+
+uint16_t Rhd2164Model::adc_sample(int chip_index, int channel, uint32_t conversion) {
+    // [15:10] channel, [9:6] chip, [5:0] conversion count
+    return static_cast<uint16_t>(((channel & 0x3F) << 10) | ((chip_index & 0xF) << 6) |
+                                 (conversion & 0x3F));
+}
+
+Rhd2164Model::Result Rhd2164Model::execute(uint16_t command) {
+    const int reg = (command >> 8) & 0x3F;
+
+    switch (command >> 14) {
+        case 0: {
+            // CONVERT(C): channel C on MISO A, channel C+32 on MISO B
+            if (reg >= 32) {
+                return {0, 0};   // Auxiliary inputs are not modelled
+            }
+            Result r;
+            r.a = adc_sample(chip_index_, reg, conversions_[reg]++);
+            r.b = adc_sample(chip_index_, reg + 32, conversions_[reg + 32]++);
+            return r;
+        }
+        case 1:
+            // CALIBRATE and CLEAR (no result data)
+            return {0, 0};
+        case 2: {
+            // WRITE(R, D): echoes the data with 0xFF in the upper byte
+            const uint16_t data = command & 0xFF;
+            if (reg < 40) {
+                registers_[reg] = data;
+            }
+            const uint16_t echo = static_cast<uint16_t>(0xFF00 | data);
+            return {echo, echo};
+        }
+        default: {
+            // READ(R): register value in the lower byte, same on both lines
+            // except the MISO marker register
+            if (reg == ROM_MISO_MARKER) {
+                return {MISO_MARKER_A, MISO_MARKER_B};
+            }
+            return {registers_[reg], registers_[reg]};
+        }
+    }
+}
+
+void Rhd2164Model::set_miso(double t_ns, bool level) {
+    if (miso_edges_.back().second != level) {
+        miso_edges_.emplace_back(t_ns, level);
+    }
+    while (miso_edges_.size() > 2 && miso_edges_[1].first < t_ns - MISO_HISTORY_NS) {
+        miso_edges_.pop_front();
+    }
+}
+
+void Rhd2164Model::drive(double t_ns, bool csn, bool sclk, bool copi) {
+    if (csn_ && !csn) {
+        // Start of a transaction: present the oldest pipelined result
+        bit_ = 0;
+        shift_in_ = 0;
+        shifting_out_ = pipeline_[0];
+        set_miso(t_ns, (shifting_out_.a >> 15) & 1);
+    } else if (!csn_ && csn) {
+        // End of a transaction: execute the command once all 16 bits arrived
+        if (bit_ == 16) {
+            transactions_.push_back({shift_in_, shifting_out_.a, shifting_out_.b});
+            pipeline_[0] = pipeline_[1];
+            pipeline_[1] = execute(shift_in_);
+        }
+        set_miso(t_ns, false);   // MISO is released (weak pull-down)
+    } else if (!csn) {
+        if (!sclk_ && sclk && bit_ < 16) {
+            // Rising edge: sample COPI, present the MISO B bit
+            shift_in_ = static_cast<uint16_t>((shift_in_ << 1) | (copi ? 1 : 0));
+            set_miso(t_ns, (shifting_out_.b >> (15 - bit_)) & 1);
+        } else if (sclk_ && !sclk && bit_ < 16) {
+            // Falling edge: present the next MISO A bit
+            bit_++;
+            if (bit_ < 16) {
+                set_miso(t_ns, (shifting_out_.a >> (15 - bit_)) & 1);
+            }
+        }
+    }
+
+    csn_ = csn;
+    sclk_ = sclk;
+}
+
+bool Rhd2164Model::miso_at(double t_ns) const {
+    // Level driven strictly before t - delay (a sampling edge coincident with a MISO
+    // change sees the old level)
+    const double t_chip = t_ns - miso_delay_ns_;
+    for (auto it = miso_edges_.rbegin(); it != miso_edges_.rend(); ++it) {
+        if (it->first < t_chip) {
+            return it->second;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,72 @@
+// rhd2164_model.h
+// Bit-level model of an Intan RHD2164 for the data generator testbench.
+//
+// The model watches CSn/SCLK/COPI once per PL clock edge and drives its MISO line the
+// way the chip does in DDR mode: after CSn falls MISO carries bit 15 of the MISO A
+// result, every SCLK rising edge puts the next MISO B bit on the line and every SCLK
+// falling edge the next MISO A bit. Results follow the command that produced them by
+// two transactions, as in the datasheet. MISO is seen by the FPGA through a fixed
+// delay (cable round trip plus chip output delay).
+
+#ifndef RHD2164_MODEL_H
+#define RHD2164_MODEL_H
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+class Rhd2164Model {
+public:
+    // One complete 16-bit transaction as seen on the wire
+    struct Transaction {
+        uint16_t command;   // Word received on COPI
+        uint16_t miso_a;    // Word shifted out on the falling edges (channels 0-31)
+        uint16_t miso_b;    // Word shifted out on the rising edges (channels 32-63)
+    };
+
+    Rhd2164Model(int chip_index, double miso_delay_ns);
+
+    // Present the interface pins at time t_ns (called after every rising PL clock edge)
+    void drive(double t_ns, bool csn, bool sclk, bool copi);
+
+    // MISO level seen at the FPGA pin at time t_ns
+    bool miso_at(double t_ns) const;
+
+    const std::vector<Transaction>& transactions() const { return transactions_; }
+
+    // Synthetic ADC sample returned for a CONVERT of amplifier channel (0-63). The
+    // value encodes the channel, chip and conversion count so misaligned data is obvious.
+    static uint16_t adc_sample(int chip_index, int channel, uint32_t conversion);
+
+private:
+    struct Result {
+        uint16_t a;
+        uint16_t b;
+    };
+
+    Result execute(uint16_t command);
+    void set_miso(double t_ns, bool level);
+
+    int chip_index_;
+    double miso_delay_ns_;
+
+    // Interface state
+    bool csn_ = true;
+    bool sclk_ = false;
+    int bit_ = 0;               // Bits received in the current transaction
+    uint16_t shift_in_ = 0;
+    Result shifting_out_{0, 0};  // Result being shifted out in the current transaction
+
+    // Two-deep command pipeline: results appear two transactions after their command
+    Result pipeline_[2] = {{0, 0}, {0, 0}};
+
+    uint16_t registers_[64] = {};
+    uint32_t conversions_[64] = {};
+
+    // MISO edges (time, new level), oldest first
+    std::deque<std::pair<double, bool>> miso_edges_;
+
+    std::vector<Transaction> transactions_;
+};
+
+#endif // RHD2164_MODEL_H
@@ -0,0 +1,702 @@
+// tb_data_generator.cpp
+// Cycle-accurate Verilator testbench for the data_generator wrapper (data generator
+// core + FIFO/BRAM interface).
+//
+// Each CIPO line is driven by an RHD2164 model that decodes the real COPI commands
+// and answers with ROM registers, write echoes and synthetic ADC conversions in DDR
+// mode, seen through a configurable cable delay. The testbench plays the role of the
+// PS: it writes the control registers, models BRAM port A (64-bit writes with byte
+// enables) and follows the BRAM write address in STATUS_REG_10, publishing its read
+// pointer back as the firmware does. Every packet is checked against what the chips
+// actually shifted out during that frame.
+//
+// The run first repeats the firmware cable test (initialization sequence, then one
+// cable-length frame per fine phase), picks the centre of the widest passing phase
+// window of each line, and then acquires the requested number of frames and reports
+// throughput and FIFO occupancy, checked against the PL high-water marks.
+//
+// Build and run with scripts/run_simulation.py.
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Vdata_generator.h"
+#include "verilated.h"
+#if VM_TRACE
+#include "verilated_vcd_c.h"
+#endif
+
+#include "rhd2164_model.h"
+
+#ifndef N_SPI_PORTS
+#define N_SPI_PORTS 1           // Must match the -GN_SPI_PORTS used to verilate the wrapper
+#endif
+#ifndef BRAM_DEPTH_WORDS
+#define BRAM_DEPTH_WORDS 65536  // Must match the -GBRAM_DEPTH_WORDS used to verilate the wrapper
+#endif
+
+namespace {
+
+constexpr int N_CIPO = 2 * N_SPI_PORTS;
+constexpr int N_SEGMENTS = 2 * N_CIPO;        // 16-bit segments per cycle (A and B per line)
+
+constexpr double CLOCK_HZ = 84.0e6;
+constexpr double HALF_PERIOD_NS = 0.5e9 / CLOCK_HZ;
+
+constexpr int CYCLES_PER_FRAME = 35;
+constexpr int CLOCKS_PER_FRAME = 80 * CYCLES_PER_FRAME;
+constexpr int NUM_FINE_PHASES = 24;
+constexpr int HEADER_WORDS = 4;
+
+constexpr uint32_t BRAM_SIZE_WORDS = BRAM_DEPTH_WORDS;
+constexpr int FIFO_DEPTH = 256;               // FIFO_DEPTH of the wrapper
+
+constexpr uint32_t MAGIC_NUMBER_LOW = 0xDEADBEEF;
+constexpr uint32_t MAGIC_NUMBER_HIGH = 0xCAFEBABE;
+
+// Control and status registers (firmware/include/main.h)
+constexpr int CTRL_REG_0 = 0;
+constexpr int CTRL_REG_1 = 1;                 // Loop count
+constexpr int CTRL_REG_3 = 3;                 // Inter-frame idle cycles
+constexpr int CTRL_REG_MOSI_START = 4;
+constexpr int CTRL_REG_PS_READ = 21 + N_SPI_PORTS;   // After the port registers
+constexpr uint32_t CTRL_ENABLE_TRANSMISSION = 1u << 0;
+constexpr uint32_t CTRL_DEBUG_MODE = 1u << 3;
+constexpr uint32_t CTRL_PHASE0_HALF_STEP = 1u << 12;
+constexpr uint32_t CTRL_PHASE1_HALF_STEP = 1u << 13;
+
+constexpr int STATUS_REG_0 = 0;
+constexpr int STATUS_REG_10 = 10;
+constexpr int STATUS_REG_11 = 11;             // High-water marks, cleared on read
+constexpr int STATUS_REG_12 = 12;             // BRAM depth in words
+constexpr uint32_t STATUS_TRANSMISSION_ACTIVE = 1u << 0;
+constexpr uint32_t STATUS_BRAM_ADDR_MASK = 0x3FFFF;
+constexpr int STATUS_FIFO_COUNT_SHIFT = 18;
+constexpr uint32_t STATUS_FIFO_COUNT_MASK = 0x1FF;
+
+// Same sequences as firmware/src-core0/pl_control.c
+const uint16_t convert_cmd_sequence[CYCLES_PER_FRAME] = {
+    0x0000, 0x0100, 0x0200, 0x0300, 0x0400, 0x0500, 0x0600, 0x0700,
+    0x0800, 0x0900, 0x0A00, 0x0B00, 0x0C00, 0x0D00, 0x0E00, 0x0F00,
+    0x1000, 0x1100, 0x1200, 0x1300, 0x1400, 0x1500, 0x1600, 0x1700,
+    0x1800, 0x1900, 0x1A00, 0x1B00, 0x1C00, 0x1D00, 0x1E00, 0x1F00,
+    0x0000, 0x0000, 0x0000
+};
+
+const uint16_t initialization_cmd_sequence[CYCLES_PER_FRAME] = {
+    0xFF00, 0xFF00,
+    0x80DE, 0x8142, 0x8204, 0x8302, 0x849C, 0x8500, 0x8680, 0x8700,
+    0x8811, 0x8980, 0x8A10, 0x8B80, 0x8C2C, 0x8D86, 0x8EFF, 0x8FFF,
+    0x90FF, 0x91FF, 0x92FF, 0x93FF, 0x94FF, 0x95FF,
+    0x5500,
+    0xFF00, 0xFF00, 0xFF00, 0xFF00, 0xFF00,
+    0xFF00, 0xFF00, 0xFF00, 0xFF00, 0xFF00
+};
+
+const uint16_t cable_length_cmd_sequence[CYCLES_PER_FRAME] = {
+    0xE800, 0xE900, 0xEA00, 0xEB00, 0xEC00, 0xFF00, 0xFB00,
+    0xE800, 0xE900, 0xEA00, 0xEB00, 0xEC00, 0xFF00, 0xFB00,
+    0xE800, 0xE900, 0xEA00, 0xEB00, 0xEC00, 0xFF00, 0xFB00,
+    0xE800, 0xE900, 0xEA00, 0xEB00, 0xEC00, 0xFF00, 0xFB00,
+    0xE800, 0xE900, 0xEA00, 0xEB00, 0xEC00, 0xFF00, 0xFB00
+};
+
+int port_ctrl_reg(int port) {
+    return (port == 0) ? 2 : (21 + port);
+}
+
+uint32_t channel_enable_all() {
+    return (N_SEGMENTS >= 32) ? 0xFFFFFFFFu : ((1u << N_SEGMENTS) - 1);
+}
+
+int popcount(uint32_t x) {
+    int n = 0;
+    for (; x; x &= x - 1) {
+        n++;
+    }
+    return n;
+}
+
+uint32_t packet_words(uint32_t nchan) {
+    return HEADER_WORDS + (CYCLES_PER_FRAME * nchan + 1) / 2;
+}
+
+struct Options {
+    double delay_ns = 25.0;         // MISO round trip delay (cable + chip output delay)
+    int frames = 100;
+    uint32_t channel_enable = channel_enable_all();
+    const uint16_t* sequence = convert_cmd_sequence;
+    int phase = -1;                 // -1 = pick from the cable test sweep
+    uint32_t frame_idle = 0;
+    bool debug_data = false;
+    bool verbose = false;
+    const char* vcd_file = nullptr;
+};
+
+struct Statistics {
+    uint64_t clocks = 0;
+    uint64_t bram_writes = 0;
+    uint64_t bram_bytes = 0;
+    uint64_t fifo_full_clocks = 0;
+    uint32_t fifo_max = 0;
+    uint64_t fifo_histogram[FIFO_DEPTH + 1] = {};
+    uint64_t packets = 0;
+    uint64_t packet_errors = 0;
+    uint64_t format_errors = 0;     // Bad magic, short or unmatched packets
+    uint64_t segment_errors = 0;
+    uint64_t timestamp_errors = 0;
+};
+
+class Testbench {
+public:
+    Testbench(VerilatedContext* context, const Options& options)
+        : options_(options), top_(new Vdata_generator{context}), bram_(BRAM_SIZE_WORDS, 0) {
+        for (int l = 0; l < N_CIPO; l++) {
+            chips_.emplace_back(l, options.delay_ns);
+        }
+#if VM_TRACE
+        if (options.vcd_file) {
+            context->traceEverOn(true);
+            trace_.reset(new VerilatedVcdC);
+            top_->trace(trace_.get(), 99);
+            trace_->open(options.vcd_file);
+        }
+#endif
+    }
+
+    ~Testbench() {
+#if VM_TRACE
+        if (trace_) {
+            trace_->close();
+        }
+#endif
+        top_->final();
+    }
+
+    void reset() {
+        for (int r = 0; r < N_CTRL; r++) {
+            write_ctrl(r, 0);
+        }
+        top_->rstn = 0;
+        top_->bram_dout = 0;
+        top_->status_read_pl = 0;
+        for (int i = 0; i < 10; i++) {
+            tick();
+        }
+        top_->rstn = 1;
+        tick();
+    }
+
+    // Fine phase (0-23) of one CIPO line: {4-bit phase, half step} in the port's register
+    void set_line_phase(int line, int phase) {
+        const int reg = port_ctrl_reg(line / 2);
+        uint32_t value = ctrl_[reg];
+        if (line % 2 == 0) {
+            value &= ~(0xFu | CTRL_PHASE0_HALF_STEP);
+            value |= (phase >> 1) | ((phase & 1) ? CTRL_PHASE0_HALF_STEP : 0);
+        } else {
+            value &= ~((0xFu << 4) | CTRL_PHASE1_HALF_STEP);
+            value |= ((phase >> 1) << 4) | ((phase & 1) ? CTRL_PHASE1_HALF_STEP : 0);
+        }
+        write_ctrl(reg, value);
+    }
+
+    void set_channel_enable(uint32_t mask) {
+        for (int p = 0; p < N_SPI_PORTS; p++) {
+            const int reg = port_ctrl_reg(p);
+            write_ctrl(reg, (ctrl_[reg] & ~(0xFu << 8)) | (((mask >> (4 * p)) & 0xF) << 8));
+        }
+        channel_enable_ = mask;
+    }
+
+    void set_copi_commands(const uint16_t* sequence) {
+        for (int i = 0; i < 18; i++) {
+            uint32_t value = sequence[2 * i];
+            if (2 * i + 1 < CYCLES_PER_FRAME) {
+                value |= static_cast<uint32_t>(sequence[2 * i + 1]) << 16;
+            }
+            write_ctrl(CTRL_REG_MOSI_START + i, value);
+        }
+    }
+
+    // Transmit `frames` frames with loop count set, like the firmware does for the cable
+    // test, then wait for the core to go idle and the FIFO to drain into BRAM.
+    // Returns false on timeout.
+    bool run_frames(int frames, bool check_data) {
+        check_data_ = check_data && !options_.debug_data;
+        write_ctrl(CTRL_REG_1, static_cast<uint32_t>(frames));
+        write_ctrl(CTRL_REG_3, options_.frame_idle);
+        const uint32_t ctrl0 = options_.debug_data ? CTRL_DEBUG_MODE : 0;
+
+        // Let the core latch the new configuration before enabling
+        for (int i = 0; i < 4; i++) {
+            tick();
+        }
+        write_ctrl(CTRL_REG_0, ctrl0 | CTRL_ENABLE_TRANSMISSION);
+
+        const uint64_t frame_clocks = CLOCKS_PER_FRAME + options_.frame_idle;
+        const uint64_t timeout = (static_cast<uint64_t>(frames) + 3) * frame_clocks;
+        bool started = false;
+        uint64_t waited = 0;
+        for (; waited < timeout; waited++) {
+            tick();
+            const bool active = status(STATUS_REG_0) & STATUS_TRANSMISSION_ACTIVE;
+            if (active) {
+                started = true;
+            } else if (started) {
+                break;
+            }
+        }
+        write_ctrl(CTRL_REG_0, ctrl0);
+
+        // One more frame boundary clears loop_limit_reached; the FIFO drains well within it
+        for (uint64_t i = 0; i < 2 * frame_clocks; i++) {
+            tick();
+        }
+        return started && waited < timeout;
+    }
+
+    // BRAM depth the wrapper was built with (STATUS_REG_12)
+    uint32_t bram_size_words() const {
+        return status(STATUS_REG_12);
+    }
+
+    // Read STATUS_REG_11 like the PS does, which clears it
+    void read_high_water(uint32_t& fifo_max, uint32_t& unread_max) {
+        const uint32_t status11 = status(STATUS_REG_11);
+        fifo_max = (status11 >> STATUS_FIFO_COUNT_SHIFT) & STATUS_FIFO_COUNT_MASK;
+        unread_max = status11 & STATUS_BRAM_ADDR_MASK;
+        top_->status_read_pl = 1u << STATUS_REG_11;
+        tick();
+        top_->status_read_pl = 0;
+    }
+
+    // Result of the most recent packet per CIPO line (both segments matched for all cycles)
+    const std::vector<bool>& last_packet_line_ok() const { return last_packet_line_ok_; }
+
+    Statistics& stats() { return stats_; }
+
+private:
+    static constexpr int N_CTRL = 22 + N_SPI_PORTS;
+
+    void write_ctrl(int reg, uint32_t value) {
+        ctrl_[reg] = value;
+        top_->ctrl_regs_pl[reg] = value;
+    }
+
+    uint32_t status(int reg) const {
+        return top_->status_regs_pl[reg];
+    }
+
+    void set_cipo(double t_ns) {
+        top_->cipo0 = chips_[0].miso_at(t_ns);
+        top_->cipo1 = chips_[1].miso_at(t_ns);
+        uint32_t ext = 0;
+        for (int l = 2; l < N_CIPO; l++) {
+            ext |= static_cast<uint32_t>(chips_[l].miso_at(t_ns)) << (l - 2);
+        }
+        top_->cipo_ext = ext;
+    }
+
+    // One PL clock. The IDDRs sample CIPO on both edges, so both are evaluated.
+    void tick() {
+        set_cipo(time_ns_);
+        top_->clk = 1;
+        top_->eval();
+        dump();
+        on_rising_edge();
+        time_ns_ += HALF_PERIOD_NS;
+
+        set_cipo(time_ns_);
+        top_->clk = 0;
+        top_->eval();
+        dump();
+        time_ns_ += HALF_PERIOD_NS;
+    }
+
+    void dump() {
+#if VM_TRACE
+        if (trace_) {
+            trace_->dump(static_cast<uint64_t>(time_ns_ * 1000.0));   // ps
+        }
+#endif
+    }
+
+    void on_rising_edge() {
+        // Registered outputs changed on this edge - the chips see them now
+        for (auto& chip : chips_) {
+            chip.drive(time_ns_, top_->csn, top_->sclk, top_->copi);
+        }
+
+        // BRAM port A. The write is applied as soon as it is presented (one clock early),
+        // which is harmless because the PS only reads behind the published address.
+        if (top_->bram_en && top_->bram_we) {
+            const uint32_t wide = (top_->bram_addr >> 3) % (BRAM_SIZE_WORDS / 2);
+            const uint64_t din = top_->bram_din;
+            for (int byte = 0; byte < 8; byte++) {
+                if (top_->bram_we & (1u << byte)) {
+                    uint32_t& word = bram_[2 * wide + byte / 4];
+                    const int shift = 8 * (byte % 4);
+                    word = (word & ~(0xFFu << shift)) |
+                           (static_cast<uint32_t>((din >> (8 * byte)) & 0xFF) << shift);
+                    stats_.bram_bytes++;
+                }
+            }
+            stats_.bram_writes++;
+        }
+
+        const uint32_t status10 = status(STATUS_REG_10);
+        const uint32_t fifo_count = (status10 >> STATUS_FIFO_COUNT_SHIFT) & STATUS_FIFO_COUNT_MASK;
+        stats_.clocks++;
+        stats_.fifo_histogram[fifo_count <= FIFO_DEPTH ? fifo_count : FIFO_DEPTH]++;
+        if (fifo_count > stats_.fifo_max) {
+            stats_.fifo_max = fifo_count;
+        }
+        if (fifo_count >= FIFO_DEPTH) {
+            stats_.fifo_full_clocks++;
+        }
+
+        const uint32_t boundary = status10 & STATUS_BRAM_ADDR_MASK;
+        if (boundary != last_boundary_) {
+            consume_packets(boundary);
+            write_ctrl(CTRL_REG_PS_READ, last_boundary_);
+        }
+    }
+
+    uint32_t bram_word(uint32_t address) const {
+        return bram_[address % BRAM_SIZE_WORDS];
+    }
+
+    // Check every packet between the last published address and the new one
+    void consume_packets(uint32_t boundary) {
+        const uint32_t nchan = popcount(channel_enable_);
+        const uint32_t words = packet_words(nchan);
+
+        while (last_boundary_ != boundary) {
+            const uint32_t available = (boundary - last_boundary_) % BRAM_SIZE_WORDS;
+            if (available < words) {
+                std::printf("ERROR: %u words published, expected a %u word packet\n",
+                            available, words);
+                stats_.packet_errors++;
+                stats_.format_errors++;
+                last_boundary_ = boundary;
+                return;
+            }
+            check_packet(last_boundary_, nchan);
+            last_boundary_ = (last_boundary_ + words) % BRAM_SIZE_WORDS;
+        }
+    }
+
+    void check_packet(uint32_t address, uint32_t nchan) {
+        const uint64_t frame = packet_index_++;
+        stats_.packets++;
+        bool packet_ok = true;
+
+        if (bram_word(address) != MAGIC_NUMBER_LOW || bram_word(address + 1) != MAGIC_NUMBER_HIGH) {
+            std::printf("ERROR: packet %" PRIu64 " at word %u: bad magic 0x%08X 0x%08X\n",
+                        frame, address, bram_word(address), bram_word(address + 1));
+            stats_.packet_errors++;
+            stats_.format_errors++;
+            return;
+        }
+
+        const uint64_t timestamp = bram_word(address + 2) |
+                                   (static_cast<uint64_t>(bram_word(address + 3)) << 32);
+        if (frame > 0 && timestamp <= last_timestamp_) {
+            std::printf("ERROR: packet %" PRIu64 ": timestamp %" PRIu64 " after %" PRIu64 "\n",
+                        frame, timestamp, last_timestamp_);
+            stats_.timestamp_errors++;
+            packet_ok = false;
+        }
+        last_timestamp_ = timestamp;
+
+        last_packet_line_ok_.assign(N_CIPO, true);
+        for (int c = 0; c < CYCLES_PER_FRAME; c++) {
+            const size_t transaction = frame * CYCLES_PER_FRAME + c;
+            int lane = 0;
+            for (int s = 0; s < N_SEGMENTS; s++) {
+                if (!(channel_enable_ & (1u << s))) {
+                    continue;
+                }
+                const uint32_t lane_index = c * nchan + lane++;
+                const uint32_t word = bram_word(address + HEADER_WORDS + lane_index / 2);
+                const uint16_t received = (lane_index & 1) ? (word >> 16) : (word & 0xFFFF);
+                if (!check_data_) {
+                    continue;
+                }
+
+                const int line = s / 2;
+                const auto& log = chips_[line].transactions();
+                if (transaction >= log.size()) {
+                    std::printf("ERROR: packet %" PRIu64 " has no matching chip transaction\n", frame);
+                    stats_.packet_errors++;
+                    stats_.format_errors++;
+                    return;
+                }
+                const uint16_t expected = (s & 1) ? log[transaction].miso_b : log[transaction].miso_a;
+                if (received != expected) {
+                    last_packet_line_ok_[line] = false;
+                    stats_.segment_errors++;
+                    packet_ok = false;
+                    if (options_.verbose) {
+                        std::printf("  packet %" PRIu64 " cycle %d line %d %s: got 0x%04X expected 0x%04X\n",
+                                    frame, c, line, (s & 1) ? "B" : "A", received, expected);
+                    }
+                }
+            }
+        }
+        if (!packet_ok) {
+            stats_.packet_errors++;
+        }
+    }
+
+    const Options& options_;
+    std::unique_ptr<Vdata_generator> top_;
+#if VM_TRACE
+    std::unique_ptr<VerilatedVcdC> trace_;
+#endif
+    std::vector<Rhd2164Model> chips_;
+    std::vector<uint32_t> bram_;
+    uint32_t ctrl_[N_CTRL] = {};
+    uint32_t channel_enable_ = channel_enable_all();
+    double time_ns_ = 0.0;
+
+    uint32_t last_boundary_ = 0;
+    uint64_t packet_index_ = 0;      // Packets since reset = frames transmitted
+    uint64_t last_timestamp_ = 0;
+    bool check_data_ = false;
+    std::vector<bool> last_packet_line_ok_;
+    Statistics stats_;
+};
+
+// Centre of the widest run of passing phases, or -1 if none passed
+int pick_phase(const std::vector<bool>& ok) {
+    int best_start = -1;
+    int best_length = 0;
+    for (int start = 0; start < static_cast<int>(ok.size());) {
+        if (!ok[start]) {
+            start++;
+            continue;
+        }
+        int end = start;
+        while (end < static_cast<int>(ok.size()) && ok[end]) {
+            end++;
+        }
+        if (end - start > best_length) {
+            best_start = start;
+            best_length = end - start;
+        }
+        start = end;
+    }
+    return (best_start < 0) ? -1 : best_start + best_length / 2;
+}
+
+void print_statistics(const Statistics& s, int frames, uint32_t frame_idle, uint32_t nchan) {
+    const double seconds = s.clocks / CLOCK_HZ;
+    uint64_t fifo_sum = 0;
+    for (int i = 0; i <= FIFO_DEPTH; i++) {
+        fifo_sum += s.fifo_histogram[i] * i;
+    }
+
+    std::printf("\n=== Acquisition statistics (%d frames, %u idle clocks/frame, %u channels) ===\n",
+                frames, frame_idle, nchan);
+    std::printf("Simulated time:      %.3f ms (%" PRIu64 " clocks)\n", seconds * 1e3, s.clocks);
+    std::printf("Packets:             %" PRIu64 " (%.1f packets/s)\n", s.packets, s.packets / seconds);
+    std::printf("Packet errors:       %" PRIu64 " (%" PRIu64 " format, %" PRIu64 " segment, %" PRIu64 " timestamp)\n",
+                s.packet_errors, s.format_errors, s.segment_errors, s.timestamp_errors);
+    std::printf("BRAM writes:         %" PRIu64 " (%.2f%% of clocks)\n", s.bram_writes,
+                100.0 * s.bram_writes / s.clocks);
+    std::printf("BRAM bytes:          %" PRIu64 " (%.1f bytes/write, %.2f MB/s)\n", s.bram_bytes,
+                s.bram_writes ? static_cast<double>(s.bram_bytes) / s.bram_writes : 0.0,
+                s.bram_bytes / seconds / 1e6);
+    std::printf("FIFO occupancy:      max %u, mean %.3f entries of %d\n", s.fifo_max,
+                static_cast<double>(fifo_sum) / s.clocks, FIFO_DEPTH);
+    std::printf("FIFO full:           %" PRIu64 " clocks\n", s.fifo_full_clocks);
+    std::printf("FIFO histogram:\n");
+    for (int i = 0; i <= FIFO_DEPTH; i++) {
+        if (s.fifo_histogram[i]) {
+            std::printf("  %3d: %10" PRIu64 " (%.3f%%)\n", i, s.fifo_histogram[i],
+                        100.0 * s.fifo_histogram[i] / s.clocks);
+        }
+    }
+}
+
+void print_usage(const char* program) {
+    std::printf("Usage: %s [options]\n", program);
+    std::printf("  --delay-ns <ns>       MISO round trip delay (default 25)\n");
+    std::printf("  --frames <n>          Frames to acquire after the cable test (default 100)\n");
+    std::printf("  --channels <mask>     Channel enable mask (default all)\n");
+    std::printf("  --sequence <name>     convert, init or cable (default convert)\n");
+    std::printf("  --phase <0-23>        Fixed fine phase for every line (default: from cable test)\n");
+    std::printf("  --frame-idle <clocks> Inter-frame idle clocks (default 0 = 30 kS/s)\n");
+    std::printf("  --debug-data          Acquire the PL sine wave instead of CIPO (data not checked)\n");
+    std::printf("  --verbose             Print every mismatching segment\n");
+    std::printf("  --vcd <file>          Write a waveform (needs a --trace build)\n");
+}
+
+bool parse_options(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool has_value = (i + 1 < argc);
+        if (arg == "--delay-ns" && has_value) {
+            options.delay_ns = std::strtod(argv[++i], nullptr);
+        } else if (arg == "--frames" && has_value) {
+            options.frames = std::atoi(argv[++i]);
+        } else if (arg == "--channels" && has_value) {
+            options.channel_enable = std::strtoul(argv[++i], nullptr, 0) & channel_enable_all();
+        } else if (arg == "--sequence" && has_value) {
+            const std::string name = argv[++i];
+            if (name == "convert") {
+                options.sequence = convert_cmd_sequence;
+            } else if (name == "init") {
+                options.sequence = initialization_cmd_sequence;
+            } else if (name == "cable") {
+                options.sequence = cable_length_cmd_sequence;
+            } else {
+                return false;
+            }
+        } else if (arg == "--phase" && has_value) {
+            options.phase = std::atoi(argv[++i]);
+            if (options.phase < 0 || options.phase >= NUM_FINE_PHASES) {
+                return false;
+            }
+        } else if (arg == "--frame-idle" && has_value) {
+            options.frame_idle = std::strtoul(argv[++i], nullptr, 0);
+        } else if (arg == "--debug-data") {
+            options.debug_data = true;
+        } else if (arg == "--verbose") {
+            options.verbose = true;
+        } else if (arg == "--vcd" && has_value) {
+            options.vcd_file = argv[++i];
+        } else if (arg[0] == '+') {
+            // Verilator plusargs
+        } else {
+            return false;
+        }
+    }
+    return options.frames > 0 && options.channel_enable != 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    const std::unique_ptr<VerilatedContext> context{new VerilatedContext};
+    context->commandArgs(argc, argv);
+    Testbench tb(context.get(), options);
+    tb.reset();
+
+    std::printf("RHD2164 x%d, %d SPI port(s), MISO delay %.2f ns\n", N_CIPO, N_SPI_PORTS,
+                options.delay_ns);
+
+    int failures = 0;
+    if (tb.bram_size_words() != BRAM_SIZE_WORDS) {
+        std::printf("ERROR: PL reports a %u word BRAM, testbench expects %u\n", tb.bram_size_words(),
+                    BRAM_SIZE_WORDS);
+        failures++;
+    }
+    std::vector<int> phases(N_CIPO, options.phase);
+
+    if (options.phase < 0) {
+        // Cable test: initialization frame, then one cable-length frame per fine phase
+        std::vector<std::vector<bool>> ok(N_CIPO, std::vector<bool>(NUM_FINE_PHASES, false));
+
+        tb.set_channel_enable(channel_enable_all());
+        tb.set_copi_commands(initialization_cmd_sequence);
+        if (!tb.run_frames(1, false)) {
+            std::printf("ERROR: initialization frame timed out\n");
+            return 1;
+        }
+
+        tb.set_copi_commands(cable_length_cmd_sequence);
+        std::printf("\nPhase ");
+        for (int l = 0; l < N_CIPO; l++) {
+            std::printf(" CIPO%d", l);
+        }
+        std::printf("\n");
+        for (int phase = 0; phase < NUM_FINE_PHASES; phase++) {
+            for (int l = 0; l < N_CIPO; l++) {
+                tb.set_line_phase(l, phase);
+            }
+            if (!tb.run_frames(1, true) || tb.last_packet_line_ok().empty()) {
+                std::printf("ERROR: cable test frame for phase %d was not received\n", phase);
+                return 1;
+            }
+            std::printf("%5d ", phase);
+            for (int l = 0; l < N_CIPO; l++) {
+                ok[l][phase] = tb.last_packet_line_ok()[l];
+                std::printf("  %s  ", ok[l][phase] ? " ok " : " -- ");
+            }
+            std::printf("\n");
+        }
+
+        for (int l = 0; l < N_CIPO; l++) {
+            phases[l] = pick_phase(ok[l]);
+            if (phases[l] < 0) {
+                std::printf("ERROR: no working fine phase for CIPO%d\n", l);
+                failures++;
+                phases[l] = 0;
+            } else {
+                std::printf("CIPO%d: fine phase %d\n", l, phases[l]);
+            }
+        }
+    }
+
+    // Acquisition
+    for (int l = 0; l < N_CIPO; l++) {
+        tb.set_line_phase(l, phases[l]);
+    }
+    tb.set_channel_enable(options.channel_enable);
+    tb.set_copi_commands(options.sequence);
+
+    // Segment errors are expected while sweeping phases; anything else is a failure
+    const Statistics& sweep = tb.stats();
+    if (sweep.format_errors || sweep.timestamp_errors) {
+        failures++;
+    }
+    tb.stats() = Statistics();
+    uint32_t pl_fifo_max = 0;
+    uint32_t pl_unread_max = 0;
+    tb.read_high_water(pl_fifo_max, pl_unread_max);
+    if (!tb.run_frames(options.frames, true)) {
+        std::printf("ERROR: acquisition timed out\n");
+        failures++;
+    }
+    const Statistics& acquisition = tb.stats();
+
+    print_statistics(acquisition, options.frames, options.frame_idle, popcount(options.channel_enable));
+    if (acquisition.packets != static_cast<uint64_t>(options.frames)) {
+        std::printf("ERROR: received %" PRIu64 " packets, expected %d\n", acquisition.packets,
+                    options.frames);
+        failures++;
+    }
+    if (acquisition.packet_errors) {
+        failures++;
+    }
+
+    // Packets are read as soon as they are published, so at most one is ever unread
+    tb.read_high_water(pl_fifo_max, pl_unread_max);
+    const uint32_t words = packet_words(popcount(options.channel_enable));
+    std::printf("PL high-water marks: FIFO %u entries, BRAM %u unread words\n", pl_fifo_max, pl_unread_max);
+    if (pl_fifo_max != acquisition.fifo_max) {
+        std::printf("ERROR: PL FIFO high-water mark %u, testbench saw %u\n", pl_fifo_max, acquisition.fifo_max);
+        failures++;
+    }
+    if (pl_unread_max != words) {
+        std::printf("ERROR: PL BRAM high-water mark %u, expected one %u word packet\n", pl_unread_max, words);
+        failures++;
+    }
+
+    std::printf("\n%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
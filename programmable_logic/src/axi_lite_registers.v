@@ -1,6 +1,6 @@
 module axi_lite_registers #(
-    parameter integer N_CTRL = 22,     // default (22 control regs)
-    parameter integer N_STATUS = 11     // default (11 status regs)
+    parameter integer N_CTRL = 23,     // default (23 control regs)
+    parameter integer N_STATUS = 13     // default (13 status regs)
 )(
     input  wire                     s_axi_aclk,
     input  wire                     s_axi_aresetn,
@@ -35,7 +35,10 @@ module axi_lite_registers #(
     output reg  [32*N_CTRL-1:0]     ctrl_regs_pl,
 
     // Status from PL (data generator status only)
-    input  wire [32*N_STATUS-1:0]   status_regs_pl
+    input  wire [32*N_STATUS-1:0]   status_regs_pl,
+
+    // One pl_clk pulse per AXI read of a status register (for clear-on-read registers)
+    output wire [N_STATUS-1:0]      status_read_pl
     
     // REMOVED: All FIFO-related ports
 );
@@ -190,4 +193,38 @@ always @(posedge s_axi_aclk) begin
     end
 end
 
+// ============================================================================
+// CLOCK DOMAIN CROSSING - STATUS READ PULSES (AXI -> PL)
+// ============================================================================
+
+// A read flips a toggle in the AXI domain; the PL sees the flip after a two-stage
+// synchronizer and turns it back into a single pulse. An AXI read takes at least
+// three AXI clocks, more than one PL clock, so no flip is missed.
+reg [N_STATUS-1:0] status_read_toggle;
+reg [N_STATUS-1:0] status_read_sync1;
+reg [N_STATUS-1:0] status_read_sync2;
+reg [N_STATUS-1:0] status_read_sync3;
+
+always @(posedge s_axi_aclk) begin
+    if (!s_axi_aresetn) begin
+        status_read_toggle <= 0;
+    end else begin
+        status_read_toggle <= status_read_toggle ^ status_read_axi;
+    end
+end
+
+always @(posedge pl_clk) begin
+    if (!pl_rstn) begin
+        status_read_sync1 <= 0;
+        status_read_sync2 <= 0;
+        status_read_sync3 <= 0;
+    end else begin
+        status_read_sync1 <= status_read_toggle;
+        status_read_sync2 <= status_read_sync1;
+        status_read_sync3 <= status_read_sync2;
+    end
+end
+
+assign status_read_pl = status_read_sync2 ^ status_read_sync3;
+
 endmodule
\ No newline at end of file
@@ -1,20 +1,22 @@
 // File: simple_dual_port_bram.sv
 // Simple dual-port BRAM: Port A write-only (data generator), Port B read-only (AXI)
-// Pin-compatible with your existing BRAM interface
+// Asymmetric: Port A writes PORTA_DATA_WIDTH-bit words with byte enables, Port B reads
+// DATA_WIDTH-bit words (the AXI BRAM controller behind the 32-bit GP port)
 
 module simple_dual_port_bram #(
-    parameter int ADDR_WIDTH = 16,    // Byte address width
-    parameter int DATA_WIDTH = 32,    // Data width
-    parameter int DEPTH = 16384       // Memory depth (64KB / 4 bytes = 16K words)
+    parameter int ADDR_WIDTH = 18,    // Byte address width
+    parameter int DATA_WIDTH = 32,    // Port B (read) data width
+    parameter int PORTA_DATA_WIDTH = 64, // Port A (write) data width - multiple of DATA_WIDTH
+    parameter int DEPTH = 65536       // Memory depth in DATA_WIDTH words (256KB / 4 bytes = 64K words)
 )(
     // Port A - Write Only (for data generator)
     input  logic                    porta_clk,
     input  logic                    porta_rst,
     input  logic                    porta_en,
-    input  logic [3:0]              porta_we,
+    input  logic [PORTA_DATA_WIDTH/8-1:0] porta_we,  // Byte enables
     input  logic [ADDR_WIDTH-1:0]   porta_addr,   // Byte address
-    input  logic [DATA_WIDTH-1:0]   porta_din,
-    output logic [DATA_WIDTH-1:0]   porta_dout,   // Not used (write-only)
+    input  logic [PORTA_DATA_WIDTH-1:0] porta_din,
+    output logic [PORTA_DATA_WIDTH-1:0] porta_dout,   // Not used (write-only)
     
     // Port B - Read Only (for AXI interface)
     input  logic                    portb_clk,
@@ -26,40 +28,58 @@ module simple_dual_port_bram #(
     output logic [DATA_WIDTH-1:0]   portb_dout
 );
 
-// Memory array - 32-bit words
-logic [DATA_WIDTH-1:0] memory [0:DEPTH-1];
+localparam int RATIO = PORTA_DATA_WIDTH / DATA_WIDTH;        // Port B words per Port A word
+localparam int RATIO_WIDTH = (RATIO > 1) ? $clog2(RATIO) : 1;
+localparam int WIDE_DEPTH = DEPTH / RATIO;
+
+// Memory array - Port A words
+logic [PORTA_DATA_WIDTH-1:0] memory [0:WIDE_DEPTH-1];
 
 // Convert byte addresses to word addresses
-logic [$clog2(DEPTH)-1:0] porta_word_addr = porta_addr[ADDR_WIDTH-1:2];
-logic [$clog2(DEPTH)-1:0] portb_word_addr = portb_addr[ADDR_WIDTH-1:2];
+wire [$clog2(WIDE_DEPTH)-1:0] porta_word_addr = porta_addr[ADDR_WIDTH-1:$clog2(PORTA_DATA_WIDTH/8)];
+wire [$clog2(DEPTH)-1:0] portb_word_addr = portb_addr[ADDR_WIDTH-1:2];
 
 // Port A - Write Only (for data generator writes)  
 always_ff @(posedge porta_clk) begin
     if (!porta_rst) begin  // Active high reset
-        if (porta_en && |porta_we) begin  // Write if any write enable bits set
-            // Simple write
-            memory[porta_word_addr] <= porta_din;
+        if (porta_en) begin
+            // Byte-enable write
+            for (int b = 0; b < PORTA_DATA_WIDTH/8; b++) begin
+                if (porta_we[b]) begin
+                    memory[porta_word_addr][8*b +: 8] <= porta_din[8*b +: 8];
+                end
+            end
         end
     end
 end
 
 // Port B - Read Only (for AXI reads)
+// Reads the full Port A word and selects the requested DATA_WIDTH word from it
+logic [PORTA_DATA_WIDTH-1:0] portb_wide_dout;
+logic [RATIO_WIDTH-1:0]      portb_select;
+
 always_ff @(posedge portb_clk) begin
     if (portb_rst) begin
-        portb_dout <= '0;
+        portb_wide_dout <= '0;
+        portb_select <= '0;
     end else if (portb_en) begin
         // Simple read with 1-cycle latency
-        portb_dout <= memory[portb_word_addr];
+        portb_wide_dout <= memory[portb_word_addr / RATIO];
+        portb_select <= RATIO_WIDTH'(portb_word_addr % RATIO);
     end
 end
 
+assign portb_dout = portb_wide_dout[DATA_WIDTH*portb_select +: DATA_WIDTH];
+
 // Tie off unused Port A output
 assign porta_dout = '0;
 
 // Initialize memory for testing (optional)
 initial begin
-    for (int i = 0; i < DEPTH; i++) begin
-        memory[i] = i * 4;  // Each word contains its byte address
+    for (int i = 0; i < WIDE_DEPTH; i++) begin
+        for (int j = 0; j < RATIO; j++) begin
+            memory[i][DATA_WIDTH*j +: DATA_WIDTH] = (i * RATIO + j) * 4;  // Each word contains its byte address
+        end
     end
 end
 
@@ -1,9 +1,10 @@
 
 // Verilog wrapper for Vivado compatibility
 module simple_dual_port_bram_wrapper #(
-    parameter integer ADDR_WIDTH = 16,
-    parameter integer DATA_WIDTH = 32,
-    parameter integer DEPTH = 16384
+    parameter integer ADDR_WIDTH = 18,
+    parameter integer DATA_WIDTH = 32,          // Port B (AXI read) width
+    parameter integer PORTA_DATA_WIDTH = 64,    // Port A (data generator write) width
+    parameter integer DEPTH = 65536             // Depth in Port B words
 )(
     // Port A - Write Only (data generator)
     (* X_INTERFACE_INFO = "xilinx.com:interface:bram:1.0 BRAM_PORTA CLK" *)
@@ -13,18 +14,18 @@ module simple_dual_port_bram_wrapper #(
     (* X_INTERFACE_INFO = "xilinx.com:interface:bram:1.0 BRAM_PORTA EN" *)
     input  wire                    porta_en,
     (* X_INTERFACE_INFO = "xilinx.com:interface:bram:1.0 BRAM_PORTA WE" *)
-    input  wire [3:0]              porta_we,
+    input  wire [PORTA_DATA_WIDTH/8-1:0] porta_we,
     (* X_INTERFACE_INFO = "xilinx.com:interface:bram:1.0 BRAM_PORTA ADDR" *)
     input  wire [ADDR_WIDTH-1:0]   porta_addr,
     (* X_INTERFACE_INFO = "xilinx.com:interface:bram:1.0 BRAM_PORTA DIN" *)
-    input  wire [DATA_WIDTH-1:0]   porta_din,
+    input  wire [PORTA_DATA_WIDTH-1:0] porta_din,
     (* X_INTERFACE_INFO = "xilinx.com:interface:bram:1.0 BRAM_PORTA DOUT" *)
-    output wire [DATA_WIDTH-1:0]   porta_dout,
+    output wire [PORTA_DATA_WIDTH-1:0] porta_dout,
     
     // Port B - Read Only (AXI interface)
     (* X_INTERFACE_INFO = "xilinx.com:interface:bram:1.0 BRAM_PORTB CLK" *)
     // We're actually read only, but AXI block expects read write. Oops!
-    (* X_INTERFACE_PARAMETER = "MASTER_TYPE BRAM_CTRL,MEM_SIZE 65536,MEM_WIDTH 32,MEM_ECC NONE,READ_WRITE_MODE READ_WRITE" *)
+    (* X_INTERFACE_PARAMETER = "MASTER_TYPE BRAM_CTRL,MEM_SIZE 262144,MEM_WIDTH 32,MEM_ECC NONE,READ_WRITE_MODE READ_WRITE" *)
     input  wire                    portb_clk,
     (* X_INTERFACE_INFO = "xilinx.com:interface:bram:1.0 BRAM_PORTB RST" *)
     input  wire                    portb_rst,
@@ -44,6 +45,7 @@ module simple_dual_port_bram_wrapper #(
     simple_dual_port_bram #(
         .ADDR_WIDTH(ADDR_WIDTH),
         .DATA_WIDTH(DATA_WIDTH), 
+        .PORTA_DATA_WIDTH(PORTA_DATA_WIDTH),
         .DEPTH(DEPTH)
     ) bram_inst (
         .porta_clk(porta_clk),
@@ -8,58 +8,84 @@
 // 3. Run the data exfiltration state machine. This loads data, prefaced by a
 //    a header and a timestamp, into a FIFO for transmission via the dual port BRAM
 //    to the PS. (FIFO and BRAM are external to this file.)
-
-module data_generator_core (
+//
+// The core drives N_SPI_PORTS headstage ports, each with two CIPO lines. All ports
+// share the same CSn/SCLK/COPI sequence (the wrapper fans these out), so every port
+// is sampled in lockstep and one FIFO entry holds one cycle's data for all lines:
+// line l (= 2*port + {0,1}) occupies fifo_write_data[32*l +: 32] and
+// fifo_channel_mask[2*l +: 2].
+//
+// Port 0 is configured by control register 2. Each additional port p gets its own
+// configuration register after the COPI words (control register 21+p) with the
+// same layout: phase0 [3:0], phase1 [7:4], channel enable [11:8], half steps [13:12].
+
+module data_generator_core #(
+    parameter int N_SPI_PORTS = 1,                      // Number of headstage SPI ports
+    localparam int N_CIPO = 2 * N_SPI_PORTS,            // CIPO lines (two per port)
+    localparam int N_CTRL = 22 + N_SPI_PORTS - 1,       // Control registers (one extra per port)
+    localparam int FIFO_DATA_WIDTH = 32 * N_CIPO,       // One 32-bit word per CIPO line
+    localparam int FIFO_MASK_WIDTH = 2 * N_CIPO         // One bit per 16-bit segment
+)(
     input  logic        clk,
     input  logic        rstn,
     
     // Control and status interfaces
-    input  logic [32*22-1:0] ctrl_regs_pl,
+    input  logic [32*N_CTRL-1:0] ctrl_regs_pl,
     output logic [32*10-1:0]  status_regs_pl,  // Only 10 registers, including mirroring 4 control - wrapper adds 11th
     
-    // FIFO interface (64-bit, gets converted to 32-bit for BRAM)
+    // FIFO interface (32 bits per CIPO line, gets converted to 32-bit for BRAM)
     output logic        fifo_write_en,
-    output logic [63:0] fifo_write_data,
-    output logic [3:0]  fifo_channel_mask,     // Which 16-bit segments are valid
+    output logic [FIFO_DATA_WIDTH-1:0] fifo_write_data,
+    output logic [FIFO_MASK_WIDTH-1:0] fifo_channel_mask,     // Which 16-bit segments are valid
 
     input  logic        fifo_full,
     input  logic [8:0]  fifo_count,
     
     output logic        fifo_packet_end_flag, // gets written with each word. 1 if it's the last word in a packet
         
-    // Serial interface signals
+    // Serial interface signals (shared by all ports)
     output logic        csn,        // Chip select (active low)
     output logic        sclk,       // Serial clock
     output logic        copi,       // Controller Out, Peripheral In
-    input  logic        cipo0,      // Controller In, Peripheral Out 0
-    input  logic        cipo1       // Controller In, Peripheral Out 1
+    input  logic [N_CIPO-1:0] cipo  // Controller In, Peripheral Out - {port N-1 cipo1, cipo0, ..., port 0 cipo1, cipo0}
 );
 
+// Parameter validation
+initial begin
+    if (N_SPI_PORTS < 1 || N_SPI_PORTS > 8) begin
+        $error("N_SPI_PORTS (%d) must be between 1 and 8", N_SPI_PORTS);
+    end
+end
+
+// Control register holding the configuration of port p
+function automatic int port_ctrl_reg(input int p);
+    return (p == 0) ? 2 : (21 + p);
+endfunction
+
 // Extract control bits
-logic enable_transmission = ctrl_regs_pl[0*32 + 0];
+wire enable_transmission = ctrl_regs_pl[0*32 + 0];
 
 // Safe control registers - only updated when transmission is not active
 logic reset_timestamp_reg;
 logic debug_mode_reg;
 logic [31:0] loop_count_reg;
-logic [3:0] phase0_reg;
-logic [3:0] phase1_reg; 
-logic [3:0] channel_enable_reg;
+logic [4:0] phase_reg [0:N_CIPO-1];  // 8x oversampled phase: {4-bit phase, half step}
+logic [FIFO_MASK_WIDTH-1:0] channel_enable_reg;  // 4 bits per port
+logic [31:0] frame_idle_cycles_reg;  // Idle clocks inserted after each frame (sets the sample rate)
 // Protected COPI message words (36 x 16-bit words) - only updated when transmission inactive
 logic [15:0] copi_words_reg [0:35];
 
-// Reserved control registers for future use
-logic [31:0] ctrl_reg_3 = ctrl_regs_pl[3*32 +: 32];  // Reserved for future control
-
 // Safe control register updates - only when transmission is not active
 always_ff @(posedge clk) begin
     if (!rstn) begin
         reset_timestamp_reg <= 1'b0;
         debug_mode_reg <= 1'b0;
         loop_count_reg <= 32'd0;
-        phase0_reg <= 4'd0;
-        phase1_reg <= 4'd0;
-        channel_enable_reg <= 4'b1111;  // Default: all channels enabled
+        for (int l = 0; l < N_CIPO; l++) begin
+            phase_reg[l] <= 5'd0;
+        end
+        channel_enable_reg <= '1;  // Default: all channels enabled
+        frame_idle_cycles_reg <= 32'd0; // Default: no idle period (30 kS/s)
         
         // Initialize COPI words to safe defaults
         for (int j = 0; j < 36; j++) begin
@@ -71,9 +97,12 @@ always_ff @(posedge clk) begin
             reset_timestamp_reg <= ctrl_regs_pl[0*32 + 1];
             debug_mode_reg <= ctrl_regs_pl[0*32 + 3];
             loop_count_reg <= ctrl_regs_pl[1*32 +: 32];
-            phase0_reg <= ctrl_regs_pl[2*32 + 3 : 2*32 + 0];
-            phase1_reg <= ctrl_regs_pl[2*32 + 7 : 2*32 + 4];
-            channel_enable_reg <= ctrl_regs_pl[2*32 + 11 : 2*32 + 8];
+            for (int p = 0; p < N_SPI_PORTS; p++) begin
+                phase_reg[2*p]     <= {ctrl_regs_pl[port_ctrl_reg(p)*32 + 0 +: 4], ctrl_regs_pl[port_ctrl_reg(p)*32 + 12]};
+                phase_reg[2*p + 1] <= {ctrl_regs_pl[port_ctrl_reg(p)*32 + 4 +: 4], ctrl_regs_pl[port_ctrl_reg(p)*32 + 13]};
+                channel_enable_reg[4*p +: 4] <= ctrl_regs_pl[port_ctrl_reg(p)*32 + 8 +: 4];
+            end
+            frame_idle_cycles_reg <= ctrl_regs_pl[3*32 +: 32];
             
             // Update COPI words from control registers 4-21 (18 registers total)
             for (int j = 0; j < 18; j++) begin
@@ -84,27 +113,44 @@ always_ff @(posedge clk) begin
     end
 end
 
-// CIPO received data storage (4 separate 16-bit registers per cycle)
-logic [31:0] cipo0_data [0:34];  // CIPO0 line, register A (low 16 bits) and B (upper 16 bits)
-logic [31:0] cipo1_data [0:34];  // CIPO1 line, register A
-
-// Registers for COPI data from CIPO 0 and CIPO 1
-reg [73:0] cipo0_4x_oversampled;
-reg [73:0] cipo1_4x_oversampled;
-reg [31:0] cipo0_phase_selected;
-reg [31:0] cipo1_phase_selected;
-
-// Instantiate phase selector modules that correct for CIPO delay because of long cable length
-CIPO_combined_phase_selector cipo0_selector(
-    .phase_select(phase0_reg),
-    .CIPO4x(cipo0_4x_oversampled),
-    .CIPO(cipo0_phase_selected)
-);
-CIPO_combined_phase_selector cipo1_selector(
-    .phase_select(phase1_reg),
-    .CIPO4x(cipo1_4x_oversampled),
-    .CIPO(cipo1_phase_selected)
-);
+// CIPO received data storage (one 32-bit word per line per cycle)
+logic [31:0] cipo_data [0:N_CIPO-1][0:34];  // Register A (low 16 bits) and B (upper 16 bits)
+
+// CIPO lines are captured on both edges of the 84 MHz clock (8x the 21 MHz SCLK).
+// IDDR in SAME_EDGE_PIPELINED mode presents the rising-edge sample (Q1) and the
+// following falling-edge sample (Q2) together, two clocks after the rising edge.
+logic [1:0] cipo_ddr [0:N_CIPO-1];  // [0] = rising edge sample, [1] = falling edge sample
+
+// Registers for COPI data from each CIPO line
+reg [147:0] cipo_8x_oversampled [0:N_CIPO-1];
+reg [31:0] cipo_phase_selected [0:N_CIPO-1];
+
+genvar gl;
+generate
+    for (gl = 0; gl < N_CIPO; gl++) begin : cipo_line
+        IDDR #(
+            .DDR_CLK_EDGE("SAME_EDGE_PIPELINED"),
+            .INIT_Q1(1'b0),
+            .INIT_Q2(1'b0),
+            .SRTYPE("SYNC")
+        ) cipo_iddr (
+            .Q1(cipo_ddr[gl][0]),
+            .Q2(cipo_ddr[gl][1]),
+            .C(clk),
+            .CE(1'b1),
+            .D(cipo[gl]),
+            .R(1'b0),
+            .S(1'b0)
+        );
+
+        // Phase selector corrects for CIPO delay because of long cable length
+        CIPO_combined_phase_selector cipo_selector(
+            .phase_select(phase_reg[gl]),
+            .CIPO8x(cipo_8x_oversampled[gl]),
+            .CIPO(cipo_phase_selected[gl])
+        );
+    end
+endgenerate
 
 // Control counters
 logic [6:0] state_counter;
@@ -121,6 +167,12 @@ logic        transmission_active;
 logic        loop_limit_reached;
 logic [31:0] loop_counter;
 
+// Programmable sample rate: after the last state of the last cycle the state machine
+// can hold for frame_idle_cycles_reg clocks before starting the next frame.
+// Frame period = 80 * 35 + frame_idle_cycles_reg clocks (2800 clocks = 30 kS/s at 84 MHz)
+logic [31:0] frame_idle_counter;
+logic        frame_idle;
+
 // Debug mode sine wave table index
 logic [8:0] dummy_data_index;
 // Debug mode 512-entry sine lookup table (signed 16-bit values)
@@ -137,9 +189,9 @@ initial begin
 end
 
 // Helper signals for state machine logic
-logic is_last_state = (state_counter == 7'd79);
-logic is_first_cycle = (cycle_counter == 6'd0);
-logic is_last_cycle = (cycle_counter == 6'd34);
+wire is_last_state = (state_counter == 7'd79);
+wire is_first_cycle = (cycle_counter == 6'd0);
+wire is_last_cycle = (cycle_counter == 6'd34);
 
 // State machine and control logic 
 always_ff @(posedge clk) begin
@@ -150,6 +202,14 @@ always_ff @(posedge clk) begin
         transmission_active <= 1'b0;
         loop_limit_reached <= 1'b0;
         loop_counter <= 32'd1; // 1 indexed
+        frame_idle_counter <= 32'd0;
+        frame_idle <= 1'b0;
+    end else if (frame_idle) begin
+        // Inter-frame idle period - counters hold at the start of the next frame
+        if (frame_idle_counter <= 32'd1) begin
+            frame_idle <= 1'b0;
+        end
+        frame_idle_counter <= frame_idle_counter - 1;
     end else begin        
         // State machine goes from 0 to 79, then repeats
         if (is_last_state) begin
@@ -157,6 +217,11 @@ always_ff @(posedge clk) begin
             if (is_last_cycle) begin
                 cycle_counter <= 6'd0;
 
+                if (frame_idle_cycles_reg != 32'd0) begin
+                    frame_idle <= 1'b1;
+                    frame_idle_counter <= frame_idle_cycles_reg;
+                end
+
                 if (!enable_transmission && reset_timestamp_reg) begin
                     timestamp <= 64'd0;
                 end else begin
@@ -173,7 +238,9 @@ always_ff @(posedge clk) begin
                         transmission_active <= 1'b0;
                     end
                     loop_counter <= loop_counter + 1;
-                    loop_limit_reached <= (loop_count_reg != 32'd0) && (loop_counter >= loop_count_reg);
+                    // The frame starting now is number loop_counter + 1 - it is the last one
+                    // when that reaches the loop count
+                    loop_limit_reached <= (loop_count_reg != 32'd0) && (loop_counter + 32'd1 >= loop_count_reg);
 
                 end else begin // transmission is not currently active
                     if (enable_transmission && !loop_limit_reached) begin
@@ -225,10 +292,10 @@ State 72: CSn=1, SCLK=0, COPI=0 (continue to read in data from CIPO)
 State 73: CSn=1, SCLK=0, COPI=0 (continue to read in data from CIPO) 
 State 74: CSn=1, SCLK=0, COPI=0 (continue to read in data from CIPO) 
 State 75: CSn=1, SCLK=0, COPI=0 (continue to read in data from CIPO)  
-State 76: CSn=1, SCLK=0, COPI=0 (register buffer data from phase selector)
-State 77: CSn=1, SCLK=0, COPI=0 (inactive) [fifo enqueue 64b of combined CIPO data]
-State 78: CSn=1, SCLK=0, COPI=0 (inactive)
-State 79: CSn=1, SCLK=0, COPI=0 (inactive)
+State 76: CSn=1, SCLK=0, COPI=0 (latch IDDR output - 2 clocks of IDDR latency)
+State 77: CSn=1, SCLK=0, COPI=0 (latch IDDR output - last samples of state 75)
+State 78: CSn=1, SCLK=0, COPI=0 (register buffer data from phase selector)
+State 79: CSn=1, SCLK=0, COPI=0 (inactive) [fifo enqueue combined CIPO data, 32b per line]
 
 Key Timing:
 - CSn active: States 0-65 (66 states total)  
@@ -237,6 +304,9 @@ Key Timing:
 - Last falling edge: State 64
 - CSn goes HIGH: State 66
 - Inactive period: States 66-79 (14 states)
+- CIPO sampled on both clock edges during states 2-75 (148 samples), latched from the
+  IDDRs during states 4-77
+- Optional inter-frame idle (frame_idle) after state 79 of cycle 34: CSn=1, SCLK=0, COPI=0
 */
 
 // Serial interface control - CSn, SCLK, and COPI generation 
@@ -251,7 +321,7 @@ always_ff @(posedge clk) begin
         sclk <= 1'b0;          // SCLK low when not active
         copi <= 1'b0;          // COPI low when not active
         
-        if (transmission_active) begin
+        if (transmission_active && !frame_idle) begin
             if (state_counter <= 7'd65) begin
                 // CSn goes low during protocol (states 0-65)
                 csn <= 1'b0;
@@ -267,7 +337,8 @@ always_ff @(posedge clk) begin
             // Uses copi_words_reg[cycle_counter] as the source for each cycle's transmission  
             // Bit index is just the bitwise NOT of state_counter[5:2] (since 15-x = ~x for 4-bit x)
             if  (state_counter <= 7'd63) begin //removed part of conditional
-                logic [3:0] bit_index = ~state_counter[5:2];  // MSB first: ~0=15, ~1=14, ..., ~15=0
+                logic [3:0] bit_index;
+                bit_index = ~state_counter[5:2];  // MSB first: ~0=15, ~1=14, ..., ~15=0
                 copi <= copi_words_reg[cycle_counter][bit_index];
             end
             
@@ -275,23 +346,26 @@ always_ff @(posedge clk) begin
     end
 end
 
-// CIPO data sampling - 4 registers total (2 per input line)
+// CIPO data sampling - 2 registers per input line
 always_ff @(posedge clk) begin
     if (!rstn) begin
         // Reset all received data
-        for (int j = 0; j < 35; j++) begin
-            cipo0_data[j] <= 32'h0;
-            cipo1_data[j] <= 32'h0;
+        for (int l = 0; l < N_CIPO; l++) begin
+            for (int j = 0; j < 35; j++) begin
+                cipo_data[l][j] <= 32'h0;
+            end
+            cipo_8x_oversampled[l] <= 148'h0;
         end
-        cipo0_4x_oversampled <= 74'h0;
-        cipo1_4x_oversampled <= 74'h0;
     end else begin
-        if (transmission_active && (state_counter >= 7'd2) && (state_counter <= 75)) begin
-            cipo0_4x_oversampled[state_counter - 2] <= cipo0; // Latch data into the phase selector input
-            cipo1_4x_oversampled[state_counter - 2] <= cipo1;
-        end else if(transmission_active && state_counter == 7'd76) begin
-            cipo0_data[cycle_counter] <= cipo0_phase_selected; // Get the phase selector output
-            cipo1_data[cycle_counter] <= cipo1_phase_selected; // It's ready one clock cycle after being latched in
+        if (transmission_active && !frame_idle && (state_counter >= 7'd4) && (state_counter <= 7'd77)) begin
+            // IDDR output at state N holds the samples from state N-2 (rising edge, then falling edge)
+            for (int l = 0; l < N_CIPO; l++) begin
+                cipo_8x_oversampled[l][2*(state_counter - 4) +: 2] <= cipo_ddr[l]; // Latch data into the phase selector input
+            end
+        end else if(transmission_active && !frame_idle && state_counter == 7'd78) begin
+            for (int l = 0; l < N_CIPO; l++) begin
+                cipo_data[l][cycle_counter] <= cipo_phase_selected[l]; // Get the phase selector output
+            end                                                        // It's ready one clock cycle after being latched in
         end
     end
 end
@@ -300,8 +374,8 @@ end
 always_ff @(posedge clk) begin
     if (!rstn) begin
         fifo_write_en <= 1'b0;
-        fifo_write_data <= 64'h0;
-        fifo_channel_mask <= 4'h0;
+        fifo_write_data <= '0;
+        fifo_channel_mask <= '0;
         packets_sent <= 32'd0;
         fifo_packet_end_flag <= 1'b0;
 
@@ -310,34 +384,36 @@ always_ff @(posedge clk) begin
         // Default: no FIFO write
         fifo_write_en <= 1'b0;
         
-        if (transmission_active && !fifo_full) begin
+        if (transmission_active && !frame_idle && !fifo_full) begin
             // Header writes (first cycle only) - always fully valid
             if (state_counter inside {7'd0, 7'd1}) begin
                 if (is_first_cycle) begin
                     fifo_write_en <= 1'b1;
-                    fifo_channel_mask <= 4'b1111;  // Header is always fully valid
+                    fifo_channel_mask <= FIFO_MASK_WIDTH'(4'b1111);  // Header is always 64 bits, fully valid
                     fifo_packet_end_flag <= 1'b0;  // Header words are never at the end
                     case (state_counter)
-                        7'd0: fifo_write_data <= {MAGIC_NUMBER_HIGH, MAGIC_NUMBER_LOW}; // magic number
-                        7'd1: fifo_write_data <= timestamp;
+                        7'd0: fifo_write_data <= FIFO_DATA_WIDTH'({MAGIC_NUMBER_HIGH, MAGIC_NUMBER_LOW}); // magic number
+                        7'd1: fifo_write_data <= FIFO_DATA_WIDTH'(timestamp);
                     endcase
                 end
             end 
             
-            // Data writes - Pack both CIPO lines into single 64-bit write with channel mask
-            if (state_counter == 7'd77) begin
+            // Data writes - Pack all CIPO lines into a single FIFO write with channel mask
+            if (state_counter == 7'd79) begin
                 fifo_write_en <= 1'b1;
                 fifo_channel_mask <= channel_enable_reg;  // Use current channel enable settings
                 fifo_packet_end_flag <= is_last_cycle;    // Only last cycle's data word ends the packet
                 
                 if (!debug_mode_reg) begin
-                    // Pack real CIPO data: CIPO1 in upper 32 bits, CIPO0 in lower 32 bits
-                    fifo_write_data <= {cipo1_data[cycle_counter], cipo0_data[cycle_counter]};
+                    // Pack real CIPO data: line l in bits [32*l +: 32]
+                    for (int l = 0; l < N_CIPO; l++) begin
+                        fifo_write_data[32*l +: 32] <= cipo_data[l][cycle_counter];
+                    end
                 end else begin
                     // Load debug data with sine wave data
                     logic [5:0] channel_offset;  // Only needs 6 bits for values 0-32
-                    logic [15:0] cipo0_regular_val, cipo0_ddr_val, cipo1_regular_val, cipo1_ddr_val;
                     logic [8:0] base_phase;         // index into 512-entry LUT
+                    logic [8:0] port_phase;
                     
                     // Calculate base sample index (0-32 for cycles 2-34)
                     channel_offset = (cycle_counter >= 6'd2) ? (cycle_counter - 6'd2) : 6'd0;
@@ -345,14 +421,15 @@ always_ff @(posedge clk) begin
                     // Base phase for this sample (9 bits total)
                     base_phase = dummy_data_index + channel_offset;
                     
-                    // Generate sine values with frequency multiplication using left shifts
-                    cipo0_regular_val = sine_lut[base_phase];                       // 1× = 58.6 Hz
-                    cipo0_ddr_val     = sine_lut[(base_phase << 1) & 9'h1FF];       // 2× = 117.2 Hz  
-                    cipo1_regular_val = sine_lut[(base_phase << 2) & 9'h1FF];       // 4× = 234.4 Hz
-                    cipo1_ddr_val     = sine_lut[(base_phase << 3) & 9'h1FF];       // 8× = 468.8 Hz
-                    
-                    // Pack debug data: CIPO1 in upper 32 bits, CIPO0 in lower 32 bits
-                    fifo_write_data <= {{cipo1_ddr_val, cipo1_regular_val}, {cipo0_ddr_val, cipo0_regular_val}};
+                    // Generate sine values with frequency multiplication using left shifts.
+                    // Within a port: CIPO0 regular 1× = 58.6 Hz, CIPO0 DDR 2×, CIPO1 regular 4×,
+                    // CIPO1 DDR 8× = 468.8 Hz. Each further port is offset by 1/8 period.
+                    for (int p = 0; p < N_SPI_PORTS; p++) begin
+                        port_phase = base_phase + 9'(64 * p);
+                        for (int s = 0; s < 4; s++) begin
+                            fifo_write_data[64*p + 16*s +: 16] <= sine_lut[(port_phase << s) & 9'h1FF];
+                        end
+                    end
                 end
             end
                     
@@ -375,18 +452,21 @@ assign status_regs_pl[0*32 +: 32] = {
     cycle_counter,        // [16:11] - 6 bits
     1'b0,                 // [10] - reserved  
     state_counter,        // [9:3] - 7 bits
-    1'b0,                 // [2] - reserved for future flags
+    frame_idle,           // [2] - 1 bit (inter-frame idle period)
     loop_limit_reached,   // [1] - 1 bit
     transmission_active   // [0] - 1 bit
 };
 
-// Status Register 1: Reflected control parameters (registered versions)
+// Status Register 1: Reflected control parameters (registered versions, port 0).
+// The configuration of ports 1 and up can be read back from their control registers.
 assign status_regs_pl[1*32 +: 32] = {
     8'd0,                 // [31:24] - reserved
-    channel_enable_reg,   // [23:20] - 4 bits
-    phase1_reg,           // [19:16] - 4 bits
-    phase0_reg,           // [15:12] - 4 bits  
-    8'd0,                 // [11:4] - reserved
+    channel_enable_reg[3:0], // [23:20] - 4 bits (port 0)
+    phase_reg[1][4:1],    // [19:16] - 4 bits (port 0 phase1)
+    phase_reg[0][4:1],    // [15:12] - 4 bits (port 0 phase0)
+    6'd0,                 // [11:6] - reserved
+    phase_reg[1][0],      // [5] - 1 bit (phase1 half step)
+    phase_reg[0][0],      // [4] - 1 bit (phase0 half step)
     debug_mode_reg,       // [3] - 1 bit
     1'b0,                 // [2] - reserved
     reset_timestamp_reg,  // [1] - 1 bit
@@ -400,7 +480,7 @@ assign status_regs_pl[5*32 +: 32] = loop_count_reg;
 assign status_regs_pl[6*32 +: 32] = ctrl_regs_pl[0*32 +: 32]; // reflected
 assign status_regs_pl[7*32 +: 32] = ctrl_regs_pl[1*32 +: 32]; // reflected
 assign status_regs_pl[8*32 +: 32] = ctrl_regs_pl[2*32 +: 32]; // reflected
-assign status_regs_pl[9*32 +: 32] = ctrl_regs_pl[3*32 +: 32]; // reflected
+assign status_regs_pl[9*32 +: 32] = ctrl_regs_pl[3*32 +: 32]; // reflected (frame idle cycles)
 
 // Status register 11 will be added by wrapper
 
@@ -1,12 +1,29 @@
 // File: data_generator_bram_blk.v
 // Clean Verilog wrapper that combines data generator and FIFO-BRAM interface
+//
+// Port 0 is exposed on the intan_spi interface. With N_SPI_PORTS > 1 the remaining
+// ports use the *_ext vectors (bit p-1 / bits 2(p-1)+1:2(p-1) for port p); CSn, SCLK
+// and COPI are the same signal on every port. ctrl_regs_pl grows by one register per
+// extra port, followed by the PS read pointer, so axi_lite_registers N_CTRL must be
+// set to 22 + N_SPI_PORTS.
+//
+// Status register 11 holds the FIFO and BRAM high-water marks and is cleared when
+// the PS reads it (status_read_pl from axi_lite_registers).
+//
+// BRAM_DEPTH_WORDS sets the size of the BRAM ring and is reported in status register
+// 12, so the PS can check it against its own build. Word addresses in status
+// registers 10 and 11 are 18 bits wide whatever the depth. The XC7Z020 has 140
+// RAMB36 of 1K x 32 bits, so the ring can take up to 140K words; the default 64K
+// words leaves 76 of them for the rest of the design.
 
 module data_generator #(
+    // Headstage configuration
+    parameter integer N_SPI_PORTS = 1,            // Number of headstage SPI ports (1-8)
     // BRAM configuration parameters
-    parameter integer BRAM_ADDR_WIDTH = 16,        // Byte address width  
-    parameter integer BRAM_DATA_WIDTH = 32,        // Data width
-    parameter integer BRAM_DEPTH_WORDS = 16384,   // BRAM depth in words (64KB / 4 = 16K words)
-    parameter integer FIFO_DEPTH = 256,           // FIFO depth (64-bit entries)
+    parameter integer BRAM_ADDR_WIDTH = 18,        // Byte address width
+    parameter integer BRAM_DATA_WIDTH = 64,        // Write data width (BRAM port A)
+    parameter integer BRAM_DEPTH_WORDS = 65536,   // BRAM depth in 32-bit words (256KB / 4 = 64K words)
+    parameter integer FIFO_DEPTH = 256,           // FIFO depth (entries of 64 bits per port)
     parameter integer BUFFER_DEPTH = 16           // Segment buffer depth for selective copying
 )(
     (* X_INTERFACE_INFO = "xilinx.com:signal:clock:1.0 CLK CLK" *)
@@ -17,10 +34,11 @@ module data_generator #(
     input  wire        rstn,
     
     // Control and status interfaces
-    input  wire [32*22-1:0] ctrl_regs_pl,
-    output wire [32*11-1:0]  status_regs_pl,
+    input  wire [32*(22+N_SPI_PORTS)-1:0] ctrl_regs_pl,
+    output wire [32*13-1:0]  status_regs_pl,
+    input  wire [12:0]       status_read_pl,
     
-    // BRAM Port A interface (32-bit)
+    // BRAM Port A interface (64-bit write with byte enables)
     (* X_INTERFACE_INFO = "xilinx.com:interface:bram:1.0 BRAM_PORTA CLK" *)
     output wire            bram_clk,
     (* X_INTERFACE_INFO = "xilinx.com:interface:bram:1.0 BRAM_PORTA RST" *)
@@ -34,7 +52,7 @@ module data_generator #(
     (* X_INTERFACE_INFO = "xilinx.com:interface:bram:1.0 BRAM_PORTA EN" *)
     output wire            bram_en,
     (* X_INTERFACE_INFO = "xilinx.com:interface:bram:1.0 BRAM_PORTA WE" *)
-    output wire [3:0]      bram_we,
+    output wire [BRAM_DATA_WIDTH/8-1:0] bram_we,
     
     // Serial interface signals
     (* X_INTERFACE_INFO = "kemerelab.org:intan:intan_spi:1.0 intan_spi csn" *)
@@ -51,21 +69,42 @@ module data_generator #(
 
     (* X_INTERFACE_INFO = "kemerelab.org:intan:intan_spi:1.0 intan_spi cipo1" *)
     (* X_INTERFACE_PARAMETER = "ASSOCIATED_BUSIF intan_spi, ASSOCIATED_RESET rst_n, ASSOCIATED_CLKEN clk" *)
-    input  wire        cipo1       // Controller In, Peripheral Out 1
+    input  wire        cipo1,      // Controller In, Peripheral Out 1
+
+    // Additional headstage ports 1..N_SPI_PORTS-1 (unused when N_SPI_PORTS = 1)
+    output wire [((N_SPI_PORTS > 1) ? N_SPI_PORTS - 1 : 1) - 1:0]       csn_ext,
+    output wire [((N_SPI_PORTS > 1) ? N_SPI_PORTS - 1 : 1) - 1:0]       sclk_ext,
+    output wire [((N_SPI_PORTS > 1) ? N_SPI_PORTS - 1 : 1) - 1:0]       copi_ext,
+    input  wire [2*((N_SPI_PORTS > 1) ? N_SPI_PORTS - 1 : 1) - 1:0]     cipo_ext  // {cipo1, cipo0} per port
 
 );
 
+    localparam integer N_CIPO = 2 * N_SPI_PORTS;
+    localparam integer WORD_ADDR_WIDTH = $clog2(BRAM_DEPTH_WORDS);
+    localparam integer BRAM_MAX_WORDS = 140 * 1024;     // All RAMB36 of the XC7Z020
+    localparam [3:0] N_SPI_PORTS_FIELD = N_SPI_PORTS;
+
     // Parameter validation
     initial begin
         if (BRAM_DEPTH_WORDS > (1 << (BRAM_ADDR_WIDTH - 2))) begin
             $error("BRAM_DEPTH_WORDS (%d) exceeds address space (%d words)", 
                    BRAM_DEPTH_WORDS, (1 << (BRAM_ADDR_WIDTH - 2)));
         end
-        // Note: Packet size is variable depending on channel enable settings
-        // Minimum: 2 header + 17 data words (if only 1 channel active) = 19 x 64-bit words 
-        // Maximum: 2 header + 35 data words (if all channels active) = 37 x 64-bit words
+        if (BRAM_DEPTH_WORDS > BRAM_MAX_WORDS) begin
+            $error("BRAM_DEPTH_WORDS (%d) exceeds the block RAM of the XC7Z020 (%d words)",
+                   BRAM_DEPTH_WORDS, BRAM_MAX_WORDS);
+        end
+        if ((BRAM_DEPTH_WORDS % (BRAM_DATA_WIDTH / 32)) != 0) begin
+            $error("BRAM_DEPTH_WORDS (%d) must be a whole number of %d-bit BRAM words",
+                   BRAM_DEPTH_WORDS, BRAM_DATA_WIDTH);
+        end
+        if (N_SPI_PORTS < 1 || N_SPI_PORTS > 8) begin
+            $error("N_SPI_PORTS (%d) must be between 1 and 8", N_SPI_PORTS);
+        end
+        // Note: Packet size is variable depending on channel enable settings, but every
+        // packet is 2 header + 35 data FIFO entries (entries are 64 bits per port wide)
         if (FIFO_DEPTH < 37) begin  
-            $warning("FIFO_DEPTH (%d) is smaller than maximum packet size (37 x 64-bit words) - may cause flow control issues", 
+            $warning("FIFO_DEPTH (%d) is smaller than maximum packet size (37 FIFO entries) - may cause flow control issues", 
                      FIFO_DEPTH);
         end
         if ((BUFFER_DEPTH & (BUFFER_DEPTH - 1)) != 0) begin
@@ -80,37 +119,64 @@ module data_generator #(
     
     // FIFO interface signals
     wire        fifo_write_en;
-    wire [63:0] fifo_write_data;
-    wire [3:0]  fifo_channel_mask;      // Channel metadata for selective copying
+    wire [32*N_CIPO-1:0] fifo_write_data;
+    wire [2*N_CIPO-1:0]  fifo_channel_mask;      // Channel metadata for selective copying
     wire        fifo_packet_end_flag;   // Channel metadata for tagging packets
     wire        fifo_full;
     wire [8:0]  fifo_count;
-    wire [13:0] current_bram_address;
+    wire [WORD_ADDR_WIDTH-1:0] current_bram_address;
+    wire [8:0]  fifo_count_max;
+    wire [WORD_ADDR_WIDTH-1:0] bram_unread_max;
+
+    // Word addresses as reported in status registers 10 and 11 (zero extended)
+    wire [17:0] status_bram_address = current_bram_address;
+    wire [17:0] status_unread_max = bram_unread_max;
+
+    // PS read pointer (32-bit word address), the control register after the ports
+    wire [WORD_ADDR_WIDTH-1:0] ps_read_address = ctrl_regs_pl[32*(21+N_SPI_PORTS) +: WORD_ADDR_WIDTH];
     
     // Data generator status (only 10 registers - wrapper adds 11th)
     wire [32*10-1:0] data_gen_status;
 
+    // CIPO lines of all ports, port 0 in the low bits
+    wire [N_CIPO-1:0] cipo_all;
+
+    generate
+        if (N_SPI_PORTS > 1) begin : extra_ports
+            assign cipo_all = {cipo_ext, cipo1, cipo0};
+            assign csn_ext  = {(N_SPI_PORTS - 1){csn}};
+            assign sclk_ext = {(N_SPI_PORTS - 1){sclk}};
+            assign copi_ext = {(N_SPI_PORTS - 1){copi}};
+        end else begin : no_extra_ports
+            assign cipo_all = {cipo1, cipo0};
+            assign csn_ext  = 1'b1;
+            assign sclk_ext = 1'b0;
+            assign copi_ext = 1'b0;
+        end
+    endgenerate
+
     // Instantiate the data generator core
-    data_generator_core data_gen_inst (
+    data_generator_core #(
+        .N_SPI_PORTS(N_SPI_PORTS)
+    ) data_gen_inst (
         .clk(clk),
         .rstn(rstn),
-        .ctrl_regs_pl(ctrl_regs_pl),
+        .ctrl_regs_pl(ctrl_regs_pl[32*(21+N_SPI_PORTS)-1:0]),
         .status_regs_pl(data_gen_status),  // Only 10 registers
         
         // FIFO interface
         .fifo_write_en(fifo_write_en),
-        .fifo_write_data(fifo_write_data),          // 64-bit data
-        .fifo_channel_mask(fifo_channel_mask),      // 4-bit channel metadata
+        .fifo_write_data(fifo_write_data),          // 32 bits per CIPO line
+        .fifo_channel_mask(fifo_channel_mask),      // 2 bits per CIPO line
         .fifo_full(fifo_full),
-        .fifo_count(fifo_count),                    // Count of 64-bit entries
+        .fifo_count(fifo_count),                    // Count of FIFO entries
         .fifo_packet_end_flag(fifo_packet_end_flag),
         
         // Serial interface
         .csn(csn),
         .sclk(sclk),
         .copi(copi),
-        .cipo0(cipo0),
-        .cipo1(cipo1)
+        .cipo(cipo_all)
     );
 
     // Instantiate the FIFO-BRAM interface
@@ -118,21 +184,28 @@ module data_generator #(
         .BRAM_ADDR_WIDTH(BRAM_ADDR_WIDTH),
         .BRAM_DATA_WIDTH(BRAM_DATA_WIDTH),
         .BRAM_DEPTH_WORDS(BRAM_DEPTH_WORDS),
-        .FIFO_DEPTH(FIFO_DEPTH)
+        .FIFO_DEPTH(FIFO_DEPTH),
+        .N_CHUNKS(N_CIPO)
     ) fifo_bram_inst (
         .clk(clk),
         .rstn(rstn),
         
-        // FIFO interface - 64-bit with additional metadata
+        // FIFO interface - one 32-bit chunk per CIPO line with additional metadata
         .fifo_write_en(fifo_write_en),
-        .fifo_write_data(fifo_write_data),          // 64-bit data
-        .fifo_channel_mask(fifo_channel_mask),      // 4-bit channel metadata
+        .fifo_write_data(fifo_write_data),          // 32 bits per CIPO line
+        .fifo_channel_mask(fifo_channel_mask),      // 2 bits per CIPO line
         .fifo_full(fifo_full),
-        .fifo_count(fifo_count),                    // Count of 64-bit entries
+        .fifo_count(fifo_count),                    // Count of FIFO entries
         .fifo_packet_end_flag(fifo_packet_end_flag),
         .current_bram_address(current_bram_address),
+
+        // High-water marks, cleared by a PS read of status register 11
+        .ps_read_address(ps_read_address),
+        .high_water_clear(status_read_pl[11]),
+        .fifo_count_max(fifo_count_max),
+        .bram_unread_max(bram_unread_max),
         
-        // BRAM interface (stays 32-bit)
+        // BRAM interface (64-bit writes, PS reads 32-bit words)
         .bram_addr(bram_addr),
         .bram_din(bram_din),
         .bram_en(bram_en),
@@ -142,7 +215,7 @@ module data_generator #(
     );
     
     // Combine status registers in wrapper
-    // Clean separation: data generator owns 0-9, wrapper adds FIFO/BRAM status as 10
+    // Clean separation: data generator owns 0-9, wrapper adds FIFO/BRAM status as 10-12
     assign status_regs_pl[0*32 +: 32] = data_gen_status[0*32 +: 32];  // Generator status 0 
     assign status_regs_pl[1*32 +: 32] = data_gen_status[1*32 +: 32];  // Generator status 1  
     assign status_regs_pl[2*32 +: 32] = data_gen_status[2*32 +: 32];  // Generator status 2
@@ -154,6 +227,8 @@ module data_generator #(
     assign status_regs_pl[8*32 +: 32] = data_gen_status[8*32 +: 32];  // Generator status 8
     assign status_regs_pl[9*32 +: 32] = data_gen_status[9*32 +: 32];  // Generator status 9
 
-    assign status_regs_pl[10*32 +: 32] = {9'd0, fifo_count, current_bram_address}; // FIFO + BRAM status
+    assign status_regs_pl[10*32 +: 32] = {1'b0, N_SPI_PORTS_FIELD, fifo_count, status_bram_address}; // Port count + FIFO + BRAM status
+    assign status_regs_pl[11*32 +: 32] = {5'd0, fifo_count_max, status_unread_max};  // High-water marks, same layout as 10
+    assign status_regs_pl[12*32 +: 32] = BRAM_DEPTH_WORDS;                        // BRAM ring depth in 32-bit words
 
 endmodule
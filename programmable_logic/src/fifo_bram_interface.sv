@@ -1,88 +1,120 @@
 // File: fifo_bram_interface.sv
-// FIFO stores 64-bit words + 4-bit channel metadata, BRAM writes 32-bit words
-// 3-state FSM: PROCESS_CHUNK (with chunk_index), FINALIZE_PACKET
+// FIFO stores N_CHUNKS x 32-bit words + 2-bit channel metadata per chunk, BRAM writes
+// BRAM_DATA_WIDTH-bit words (64-bit by default) with byte enables.
+// Lane packer: each FIFO entry is processed 64 bits (4 x 16-bit segments) per clock.
+// Enabled segments are compacted into 16-bit lanes of an accumulator word which is
+// written to BRAM as soon as it is full, so the BRAM sees at most one full-width write
+// per clock regardless of the channel mask.
+// 2-state FSM: PROCESS_SLICE (with slice_index), FINALIZE_PACKET
+//
+// Packets stay aligned to 32-bit words: an odd number of segments is padded with one
+// zero segment at the packet end. A packet may therefore end half way through a BRAM
+// word - that partial word is written with only its low byte enables set, and the next
+// packet fills the remaining lanes of the same word with the complementary enables.
+//
+// High-water marks: the largest FIFO count and the largest distance from the PS read
+// pointer to the packet boundary (words the PS has not read yet) since the last
+// clear. A clear restarts both from their current values, so a level that is still
+// there when the PS reads the marks shows up again in the next read.
 
 module fifo_bram_interface #(
-    parameter int BRAM_ADDR_WIDTH = 16,        // Byte address width
-    parameter int BRAM_DATA_WIDTH = 32,        // Data width
+    parameter int BRAM_ADDR_WIDTH = 18,        // Byte address width
+    parameter int BRAM_DATA_WIDTH = 64,        // Write data width (power of 2, >= 64)
     parameter int FIFO_DEPTH = 256,           // FIFO depth (entries)
-    parameter int BRAM_DEPTH_WORDS = 16384    // BRAM depth in words (64KB / 4 = 16K words)
+    parameter int BRAM_DEPTH_WORDS = 65536,   // BRAM depth in 32-bit words (256KB / 4 = 64K words)
+    parameter int N_CHUNKS = 2,               // 32-bit chunks per FIFO entry (one per CIPO line)
+    localparam int WORD_ADDR_WIDTH = $clog2(BRAM_DEPTH_WORDS),   // 32-bit word address width
+    localparam int FIFO_DATA_WIDTH = 32 * N_CHUNKS,
+    localparam int FIFO_MASK_WIDTH = 2 * N_CHUNKS
 )(
     input  logic        clk,
     input  logic        rstn,
-    
+
     // FIFO interface (input side)
     input  logic        fifo_write_en,
-    input  logic [63:0] fifo_write_data,      // 64-bit data
-    input  logic [3:0]  fifo_channel_mask,    // Which 16-bit segments are valid (travels along with every fifo word)
+    input  logic [FIFO_DATA_WIDTH-1:0] fifo_write_data,      // 32 bits per chunk
+    input  logic [FIFO_MASK_WIDTH-1:0] fifo_channel_mask,    // Which 16-bit segments are valid (travels along with every fifo word)
     input logic         fifo_packet_end_flag, // Signals end of packet (travels along with every fifo word)
 
     output logic        fifo_full,
-    output logic [8:0]  fifo_count,           // Count of 64-bit entries
-    
-    // Status output for PS monitoring
-    output logic [13:0] current_bram_address,
-    
+    output logic [8:0]  fifo_count,           // Count of FIFO entries
+
+    // Status output for PS monitoring (32-bit word address)
+    output logic [WORD_ADDR_WIDTH-1:0] current_bram_address,
+
+    // High-water marks (PS read pointer in 32-bit words, synchronized to clk)
+    input  logic [WORD_ADDR_WIDTH-1:0] ps_read_address,
+    input  logic        high_water_clear,       // One clock pulse
+    output logic [8:0]  fifo_count_max,
+    output logic [WORD_ADDR_WIDTH-1:0] bram_unread_max,
+
     // BRAM interface (output side)
-    output logic [15:0] bram_addr,
-    output logic [31:0] bram_din,
-    output logic        bram_en,
-    output logic [3:0]  bram_we,
+    output logic [BRAM_ADDR_WIDTH-1:0]   bram_addr,     // Byte address
+    output logic [BRAM_DATA_WIDTH-1:0]   bram_din,
+    output logic                         bram_en,
+    output logic [BRAM_DATA_WIDTH/8-1:0] bram_we,       // Byte enables
     output logic        bram_clk,
     output logic        bram_rst
 );
 
+// Derived parameters
+localparam int FIFO_PTR_WIDTH = $clog2(FIFO_DEPTH);
+localparam int FIFO_COUNT_WIDTH = $clog2(FIFO_DEPTH + 1);
+localparam int LANES = BRAM_DATA_WIDTH / 16;                      // 16-bit lanes per BRAM word
+localparam int LANE_POS_WIDTH = $clog2(LANES);
+localparam int BRAM_DEPTH_WIDE = BRAM_DEPTH_WORDS / (BRAM_DATA_WIDTH / 32); // Depth in BRAM words
+localparam int BRAM_WIDE_ADDR_WIDTH = $clog2(BRAM_DEPTH_WIDE);
+localparam int BYTE_OFFSET_WIDTH = $clog2(BRAM_DATA_WIDTH / 8);
+localparam int N_SLICES = N_CHUNKS / 2;                           // 64-bit slices per FIFO entry
+localparam int SLICE_INDEX_WIDTH = (N_SLICES > 1) ? $clog2(N_SLICES) : 1;
+localparam int FIFO_ENTRY_WIDTH = FIFO_DATA_WIDTH + FIFO_MASK_WIDTH + 1;
+
 // Parameter validation
 initial begin
     if (FIFO_DEPTH > 512) begin
         $error("FIFO_DEPTH (%d) too large - maximum 512 entries", FIFO_DEPTH);
     end
     if (BRAM_DEPTH_WORDS > (1 << (BRAM_ADDR_WIDTH - 2))) begin
-        $error("BRAM_DEPTH_WORDS (%d) exceeds address space (%d words)", 
+        $error("BRAM_DEPTH_WORDS (%d) exceeds address space (%d words)",
                BRAM_DEPTH_WORDS, (1 << (BRAM_ADDR_WIDTH - 2)));
     end
+    if (N_CHUNKS < 2 || (N_CHUNKS % 2) != 0) begin
+        $error("N_CHUNKS (%d) must be a multiple of 2 - entries are processed 64 bits at a time", N_CHUNKS);
+    end
+    if (BRAM_DATA_WIDTH < 64 || (BRAM_DATA_WIDTH & (BRAM_DATA_WIDTH - 1)) != 0) begin
+        $error("BRAM_DATA_WIDTH (%d) must be a power of 2 and at least 64", BRAM_DATA_WIDTH);
+    end
 end
 
-// Derived parameters
-localparam int FIFO_PTR_WIDTH = $clog2(FIFO_DEPTH);
-localparam int FIFO_COUNT_WIDTH = $clog2(FIFO_DEPTH + 1);
-localparam int BRAM_WORD_ADDR_WIDTH = $clog2(BRAM_DEPTH_WORDS);
-
-// FIFO storage - 64-bit data + 4-bit channel mask + 1-bit packet end flag
-logic [68:0] write_fifo [0:FIFO_DEPTH-1]; // 64-bit data + 4-bit mask + 1-bit flag
+// FIFO storage - data + channel mask + 1-bit packet end flag
+logic [FIFO_ENTRY_WIDTH-1:0] write_fifo [0:FIFO_DEPTH-1]; // {flag, mask, data}
 logic [FIFO_PTR_WIDTH-1:0] fifo_write_ptr;
 logic [FIFO_PTR_WIDTH-1:0] fifo_read_ptr;
 
 // FIFO status signals
 assign fifo_full = (fifo_count == FIFO_DEPTH);
 
-// State machine for processing 64-bit entries
+// State machine for processing FIFO entries
 typedef enum logic {
-    PROCESS_CHUNK,    // Process 32-bit chunks (index 0 = low, 1 = high)
-    FINALIZE_PACKET   // Handle leftover 16 bits at packet end
+    PROCESS_SLICE,    // Pack 64-bit slices (index 0 = lowest, N_SLICES-1 = highest)
+    FINALIZE_PACKET   // Write the partially filled BRAM word left at packet end
 } process_state_t;
 
 process_state_t process_state;
-logic chunk_index;  // 0 = process lower 32 bits, 1 = process upper 32 bits
-
-// Data processing registers
-logic [31:0] data_buffer_reg;        // Accumulates 32-bit words for BRAM
-logic        buffer_valid_reg;       // True when data_buffer_reg contains valid data
-logic        packet_end_reg;      // Used to copy packet end flag over to BRAM write as needed
+logic [SLICE_INDEX_WIDTH-1:0] slice_index;  // Which 64-bit slice of the entry is being processed
 
-logic [15:0] stash;              // Holds leftover 16-bit segment
-logic        stash_valid;        // True when stash contains valid data
-
-// Pipeline registers for packet boundary tracking
-logic        current_packet_end;  // Packet end flag for current FIFO entry being processed
+// Lane packer registers
+logic [BRAM_DATA_WIDTH-1:0] acc_data;      // Accumulates lanes for the next BRAM write
+logic [LANES-1:0]           acc_lanes;     // Lanes of acc_data holding data not yet written
+logic [LANE_POS_WIDTH-1:0]  lane_pos;      // Next free lane of the current BRAM word
 
 // BRAM interface registers
-logic [15:0] bram_addr_reg;
-logic [BRAM_DATA_WIDTH-1:0] bram_din_reg;
-logic        bram_en_reg;
-logic [3:0]  bram_we_reg;
-logic [BRAM_WORD_ADDR_WIDTH-1:0] write_address;
-logic [BRAM_WORD_ADDR_WIDTH-1:0] packet_boundary_address;
+logic [BRAM_ADDR_WIDTH-1:0]   bram_addr_reg;
+logic [BRAM_DATA_WIDTH-1:0]   bram_din_reg;
+logic                         bram_en_reg;
+logic [BRAM_DATA_WIDTH/8-1:0] bram_we_reg;
+logic [BRAM_WIDE_ADDR_WIDTH-1:0] write_address;            // BRAM word being filled
+logic [WORD_ADDR_WIDTH-1:0]      packet_boundary_address;  // 32-bit word after the last complete packet
 
 // Connect BRAM interface
 assign bram_addr = bram_addr_reg;
@@ -97,231 +129,228 @@ assign current_bram_address = packet_boundary_address;
 
 // Registered FIFO write signals (1 cycle latency)
 logic fifo_write_en_reg;
-logic [63:0] fifo_write_data_reg;
-logic [3:0] fifo_channel_mask_reg;
+logic [FIFO_DATA_WIDTH-1:0] fifo_write_data_reg;
+logic [FIFO_MASK_WIDTH-1:0] fifo_channel_mask_reg;
+logic fifo_packet_end_flag_reg;
 
 // Control signals
 logic fifo_write_this_cycle;
 logic fifo_read_this_cycle;
 
-// Helper function to extract segments from 32-bit word based on 2-bit mask
-function automatic logic [31:0] extract_segments(input logic [31:0] word_32, input logic [1:0] mask_2);
-    logic [15:0] seg0 = word_32[15:0];
-    logic [15:0] seg1 = word_32[31:16];
-    
-    case (mask_2)
-        2'b00: return 32'h0;                   // No segments
-        2'b01: return {16'h0, seg0};           // Only segment 0
-        2'b10: return {16'h0, seg1};           // Only segment 1 - TECHNICALLY THIS SHOULD NEVER OCCUR!  
-        2'b11: return {seg1, seg0};            // Both segments
-    endcase
+// Helper function to expand a lane mask to byte enables
+function automatic logic [BRAM_DATA_WIDTH/8-1:0] lanes_to_byte_enables(input logic [LANES-1:0] lanes);
+    logic [BRAM_DATA_WIDTH/8-1:0] be;
+    for (int j = 0; j < LANES; j++) begin
+        be[2*j +: 2] = {2{lanes[j]}};
+    end
+    return be;
 endfunction
 
-// Helper function to count valid segments in 2-bit mask
-function automatic logic [1:0] count_segments(input logic [1:0] mask_2);
-    return mask_2[0] + mask_2[1];
+// Helper function to advance a BRAM word address with wrap-around
+function automatic logic [BRAM_WIDE_ADDR_WIDTH-1:0] next_wide_address(input logic [BRAM_WIDE_ADDR_WIDTH-1:0] address);
+    return (address >= (BRAM_DEPTH_WIDE - 1)) ? '0 : (address + 1);
 endfunction
 
-// Combinatorial logic for next state calculation
-logic next_stash_valid;
-
 // Combined FIFO and BRAM management
 always_ff @(posedge clk) begin
     if (!rstn) begin
         // FIFO write side
         fifo_write_ptr <= '0;
         fifo_write_en_reg <= 1'b0;
-        fifo_write_data_reg <= 64'h0;
-        fifo_channel_mask_reg <= 4'h0;
-        
+        fifo_write_data_reg <= '0;
+        fifo_channel_mask_reg <= '0;
+        fifo_packet_end_flag_reg <= 1'b0;
+
         // FIFO read side
         fifo_read_ptr <= '0;
         fifo_count <= '0;
 
         // State machine
-        process_state <= PROCESS_CHUNK;
-        chunk_index <= 1'b0;
-        
-        // Data processing
-        data_buffer_reg <= 32'h0;
-        buffer_valid_reg <= 1'b0;
-        stash <= 16'h0;
-        stash_valid <= 1'b0;
-        current_packet_end <= 1'b0;
-        packet_end_reg <= 1'b0;
-        
+        process_state <= PROCESS_SLICE;
+        slice_index <= '0;
+
+        // Lane packer
+        acc_data <= '0;
+        acc_lanes <= '0;
+        lane_pos <= '0;
+
         // BRAM interface
-        bram_addr_reg <= 16'h0;
-        bram_din_reg <= 32'h0;
+        bram_addr_reg <= '0;
+        bram_din_reg <= '0;
         bram_en_reg <= 1'b0;
-        bram_we_reg <= 4'h0;
+        bram_we_reg <= '0;
         write_address <= '0;
         packet_boundary_address <= '0;
-        
+
         for (int i = 0; i < FIFO_DEPTH; i++) begin
-            write_fifo[i] <= 69'h0;
+            write_fifo[i] <= '0;
         end
 
     end else begin
-        
+
         // ====================================================================
         // FIFO WRITE SIDE (Data Generator → FIFO)
         // ====================================================================
-        
+
         // Register the input signals (1 cycle delay for clean timing)
         fifo_write_en_reg <= fifo_write_en;
         fifo_write_data_reg <= fifo_write_data;
         fifo_channel_mask_reg <= fifo_channel_mask;
-        
+        fifo_packet_end_flag_reg <= fifo_packet_end_flag;   // Stays with its data word
+
         // Determine if FIFO write will happen this cycle
         fifo_write_this_cycle = fifo_write_en_reg && !fifo_full;
-        
+
         // Perform FIFO write operation
         if (fifo_write_this_cycle) begin
-            write_fifo[fifo_write_ptr] <= {fifo_packet_end_flag, fifo_channel_mask_reg, fifo_write_data_reg};
+            write_fifo[fifo_write_ptr] <= {fifo_packet_end_flag_reg, fifo_channel_mask_reg, fifo_write_data_reg};
             fifo_write_ptr <= fifo_write_ptr + 1;
         end
 
         // ====================================================================
-        // DATA PROCESSING STATE MACHINE
+        // LANE PACKER STATE MACHINE + BRAM WRITE LOGIC
         // ====================================================================
-        
+
         // Default: no BRAM write
         bram_en_reg <= 1'b0;
-        bram_we_reg <= 4'h0;
+        bram_we_reg <= '0;
         fifo_read_this_cycle = 1'b0;
-        next_stash_valid = stash_valid;  // Default to current state (in case we skip a chunk)
-        buffer_valid_reg <= 1'b0;
 
         case (process_state)
-            
-            PROCESS_CHUNK: begin
-                // Process current chunk if FIFO has data
+
+            PROCESS_SLICE: begin
+                // Process current slice if FIFO has data
                 if (fifo_count > 0) begin
-                    // Read FIFO entry directly (pointer doesn't advance until both chunks done)
-                    logic [68:0] fifo_entry = write_fifo[fifo_read_ptr];
-                    logic packet_end = fifo_entry[68];
-                    logic [3:0] channel_mask = fifo_entry[67:64];
-                    logic [63:0] data_word = fifo_entry[63:0];
-                    
-                    logic [1:0] chunk_mask;
-                    logic [31:0] chunk_word;
-                    logic [31:0] extracted;
-                    logic [1:0] seg_count;
-                    
-                    // Store packet end flag for this entry
-                    current_packet_end <= packet_end;
-
-                    if (chunk_index == 1'b0) begin
-                        // Process lower 32 bits (chunk 0)
-                        chunk_mask = channel_mask[1:0];    // Bits [1:0]
-                        chunk_word = data_word[31:0];      // Bits [31:0]  
-                    end else begin
-                        // Process upper 32 bits (chunk 1)
-                        chunk_mask = channel_mask[3:2];    // Bits [3:2]
-                        chunk_word = data_word[63:32];     // Bits [63:32]
+                    // Read FIFO entry directly (pointer doesn't advance until all slices done)
+                    logic [FIFO_ENTRY_WIDTH-1:0] fifo_entry;
+                    logic                        packet_end;
+                    logic [FIFO_MASK_WIDTH-1:0]  channel_mask;
+                    logic [FIFO_DATA_WIDTH-1:0]  data_word;
+
+                    logic [63:0] slice_word;
+                    logic [3:0]  slice_mask;
+                    logic        last_slice;
+                    logic        end_of_packet;
+
+                    // Two BRAM words of lanes: the current word and its overflow
+                    logic [2*BRAM_DATA_WIDTH-1:0] window;
+                    logic [2*LANES-1:0]           window_lanes;
+                    logic [LANE_POS_WIDTH+1:0]    pos;   // Next free lane of the window (0 to 2*LANES)
+
+                    fifo_entry = write_fifo[fifo_read_ptr];
+                    packet_end = fifo_entry[FIFO_ENTRY_WIDTH-1];
+                    channel_mask = fifo_entry[FIFO_DATA_WIDTH +: FIFO_MASK_WIDTH];
+                    data_word = fifo_entry[FIFO_DATA_WIDTH-1:0];
+
+                    // Select the current 64-bit slice and its 4-bit mask
+                    slice_word = data_word[64*slice_index +: 64];
+                    slice_mask = channel_mask[4*slice_index +: 4];
+                    last_slice = (slice_index == SLICE_INDEX_WIDTH'(N_SLICES - 1));
+                    end_of_packet = last_slice && packet_end;
+
+                    // Compact the enabled segments into the lanes following the accumulator
+                    window = {{BRAM_DATA_WIDTH{1'b0}}, acc_data};
+                    window_lanes = {{LANES{1'b0}}, acc_lanes};
+                    pos = lane_pos;
+                    for (int i = 0; i < 4; i++) begin
+                        if (slice_mask[i]) begin
+                            window[16*pos +: 16] = slice_word[16*i +: 16];
+                            window_lanes[pos] = 1'b1;
+                            pos = pos + 1;
+                        end
+                    end
+
+                    // Packets end on a 32-bit boundary - pad an odd segment count with zeros
+                    if (end_of_packet && pos[0]) begin
+                        window[16*pos +: 16] = 16'h0000;
+                        window_lanes[pos] = 1'b1;
+                        pos = pos + 1;
                     end
-                    
-                    // Common processing logic based on channel enable mask
-                    extracted = extract_segments(chunk_word, chunk_mask);
-                    seg_count = count_segments(chunk_mask);
-
-                    // Two possibilities - we have leftover data in stash from last chunk or not
-                    if (seg_count == 2'd2) begin
-                        // Two segments: fill buffer if we have stash, or store in buffer
-                        if (stash_valid) begin
-                            // Combine stash with first segment, second becomes new stash
-                            data_buffer_reg <= {extracted[15:0], stash};
-                            buffer_valid_reg <= 1'b1;
-                            stash <= extracted[31:16];
-                            next_stash_valid = 1'b1; // Stash entry for next
-                        end else begin
-                            // Store both segments in buffer
-                            data_buffer_reg <= extracted;
-                            buffer_valid_reg <= 1'b1;
-                            next_stash_valid = 1'b0; // No stash bc we copied directly
+
+                    if (pos >= LANES) begin
+                        // Current BRAM word is complete - write it and keep the overflow lanes
+                        logic [BRAM_WIDE_ADDR_WIDTH-1:0] next_address;
+                        next_address = next_wide_address(write_address);
+
+                        bram_addr_reg <= {write_address, {BYTE_OFFSET_WIDTH{1'b0}}};
+                        bram_din_reg <= window[BRAM_DATA_WIDTH-1:0];
+                        bram_en_reg <= 1'b1;
+                        bram_we_reg <= lanes_to_byte_enables(window_lanes[LANES-1:0]);
+                        write_address <= next_address;
+
+                        acc_data <= window[BRAM_DATA_WIDTH +: BRAM_DATA_WIDTH];
+                        acc_lanes <= window_lanes[LANES +: LANES];
+                        lane_pos <= LANE_POS_WIDTH'(pos - LANES);
+
+                        if (end_of_packet) begin
+                            if (pos == LANES) begin
+                                // Packet ends exactly on the BRAM word boundary
+                                packet_boundary_address <= WORD_ADDR_WIDTH'({next_address, {(LANE_POS_WIDTH-1){1'b0}}});
+                            end else begin
+                                // Overflow lanes still need to be written (all of them when
+                                // pos == 2*LANES)
+                                process_state <= FINALIZE_PACKET;
+                            end
                         end
-                    end else if (seg_count == 2'd1) begin
-                        // One segment
-                        if (stash_valid) begin
-                            // Combine with stash to make full buffer
-                            data_buffer_reg <= {extracted[15:0], stash};
-                            buffer_valid_reg <= 1'b1;
-                            next_stash_valid = 1'b0; // Combined with old stash
-                        end else begin
-                            // Put in stash
-                            stash <= extracted[15:0];
-                            next_stash_valid = 1'b1; // Stash entry for next
+                    end else begin
+                        acc_data <= window[BRAM_DATA_WIDTH-1:0];
+                        acc_lanes <= window_lanes[LANES-1:0];
+                        lane_pos <= LANE_POS_WIDTH'(pos);
+
+                        if (end_of_packet) begin
+                            // Packet ends part way through the BRAM word - write what we have.
+                            // The next packet continues in the remaining lanes of the same word.
+                            if (|window_lanes[LANES-1:0]) begin
+                                bram_addr_reg <= {write_address, {BYTE_OFFSET_WIDTH{1'b0}}};
+                                bram_din_reg <= window[BRAM_DATA_WIDTH-1:0];
+                                bram_en_reg <= 1'b1;
+                                bram_we_reg <= lanes_to_byte_enables(window_lanes[LANES-1:0]);
+                            end
+                            acc_lanes <= '0;
+                            packet_boundary_address <= WORD_ADDR_WIDTH'({write_address, pos[LANE_POS_WIDTH-1:1]});
                         end
                     end
 
-                    // State transition logic
-                    if (chunk_index == 1'b1) begin
-                        // Just finished upper chunk
-                        if (current_packet_end && next_stash_valid) begin 
-                            // Need to finalize the packet with remaining stash
-                            process_state <= FINALIZE_PACKET;
-                        end else begin
-                            packet_end_reg <= current_packet_end; // Copy the packet end over to the BRAM write
-
-                            // Normal case: consume FIFO entry and move to next
-                            fifo_read_ptr <= fifo_read_ptr + 1;
-                            fifo_read_this_cycle = 1'b1;
-                            process_state <= PROCESS_CHUNK;
-                            chunk_index <= 1'b0;  // Reset to lower chunk for next entry
-                        end
+                    // Slice transition logic
+                    if (last_slice) begin
+                        // Consume FIFO entry and move to next
+                        fifo_read_ptr <= fifo_read_ptr + 1;
+                        fifo_read_this_cycle = 1'b1;
+                        slice_index <= '0;
                     end else begin
-                        // Move from chunk 0 to chunk 1
-                        process_state <= PROCESS_CHUNK;
-                        chunk_index <= 1'b1;
+                        // Move on to the next slice
+                        slice_index <= slice_index + 1;
                     end
                 end
             end
-            
+
             FINALIZE_PACKET: begin
-                // Handle leftover stash at packet end
-                data_buffer_reg <= {16'h0000, stash};  // Pad with zeros
-                buffer_valid_reg <= 1'b1;
-                packet_end_reg <= current_packet_end;
-                next_stash_valid = 1'b0; // Cleaned up and ready to go for next
-                
-                // Consume FIFO entry and return to normal processing
-                fifo_read_ptr <= fifo_read_ptr + 1;
-                fifo_read_this_cycle = 1'b1;
-                process_state <= PROCESS_CHUNK;
-                chunk_index <= 1'b0;
+                // Write the lanes left over at packet end (FIFO entry was already consumed)
+                bram_addr_reg <= {write_address, {BYTE_OFFSET_WIDTH{1'b0}}};
+                bram_din_reg <= acc_data;
+                bram_en_reg <= 1'b1;
+                bram_we_reg <= lanes_to_byte_enables(acc_lanes);
+                acc_lanes <= '0;
+
+                if (&acc_lanes) begin
+                    // The overflow word is full (the packet ended on lane 2*LANES, where
+                    // lane_pos wrapped to 0) - the packet ends after it
+                    logic [BRAM_WIDE_ADDR_WIDTH-1:0] next_address;
+                    next_address = next_wide_address(write_address);
+                    write_address <= next_address;
+                    packet_boundary_address <= WORD_ADDR_WIDTH'({next_address, {(LANE_POS_WIDTH-1){1'b0}}});
+                end else begin
+                    packet_boundary_address <= WORD_ADDR_WIDTH'({write_address, lane_pos[LANE_POS_WIDTH-1:1]});
+                end
+                process_state <= PROCESS_SLICE;
             end
-            
+
         endcase
 
-        stash_valid <= next_stash_valid;
-        
-        // ====================================================================
-        // BRAM WRITE LOGIC
-        // ====================================================================
-        
-        // Write buffer to BRAM when it's valid
-        if (buffer_valid_reg) begin
-            logic [BRAM_WORD_ADDR_WIDTH-1:0] next_address;
-
-            bram_addr_reg <= {write_address, 2'b00};
-            bram_din_reg <= data_buffer_reg;
-            bram_en_reg <= 1'b1;
-            bram_we_reg <= 4'hF;
-            
-            // Advance BRAM address
-            next_address = (write_address >= (BRAM_DEPTH_WORDS - 1)) ? '0 : (write_address + 1);
-            write_address <= next_address;
-            
-            if (packet_end_reg) begin
-                packet_boundary_address <= next_address;
-            end
-        end
-        
         // ====================================================================
         // FIFO COUNT MANAGEMENT
         // ====================================================================
-        
+
         // Update FIFO count based on operations (perfectly synchronized!)
         case ({fifo_write_this_cycle, fifo_read_this_cycle})
             2'b00: fifo_count <= fifo_count;        // No operations
@@ -332,4 +361,46 @@ always_ff @(posedge clk) begin
     end
 end
 
+// ============================================================================
+// HIGH-WATER MARKS
+// ============================================================================
+
+// The PS read pointer comes through a plain two-stage synchronizer, so a value
+// caught mid-update can be torn for one clock - only a value that holds for two
+// clocks is used
+logic [WORD_ADDR_WIDTH-1:0] ps_read_prev;
+logic [WORD_ADDR_WIDTH-1:0] ps_read_stable;
+logic [WORD_ADDR_WIDTH-1:0] bram_unread;
+
+always_ff @(posedge clk) begin
+    if (!rstn) begin
+        ps_read_prev <= '0;
+        ps_read_stable <= '0;
+        bram_unread <= '0;
+        fifo_count_max <= '0;
+        bram_unread_max <= '0;
+    end else begin
+        ps_read_prev <= ps_read_address;
+        if (ps_read_address == ps_read_prev) begin
+            ps_read_stable <= ps_read_address;
+        end
+
+        bram_unread <= (packet_boundary_address >= ps_read_stable) ?
+                       (packet_boundary_address - ps_read_stable) :
+                       WORD_ADDR_WIDTH'(BRAM_DEPTH_WORDS - ps_read_stable + packet_boundary_address);
+
+        if (high_water_clear) begin
+            fifo_count_max <= fifo_count;
+            bram_unread_max <= bram_unread;
+        end else begin
+            if (fifo_count > fifo_count_max) begin
+                fifo_count_max <= fifo_count;
+            end
+            if (bram_unread > bram_unread_max) begin
+                bram_unread_max <= bram_unread;
+            end
+        end
+    end
+end
+
 endmodule
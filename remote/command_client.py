@@ -0,0 +1,362 @@
+"""
+Pipelined client for the binary TCP command protocol (see firmware/src-core0/network.c).
+
+The firmware handles commands strictly in order and echoes the low 16 bits of each
+command's ack_id, so any number of commands can be in flight on one connection. A
+reader thread frames the responses - a 3-byte ACK [ack_id:u16 BE][status:u8], or for
+commands that return data the 5-byte header [ack_id][status][length:u16 BE] plus the
+data - and resolves the future of the command with that ack_id. A configuration
+sequence then costs one round trip instead of one per command.
+
+START, STOP, RESET_TIMESTAMP, DUMP_BRAM and FULL_CABLE_TEST are ACKed when accepted
+and carried out later by the firmware's main loop, which then sends a completion
+notification (status ACK_COMPLETE) with the same ack_id. command() and pipeline()
+wait for it and return the Completion as the command's data, so callers can chain
+operations without guard sleeps.
+
+READ_BRAM answers with a 5-byte header carrying a bram_read_response_t, then the
+requested words in binary; read_bram() returns them as a BramRead.
+
+TRIGGER_CAPTURE is completed once the device has recorded the requested frames
+around the trigger; its completion carries them (a Capture), so trigger_capture()
+returns the window in one call.
+
+RUN_BENCHMARK times the device's BRAM copy methods, its UDP send path and single
+register reads with the stream stopped, and switches the device to the fastest copy
+method; its completion carries the results (a Benchmark).
+
+RESEND_FRAMES is a NACK: the device sends the frames of a timestamp range again as
+ordinary UDP datagrams, from its DDR history. resend_frames() does not wait; the
+ACK only says whether the range was queued.
+
+    client = CommandClient("192.168.18.10")
+    ok, _ = client.command(CMD_STOP)                        # one command, waits
+    results = client.pipeline([(CMD_STOP,), (CMD_SET_LOOP_COUNT, 1), (CMD_LOAD_INIT,)])
+    future = client.submit(CMD_GET_STATUS)                  # returns immediately
+    response = future.result(timeout=2.0)                   # Response(success, status, data)
+    ok, completion = client.command(CMD_START)              # waits until streaming has begun
+    ok, statuses = client.transaction([(CMD_SET_CHANNEL_ENABLE, 0x3), (CMD_START,)])
+    ok, bram = client.read_bram(snapshot=True)              # the whole buffer, one instant
+    ok, capture = client.trigger_capture(3000, 6000)        # 100 ms before to 200 ms after now
+    client.resend_frames(120000, 3)                         # datagrams 120000-120002 were lost
+    ok, bench = client.run_benchmark()                      # with the stream stopped
+"""
+
+import socket
+import struct
+import threading
+from collections import OrderedDict, namedtuple
+from concurrent.futures import Future, TimeoutError as FutureTimeout
+
+CMD_MAGIC = 0xDEADBEEF
+CMD_START = 0x01
+CMD_STOP = 0x02
+CMD_RESET_TIMESTAMP = 0x03
+CMD_FULL_CABLE_TEST = 0x30
+CMD_GET_STATUS = 0x40
+CMD_DUMP_BRAM = 0x41
+CMD_READ_BRAM = 0x42
+CMD_TRIGGER_CAPTURE = 0x43
+CMD_RESEND_FRAMES = 0x44
+CMD_RUN_BENCHMARK = 0x45
+CMD_TRANSACTION = 0x60
+ACK_SUCCESS = 0x06
+ACK_COMPLETE = 0x04
+ACK_PACKET_SIZE = 3
+RESPONSE_HEADER_SIZE = 5
+
+# Commands answered with a 5-byte header and data instead of a plain ACK
+DATA_COMMANDS = {CMD_GET_STATUS, CMD_READ_BRAM, CMD_TRANSACTION}
+
+# Commands that are completed by a notification after their ACK
+DEFERRED_COMMANDS = {CMD_START, CMD_STOP, CMD_RESET_TIMESTAMP, CMD_DUMP_BRAM, CMD_FULL_CABLE_TEST,
+                     CMD_TRIGGER_CAPTURE, CMD_RUN_BENCHMARK}
+
+MAX_TRANSACTION_COMMANDS = 16
+MAX_RESEND_FRAMES = 4096
+
+BRAM_SIZE_WORDS = 16384         # Firmware that does not report its BRAM depth
+BRAM_SIZE_OFFSET = 228          # status_response_t.bram_size_words
+BRAM_READ_SNAPSHOT = 0x80000000
+
+ACK_ID_MASK = 0xFFFF    # ack_id is 32 bits in the command but 16 bits in the response
+
+Response = namedtuple("Response", ["success", "status", "data"])
+
+# completion_response_t: status is ACK_ERROR if there was nothing to do (START while
+# streaming); timestamp is the first timestamp of the new stream after START
+COMPLETION_FORMAT = '<IBBHQII'
+Completion = namedtuple("Completion", ["cmd_id", "status", "stream_enabled", "timestamp",
+                                       "packets_received", "detail"])
+
+# TRIGGER_CAPTURE completion: the completion_response_t fields (timestamp = trigger
+# frame, detail = frame count) followed by capture_response_t's own, then the frames
+CAPTURE_FORMAT = '<QII'
+Capture = namedtuple("Capture", ["trigger_timestamp", "first_timestamp", "frame_count",
+                                 "packet_words", "pre_frames", "words"])
+
+# RUN_BENCHMARK completion: the completion_response_t fields (detail = selected copy
+# method) followed by benchmark_response_t's own. Times are device timer ticks
+# (timer_hz per second) summed over the repeats; copy_ticks[size][method].
+BENCHMARK_FORMAT = '<IBBBBHHIIII'
+BRAM_COPY_METHODS = ["in32", "memcpy", "ldm", "neon",
+                     "cached-in32", "cached-memcpy", "cached-ldm", "cached-neon"]
+Benchmark = namedtuple("Benchmark", ["status", "timer_hz", "selected_method", "copy_repeats",
+                                     "net_repeats", "reg_repeats", "reg_read_ticks",
+                                     "bram_read_ticks", "send_failures", "frame_words",
+                                     "copy_ticks", "pbuf_ticks", "send_ticks"])
+
+# bram_read_response_t, with `words` the raw little-endian data. Words between
+# write_addr_before and write_addr_after may have changed while a snapshot was taken.
+BRAM_READ_FORMAT = '<IIIIQ'
+BramRead = namedtuple("BramRead", ["start_addr", "word_count", "write_addr_before",
+                                   "write_addr_after", "timestamp", "words"])
+
+
+def parse_benchmark(status, data):
+    (timer_hz, num_sizes, num_methods, _, selected, copy_repeats, net_repeats, reg_repeats,
+     reg_read_ticks, bram_read_ticks, send_failures) = struct.unpack_from(BENCHMARK_FORMAT, data)
+    pos = struct.calcsize(BENCHMARK_FORMAT)
+    frame_words = list(struct.unpack_from(f'<{num_sizes}H', data, pos))
+    pos += num_sizes * 2
+    flat = struct.unpack_from(f'<{num_sizes * num_methods}I', data, pos)
+    copy_ticks = [list(flat[i * num_methods:(i + 1) * num_methods]) for i in range(num_sizes)]
+    pos += num_sizes * num_methods * 4
+    pbuf_ticks = list(struct.unpack_from(f'<{num_sizes}I', data, pos))
+    send_ticks = list(struct.unpack_from(f'<{num_sizes}I', data, pos + num_sizes * 4))
+    return Benchmark(status, timer_hz, selected, copy_repeats, net_repeats, reg_repeats,
+                     reg_read_ticks, bram_read_ticks, send_failures, frame_words,
+                     copy_ticks, pbuf_ticks, send_ticks)
+
+
+def pack_command(cmd_id, ack_id=0, param1=0, param2=0):
+    return struct.pack('<IIIII', CMD_MAGIC, cmd_id, ack_id & 0xFFFFFFFF, param1 & 0xFFFFFFFF, param2 & 0xFFFFFFFF)
+
+
+class CommandClient:
+    def __init__(self, host, port=6000, timeout=2.0, verbose=True):
+        self.timeout = timeout
+        self.verbose = verbose
+        self._sock = socket.create_connection((host, port), timeout=timeout)
+        self._sock.settimeout(None)
+        self._sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+        self._lock = threading.Lock()
+        self._pending = OrderedDict()   # wire ack_id -> (cmd_id, future), in send order
+        self._completions = {}          # wire ack_id -> completion future of a deferred command
+        self._next_ack_id = 1           # Monotonic; the wire carries the low 16 bits
+        self._closed = False
+        self._error = None
+        self._bram_size_words = None    # Asked for on first use
+
+        self._reader = threading.Thread(target=self._read_responses, daemon=True)
+        self._reader.start()
+
+    def submit(self, cmd_id, param1=0, param2=0, payload=b""):
+        """Send a command without waiting. The future resolves to a Response; for
+        deferred commands future.completion resolves to the Completion (or None if
+        the command was rejected). `payload` is sent right behind the command (the
+        sub-commands of a transaction)."""
+        future = Future()
+        if cmd_id in DEFERRED_COMMANDS:
+            future.completion = Future()
+        with self._lock:
+            if self._closed:
+                raise ConnectionError(self._error or "command connection closed")
+            if len(self._pending) > ACK_ID_MASK:
+                raise RuntimeError("too many commands in flight")
+            ack_id = self._next_ack_id
+            self._next_ack_id += 1
+            wire_id = ack_id & ACK_ID_MASK
+            self._pending[wire_id] = (cmd_id, future)
+            if cmd_id in DEFERRED_COMMANDS:
+                self._completions[wire_id] = future.completion
+            # Sending under the lock keeps the wire order equal to the pending order
+            self._sock.sendall(pack_command(cmd_id, ack_id, param1, param2) + payload)
+        return future
+
+    def command(self, cmd_id, param1=0, param2=0, timeout=None):
+        """Send one command and wait for its response: (success, data)"""
+        try:
+            return self._wait(self.submit(cmd_id, param1, param2), timeout)
+        except (ConnectionError, OSError) as e:
+            self._report(f"[TCP] Error: {e}")
+            return (False, None)
+
+    def pipeline(self, commands, timeout=None):
+        """Send every (cmd_id[, param1[, param2]]) back to back, then wait for all of
+        the responses. Returns the list of (success, data) in command order."""
+        try:
+            futures = [self.submit(*command) for command in commands]
+        except (ConnectionError, OSError) as e:
+            self._report(f"[TCP] Error: {e}")
+            return [(False, None)] * len(commands)
+        return [self._wait(future, timeout) for future in futures]
+
+    def transaction(self, commands, timeout=None):
+        """Apply up to MAX_TRANSACTION_COMMANDS (cmd_id[, param1[, param2]]) atomically:
+        the device validates all of them before applying any, then applies them in
+        order at one point of its main loop. START/STOP/RESET_TIMESTAMP finish before the
+        answer and send no completion of their own. Returns (success, per-command status
+        bytes: ACK_SUCCESS or ACK_ERROR as applied, or 0 for valid commands that were
+        not applied); success means every command succeeded."""
+        if not 0 < len(commands) <= MAX_TRANSACTION_COMMANDS:
+            raise ValueError(f"a transaction holds 1-{MAX_TRANSACTION_COMMANDS} commands")
+        payload = b"".join(pack_command(command[0], 0, *command[1:]) for command in commands)
+        try:
+            response = self.submit(CMD_TRANSACTION, len(commands), payload=payload).result(
+                self.timeout if timeout is None else timeout)
+        except FutureTimeout:
+            self._report("[TCP] Timeout waiting for response")
+            return (False, None)
+        except (ConnectionError, OSError) as e:
+            self._report(f"[TCP] Error: {e}")
+            return (False, None)
+        if not response.success:
+            self._report("[TCP] Transaction failed")
+        return (response.success, list(response.data or b""))
+
+    def bram_size_words(self):
+        """BRAM ring depth of the device build in words (from GET_STATUS, once)"""
+        if self._bram_size_words is None:
+            ok, status = self.command(CMD_GET_STATUS)
+            if not ok:
+                return BRAM_SIZE_WORDS
+            self._bram_size_words = struct.unpack_from('<I', status, BRAM_SIZE_OFFSET)[0] \
+                if len(status) >= BRAM_SIZE_OFFSET + 4 else BRAM_SIZE_WORDS
+        return self._bram_size_words
+
+    def read_bram(self, start_addr=0, word_count=None, snapshot=False, timeout=None):
+        """Read word_count BRAM words from start_addr (wrapping) in binary: (success, BramRead).
+        word_count defaults to the whole ring. With snapshot the device copies the range
+        first instead of reading it while sending."""
+        if word_count is None:
+            word_count = self.bram_size_words()
+        flags = BRAM_READ_SNAPSHOT if snapshot else 0
+        return self.command(CMD_READ_BRAM, start_addr, word_count | flags, timeout)
+
+    def trigger_capture(self, pre_frames, post_frames, timeout=30.0):
+        """Capture the frames from pre_frames before the newest recorded frame to
+        post_frames after it: (success, Capture). Returns once the window is recorded."""
+        return self.command(CMD_TRIGGER_CAPTURE, pre_frames, post_frames, timeout)
+
+    def run_benchmark(self, timeout=30.0):
+        """Run the device benchmark with the stream stopped: (success, Benchmark). The
+        device streams with the fastest copy method afterwards."""
+        ok, bench = self.command(CMD_RUN_BENCHMARK, timeout=timeout)
+        return (ok and bench is not None and bench.status == ACK_SUCCESS, bench)
+
+    def resend_frames(self, first_timestamp, count):
+        """Ask for the frames first_timestamp .. first_timestamp + count - 1 again over
+        UDP. Returns the future at once; it resolves to a Response whose success says
+        whether the device still had the range and queued it."""
+        if not 0 < count <= MAX_RESEND_FRAMES:
+            raise ValueError(f"a resend request covers 1-{MAX_RESEND_FRAMES} frames")
+        return self.submit(CMD_RESEND_FRAMES, first_timestamp & 0xFFFFFFFF, count)
+
+    def close(self):
+        with self._lock:
+            self._closed = True
+        try:
+            self._sock.shutdown(socket.SHUT_RDWR)
+        except OSError:
+            pass
+        self._sock.close()
+        self._reader.join(timeout=1.0)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def _wait(self, future, timeout):
+        timeout = self.timeout if timeout is None else timeout
+        try:
+            success, status, data = future.result(timeout)
+            if success and hasattr(future, "completion"):
+                data = future.completion.result(timeout)
+        except FutureTimeout:
+            self._report("[TCP] Timeout waiting for response")
+            return (False, None)
+        except ConnectionError as e:
+            self._report(f"[TCP] Error: {e}")
+            return (False, None)
+        if not success:
+            self._report(f"[TCP] Command failed (status: 0x{status:02X})")
+            return (False, None)
+        return (True, data)
+
+    def _report(self, message):
+        if self.verbose:
+            print(message)
+
+    def _recv_exact(self, count):
+        buf = bytearray()
+        while len(buf) < count:
+            chunk = self._sock.recv(count - len(buf))
+            if not chunk:
+                raise ConnectionError("connection closed by device")
+            buf += chunk
+        return bytes(buf)
+
+    def _read_responses(self):
+        try:
+            while True:
+                ack_id, status = struct.unpack('>HB', self._recv_exact(ACK_PACKET_SIZE))
+                if status == ACK_COMPLETE:
+                    self._read_completion(ack_id)
+                    continue
+                with self._lock:
+                    entry = self._pending.pop(ack_id, None)
+                    completion = self._completions.pop(ack_id, None) if entry and status != ACK_SUCCESS else None
+                if entry is None:
+                    # Without the command we cannot tell where this response ends
+                    raise ConnectionError(f"response for unknown ack_id {ack_id}")
+                cmd_id, future = entry
+                data = None
+                if cmd_id in DATA_COMMANDS:
+                    (length,) = struct.unpack('>H', self._recv_exact(RESPONSE_HEADER_SIZE - ACK_PACKET_SIZE))
+                    data = self._recv_exact(length) if length else None
+                if cmd_id == CMD_READ_BRAM and data:
+                    header = struct.unpack_from(BRAM_READ_FORMAT, data)
+                    data = BramRead(*header, self._recv_exact(header[1] * 4))
+                future.set_result(Response(status == ACK_SUCCESS, status, data))
+                if completion:
+                    completion.set_result(None)     # Rejected - nothing will be carried out
+        except (ConnectionError, OSError) as e:
+            self._fail_pending(str(e))
+
+    def _read_completion(self, ack_id):
+        (length,) = struct.unpack('>H', self._recv_exact(RESPONSE_HEADER_SIZE - ACK_PACKET_SIZE))
+        payload = self._recv_exact(length) if length else b""
+        completion = None
+        if len(payload) >= struct.calcsize(COMPLETION_FORMAT):
+            cmd_id, status, stream_enabled, _, timestamp, packets, detail = struct.unpack_from(
+                COMPLETION_FORMAT, payload)
+            completion = Completion(cmd_id, status, bool(stream_enabled), timestamp, packets, detail)
+            if cmd_id == CMD_TRIGGER_CAPTURE:
+                # The frames follow on the connection and must be read in any case
+                first_timestamp, packet_words, pre_frames = struct.unpack_from(
+                    CAPTURE_FORMAT, payload, struct.calcsize(COMPLETION_FORMAT))
+                words = self._recv_exact(detail * packet_words * 4)
+                completion = Capture(timestamp, first_timestamp, detail, packet_words, pre_frames, words)
+            elif cmd_id == CMD_RUN_BENCHMARK:
+                completion = parse_benchmark(status, payload[struct.calcsize(COMPLETION_FORMAT):])
+        with self._lock:
+            future = self._completions.pop(ack_id, None)
+        # Completions of commands sent before this client connected are ignored
+        if future and completion:
+            future.set_result(completion)
+
+    def _fail_pending(self, error):
+        with self._lock:
+            if self._closed:
+                error = "command connection closed"
+            self._closed = True
+            self._error = error
+            pending = [future for _, future in self._pending.values()] + list(self._completions.values())
+            self._pending.clear()
+            self._completions.clear()
+        for future in pending:
+            future.set_exception(ConnectionError(error))
@@ -0,0 +1,316 @@
+// decoder.cpp
+// Scalar reference and SIMD transpose kernels of Decoder (see decoder.h).
+
+#include "decoder.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define INTAN_DECODER_X86 1
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#define INTAN_DECODER_NEON 1
+#endif
+
+namespace intan {
+
+namespace {
+
+// All kernels share this signature. `lanes` points at the first data lane of the
+// first packet; consecutive packets are `stride` 16-bit units apart.
+struct KernelArgs {
+    const uint16_t* lanes;
+    size_t stride;
+    size_t num_frames;
+    uint32_t num_lanes;
+    const int32_t* lane_rows;
+    uint16_t* out;
+    size_t out_stride;
+    uint16_t flip;      // XORed into every sample (0x8000 converts offset binary to signed)
+};
+
+// Frames [f0, f1) x lanes [l0, l1), one sample at a time
+void decode_block_scalar(const KernelArgs& a, size_t f0, size_t f1, uint32_t l0, uint32_t l1) {
+    for (size_t f = f0; f < f1; f++) {
+        const uint16_t* in = a.lanes + f * a.stride;
+        for (uint32_t l = l0; l < l1; l++) {
+            const int32_t row = a.lane_rows[l];
+            if (row >= 0) {
+                a.out[static_cast<size_t>(row) * a.out_stride + f] = in[l] ^ a.flip;
+            }
+        }
+    }
+}
+
+// Reference implementation
+void decode_scalar(const KernelArgs& a) {
+    decode_block_scalar(a, 0, a.num_frames, 0, a.num_lanes);
+}
+
+#if INTAN_DECODER_X86
+
+// 8x8 transpose of 16-bit elements; with 256-bit registers both 128-bit halves are
+// transposed independently
+#define INTAN_TRANSPOSE_8X8(T, unpacklo16, unpackhi16, unpacklo32, unpackhi32, unpacklo64, unpackhi64, r) \
+    do {                                                                                                 \
+        const T b0 = unpacklo16(r[0], r[1]), b1 = unpackhi16(r[0], r[1]);                               \
+        const T b2 = unpacklo16(r[2], r[3]), b3 = unpackhi16(r[2], r[3]);                               \
+        const T b4 = unpacklo16(r[4], r[5]), b5 = unpackhi16(r[4], r[5]);                               \
+        const T b6 = unpacklo16(r[6], r[7]), b7 = unpackhi16(r[6], r[7]);                               \
+        const T c0 = unpacklo32(b0, b2), c1 = unpackhi32(b0, b2);                                       \
+        const T c2 = unpacklo32(b1, b3), c3 = unpackhi32(b1, b3);                                       \
+        const T c4 = unpacklo32(b4, b6), c5 = unpackhi32(b4, b6);                                       \
+        const T c6 = unpacklo32(b5, b7), c7 = unpackhi32(b5, b7);                                       \
+        r[0] = unpacklo64(c0, c4); r[1] = unpackhi64(c0, c4);                                           \
+        r[2] = unpacklo64(c1, c5); r[3] = unpackhi64(c1, c5);                                           \
+        r[4] = unpacklo64(c2, c6); r[5] = unpackhi64(c2, c6);                                           \
+        r[6] = unpacklo64(c3, c7); r[7] = unpackhi64(c3, c7);                                           \
+    } while (0)
+
+void decode_sse2(const KernelArgs& a) {
+    const __m128i flip = _mm_set1_epi16(static_cast<short>(a.flip));
+    size_t f = 0;
+    for (; f + 8 <= a.num_frames; f += 8) {
+        const uint16_t* base = a.lanes + f * a.stride;
+        uint32_t l = 0;
+        for (; l + 8 <= a.num_lanes; l += 8) {
+            __m128i r[8];
+            for (int i = 0; i < 8; i++) {
+                r[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(base + i * a.stride + l));
+            }
+            INTAN_TRANSPOSE_8X8(__m128i, _mm_unpacklo_epi16, _mm_unpackhi_epi16, _mm_unpacklo_epi32,
+                                _mm_unpackhi_epi32, _mm_unpacklo_epi64, _mm_unpackhi_epi64, r);
+            for (int k = 0; k < 8; k++) {
+                const int32_t row = a.lane_rows[l + k];
+                if (row >= 0) {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(a.out + static_cast<size_t>(row) * a.out_stride + f),
+                                     _mm_xor_si128(r[k], flip));
+                }
+            }
+        }
+        decode_block_scalar(a, f, f + 8, l, a.num_lanes);
+    }
+    decode_block_scalar(a, f, a.num_frames, 0, a.num_lanes);
+}
+
+__attribute__((target("avx2")))
+void decode_avx2(const KernelArgs& a) {
+    const __m256i flip = _mm256_set1_epi16(static_cast<short>(a.flip));
+    size_t f = 0;
+    for (; f + 16 <= a.num_frames; f += 16) {
+        const uint16_t* base = a.lanes + f * a.stride;
+        uint32_t l = 0;
+        for (; l + 16 <= a.num_lanes; l += 16) {
+            // Frames 0-7 and 8-15, 16 lanes each; the 8x8 transposes run per 128-bit half
+            __m256i u[8], v[8];
+            for (int i = 0; i < 8; i++) {
+                u[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(base + i * a.stride + l));
+                v[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(base + (i + 8) * a.stride + l));
+            }
+            INTAN_TRANSPOSE_8X8(__m256i, _mm256_unpacklo_epi16, _mm256_unpackhi_epi16, _mm256_unpacklo_epi32,
+                                _mm256_unpackhi_epi32, _mm256_unpacklo_epi64, _mm256_unpackhi_epi64, u);
+            INTAN_TRANSPOSE_8X8(__m256i, _mm256_unpacklo_epi16, _mm256_unpackhi_epi16, _mm256_unpacklo_epi32,
+                                _mm256_unpackhi_epi32, _mm256_unpacklo_epi64, _mm256_unpackhi_epi64, v);
+            // u[k] = lane k (low half) and lane k + 8 (high half) of frames 0-7, v[k] of frames 8-15
+            for (int k = 0; k < 8; k++) {
+                const int32_t row_low = a.lane_rows[l + k];
+                const int32_t row_high = a.lane_rows[l + k + 8];
+                if (row_low >= 0) {
+                    const __m256i lane = _mm256_permute2x128_si256(u[k], v[k], 0x20);
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(a.out + static_cast<size_t>(row_low) * a.out_stride + f),
+                                        _mm256_xor_si256(lane, flip));
+                }
+                if (row_high >= 0) {
+                    const __m256i lane = _mm256_permute2x128_si256(u[k], v[k], 0x31);
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(a.out + static_cast<size_t>(row_high) * a.out_stride + f),
+                                        _mm256_xor_si256(lane, flip));
+                }
+            }
+        }
+        decode_block_scalar(a, f, f + 16, l, a.num_lanes);
+    }
+    decode_block_scalar(a, f, a.num_frames, 0, a.num_lanes);
+}
+
+#endif // INTAN_DECODER_X86
+
+#if INTAN_DECODER_NEON
+
+void decode_neon(const KernelArgs& a) {
+    const uint16x8_t flip = vdupq_n_u16(a.flip);
+    size_t f = 0;
+    for (; f + 8 <= a.num_frames; f += 8) {
+        const uint16_t* base = a.lanes + f * a.stride;
+        uint32_t l = 0;
+        for (; l + 8 <= a.num_lanes; l += 8) {
+            uint16x8_t r[8];
+            for (int i = 0; i < 8; i++) {
+                r[i] = vld1q_u16(base + i * a.stride + l);
+            }
+            // 16-bit, then 32-bit transposes of 2x2 blocks, then swap 64-bit halves
+            const uint16x8x2_t t0 = vtrnq_u16(r[0], r[1]);
+            const uint16x8x2_t t1 = vtrnq_u16(r[2], r[3]);
+            const uint16x8x2_t t2 = vtrnq_u16(r[4], r[5]);
+            const uint16x8x2_t t3 = vtrnq_u16(r[6], r[7]);
+            const uint32x4x2_t s0 = vtrnq_u32(vreinterpretq_u32_u16(t0.val[0]), vreinterpretq_u32_u16(t1.val[0]));
+            const uint32x4x2_t s1 = vtrnq_u32(vreinterpretq_u32_u16(t0.val[1]), vreinterpretq_u32_u16(t1.val[1]));
+            const uint32x4x2_t s2 = vtrnq_u32(vreinterpretq_u32_u16(t2.val[0]), vreinterpretq_u32_u16(t3.val[0]));
+            const uint32x4x2_t s3 = vtrnq_u32(vreinterpretq_u32_u16(t2.val[1]), vreinterpretq_u32_u16(t3.val[1]));
+            uint16x8_t c[8];
+            c[0] = vreinterpretq_u16_u32(vcombine_u32(vget_low_u32(s0.val[0]), vget_low_u32(s2.val[0])));
+            c[1] = vreinterpretq_u16_u32(vcombine_u32(vget_low_u32(s1.val[0]), vget_low_u32(s3.val[0])));
+            c[2] = vreinterpretq_u16_u32(vcombine_u32(vget_low_u32(s0.val[1]), vget_low_u32(s2.val[1])));
+            c[3] = vreinterpretq_u16_u32(vcombine_u32(vget_low_u32(s1.val[1]), vget_low_u32(s3.val[1])));
+            c[4] = vreinterpretq_u16_u32(vcombine_u32(vget_high_u32(s0.val[0]), vget_high_u32(s2.val[0])));
+            c[5] = vreinterpretq_u16_u32(vcombine_u32(vget_high_u32(s1.val[0]), vget_high_u32(s3.val[0])));
+            c[6] = vreinterpretq_u16_u32(vcombine_u32(vget_high_u32(s0.val[1]), vget_high_u32(s2.val[1])));
+            c[7] = vreinterpretq_u16_u32(vcombine_u32(vget_high_u32(s1.val[1]), vget_high_u32(s3.val[1])));
+            for (int k = 0; k < 8; k++) {
+                const int32_t row = a.lane_rows[l + k];
+                if (row >= 0) {
+                    vst1q_u16(a.out + static_cast<size_t>(row) * a.out_stride + f, veorq_u16(c[k], flip));
+                }
+            }
+        }
+        decode_block_scalar(a, f, f + 8, l, a.num_lanes);
+    }
+    decode_block_scalar(a, f, a.num_frames, 0, a.num_lanes);
+}
+
+#endif // INTAN_DECODER_NEON
+
+DecodeKernel best_kernel() {
+#if INTAN_DECODER_X86
+    if (kernel_available(DecodeKernel::Avx2)) {
+        return DecodeKernel::Avx2;
+    }
+    if (kernel_available(DecodeKernel::Sse2)) {
+        return DecodeKernel::Sse2;
+    }
+#endif
+#if INTAN_DECODER_NEON
+    return DecodeKernel::Neon;
+#endif
+    return DecodeKernel::Scalar;
+}
+
+constexpr size_t SCALED_CHUNK_FRAMES = 256;
+
+} // namespace
+
+const char* kernel_name(DecodeKernel kernel) {
+    switch (kernel) {
+        case DecodeKernel::Auto:
+            return "auto";
+        case DecodeKernel::Scalar:
+            return "scalar";
+        case DecodeKernel::Sse2:
+            return "sse2";
+        case DecodeKernel::Avx2:
+            return "avx2";
+        case DecodeKernel::Neon:
+            return "neon";
+    }
+    return "?";
+}
+
+bool kernel_available(DecodeKernel kernel) {
+    switch (kernel) {
+        case DecodeKernel::Auto:
+        case DecodeKernel::Scalar:
+            return true;
+#if INTAN_DECODER_X86
+        case DecodeKernel::Sse2:
+            return __builtin_cpu_supports("sse2");
+        case DecodeKernel::Avx2:
+            return __builtin_cpu_supports("avx2");
+#endif
+#if INTAN_DECODER_NEON
+        case DecodeKernel::Neon:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+Decoder::Decoder(uint32_t channel_enable, uint32_t num_spi_ports, DecodeOrder order, DecodeKernel kernel) {
+    num_streams_ = count_channels(channel_enable & channel_enable_all(num_spi_ports));
+    if (num_streams_ == 0) {
+        num_streams_ = CHANNELS_PER_PORT * num_spi_ports;    // As calculate_data_words()
+    }
+    num_lanes_ = CYCLES_PER_FRAME * num_streams_;
+    packet_words_ = PACKET_HEADER_WORDS + (num_lanes_ + 1) / 2;
+    num_rows_ = num_streams_ * (order == DecodeOrder::Slots ? CYCLES_PER_FRAME : AMPLIFIERS_PER_STREAM);
+    kernel_ = (kernel == DecodeKernel::Auto || !kernel_available(kernel)) ? best_kernel() : kernel;
+
+    lane_rows_.resize(num_lanes_);
+    for (uint32_t lane = 0; lane < num_lanes_; lane++) {
+        const uint32_t cycle = lane / num_streams_;
+        const uint32_t stream = lane % num_streams_;
+        if (order == DecodeOrder::Slots) {
+            lane_rows_[lane] = static_cast<int32_t>(stream * CYCLES_PER_FRAME + cycle);
+        } else if (cycle >= PIPELINE_DELAY_CYCLES && cycle - PIPELINE_DELAY_CYCLES < AMPLIFIERS_PER_STREAM) {
+            lane_rows_[lane] = static_cast<int32_t>(stream * AMPLIFIERS_PER_STREAM + cycle - PIPELINE_DELAY_CYCLES);
+        } else {
+            lane_rows_[lane] = -1;
+        }
+    }
+}
+
+void Decoder::decode(const uint32_t* packets, size_t packet_stride_words, size_t num_frames,
+                     uint16_t* out, size_t out_stride, uint16_t flip) const {
+    const KernelArgs args = {reinterpret_cast<const uint16_t*>(packets + PACKET_HEADER_WORDS),
+                             packet_stride_words * 2, num_frames, num_lanes_, lane_rows_.data(),
+                             out, out_stride, flip};
+    switch (kernel_) {
+#if INTAN_DECODER_X86
+        case DecodeKernel::Sse2:
+            decode_sse2(args);
+            return;
+        case DecodeKernel::Avx2:
+            decode_avx2(args);
+            return;
+#endif
+#if INTAN_DECODER_NEON
+        case DecodeKernel::Neon:
+            decode_neon(args);
+            return;
+#endif
+        default:
+            decode_scalar(args);
+            return;
+    }
+}
+
+void Decoder::decode_raw(const uint32_t* packets, size_t packet_stride_words, size_t num_frames,
+                         uint16_t* out, size_t out_stride) const {
+    decode(packets, packet_stride_words, num_frames, out, out_stride, 0);
+}
+
+void Decoder::decode_signed(const uint32_t* packets, size_t packet_stride_words, size_t num_frames,
+                            int16_t* out, size_t out_stride) const {
+    decode(packets, packet_stride_words, num_frames, reinterpret_cast<uint16_t*>(out), out_stride, 0x8000);
+}
+
+void Decoder::decode_scaled(const uint32_t* packets, size_t packet_stride_words, size_t num_frames,
+                            float* out, size_t out_stride, float scale) const {
+    // Transpose a chunk into signed samples, then convert row by row (vectorized by the compiler)
+    thread_local std::vector<int16_t> chunk;
+    chunk.resize(static_cast<size_t>(num_rows_) * SCALED_CHUNK_FRAMES);
+    for (size_t f0 = 0; f0 < num_frames; f0 += SCALED_CHUNK_FRAMES) {
+        const size_t n = std::min(SCALED_CHUNK_FRAMES, num_frames - f0);
+        decode_signed(packets + f0 * packet_stride_words, packet_stride_words, n, chunk.data(), SCALED_CHUNK_FRAMES);
+        for (uint32_t row = 0; row < num_rows_; row++) {
+            const int16_t* in = chunk.data() + static_cast<size_t>(row) * SCALED_CHUNK_FRAMES;
+            float* dst = out + static_cast<size_t>(row) * out_stride + f0;
+            for (size_t i = 0; i < n; i++) {
+                dst[i] = static_cast<float>(in[i]) * scale;
+            }
+        }
+    }
+}
+
+} // namespace intan
@@ -0,0 +1,80 @@
+// decoder.h
+// Turns batches of data packets from the wire layout into per-channel arrays.
+//
+// On the wire every frame is 35 cycles x the enabled 16-bit streams, cycle-major and
+// packed back to back (lane c * num_streams + s, see protocol.h), so one channel is
+// strided through every packet. Decoding is a transpose of the frames x lanes matrix:
+// the SIMD kernels move 8x8 (SSE2, NEON) or 16x16 (AVX2) tiles of 16-bit samples
+// through registers, and a lane-to-row table built once per channel mask puts every
+// lane in its output row - which also undoes the two-cycle pipeline delay of the
+// command results and drops the non-amplifier cycles in amplifier order.
+
+#ifndef INTAN_DECODER_H
+#define INTAN_DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "protocol.h"
+
+namespace intan {
+
+constexpr uint32_t PIPELINE_DELAY_CYCLES = 2;       // Results follow their command by two cycles
+constexpr uint32_t AMPLIFIERS_PER_STREAM = 32;      // CONVERT(0..31) in the convert sequence
+constexpr float MICROVOLTS_PER_LSB = 0.195f;
+
+enum class DecodeOrder {
+    Slots,          // Row s * 35 + c: every cycle of every enabled stream, as received
+    Amplifiers,     // Row s * 32 + ch: amplifier channel ch of stream s (convert sequence)
+};
+
+enum class DecodeKernel {
+    Auto,
+    Scalar,
+    Sse2,
+    Avx2,
+    Neon,
+};
+
+const char* kernel_name(DecodeKernel kernel);
+bool kernel_available(DecodeKernel kernel);
+
+class Decoder {
+public:
+    Decoder(uint32_t channel_enable, uint32_t num_spi_ports, DecodeOrder order = DecodeOrder::Amplifiers,
+            DecodeKernel kernel = DecodeKernel::Auto);
+
+    uint32_t num_streams() const { return num_streams_; }
+    uint32_t num_rows() const { return num_rows_; }
+    uint32_t packet_words() const { return packet_words_; }
+    DecodeKernel kernel() const { return kernel_; }
+
+    // Decode `num_frames` packets, packet f starting at packets + f * packet_stride_words
+    // (packet_words() for back-to-back packets). Row r of the output starts at
+    // out + r * out_stride and receives num_frames samples.
+    //   decode_raw:    samples as sent (offset binary for amplifier data)
+    //   decode_signed: amplifier data as two's complement (sample - 32768)
+    //   decode_scaled: (sample - 32768) * scale, microvolts by default
+    void decode_raw(const uint32_t* packets, size_t packet_stride_words, size_t num_frames,
+                    uint16_t* out, size_t out_stride) const;
+    void decode_signed(const uint32_t* packets, size_t packet_stride_words, size_t num_frames,
+                       int16_t* out, size_t out_stride) const;
+    void decode_scaled(const uint32_t* packets, size_t packet_stride_words, size_t num_frames,
+                       float* out, size_t out_stride, float scale = MICROVOLTS_PER_LSB) const;
+
+private:
+    void decode(const uint32_t* packets, size_t packet_stride_words, size_t num_frames,
+                uint16_t* out, size_t out_stride, uint16_t flip) const;
+
+    uint32_t num_streams_;
+    uint32_t num_lanes_;
+    uint32_t num_rows_;
+    uint32_t packet_words_;
+    DecodeKernel kernel_;
+    std::vector<int32_t> lane_rows_;    // Output row of every lane, -1 = not decoded
+};
+
+} // namespace intan
+
+#endif // INTAN_DECODER_H
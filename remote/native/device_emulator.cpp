@@ -0,0 +1,1903 @@
+// device_emulator.cpp
+// Software emulator of the Intan interface board for client and recorder development.
+//
+// Speaks the binary TCP command protocol of firmware/src-core0/network.c on TCP_PORT
+// and streams UDP data packets the way the firmware main loop does, one packet per
+// datagram. The PL is modelled frame by frame: control registers only latch while
+// transmission is stopped, loop counts, timestamps, channel-mask dependent packet
+// sizes and the debug sine data follow data_generator_core.sv. Packets go through a
+// BRAM ring (64K words, --bram-words) that the PS side drains, so DUMP_BRAM, READ_BRAM and the status
+// counters behave like the board; drained packets also go into the rolling frame
+// history that TRIGGER_CAPTURE, RESEND_FRAMES and the frame stream on STREAM_TCP_PORT
+// read from, and SET_FEC adds parity datagrams as fec.c does. SET_TELEMETRY datagrams are built
+// from the status counters as in telemetry.c, on wall-clock time. With debug mode off, each CIPO line is
+// answered by a word-level RHD2164 model (ROM registers, write echoes, DDR
+// conversions) that only decodes correctly within a window of fine phases, so the
+// cable test and the automatic phase detection in remote/net.py work against it.
+//
+// Frames are produced at the configured sample rate times --speed (--speed 0 runs
+// as fast as the host can send). Fault injection: datagram loss, reordering, PS
+// stalls (the backlog then drains through the pacer of firmware/src-core0/pacer.c,
+// in whole frame periods) and BRAM overrun gaps (runs of packets lost on the device,
+// counted in error_count).
+//
+// Differences from the board: loopback UDP destinations are accepted, the
+// firmware's blocking sleeps in the cable test are not reproduced, and RUN_BENCHMARK
+// reports host timings in ns: every copy method is a memcpy out of the emulated
+// BRAM, and the pbuf, udp_sendto and register figures are zero.
+//
+// Build: g++ -O2 -std=c++17 -pthread -o device_emulator device_emulator.cpp
+// Run:   ./device_emulator --udp-dest 127.0.0.1:5000 --speed 10
+//        ZYNQ_IP=127.0.0.1 python3 remote/net.py
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/sockios.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "protocol.h"
+
+using namespace intan;
+
+namespace {
+
+constexpr uint32_t FIRMWARE_VERSION_WORD = (1u << 24);   // 1.0.0.0
+constexpr uint32_t DEFAULT_UDP_DEST_IP = (192u << 24) | (168u << 16) | (18u << 8) | 100u;
+constexpr int MAX_CIPO_LINES = 2 * MAX_SPI_PORTS;
+constexpr int FINE_PHASE_WINDOW = 2;         // Phases either side of the optimum that decode
+constexpr uint32_t MAX_FRAMES_PER_ITERATION = 4096;
+constexpr size_t SEND_BATCH = 64;
+constexpr uint32_t MAX_RESEND_REQUESTS = 16;
+constexpr uint32_t RESEND_FRAMES_PER_POLL = 8;  // Per emulated frame, after the live datagrams
+
+std::atomic<bool> running{true};
+
+void handle_signal(int) {
+    running = false;
+}
+
+// ============================================================================
+// OPTIONS
+// ============================================================================
+
+struct Options {
+    uint16_t tcp_port = TCP_PORT;
+    uint16_t stream_port = STREAM_TCP_PORT;
+    uint32_t udp_dest_ip = (127u << 24) | 1u;    // Host byte order
+    uint16_t udp_dest_port = UDP_PORT;
+    uint32_t num_spi_ports = 1;
+    uint32_t bram_words = BRAM_SIZE_WORDS;       // BRAM ring depth (bram_depth_words of the PL build)
+    double speed = 1.0;                          // Multiple of real time, 0 = unthrottled
+    int cable_phase = 6;                         // Fine phase at the centre of the good window
+    uint32_t chips_present = 0xFFFF;             // One bit per CIPO line
+    bool ddr = true;                             // RHD2164 (DDR) or RHD2132 (no DDR)
+    double loss = 0.0;                           // Datagram loss probability
+    double reorder = 0.0;                        // Probability a datagram is delayed by one
+    double overrun = 0.0;                        // Probability per packet of an overrun gap
+    uint32_t overrun_packets = 16;               // Packets lost per overrun gap
+    double stall = 0.0;                          // Probability per frame of a PS stall
+    uint32_t stall_frames = 50;                  // Frame periods the PS stops draining BRAM
+    uint32_t seed = 1;
+    bool quiet = false;
+};
+
+bool parse_ip_port(const char* text, uint32_t& ip, uint16_t& port) {
+    std::string s(text);
+    const size_t colon = s.find(':');
+    in_addr addr;
+    if (inet_pton(AF_INET, s.substr(0, colon).c_str(), &addr) != 1) {
+        return false;
+    }
+    ip = ntohl(addr.s_addr);
+    if (colon != std::string::npos) {
+        port = static_cast<uint16_t>(std::atoi(s.c_str() + colon + 1));
+    }
+    return port != 0;
+}
+
+void print_usage(const char* program) {
+    std::printf("Usage: %s [options]\n", program);
+    std::printf("  --tcp-port <port>        Command port (default %u)\n", TCP_PORT);
+    std::printf("  --stream-port <port>     TCP frame stream port (default %u)\n", STREAM_TCP_PORT);
+    std::printf("  --udp-dest <ip[:port]>   Initial UDP destination (default 127.0.0.1:%u)\n", UDP_PORT);
+    std::printf("  --ports <1-8>            Headstage SPI ports (default 1)\n");
+    std::printf("  --bram-words <n>         BRAM ring depth, power of 2 from 1024 to 131072 (default %u)\n", BRAM_SIZE_WORDS);
+    std::printf("  --speed <x>              Frame rate multiple of real time, 0 = unthrottled (default 1)\n");
+    std::printf("  --cable-phase <0-23>     Fine phase that decodes best (default 6)\n");
+    std::printf("  --chips <mask>           CIPO lines with a chip attached (default all)\n");
+    std::printf("  --no-ddr                 Emulate RHD2132 chips (no DDR data)\n");
+    std::printf("  --loss <p>               Drop datagrams with probability p\n");
+    std::printf("  --reorder <p>            Swap a datagram with the next one with probability p\n");
+    std::printf("  --overrun <p>            Lose a run of packets in BRAM with probability p per packet\n");
+    std::printf("  --overrun-packets <n>    Packets lost per overrun (default 16)\n");
+    std::printf("  --stall <p>              Stop draining BRAM with probability p per frame\n");
+    std::printf("  --stall-frames <n>       Frame periods per stall (default 50)\n");
+    std::printf("  --seed <n>               Fault injection seed (default 1)\n");
+    std::printf("  --quiet                  No per-second statistics\n");
+}
+
+bool parse_options(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        const bool takes_value = arg != "--no-ddr" && arg != "--quiet";
+        if (takes_value && !value) {
+            return false;
+        }
+        if (arg == "--tcp-port") {
+            options.tcp_port = static_cast<uint16_t>(std::atoi(value));
+        } else if (arg == "--stream-port") {
+            options.stream_port = static_cast<uint16_t>(std::atoi(value));
+        } else if (arg == "--udp-dest") {
+            if (!parse_ip_port(value, options.udp_dest_ip, options.udp_dest_port)) {
+                return false;
+            }
+        } else if (arg == "--ports") {
+            options.num_spi_ports = std::strtoul(value, nullptr, 0);
+            if (options.num_spi_ports < 1 || options.num_spi_ports > MAX_SPI_PORTS) {
+                return false;
+            }
+        } else if (arg == "--bram-words") {
+            options.bram_words = std::strtoul(value, nullptr, 0);
+            if (options.bram_words < 1024 || options.bram_words > 131072 ||
+                (options.bram_words & (options.bram_words - 1)) != 0) {
+                return false;
+            }
+        } else if (arg == "--speed") {
+            options.speed = std::strtod(value, nullptr);
+        } else if (arg == "--cable-phase") {
+            options.cable_phase = std::atoi(value);
+        } else if (arg == "--chips") {
+            options.chips_present = std::strtoul(value, nullptr, 0);
+        } else if (arg == "--loss") {
+            options.loss = std::strtod(value, nullptr);
+        } else if (arg == "--reorder") {
+            options.reorder = std::strtod(value, nullptr);
+        } else if (arg == "--overrun") {
+            options.overrun = std::strtod(value, nullptr);
+        } else if (arg == "--overrun-packets") {
+            options.overrun_packets = std::strtoul(value, nullptr, 0);
+        } else if (arg == "--stall") {
+            options.stall = std::strtod(value, nullptr);
+        } else if (arg == "--stall-frames") {
+            options.stall_frames = std::strtoul(value, nullptr, 0);
+        } else if (arg == "--seed") {
+            options.seed = std::strtoul(value, nullptr, 0);
+        } else if (arg == "--no-ddr") {
+            options.ddr = false;
+            continue;
+        } else if (arg == "--quiet") {
+            options.quiet = true;
+            continue;
+        } else {
+            return false;
+        }
+        i++;
+    }
+    return options.speed >= 0.0;
+}
+
+// ============================================================================
+// DEBUG SINE TABLE (data_generator_core.sv)
+// ============================================================================
+
+struct SineTable {
+    uint16_t lut[512];
+    SineTable() {
+        for (int i = 0; i < 512; i++) {
+            const double angle = 2.0 * 3.14159265359 * i / 512.0;
+            lut[i] = static_cast<uint16_t>(static_cast<int16_t>(32767.0 / 8 * std::sin(angle)));
+        }
+    }
+};
+
+const SineTable sine_table;
+
+// ============================================================================
+// HEADSTAGE MODEL
+// ============================================================================
+
+// Word-level RHD2164/RHD2132 on one CIPO line. Results follow their command by two
+// transactions; DDR chips return channel C on the regular word and C+32 on the DDR word.
+class Headstage {
+public:
+    struct Result {
+        uint16_t regular;
+        uint16_t ddr;
+    };
+
+    Headstage() {
+        const char company[] = "INTAN";
+        for (int i = 0; i < 5; i++) {
+            registers_[40 + i] = static_cast<uint16_t>(company[i]);
+        }
+        registers_[61] = 1;     // Unipolar amplifiers
+        registers_[62] = 64;    // Number of amplifiers
+        registers_[63] = 4;     // Chip ID (RHD2164)
+    }
+
+    void configure(bool present, bool ddr, int line) {
+        present_ = present;
+        ddr_ = ddr;
+        line_ = line;
+        registers_[62] = ddr ? 64 : 32;
+        registers_[63] = ddr ? 4 : 1;
+    }
+
+    // One SPI transaction: returns what the chip shifts out while receiving `command`
+    Result transact(uint16_t command) {
+        const Result out = pipeline_[0];
+        pipeline_[0] = pipeline_[1];
+        pipeline_[1] = execute(command);
+        if (!present_) {
+            return {0, 0};      // MISO pulled low
+        }
+        return out;
+    }
+
+private:
+    Result execute(uint16_t command) {
+        const int reg = (command >> 8) & 0x3F;
+        switch (command >> 14) {
+            case 0: {   // CONVERT(C)
+                if (reg >= 32) {
+                    return {0, 0};
+                }
+                const uint16_t a = sample(reg);
+                return {a, ddr_ ? sample(reg + 32) : a};
+            }
+            case 1:     // CALIBRATE, CLEAR
+                return {0, 0};
+            case 2: {   // WRITE(R, D)
+                const uint16_t data = command & 0xFF;
+                if (reg < 40) {
+                    registers_[reg] = data;
+                }
+                const uint16_t echo = static_cast<uint16_t>(0xFF00 | data);
+                return {echo, echo};
+            }
+            default:    // READ(R)
+                if (reg == 59) {
+                    return {53, static_cast<uint16_t>(ddr_ ? 58 : 53)};   // MISO A/B marker
+                }
+                return {registers_[reg], registers_[reg]};
+        }
+    }
+
+    // Offset-binary sine of a different frequency on every channel
+    uint16_t sample(int channel) {
+        phase_[channel] += 0x00100000u * (1 + channel + 7 * line_);
+        const int16_t sine = static_cast<int16_t>(sine_table.lut[phase_[channel] >> 23]);
+        return static_cast<uint16_t>(0x8000 + sine / 16);
+    }
+
+    bool present_ = true;
+    bool ddr_ = true;
+    int line_ = 0;
+    Result pipeline_[2] = {{0, 0}, {0, 0}};
+    uint16_t registers_[64] = {};
+    uint32_t phase_[64] = {};
+};
+
+// Bits land in the wrong place when the sampling phase is outside the good window
+uint16_t misalign(uint16_t word, int phase_error) {
+    const int distance = std::abs(phase_error);
+    if (distance <= FINE_PHASE_WINDOW) {
+        return word;
+    }
+    const int shift = std::min(1 + (distance - FINE_PHASE_WINDOW - 1) / 8, 15);
+    return (phase_error > 0) ? static_cast<uint16_t>(word << shift)
+                             : static_cast<uint16_t>(word >> shift);
+}
+
+// ============================================================================
+// DEVICE MODEL (PL + PS)
+// ============================================================================
+
+struct Datagram {
+    std::vector<uint32_t> words;
+};
+
+class Device {
+public:
+    explicit Device(const Options& options)
+        : options_(options), num_ports_(options.num_spi_ports),
+          bram_words_(options.bram_words), bram_(bram_words_, 0),
+          udp_dest_ip_(options.udp_dest_ip), udp_dest_port_(options.udp_dest_port) {
+        for (int l = 0; l < MAX_CIPO_LINES; l++) {
+            headstages_[l].configure((options.chips_present >> l) & 1, options.ddr, l);
+        }
+        ctrl_.channel_enable = channel_enable_all(num_ports_);
+        ctrl_.sequence = initialization_cmd_sequence;   // Loaded by main() at boot
+        pl_ = ctrl_;
+        ps_packet_size_ = calculate_packet_size(ctrl_.channel_enable, num_ports_);
+        ps_channel_enable_ = ctrl_.channel_enable;
+    }
+
+    std::mutex& mutex() { return mutex_; }
+
+    uint32_t frame_rate() const { return ctrl_.sample_rate; }
+
+    // Handle one command, appending the ACK or response to `reply`. Deferred commands
+    // from a client (not from a transaction) are also completed via notifications().
+    // Returns the command's status once carried out (the completion status for deferred
+    // commands), which a transaction reports per sub-command.
+    uint8_t handle_command(const CommandPacket& cmd, std::string& reply, bool from_client = true) {
+        uint8_t status = ACK_SUCCESS;
+        if (from_client && is_deferred_command(cmd.cmd_id)) {
+            pending_completions_.push_back({cmd.cmd_id, cmd.ack_id});
+        }
+
+        switch (cmd.cmd_id) {
+            case CMD_START: {
+                const bool started = enable_streaming(true);
+                if (started) {
+                    pl_frame();     // The firmware completes START once the first frame has begun
+                }
+                append_ack(reply, cmd.ack_id, status);
+                complete(CMD_START, started ? ACK_SUCCESS : ACK_ERROR, stream_start_timestamp_, 0);
+                return started ? ACK_SUCCESS : ACK_ERROR;
+            }
+            case CMD_STOP: {
+                const bool stopped = stream_enabled_;
+                disable_streaming();
+                append_ack(reply, cmd.ack_id, status);
+                complete(CMD_STOP, stopped ? ACK_SUCCESS : ACK_ERROR, timestamp_, 0);
+                poll_history_capture();     // A window still open is cut short
+                return stopped ? ACK_SUCCESS : ACK_ERROR;
+            }
+            case CMD_RESET_TIMESTAMP:
+                reset_ps_counters();
+                if (!ctrl_.enable) {
+                    timestamp_ = 0;
+                }
+                history_epoch_ = history_frames_;
+                append_ack(reply, cmd.ack_id, status);
+                complete(CMD_RESET_TIMESTAMP, ACK_SUCCESS, timestamp_, 0);
+                return ACK_SUCCESS;
+            case CMD_SET_LOOP_COUNT:
+                ctrl_.loop_count = cmd.param1;
+                break;
+            case CMD_SET_PHASE:
+                ctrl_.fine_phase[0] = static_cast<uint8_t>((cmd.param1 & 0xF) << 1);
+                ctrl_.fine_phase[1] = static_cast<uint8_t>((cmd.param2 & 0xF) << 1);
+                break;
+            case CMD_SET_DEBUG_MODE:
+                ctrl_.debug_mode = cmd.param1 != 0;
+                break;
+            case CMD_SET_CHANNEL_ENABLE:
+                ctrl_.channel_enable = cmd.param1 & channel_enable_all(num_ports_);
+                break;
+            case CMD_SET_SAMPLE_RATE:
+                if (is_valid_sample_rate(cmd.param1) && !pl_active_) {
+                    ctrl_.sample_rate = cmd.param1;
+                } else {
+                    status = ACK_ERROR;
+                }
+                break;
+            case CMD_SET_FINE_PHASE:
+            case CMD_SET_PORT_FINE_PHASE: {
+                const bool per_port = cmd.cmd_id == CMD_SET_PORT_FINE_PHASE;
+                const uint32_t port = per_port ? cmd.param1 : 0;
+                const uint32_t fine_phase0 = per_port ? (cmd.param2 & 0xFF) : cmd.param1;
+                const uint32_t fine_phase1 = per_port ? ((cmd.param2 >> 8) & 0xFF) : cmd.param2;
+                if (port < num_ports_ && fine_phase0 < NUM_FINE_PHASES && fine_phase1 < NUM_FINE_PHASES) {
+                    ctrl_.fine_phase[2 * port] = static_cast<uint8_t>(fine_phase0);
+                    ctrl_.fine_phase[2 * port + 1] = static_cast<uint8_t>(fine_phase1);
+                } else {
+                    status = ACK_ERROR;
+                }
+                break;
+            }
+            case CMD_LOAD_CONVERT:
+            case CMD_LOAD_INIT:
+            case CMD_LOAD_CABLE_TEST:
+                // The firmware refuses while transmitting but still ACKs success
+                if (!pl_active_) {
+                    ctrl_.sequence = (cmd.cmd_id == CMD_LOAD_CONVERT) ? convert_cmd_sequence
+                                   : (cmd.cmd_id == CMD_LOAD_INIT)    ? initialization_cmd_sequence
+                                                                      : cable_length_cmd_sequence;
+                }
+                break;
+            case CMD_FULL_CABLE_TEST:
+                cable_test_pending_ = true;     // Runs from the main loop, like the firmware
+                break;
+            case CMD_GET_STATUS: {
+                StatusResponse response;
+                collect_status(response);
+                append_response(reply, cmd.ack_id, ACK_SUCCESS, &response, sizeof(response));
+                return ACK_SUCCESS;
+            }
+            case CMD_DUMP_BRAM:
+                dump_bram(cmd.param1, cmd.param2);
+                append_ack(reply, cmd.ack_id, status);
+                complete(CMD_DUMP_BRAM, ACK_SUCCESS, timestamp_, cmd.param2);
+                return ACK_SUCCESS;
+            case CMD_READ_BRAM:
+                read_bram(cmd, reply);
+                return ACK_SUCCESS;
+            case CMD_TRIGGER_CAPTURE:
+                if (from_client && history_trigger(cmd.param1, cmd.param2)) {
+                    capture_ack_id_ = cmd.ack_id;
+                } else {
+                    status = ACK_ERROR;
+                }
+                break;
+            case CMD_RUN_BENCHMARK:
+                if (from_client && !stream_enabled_ && !benchmark_pending_) {
+                    benchmark_pending_ = true;  // Runs from the main loop, like the firmware
+                    benchmark_ack_id_ = cmd.ack_id;
+                } else {
+                    status = ACK_ERROR;
+                }
+                break;
+            case CMD_RESEND_FRAMES:
+                if (!queue_frame_resend(cmd.param1, cmd.param2)) {
+                    status = ACK_ERROR;
+                }
+                break;
+            case CMD_SET_UDP_STREAM:
+                udp_stream_enabled_ = cmd.param1 != 0;
+                break;
+            case CMD_SET_FEC:
+                if (!fec_configure(cmd.param1)) {
+                    status = ACK_ERROR;
+                }
+                break;
+            case CMD_SET_PACING:
+                if (!pacer_configure(cmd.param1, cmd.param2)) {
+                    status = ACK_ERROR;
+                }
+                break;
+            case CMD_SET_TELEMETRY:
+                if (!telemetry_configure(cmd.param1, cmd.param2 & 0xFFFF, cmd.param2 >> 16)) {
+                    status = ACK_ERROR;
+                }
+                break;
+            case CMD_SET_UDP_DEST: {
+                const uint32_t ip = cmd.param1;     // Host byte order on the wire
+                const uint16_t port = static_cast<uint16_t>(cmd.param2 & 0xFFFF);
+                if (ip != 0 && ip != 0xFFFFFFFF && port != 0) {
+                    udp_dest_ip_ = ip;
+                    udp_dest_port_ = port;
+                    std::printf("UDP destination updated to %u.%u.%u.%u:%u\n", ip >> 24,
+                                (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF, port);
+                } else {
+                    status = ACK_ERROR;
+                }
+                break;
+            }
+            default:
+                status = ACK_ERROR;
+                std::printf("Binary Command: UNKNOWN (0x%08X)\n", cmd.cmd_id);
+                break;
+        }
+
+        append_ack(reply, cmd.ack_id, status);
+        return status;
+    }
+
+    // Completion notifications produced since the last call, for the TCP client
+    std::string notifications() {
+        std::string out;
+        out.swap(notifications_);
+        return out;
+    }
+
+    // Apply a complete transaction like run_transaction() in network.c: every
+    // sub-command is validated first, then all are applied back to back and each
+    // reports how it went
+    void handle_transaction(const std::vector<CommandPacket>& cmds, uint32_t ack_id, std::string& reply) {
+        std::vector<uint8_t> results(cmds.size());
+        uint8_t status = ACK_SUCCESS;
+        bool streaming = stream_enabled_;
+        for (size_t i = 0; i < cmds.size(); i++) {
+            results[i] = validate_transaction_command(cmds[i], streaming);
+            if (results[i] != ACK_SUCCESS) {
+                status = ACK_ERROR;
+            }
+        }
+        if (status == ACK_SUCCESS) {
+            std::string ignored;
+            for (size_t i = 0; i < cmds.size(); i++) {
+                results[i] = handle_command(cmds[i], ignored, false);
+                if (results[i] != ACK_SUCCESS) {
+                    status = ACK_ERROR;
+                }
+            }
+        } else {
+            for (uint8_t& result : results) {
+                result = (result == ACK_SUCCESS) ? 0 : result;
+            }
+        }
+        append_response(reply, ack_id, status, results.data(), static_cast<uint16_t>(results.size()));
+    }
+
+    // Advance the PL by one frame period and let the PS drain BRAM into `out`
+    void run_frame(std::vector<Datagram>& out) {
+        if (cable_test_pending_) {
+            cable_test_pending_ = false;
+            run_cable_test();
+            const bool started = enable_streaming(false);
+            complete(CMD_FULL_CABLE_TEST, started ? ACK_SUCCESS : ACK_ERROR, stream_start_timestamp_, 0);
+        }
+        if (benchmark_pending_) {
+            benchmark_pending_ = false;
+            run_benchmark();
+        }
+        if (!stop_backlog_.empty()) {
+            out.insert(out.end(), std::make_move_iterator(stop_backlog_.begin()),
+                       std::make_move_iterator(stop_backlog_.end()));
+            stop_backlog_.clear();
+        }
+        pl_frame();
+        if (stream_enabled_) {
+            // The PL high-water mark: the backlog peaks right after a frame is written
+            const uint64_t backlog = pl_write_total_ - ps_read_total_;
+            bram_backlog_max_ = std::max(bram_backlog_max_, backlog);
+            telemetry_max_backlog_ = std::max(telemetry_max_backlog_, backlog);
+        }
+        if (stall_frames_left_ == 0 && options_.stall > 0.0 && chance(options_.stall)) {
+            stall_frames_left_ = options_.stall_frames;
+        }
+        if (stall_frames_left_ > 0) {
+            stall_frames_left_--;
+        } else {
+            pacer_refill();
+            ps_drain(out, true);
+        }
+        if (!stream_enabled_ || pl_write_total_ - ps_read_total_ < ps_packet_size_) {
+            poll_frame_resend(out);     // Only once the live frames have all gone out
+        }
+        poll_history_capture();
+    }
+
+    void sockaddr_dest(sockaddr_in& addr) const {
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(udp_dest_ip_);
+        addr.sin_port = htons(udp_dest_port_);
+    }
+
+    void count_udp(uint32_t sent, uint32_t errors) {
+        udp_packets_sent_ += sent;
+        udp_send_errors_ += errors;
+    }
+
+    // Frame stream: a new client starts at the newest frame
+    void stream_connect() {
+        stream_next_frame_ = history_frames_;
+        stream_frames_sent_ = 0;
+        stream_frames_dropped_ = 0;
+        stream_buffered_bytes_ = 0;
+    }
+
+    // Appends whole frames recorded since the last call, at most max_bytes. A client
+    // more than half the history behind skips to the newest frame.
+    void stream_take(std::string& out, size_t max_bytes, uint32_t buffered_bytes) {
+        stream_buffered_bytes_ = buffered_bytes;
+        if (stream_next_frame_ > history_frames_) {
+            stream_next_frame_ = 0;     // History restarted by START
+        }
+        if (history_frames_ - stream_next_frame_ > history_slots_ / 2) {
+            stream_frames_dropped_ += static_cast<uint32_t>(history_frames_ - stream_next_frame_);
+            stream_next_frame_ = history_frames_;
+        }
+        const size_t frame_bytes = ps_packet_size_ * 4;
+        while (stream_next_frame_ < history_frames_ && out.size() + frame_bytes <= max_bytes) {
+            out.append(reinterpret_cast<const char*>(&history_[(stream_next_frame_ % history_slots_) * ps_packet_size_]),
+                       frame_bytes);
+            stream_next_frame_++;
+            stream_frames_sent_++;
+        }
+    }
+
+    // telemetry_poll() in firmware/src-core0/telemetry.c
+    bool poll_telemetry(std::chrono::steady_clock::time_point now, TelemetryDatagram& datagram,
+                        sockaddr_in& dest) {
+        if (telemetry_rate_hz_ == 0 || now < telemetry_next_due_) {
+            return false;
+        }
+        StatusResponse status;
+        collect_status(status);
+        const auto delta = [](uint32_t after, uint32_t before) { return after >= before ? after - before : after; };
+        const uint32_t interval_us = static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(now - telemetry_last_sent_).count());
+        const auto per_second = [interval_us](uint32_t count) {
+            return interval_us ? static_cast<uint32_t>(uint64_t{count} * 1000000 / interval_us) : 0;
+        };
+        const StatusResponse& last = telemetry_last_;
+
+        std::memset(&datagram, 0, sizeof(datagram));
+        datagram.magic_low = MAGIC_NUMBER_LOW;
+        datagram.magic_high = TELEMETRY_MAGIC_HIGH;
+        datagram.sequence = telemetry_sent_++;
+        datagram.interval_us = interval_us;
+        datagram.timestamp = status.timestamp;
+        datagram.flags_pl = status.flags_pl;
+        datagram.flags_ps = status.flags_ps;
+        datagram.packets_received = status.packets_received;
+        datagram.udp_packets_sent = status.udp_packets_sent;
+        datagram.udp_bytes_sent = status.udp_bytes_sent;
+        datagram.udp_frames_resent = status.udp_frames_resent;
+        datagram.rx_frames_per_s = per_second(delta(status.packets_received, last.packets_received));
+        datagram.tx_frames_per_s = per_second(delta(status.udp_packets_sent, last.udp_packets_sent));
+        datagram.max_backlog_words = static_cast<uint32_t>(telemetry_max_backlog_);
+        datagram.errors = delta(status.error_count, last.error_count);
+        datagram.udp_send_errors = delta(status.udp_send_errors, last.udp_send_errors);
+        datagram.udp_tx_forced_drops = delta(status.udp_tx_forced_drops, last.udp_tx_forced_drops);
+        datagram.udp_resend_misses = delta(status.udp_resend_misses, last.udp_resend_misses);
+        datagram.tcp_stream_frames_dropped = delta(status.tcp_stream_frames_dropped, last.tcp_stream_frames_dropped);
+        datagram.deadline_misses = delta(status.sched_deadline_misses, last.sched_deadline_misses);
+        datagram.budget_overruns = delta(status.sched_budget_overruns, last.sched_budget_overruns);
+
+        std::memset(&dest, 0, sizeof(dest));
+        dest.sin_family = AF_INET;
+        dest.sin_addr.s_addr = status.telemetry_dest_ip;
+        dest.sin_port = htons(status.telemetry_dest_port);
+
+        telemetry_last_ = status;
+        telemetry_last_sent_ = now;
+        telemetry_max_backlog_ = 0;
+        telemetry_next_due_ += telemetry_period();
+        if (telemetry_next_due_ <= now) {
+            telemetry_next_due_ = now + telemetry_period();
+        }
+        return true;
+    }
+
+    uint32_t error_count() const { return error_count_; }
+    uint32_t packets_received() const { return packets_received_; }
+
+private:
+    // Control registers as last written by the PS
+    struct Control {
+        bool enable = false;
+        bool debug_mode = false;
+        uint32_t loop_count = 0;
+        uint32_t sample_rate = MAX_SAMPLE_RATE_HZ;
+        uint32_t channel_enable = 0;
+        uint8_t fine_phase[MAX_CIPO_LINES] = {};
+        const uint16_t* sequence = nullptr;
+    };
+
+    static void append_response(std::string& reply, uint32_t ack_id, uint8_t status,
+                                const void* data, uint16_t length) {
+        const char header[RESPONSE_HEADER_SIZE] = {
+            static_cast<char>((ack_id >> 8) & 0xFF), static_cast<char>(ack_id & 0xFF),
+            static_cast<char>(status), static_cast<char>((length >> 8) & 0xFF),
+            static_cast<char>(length & 0xFF)};
+        reply.append(header, sizeof(header));
+        reply.append(static_cast<const char*>(data), length);
+    }
+
+    static void append_ack(std::string& reply, uint32_t ack_id, uint8_t status) {
+        const char ack[ACK_PACKET_SIZE] = {static_cast<char>((ack_id >> 8) & 0xFF),
+                                           static_cast<char>(ack_id & 0xFF), static_cast<char>(status)};
+        reply.append(ack, sizeof(ack));
+    }
+
+    // notify_command_complete() in firmware/src-core0/network.c
+    void complete(uint32_t cmd_id, uint8_t status, uint64_t timestamp, uint32_t detail) {
+        CompletionResponse completion = {};
+        completion.cmd_id = cmd_id;
+        completion.status = status;
+        completion.stream_enabled = stream_enabled_ ? 1 : 0;
+        completion.timestamp = timestamp;
+        completion.packets_received = packets_received_;
+        completion.detail = detail;
+        auto pending = pending_completions_.begin();
+        while (pending != pending_completions_.end()) {
+            if (pending->first == cmd_id) {
+                append_response(notifications_, pending->second, ACK_COMPLETE, &completion, sizeof(completion));
+                pending = pending_completions_.erase(pending);
+            } else {
+                ++pending;
+            }
+        }
+    }
+
+    // Same checks as handle_command(), without side effects. `streaming` follows the
+    // stream state the sub-commands before this one will have left behind.
+    uint8_t validate_transaction_command(const CommandPacket& cmd, bool& streaming) const {
+        switch (cmd.cmd_id) {
+            case CMD_START:
+            case CMD_STOP:
+                if (streaming == (cmd.cmd_id == CMD_START)) {
+                    return ACK_ERROR;
+                }
+                streaming = (cmd.cmd_id == CMD_START);
+                return ACK_SUCCESS;
+            case CMD_RESET_TIMESTAMP:
+            case CMD_SET_LOOP_COUNT:
+            case CMD_SET_PHASE:
+            case CMD_SET_CHANNEL_ENABLE:
+            case CMD_SET_DEBUG_MODE:
+            case CMD_SET_UDP_STREAM:
+            case CMD_LOAD_CONVERT:
+            case CMD_LOAD_INIT:
+            case CMD_LOAD_CABLE_TEST:
+                return ACK_SUCCESS;
+            case CMD_SET_FINE_PHASE:
+                return (cmd.param1 < NUM_FINE_PHASES && cmd.param2 < NUM_FINE_PHASES) ? ACK_SUCCESS : ACK_ERROR;
+            case CMD_SET_PORT_FINE_PHASE:
+                return (cmd.param1 < num_ports_ && (cmd.param2 & 0xFF) < NUM_FINE_PHASES &&
+                        ((cmd.param2 >> 8) & 0xFF) < NUM_FINE_PHASES) ? ACK_SUCCESS : ACK_ERROR;
+            case CMD_SET_SAMPLE_RATE:
+                return (is_valid_sample_rate(cmd.param1) && !streaming) ? ACK_SUCCESS : ACK_ERROR;
+            case CMD_SET_FEC:
+                return (cmd.param1 != 1 && cmd.param1 <= FEC_MAX_GROUP_SIZE) ? ACK_SUCCESS : ACK_ERROR;
+            case CMD_SET_PACING:
+                return pacer_is_valid(cmd.param1, cmd.param2) ? ACK_SUCCESS : ACK_ERROR;
+            case CMD_SET_TELEMETRY:
+                return telemetry_is_valid(cmd.param1, cmd.param2 >> 16) ? ACK_SUCCESS : ACK_ERROR;
+            case CMD_SET_UDP_DEST:
+                return (cmd.param1 != 0 && cmd.param1 != 0xFFFFFFFF && (cmd.param2 & 0xFFFF) != 0) ? ACK_SUCCESS
+                                                                                               : ACK_ERROR;
+            default:
+                return ACK_ERROR;
+        }
+    }
+
+    void reset_ps_counters() {
+        packets_received_ = 0;
+        error_count_ = 0;
+        udp_packets_sent_ = 0;
+        udp_send_errors_ = 0;
+    }
+
+    // handle_enable_streaming() in firmware/src-core0/main.c
+    bool enable_streaming(bool discard_stale_packets) {
+        if (stream_enabled_) {
+            return false;
+        }
+        ps_channel_enable_ = pl_active_ ? pl_.channel_enable : ctrl_.channel_enable;
+        ps_packet_size_ = calculate_packet_size(ps_channel_enable_, num_ports_);
+        history_start();
+        pacer_start();
+        reset_ps_counters();
+        bram_backlog_max_ = 0;
+        std::fill(std::begin(backlog_histogram_), std::end(backlog_histogram_), 0u);
+        // The firmware disables transmission and waits long enough for the current
+        // frame to finish and loop_limit_reached to clear before resetting the timestamp
+        ctrl_.enable = false;
+        while (pl_active_ || loop_limit_reached_) {
+            pl_frame();
+        }
+        if (discard_stale_packets) {
+            discard_bram();
+        }
+        timestamp_ = 0;
+        stream_start_timestamp_ = timestamp_;
+        stream_enabled_ = true;
+        ctrl_.enable = true;
+        return true;
+    }
+
+    // Packets the PL wrote while nobody was streaming (e.g. the frame that was running
+    // at STOP) are not part of the next stream
+    void discard_bram() {
+        ps_read_total_ = pl_write_total_;
+    }
+
+    // handle_disable_streaming(): the PL finishes the frame in progress, and that and
+    // the packets already in BRAM still go out
+    void disable_streaming() {
+        ctrl_.enable = false;
+        if (pl_active_) {
+            pl_frame();
+        }
+        ps_drain(stop_backlog_);
+        fec_send_parity(stop_backlog_);
+        stream_enabled_ = false;
+    }
+
+    // pl_run_full_cable_test(): initialization frame, then one frame per fine phase
+    void run_cable_test() {
+        if (pl_active_) {
+            return;
+        }
+        discard_bram();
+        ctrl_.loop_count = 1;
+        ctrl_.sequence = initialization_cmd_sequence;
+        run_single_frame();
+        ctrl_.sequence = cable_length_cmd_sequence;
+        for (uint32_t phase = 0; phase < NUM_FINE_PHASES; phase++) {
+            ctrl_.fine_phase[0] = static_cast<uint8_t>(phase);
+            ctrl_.fine_phase[1] = static_cast<uint8_t>(phase);
+            run_single_frame();
+        }
+    }
+
+    void run_single_frame() {
+        ctrl_.enable = true;
+        while (!pl_active_) {
+            pl_frame();
+        }
+        while (pl_active_) {
+            pl_frame();
+        }
+        ctrl_.enable = false;
+        pl_frame();     // Clears loop_limit_reached
+    }
+
+    // One frame of data_generator_core.sv
+    void pl_frame() {
+        if (!pl_active_) {
+            pl_ = ctrl_;    // Safe registers only update while transmission is stopped
+        }
+
+        if (pl_active_) {
+            write_packet();
+            packets_sent_++;
+            dummy_data_index_ = (dummy_data_index_ + 1) & 0x1FF;
+        }
+
+        // Frame boundary (all decisions use the values from before the boundary)
+        const bool was_active = pl_active_;
+        const bool limit = loop_limit_reached_;
+        timestamp_++;
+        if (!ctrl_.enable) {
+            pl_active_ = false;
+            loop_limit_reached_ = false;
+        }
+        if (was_active) {
+            if (limit) {
+                pl_active_ = false;
+            }
+            loop_limit_reached_ = pl_.loop_count != 0 && loop_counter_ + 1 >= pl_.loop_count;
+            loop_counter_++;
+        } else if (ctrl_.enable && !limit) {
+            loop_counter_ = 1;
+            loop_limit_reached_ = pl_.loop_count != 0 && pl_.loop_count <= 1;
+            pl_active_ = true;
+        }
+    }
+
+    void write_packet() {
+        const uint32_t num_segments = CHANNELS_PER_PORT * num_ports_;
+        const uint32_t num_channels = count_channels(pl_.channel_enable);
+        const uint32_t data_words = (CYCLES_PER_FRAME * num_channels + 1) / 2;
+
+        uint32_t* words = packet_buffer_;
+        words[0] = MAGIC_NUMBER_LOW;
+        words[1] = MAGIC_NUMBER_HIGH;
+        words[2] = static_cast<uint32_t>(timestamp_);
+        words[3] = static_cast<uint32_t>(timestamp_ >> 32);
+        std::memset(words + PACKET_HEADER_WORDS, 0, data_words * 4);
+        uint16_t* lanes = reinterpret_cast<uint16_t*>(words + PACKET_HEADER_WORDS);
+
+        uint32_t lane = 0;
+        for (uint32_t c = 0; c < CYCLES_PER_FRAME; c++) {
+            uint16_t segments[4 * MAX_SPI_PORTS];
+            if (pl_.debug_mode) {
+                const uint32_t offset = (c >= 2) ? c - 2 : 0;
+                const uint32_t base = (dummy_data_index_ + offset) & 0x1FF;
+                for (uint32_t p = 0; p < num_ports_; p++) {
+                    const uint32_t port_phase = (base + 64 * p) & 0x1FF;
+                    for (uint32_t s = 0; s < 4; s++) {
+                        segments[4 * p + s] = sine_table.lut[(port_phase << s) & 0x1FF];
+                    }
+                }
+            } else {
+                for (uint32_t l = 0; l < 2 * num_ports_; l++) {
+                    const Headstage::Result r = headstages_[l].transact(pl_.sequence[c]);
+                    const int error = static_cast<int>(pl_.fine_phase[l]) - options_.cable_phase;
+                    segments[2 * l] = misalign(r.regular, error);
+                    segments[2 * l + 1] = misalign(r.ddr, error);
+                }
+            }
+            for (uint32_t s = 0; s < num_segments; s++) {
+                if (pl_.channel_enable & (1u << s)) {
+                    lanes[lane++] = segments[s];
+                }
+            }
+        }
+
+        // Into the BRAM ring at the PL write address
+        const uint32_t packet_words = PACKET_HEADER_WORDS + data_words;
+        for (uint32_t i = 0; i < packet_words; i++) {
+            bram_[(pl_write_total_ + i) % bram_words_] = words[i];
+        }
+        pl_write_total_ += packet_words;
+    }
+
+    // The firmware main loop: read whole packets behind the PL write address, paced
+    // except for the final drain at STOP
+    void ps_drain(std::vector<Datagram>& out, bool paced = false) {
+        if (!stream_enabled_) {
+            return;
+        }
+        uint32_t burst = 0;
+        const bool missed = pl_write_total_ - ps_read_total_ >= bram_words_ * 3 / 4;   // SCHED_DEADLINE_WORDS
+        if (missed && !sched_missed_) {
+            sched_deadline_misses_++;
+        }
+        sched_missed_ = missed;
+        // The PL lapped the PS: the oldest packets were overwritten
+        while (pl_write_total_ - ps_read_total_ > bram_words_) {
+            ps_read_total_ += ps_packet_size_;
+            error_count_++;
+        }
+        if (paced && pl_write_total_ - ps_read_total_ >= ps_packet_size_) {
+            backlog_histogram_[backlog_hist_bin(pl_write_total_ - ps_read_total_)]++;
+        }
+        while (pl_write_total_ - ps_read_total_ >= ps_packet_size_) {
+            if (paced && !pacer_release(pl_write_total_ - ps_read_total_)) {
+                break;
+            }
+            burst++;
+            const uint32_t start = ps_read_total_ % bram_words_;
+            ps_read_total_ += ps_packet_size_;
+            if (bram_[start] != MAGIC_NUMBER_LOW ||
+                bram_[(start + 1) % bram_words_] != MAGIC_NUMBER_HIGH) {
+                error_count_++;
+                continue;
+            }
+            if (options_.overrun > 0.0 && chance(options_.overrun)) {
+                // Emulated overrun: the PS fell behind and the next packets were overwritten
+                const uint64_t lost = std::min<uint64_t>(options_.overrun_packets,
+                                                         (pl_write_total_ - ps_read_total_) / ps_packet_size_);
+                ps_read_total_ += lost * ps_packet_size_;
+                error_count_ += static_cast<uint32_t>(lost) + 1;
+                continue;
+            }
+            Datagram datagram;
+            datagram.words.resize(ps_packet_size_);
+            for (uint32_t i = 0; i < ps_packet_size_; i++) {
+                datagram.words[i] = bram_[(start + i) % bram_words_];
+            }
+            history_store(datagram.words.data());
+            if (udp_stream_enabled_) {
+                out.push_back(std::move(datagram));
+                fec_frame_sent(out.back().words, out);
+            }
+            packets_received_++;
+        }
+        max_burst_frames_ = std::max(max_burst_frames_, burst);
+    }
+
+    bool chance(double p) {
+        return std::uniform_real_distribution<double>(0.0, 1.0)(rng_) < p;
+    }
+
+    // Rolling frame history of firmware/src-core0/history.c
+    void history_start() {
+        history_.resize(HISTORY_SIZE_WORDS);
+        history_slots_ = HISTORY_SIZE_WORDS / ps_packet_size_;
+        history_frames_ = 0;
+        history_epoch_ = 0;
+        capture_armed_ = false;
+    }
+
+    void history_store(const uint32_t* packet) {
+        std::memcpy(&history_[(history_frames_ % history_slots_) * ps_packet_size_], packet, ps_packet_size_ * 4);
+        history_frames_++;
+    }
+
+    uint64_t history_frame_timestamp(uint64_t frame) const {
+        const uint32_t* words = &history_[(frame % history_slots_) * ps_packet_size_];
+        return (static_cast<uint64_t>(words[3]) << 32) | words[2];
+    }
+
+    // Token bucket of firmware/src-core0/pacer.c, counted in frames per frame period
+    static bool pacer_is_valid(uint32_t rate, uint32_t burst) {
+        return (rate == 0 || (rate >= PACING_MIN_RATE_PERCENT && rate <= 0xFFFF)) && burst <= PACING_MAX_BURST_FRAMES;
+    }
+
+    bool pacer_configure(uint32_t rate, uint32_t burst) {
+        if (!pacer_is_valid(rate, burst)) {
+            return false;
+        }
+        pacing_rate_percent_ = rate;
+        pacing_burst_frames_ = burst ? burst : PACING_BURST_FRAMES;
+        if (stream_enabled_) {
+            pacer_start();
+        }
+        return true;
+    }
+
+    void pacer_start() {
+        pacing_credit_ = pacing_burst_frames_;
+        pacing_holding_ = false;
+        pacing_delays_ = 0;
+        pacing_overrides_ = 0;
+        max_burst_frames_ = 0;
+        sched_deadline_misses_ = 0;
+    }
+
+    void pacer_refill() {
+        pacing_credit_ = std::min<double>(pacing_credit_ + pacing_rate_percent_ / 100.0, pacing_burst_frames_);
+    }
+
+    bool pacer_release(uint64_t backlog_words) {
+        if (pacing_rate_percent_ == 0) {
+            return true;
+        }
+        if (pacing_credit_ >= 1.0) {
+            pacing_credit_ -= 1.0;
+            pacing_holding_ = false;
+            return true;
+        }
+        if (backlog_words >= bram_words_ / 2) {     // PACING_OVERRIDE_WORDS
+            pacing_overrides_++;
+            pacing_holding_ = false;
+            return true;
+        }
+        if (!pacing_holding_) {
+            pacing_delays_++;
+            pacing_holding_ = true;
+        }
+        return false;
+    }
+
+    // SET_TELEMETRY: ip 0 follows the UDP stream host, port 0 is TELEMETRY_PORT
+    static bool telemetry_is_valid(uint32_t ip, uint32_t rate_hz) {
+        return rate_hz <= TELEMETRY_MAX_RATE_HZ && (rate_hz == 0 || ip != 0xFFFFFFFF);
+    }
+
+    bool telemetry_configure(uint32_t ip, uint16_t port, uint32_t rate_hz) {
+        if (!telemetry_is_valid(ip, rate_hz)) {
+            return false;
+        }
+        telemetry_rate_hz_ = rate_hz;
+        telemetry_ip_ = ip;
+        telemetry_port_ = port ? port : TELEMETRY_PORT;
+        telemetry_sent_ = 0;
+        telemetry_max_backlog_ = 0;
+        if (rate_hz != 0) {
+            collect_status(telemetry_last_);
+            telemetry_last_sent_ = std::chrono::steady_clock::now();
+            telemetry_next_due_ = telemetry_last_sent_ + telemetry_period();
+        }
+        return true;
+    }
+
+    std::chrono::steady_clock::duration telemetry_period() const {
+        return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1.0 / telemetry_rate_hz_));
+    }
+
+    // XOR parity groups of firmware/src-core0/fec.c
+    bool fec_configure(uint32_t size) {
+        if (size == 1 || size > FEC_MAX_GROUP_SIZE) {
+            return false;
+        }
+        fec_mask_ = 0;
+        fec_group_size_ = size;
+        fec_parity_sent_ = 0;
+        return true;
+    }
+
+    void fec_frame_sent(const std::vector<uint32_t>& packet, std::vector<Datagram>& out) {
+        if (fec_group_size_ == 0) {
+            return;
+        }
+        const uint64_t timestamp = (static_cast<uint64_t>(packet[3]) << 32) | packet[2];
+        if (fec_mask_ != 0 && (timestamp < fec_first_ || timestamp - fec_first_ >= fec_group_size_ ||
+                               packet.size() != fec_packet_words_)) {
+            fec_send_parity(out);
+        }
+        if (fec_mask_ == 0) {
+            fec_first_ = timestamp - timestamp % fec_group_size_;
+            fec_packet_words_ = static_cast<uint32_t>(packet.size());
+            fec_parity_.assign(packet.begin() + PACKET_HEADER_WORDS, packet.end());
+        } else {
+            for (size_t i = PACKET_HEADER_WORDS; i < packet.size(); i++) {
+                fec_parity_[i - PACKET_HEADER_WORDS] ^= packet[i];
+            }
+        }
+        const uint32_t index = static_cast<uint32_t>(timestamp - fec_first_);
+        fec_mask_ |= 1u << index;
+        if (index == fec_group_size_ - 1) {
+            fec_send_parity(out);
+        }
+    }
+
+    void fec_send_parity(std::vector<Datagram>& out) {
+        if (fec_mask_ == 0) {
+            return;
+        }
+        Datagram datagram;
+        datagram.words = {MAGIC_NUMBER_LOW, FEC_MAGIC_HIGH, static_cast<uint32_t>(fec_first_),
+                          static_cast<uint32_t>(fec_first_ >> 32), fec_group_size_, fec_mask_};
+        datagram.words.insert(datagram.words.end(), fec_parity_.begin(), fec_parity_.end());
+        out.push_back(std::move(datagram));
+        fec_parity_sent_++;
+        fec_mask_ = 0;
+    }
+
+    // RESEND_FRAMES (queue_frame_resend() and poll_frame_resend() in network.c)
+    bool queue_frame_resend(uint32_t first_low, uint32_t count) {
+        if (count == 0 || count > MAX_RESEND_FRAMES || resend_queue_.size() == MAX_RESEND_REQUESTS ||
+            history_frames_ == 0) {
+            return false;
+        }
+        const uint64_t newest = history_frame_timestamp(history_frames_ - 1);
+        uint64_t first = (newest & 0xFFFFFFFF00000000ull) | first_low;
+        if (first > newest && first >= 0x100000000ull) {
+            first -= 0x100000000ull;
+        }
+        uint64_t low = std::max(history_frames_ > history_slots_ ? history_frames_ - history_slots_ : 0,
+                                history_epoch_);
+        uint64_t high = history_frames_;
+        while (low < high) {
+            const uint64_t mid = low + (high - low) / 2;
+            if (history_frame_timestamp(mid) < first) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        if (low == history_frames_ || history_frame_timestamp(low) >= first + count) {
+            udp_resend_misses_ += count;
+            return false;
+        }
+        const uint32_t skipped = static_cast<uint32_t>(history_frame_timestamp(low) - first);
+        udp_resend_misses_ += skipped;
+        resend_queue_.push_back({low, first + count, count - skipped});
+        return true;
+    }
+
+    void poll_frame_resend(std::vector<Datagram>& out) {
+        uint32_t budget = RESEND_FRAMES_PER_POLL;
+        while (!resend_queue_.empty() && budget > 0) {
+            Resend& resend = resend_queue_.front();
+            if (resend.frames_left == 0 || resend.next_frame >= history_frames_ ||
+                history_frames_ - resend.next_frame >= history_slots_ || resend.next_frame < history_epoch_ ||
+                history_frame_timestamp(resend.next_frame) >= resend.end_timestamp) {
+                udp_resend_misses_ += resend.frames_left;
+                resend_queue_.pop_front();
+                continue;
+            }
+            Datagram datagram;
+            const uint32_t* words = &history_[(resend.next_frame % history_slots_) * ps_packet_size_];
+            datagram.words.assign(words, words + ps_packet_size_);
+            out.push_back(std::move(datagram));
+            resend.next_frame++;
+            resend.frames_left--;
+            udp_frames_resent_++;
+            budget--;
+        }
+    }
+
+    bool history_trigger(uint32_t pre_frames, uint32_t post_frames) {
+        if (!stream_enabled_ || capture_armed_ ||
+            static_cast<uint64_t>(pre_frames) + post_frames + 1 > history_slots_ / 2) {
+            return false;
+        }
+        capture_trigger_ = history_frames_ > 0 ? history_frames_ - 1 : 0;
+        const uint64_t available = std::min<uint64_t>(capture_trigger_, history_slots_ - 1);
+        capture_first_ = capture_trigger_ - std::min<uint64_t>(pre_frames, available);
+        capture_end_ = capture_trigger_ + 1 + post_frames;
+        capture_armed_ = true;
+        return true;
+    }
+
+    // poll_history_capture() in network.c: the capture goes out as the completion
+    void poll_history_capture() {
+        if (!capture_armed_) {
+            return;
+        }
+        if (history_frames_ < capture_end_) {
+            if (stream_enabled_) {
+                return;
+            }
+            capture_end_ = history_frames_;
+        }
+        capture_armed_ = false;
+
+        const uint32_t frames = capture_end_ > capture_first_ ? static_cast<uint32_t>(capture_end_ - capture_first_) : 0;
+        CaptureResponse capture = {};
+        capture.completion.cmd_id = CMD_TRIGGER_CAPTURE;
+        capture.completion.status = ACK_SUCCESS;
+        capture.completion.stream_enabled = stream_enabled_ ? 1 : 0;
+        capture.completion.packets_received = packets_received_;
+        capture.completion.detail = frames;
+        capture.packet_words = ps_packet_size_;
+        capture.pre_frames = static_cast<uint32_t>(capture_trigger_ - capture_first_);
+        auto frame_words = [this](uint64_t frame) { return &history_[(frame % history_slots_) * ps_packet_size_]; };
+        if (frames > 0) {
+            const uint32_t* first = frame_words(capture_first_);
+            capture.first_timestamp = (static_cast<uint64_t>(first[3]) << 32) | first[2];
+            const uint32_t* trigger = frame_words(capture_trigger_);
+            capture.completion.timestamp = (static_cast<uint64_t>(trigger[3]) << 32) | trigger[2];
+        }
+        append_response(notifications_, capture_ack_id_, ACK_COMPLETE, &capture, sizeof(capture));
+        for (uint64_t frame = capture_first_; frame < capture_end_; frame++) {
+            notifications_.append(reinterpret_cast<const char*>(frame_words(frame)), ps_packet_size_ * 4);
+        }
+    }
+
+    // benchmark.c and poll_benchmark() in network.c, timed on the host (see the top)
+    void run_benchmark() {
+        using clock = std::chrono::steady_clock;
+        const uint32_t num_sizes = CHANNELS_PER_PORT * num_ports_;
+        BenchmarkHeader header = {};
+        std::vector<uint16_t> frame_words(num_sizes);
+        std::vector<uint32_t> copy_ticks(num_sizes * BRAM_COPY_NUM_METHODS);
+        const std::vector<uint32_t> net_ticks(2 * num_sizes, 0);    // pbuf_ticks, send_ticks
+        uint64_t total[BRAM_COPY_NUM_METHODS] = {};
+        uint32_t buffer[MAX_PACKET_WORDS];
+        volatile uint32_t sink = 0;
+        auto ticks_since = [](clock::time_point start) {
+            return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count());
+        };
+
+        header.completion.status = stream_enabled_ ? ACK_ERROR : ACK_SUCCESS;
+        for (uint32_t size = 0; size < num_sizes && !stream_enabled_; size++) {
+            const uint32_t words = calculate_packet_size(channel_enable_all(num_ports_) >> (num_sizes - 1 - size), num_ports_);
+            frame_words[size] = static_cast<uint16_t>(words);
+            for (uint32_t method = 0; method < BRAM_COPY_NUM_METHODS; method++) {
+                uint32_t addr = 0;
+                const auto start = clock::now();
+                for (uint32_t i = 0; i < BENCH_COPY_REPEATS; i++) {
+                    const uint32_t first_part = std::min(words, bram_words_ - addr);
+                    std::memcpy(buffer, &bram_[addr], first_part * 4);
+                    std::memcpy(&buffer[first_part], &bram_[0], (words - first_part) * 4);
+                    sink = sink + buffer[words - 1];
+                    addr = (addr + words) % bram_words_;
+                }
+                copy_ticks[size * BRAM_COPY_NUM_METHODS + method] = ticks_since(start);
+                total[method] += copy_ticks[size * BRAM_COPY_NUM_METHODS + method];
+            }
+        }
+        const auto start = clock::now();
+        for (uint32_t i = 0; i < BENCH_REG_REPEATS; i++) {
+            sink = sink + bram_[i % bram_words_];
+        }
+        header.bram_read_ticks = ticks_since(start);
+
+        header.selected_method = static_cast<uint8_t>(std::min_element(std::begin(total), std::end(total)) - std::begin(total));
+        header.completion.cmd_id = CMD_RUN_BENCHMARK;
+        header.completion.stream_enabled = stream_enabled_ ? 1 : 0;
+        header.completion.timestamp = timestamp_;
+        header.completion.packets_received = packets_received_;
+        header.completion.detail = header.selected_method;
+        header.timer_hz = 1000000000;
+        header.num_sizes = static_cast<uint8_t>(num_sizes);
+        header.num_methods = BRAM_COPY_NUM_METHODS;
+        header.num_routines = BRAM_COPY_NUM_ROUTINES;
+        header.copy_repeats = BENCH_COPY_REPEATS;
+        header.net_repeats = BENCH_NET_REPEATS;
+        header.reg_repeats = BENCH_REG_REPEATS;
+
+        std::string payload(reinterpret_cast<const char*>(&header), sizeof(header));
+        payload.append(reinterpret_cast<const char*>(frame_words.data()), frame_words.size() * 2);
+        payload.append(reinterpret_cast<const char*>(copy_ticks.data()), copy_ticks.size() * 4);
+        payload.append(reinterpret_cast<const char*>(net_ticks.data()), net_ticks.size() * 4);
+        append_response(notifications_, benchmark_ack_id_, ACK_COMPLETE, payload.data(),
+                        static_cast<uint16_t>(payload.size()));
+    }
+
+    // Both modes are consistent here since the PL cannot run while the mutex is held
+    void read_bram(const CommandPacket& cmd, std::string& reply) {
+        const uint32_t count = cmd.param2 & BRAM_READ_COUNT_MASK;
+        if (cmd.param1 >= bram_words_ || count == 0 || count > bram_words_) {
+            append_response(reply, cmd.ack_id, ACK_ERROR, nullptr, 0);
+            return;
+        }
+        BramReadResponse header;
+        header.start_addr = cmd.param1;
+        header.word_count = count;
+        header.write_addr_before = static_cast<uint32_t>(pl_write_total_ % bram_words_);
+        header.write_addr_after = header.write_addr_before;
+        header.timestamp = timestamp_;
+        append_response(reply, cmd.ack_id, ACK_SUCCESS, &header, sizeof(header));
+        for (uint32_t i = 0; i < count; i++) {
+            const uint32_t word = bram_[(cmd.param1 + i) % bram_words_];
+            reply.append(reinterpret_cast<const char*>(&word), sizeof(word));
+        }
+    }
+
+    void dump_bram(uint32_t start, uint32_t count) {
+        std::printf("BRAM dump starting at address %u:\n", start);
+        for (uint32_t i = 0; i < count; i++) {
+            const uint32_t addr = (start + i) % bram_words_;
+            std::printf("%u: 0x%08X - 0x%08X\n", i, 0x80000000u + addr * 4, bram_[addr]);
+        }
+    }
+
+    void collect_status(StatusResponse& s) const {
+        std::memset(&s, 0, sizeof(s));
+        s.version = PROTOCOL_VERSION;
+        s.device_type = DEVICE_TYPE_INTAN_INTERFACE;
+        s.firmware_version = FIRMWARE_VERSION_WORD;
+
+        s.timestamp = timestamp_;
+        s.packets_sent = packets_sent_;
+        s.bram_write_addr = static_cast<uint32_t>(pl_write_total_ % bram_words_);
+        s.flags_pl = (pl_active_ ? STATUS_PL_TRANSMISSION_ACTIVE : 0) |
+                     (loop_limit_reached_ ? STATUS_PL_LOOP_LIMIT_REACHED : 0);
+        s.phase_half_steps = static_cast<uint8_t>((pl_.fine_phase[0] & 1) | ((pl_.fine_phase[1] & 1) << 1));
+
+        s.packets_received = packets_received_;
+        s.error_count = error_count_;
+        s.udp_packets_sent = udp_packets_sent_;
+        s.udp_send_errors = udp_send_errors_;
+        s.ps_read_addr = static_cast<uint32_t>(ps_read_total_ % bram_words_);
+        s.packet_size = ps_packet_size_;
+        s.flags_ps = stream_enabled_ ? STATUS_PS_STREAM_ENABLED : 0;
+        s.num_spi_ports = static_cast<uint8_t>(num_ports_);
+
+        // Port 0 reflects the latched registers, ports 1 and up the control registers
+        const uint32_t channel_enable = (pl_.channel_enable & 0xF) | (ctrl_.channel_enable & ~0xFu);
+        s.loop_count = pl_.loop_count;
+        s.phase0 = pl_.fine_phase[0] >> 1;
+        s.phase1 = pl_.fine_phase[1] >> 1;
+        s.channel_enable = channel_enable & 0xF;
+        s.channel_enable_all = channel_enable;
+        s.debug_mode = pl_.debug_mode ? 1 : 0;
+        s.sample_rate = ctrl_.sample_rate;
+
+        s.udp_dest_ip = htonl(udp_dest_ip_);
+        s.udp_dest_port = udp_dest_port_;
+        s.udp_packet_format = UDP_PACKET_FORMAT_V1;
+        s.udp_bytes_sent = udp_packets_sent_ * ps_packet_size_ * 4;
+
+        s.tcp_stream_frames_sent = stream_frames_sent_;
+        s.tcp_stream_frames_dropped = stream_frames_dropped_;
+        s.tcp_stream_buffered_bytes = stream_buffered_bytes_;
+
+        s.udp_frames_resent = udp_frames_resent_;
+        s.udp_resend_misses = udp_resend_misses_;
+
+        s.fec_group_size = fec_group_size_;
+        s.fec_parity_sent = fec_parity_sent_;
+
+        s.pacing_rate_percent = static_cast<uint16_t>(pacing_rate_percent_);
+        s.pacing_burst_frames = static_cast<uint16_t>(pacing_burst_frames_);
+        s.pacing_delays = pacing_delays_;
+        s.pacing_overrides = pacing_overrides_;
+        s.max_burst_frames = max_burst_frames_;
+
+        // udp_tx_waits and udp_tx_forced_drops stay 0: sends to the host socket block
+        // instead of running out of TX descriptors. The main loop is not timed, only
+        // deadline misses (from --stall) are counted.
+        s.sched_deadline_misses = sched_deadline_misses_;
+
+        s.telemetry_dest_ip = htonl(telemetry_ip_ ? telemetry_ip_ : udp_dest_ip_);
+        s.telemetry_dest_port = telemetry_port_;
+        s.telemetry_rate_hz = static_cast<uint16_t>(telemetry_rate_hz_);
+        s.telemetry_sent = telemetry_sent_;
+
+        // The PL FIFO is not modelled, fifo_count_max stays 0
+        s.bram_backlog_max = static_cast<uint32_t>(bram_backlog_max_);
+        std::copy(std::begin(backlog_histogram_), std::end(backlog_histogram_), s.backlog_histogram);
+        s.bram_size_words = bram_words_;
+    }
+
+    const Options& options_;
+    const uint32_t num_ports_;
+    const uint32_t bram_words_;
+    std::mutex mutex_;
+    std::mt19937 rng_{options_.seed};
+
+    // PL
+    Control ctrl_;
+    Control pl_;                // Latched copy used by the running frame
+    bool pl_active_ = false;
+    bool loop_limit_reached_ = false;
+    uint32_t loop_counter_ = 1;
+    uint64_t timestamp_ = 0;
+    uint64_t stream_start_timestamp_ = 0;
+    std::vector<std::pair<uint32_t, uint32_t>> pending_completions_;    // (cmd_id, ack_id)
+    std::string notifications_;
+    std::vector<Datagram> stop_backlog_;    // Drained at STOP, sent with the next frame
+    uint32_t packets_sent_ = 0;
+    uint32_t dummy_data_index_ = 0;
+    Headstage headstages_[MAX_CIPO_LINES];
+    uint32_t packet_buffer_[PACKET_HEADER_WORDS + CYCLES_PER_FRAME * 2 * MAX_SPI_PORTS + 1];
+    bool cable_test_pending_ = false;
+    bool benchmark_pending_ = false;
+    uint32_t benchmark_ack_id_ = 0;
+
+    // BRAM ring (totals are in words and never wrap)
+    std::vector<uint32_t> bram_;
+    uint64_t pl_write_total_ = 0;
+    uint64_t ps_read_total_ = 0;
+
+    // PS
+    bool stream_enabled_ = false;
+    uint32_t ps_packet_size_ = 0;
+    uint32_t ps_channel_enable_ = 0;
+    uint32_t packets_received_ = 0;
+    uint32_t error_count_ = 0;
+    uint32_t udp_packets_sent_ = 0;
+    uint32_t udp_send_errors_ = 0;
+    uint32_t udp_dest_ip_;      // Host byte order
+    uint16_t udp_dest_port_;
+    bool udp_stream_enabled_ = true;
+
+    // Frame history and the armed capture
+    std::vector<uint32_t> history_;
+    uint64_t history_slots_ = 1;
+    uint64_t history_frames_ = 0;
+    uint64_t history_epoch_ = 0;        // First frame since RESET_TIMESTAMP (history_reset_timestamps())
+    bool capture_armed_ = false;
+    uint64_t capture_trigger_ = 0;
+    uint64_t capture_first_ = 0;
+    uint64_t capture_end_ = 0;
+    uint32_t capture_ack_id_ = 0;
+
+    // Frame stream client (poll_tcp_stream() in firmware/src-core0/network.c)
+    uint64_t stream_next_frame_ = 0;
+    uint32_t stream_frames_sent_ = 0;
+    uint32_t stream_frames_dropped_ = 0;
+    uint32_t stream_buffered_bytes_ = 0;
+
+    // RESEND_FRAMES ranges waiting to go out, oldest first
+    struct Resend {
+        uint64_t next_frame;
+        uint64_t end_timestamp;     // One past the last requested timestamp
+        uint32_t frames_left;
+    };
+    std::deque<Resend> resend_queue_;
+    uint32_t udp_frames_resent_ = 0;
+    uint32_t udp_resend_misses_ = 0;
+
+    // FEC group being built
+    uint32_t fec_group_size_ = 0;
+    uint32_t fec_packet_words_ = 0;
+    uint64_t fec_first_ = 0;
+    uint32_t fec_mask_ = 0;
+    std::vector<uint32_t> fec_parity_;
+    uint32_t fec_parity_sent_ = 0;
+
+    // Transmit pacing and the emulated PS stall
+    uint32_t pacing_rate_percent_ = PACING_RATE_PERCENT;
+    uint32_t pacing_burst_frames_ = PACING_BURST_FRAMES;
+    double pacing_credit_ = 0.0;
+    bool pacing_holding_ = false;
+    uint32_t pacing_delays_ = 0;
+    uint32_t pacing_overrides_ = 0;
+    uint32_t max_burst_frames_ = 0;
+    uint32_t stall_frames_left_ = 0;
+    bool sched_missed_ = false;
+    uint32_t sched_deadline_misses_ = 0;
+
+    // Buffer headroom
+    uint64_t bram_backlog_max_ = 0;
+    uint32_t backlog_histogram_[BACKLOG_HIST_BINS] = {};
+
+    // Telemetry datagrams
+    uint32_t telemetry_rate_hz_ = 0;
+    uint32_t telemetry_ip_ = 0;     // Host byte order, 0 = UDP stream host
+    uint16_t telemetry_port_ = TELEMETRY_PORT;
+    uint32_t telemetry_sent_ = 0;
+    uint64_t telemetry_max_backlog_ = 0;
+    StatusResponse telemetry_last_ = {};
+    std::chrono::steady_clock::time_point telemetry_last_sent_;
+    std::chrono::steady_clock::time_point telemetry_next_due_;
+};
+
+// ============================================================================
+// UDP SENDER WITH FAULT INJECTION
+// ============================================================================
+
+class UdpSender {
+public:
+    explicit UdpSender(const Options& options) : options_(options), rng_(options.seed + 1) {
+        socket_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+        const int buffer = 4 << 20;
+        setsockopt(socket_, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer));
+    }
+
+    ~UdpSender() {
+        ::close(socket_);
+    }
+
+    // Returns the number of datagrams the device counts as sent and as errors
+    void send(std::vector<Datagram>& datagrams, const sockaddr_in& dest, uint32_t& sent, uint32_t& errors) {
+        sent = 0;
+        errors = 0;
+        std::vector<const Datagram*> order;
+        order.reserve(datagrams.size() + 1);
+        for (const Datagram& d : datagrams) {
+            if (held_ && !held_sent_) {
+                // Reordered datagram goes out after the one that overtook it
+                order.push_back(&d);
+                order.push_back(&held_datagram_);
+                held_sent_ = true;
+                continue;
+            }
+            if (options_.reorder > 0.0 && chance(options_.reorder) && !held_) {
+                held_datagram_ = d;
+                held_ = true;
+                held_sent_ = false;
+                continue;
+            }
+            order.push_back(&d);
+        }
+
+        std::vector<mmsghdr> messages;
+        std::vector<iovec> iovs;
+        messages.reserve(order.size());
+        iovs.reserve(order.size());
+        for (const Datagram* d : order) {
+            sent++;     // Counted by the device even when the network drops it
+            if (options_.loss > 0.0 && chance(options_.loss)) {
+                lost_++;
+                continue;
+            }
+            iovs.push_back({const_cast<uint32_t*>(d->words.data()), d->words.size() * 4});
+            mmsghdr message;
+            std::memset(&message, 0, sizeof(message));
+            message.msg_hdr.msg_name = const_cast<sockaddr_in*>(&dest);
+            message.msg_hdr.msg_namelen = sizeof(dest);
+            message.msg_hdr.msg_iov = &iovs.back();
+            message.msg_hdr.msg_iovlen = 1;
+            messages.push_back(message);
+        }
+
+        for (size_t first = 0; first < messages.size();) {
+            const unsigned batch = static_cast<unsigned>(std::min(SEND_BATCH, messages.size() - first));
+            const int n = sendmmsg(socket_, &messages[first], batch, 0);
+            if (n <= 0) {
+                errors++;
+                first++;
+                continue;
+            }
+            first += n;
+        }
+        sent -= errors;
+
+        if (held_ && held_sent_) {
+            held_ = false;
+            reordered_++;
+        }
+    }
+
+    uint64_t lost() const { return lost_; }
+    uint64_t reordered() const { return reordered_; }
+
+private:
+    bool chance(double p) {
+        return std::uniform_real_distribution<double>(0.0, 1.0)(rng_) < p;
+    }
+
+    const Options& options_;
+    std::mt19937 rng_;
+    int socket_ = -1;
+    Datagram held_datagram_;
+    bool held_ = false;
+    bool held_sent_ = false;
+    uint64_t lost_ = 0;
+    uint64_t reordered_ = 0;
+};
+
+// ============================================================================
+// TCP COMMAND SERVER
+// ============================================================================
+
+struct Client {
+    int fd;
+    std::string buffer;
+    std::vector<CommandPacket> transaction;     // Sub-commands collected so far
+    uint32_t transaction_count = 0;             // 0 = no transaction open
+    uint32_t transaction_ack_id = 0;
+};
+
+// Parse complete commands like tcp_recv_cb(): bad bytes are skipped one at a time
+void process_client_data(Device& device, Client& client, std::string& reply) {
+    size_t pos = 0;
+    while (client.buffer.size() - pos >= CMD_PACKET_SIZE) {
+        CommandPacket cmd;
+        std::memcpy(&cmd, client.buffer.data() + pos, sizeof(cmd));
+        if (cmd.magic != CMD_MAGIC) {
+            pos++;
+            continue;
+        }
+        pos += CMD_PACKET_SIZE;
+        if (client.transaction_count > 0) {
+            client.transaction.push_back(cmd);
+            if (client.transaction.size() == client.transaction_count) {
+                std::lock_guard<std::mutex> lock(device.mutex());
+                device.handle_transaction(client.transaction, client.transaction_ack_id, reply);
+                client.transaction.clear();
+                client.transaction_count = 0;
+            }
+        } else if (cmd.cmd_id == CMD_TRANSACTION) {
+            if (cmd.param1 > 0 && cmd.param1 <= MAX_TRANSACTION_COMMANDS) {
+                client.transaction_count = cmd.param1;
+                client.transaction_ack_id = cmd.ack_id;
+            } else {
+                const char error[RESPONSE_HEADER_SIZE] = {static_cast<char>((cmd.ack_id >> 8) & 0xFF),
+                                                          static_cast<char>(cmd.ack_id & 0xFF),
+                                                          static_cast<char>(ACK_ERROR), 0, 0};
+                reply.append(error, sizeof(error));
+            }
+        } else {
+            std::lock_guard<std::mutex> lock(device.mutex());
+            device.handle_command(cmd, reply);
+        }
+    }
+    client.buffer.erase(0, pos);
+}
+
+// The firmware has a single command connection; here every client gets the notifications
+void send_notifications(Device& device, const std::vector<Client>& clients) {
+    std::string notifications;
+    {
+        std::lock_guard<std::mutex> lock(device.mutex());
+        notifications = device.notifications();
+    }
+    if (notifications.empty()) {
+        return;
+    }
+    for (const Client& c : clients) {
+        if (c.fd >= 0) {
+            ::send(c.fd, notifications.data(), notifications.size(), MSG_NOSIGNAL);
+        }
+    }
+}
+
+void tcp_server(Device& device, uint16_t port) {
+    const int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    const int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener, 4) != 0) {
+        std::perror("TCP bind");
+        running = false;
+        return;
+    }
+    std::printf("Binary TCP command server started on port %u\n", port);
+
+    std::vector<Client> clients;
+    while (running) {
+        std::vector<pollfd> fds;
+        fds.push_back({listener, POLLIN, 0});
+        for (const Client& c : clients) {
+            fds.push_back({c.fd, POLLIN, 0});
+        }
+        const int ready = poll(fds.data(), fds.size(), 10);
+        send_notifications(device, clients);
+        if (ready <= 0) {
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            const int fd = accept(listener, nullptr, nullptr);
+            if (fd >= 0) {
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                clients.emplace_back();
+                clients.back().fd = fd;
+                std::printf("Binary TCP connection established\n");
+            }
+        }
+
+        for (size_t i = 1; i < fds.size(); i++) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            Client& client = clients[i - 1];
+            char data[4096];
+            const ssize_t n = recv(client.fd, data, sizeof(data), 0);
+            if (n <= 0) {
+                ::close(client.fd);
+                client.fd = -1;
+                continue;
+            }
+            client.buffer.append(data, static_cast<size_t>(n));
+            std::string reply;
+            process_client_data(device, client, reply);
+            if (!reply.empty()) {
+                ::send(client.fd, reply.data(), reply.size(), MSG_NOSIGNAL);
+            }
+            send_notifications(device, clients);
+        }
+        clients.erase(std::remove_if(clients.begin(), clients.end(),
+                                     [](const Client& c) { return c.fd < 0; }),
+                      clients.end());
+    }
+
+    for (const Client& c : clients) {
+        ::close(c.fd);
+    }
+    ::close(listener);
+}
+
+// ============================================================================
+// TCP FRAME STREAM
+// ============================================================================
+
+// One client at a time, like the firmware: a new connection replaces the old one.
+// The socket is non-blocking so a stalled client only stops its own stream.
+void stream_server(Device& device, uint16_t port) {
+    constexpr size_t STREAM_CHUNK_BYTES = 256 * 1024;
+    const int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    const int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener, 1) != 0) {
+        std::perror("TCP stream bind");
+        running = false;
+        return;
+    }
+    std::printf("TCP frame stream server started on port %u\n", port);
+
+    int client = -1;
+    std::string pending;
+    size_t pending_pos = 0;
+    while (running) {
+        const short client_events = pending_pos < pending.size() ? (POLLIN | POLLOUT) : POLLIN;
+        pollfd fds[2] = {{listener, POLLIN, 0}, {client, client_events, 0}};
+        poll(fds, client >= 0 ? 2 : 1, 2);
+
+        if (fds[0].revents & POLLIN) {
+            const int fd = accept(listener, nullptr, nullptr);
+            if (fd >= 0) {
+                if (client >= 0) {
+                    ::close(client);
+                }
+                client = fd;
+                pending.clear();
+                pending_pos = 0;
+                std::lock_guard<std::mutex> lock(device.mutex());
+                device.stream_connect();
+                std::printf("TCP stream: client connected\n");
+            }
+            continue;
+        }
+        if (client < 0) {
+            continue;
+        }
+
+        bool closed = false;
+        if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            char discard[256];
+            closed = recv(client, discard, sizeof(discard), MSG_DONTWAIT) == 0;
+        }
+        if (!closed && pending_pos == pending.size()) {
+            int unacked = 0;
+            ioctl(client, SIOCOUTQ, &unacked);
+            pending.clear();
+            pending_pos = 0;
+            std::lock_guard<std::mutex> lock(device.mutex());
+            device.stream_take(pending, STREAM_CHUNK_BYTES, static_cast<uint32_t>(unacked));
+        }
+        while (!closed && pending_pos < pending.size()) {
+            const ssize_t n = ::send(client, pending.data() + pending_pos, pending.size() - pending_pos,
+                                     MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n > 0) {
+                pending_pos += static_cast<size_t>(n);
+            } else {
+                closed = n < 0 && errno != EAGAIN && errno != EWOULDBLOCK;
+                break;
+            }
+        }
+        if (closed) {
+            ::close(client);
+            client = -1;
+            std::printf("TCP stream: client disconnected\n");
+        }
+    }
+
+    if (client >= 0) {
+        ::close(client);
+    }
+    ::close(listener);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    std::signal(SIGINT, handle_signal);
+    std::signal(SIGTERM, handle_signal);
+
+    Device device(options);
+    UdpSender sender(options);
+    const int telemetry_socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+    std::thread tcp_thread(tcp_server, std::ref(device), options.tcp_port);
+    std::thread stream_thread(stream_server, std::ref(device), options.stream_port);
+
+    std::printf("Emulating %u SPI port(s) at %gx real time\n", options.num_spi_ports, options.speed);
+
+    using clock = std::chrono::steady_clock;
+    auto last = clock::now();
+    auto last_report = last;
+    double frame_credit = 0.0;
+    uint64_t frames = 0;
+    uint64_t frames_reported = 0;
+    std::vector<Datagram> datagrams;
+
+    while (running) {
+        const auto now = clock::now();
+        const double elapsed = std::chrono::duration<double>(now - last).count();
+        last = now;
+
+        uint32_t due;
+        sockaddr_in dest;
+        datagrams.clear();
+        {
+            std::lock_guard<std::mutex> lock(device.mutex());
+            if (options.speed > 0.0) {
+                frame_credit += elapsed * device.frame_rate() * options.speed;
+                due = static_cast<uint32_t>(std::min<double>(frame_credit, MAX_FRAMES_PER_ITERATION));
+                frame_credit = std::min<double>(frame_credit - due, MAX_FRAMES_PER_ITERATION);
+            } else {
+                due = 256;
+            }
+            for (uint32_t i = 0; i < due; i++) {
+                device.run_frame(datagrams);
+            }
+            device.sockaddr_dest(dest);
+        }
+        frames += due;
+
+        if (!datagrams.empty()) {
+            uint32_t sent, errors;
+            sender.send(datagrams, dest, sent, errors);
+            std::lock_guard<std::mutex> lock(device.mutex());
+            device.count_udp(sent, errors);
+        }
+
+        TelemetryDatagram telemetry;
+        sockaddr_in telemetry_dest;
+        bool telemetry_due;
+        {
+            std::lock_guard<std::mutex> lock(device.mutex());
+            telemetry_due = device.poll_telemetry(now, telemetry, telemetry_dest);
+        }
+        if (telemetry_due) {
+            sendto(telemetry_socket, &telemetry, sizeof(telemetry), 0, reinterpret_cast<sockaddr*>(&telemetry_dest),
+                   sizeof(telemetry_dest));
+        }
+
+        if (!options.quiet && now - last_report >= std::chrono::seconds(1)) {
+            const double seconds = std::chrono::duration<double>(now - last_report).count();
+            std::lock_guard<std::mutex> lock(device.mutex());
+            std::printf("%.0f frames/s, %u packets, %u errors, %llu lost, %llu reordered\n",
+                        (frames - frames_reported) / seconds, device.packets_received(),
+                        device.error_count(), static_cast<unsigned long long>(sender.lost()),
+                        static_cast<unsigned long long>(sender.reordered()));
+            std::fflush(stdout);
+            frames_reported = frames;
+            last_report = now;
+        }
+
+        if (options.speed > 0.0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+
+    tcp_thread.join();
+    stream_thread.join();
+    ::close(telemetry_socket);
+    return 0;
+}
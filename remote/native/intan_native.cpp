@@ -0,0 +1,537 @@
+// intan_native.cpp
+// CPython extension exposing the native receiver and decoder to the Python tools.
+//
+//   FrameDecoder(channel_enable, num_spi_ports=1, order="amplifier", output="signed")
+//       process(data, timestamps=None, samples=None) -> (timestamps, samples, gaps)
+//       Validates and decodes every packet in a buffer of back-to-back packets in one
+//       call: magic check, timestamp continuity (carried across calls) and decoding to
+//       a (rows, frames) numpy array. Pass preallocated arrays to avoid allocations.
+//   Receiver(port=5000, bind="", cpu=-1, busy_poll=False, rcvbuf=64 MiB, drop_invalid=True)
+//       read(max_frames=4096, timeout=1.0) -> (bytes, sizes)
+//       Packets received by UdpReceiver's thread, back to back (only valid ones
+//       unless drop_invalid=False).
+//
+// Build: python3 setup.py build_ext --inplace (in this directory)
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+#include <structmember.h>
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "decoder.h"
+#include "udp_receiver.h"
+
+using namespace intan;
+
+namespace {
+
+// ============================================================================
+// FrameDecoder
+// ============================================================================
+
+enum OutputType {
+    OUTPUT_SIGNED,
+    OUTPUT_RAW,
+    OUTPUT_MICROVOLTS,
+};
+
+struct FrameDecoderObject {
+    PyObject_HEAD
+    Decoder* decoder;
+    OutputType output;
+    int has_last_timestamp;
+    unsigned long long last_timestamp;
+    unsigned long long frames;
+    unsigned long long magic_errors;
+    unsigned long long size_errors;
+    unsigned long long timestamp_errors;
+    unsigned long long frames_lost;
+};
+
+int output_numpy_type(OutputType output) {
+    switch (output) {
+        case OUTPUT_RAW:
+            return NPY_UINT16;
+        case OUTPUT_MICROVOLTS:
+            return NPY_FLOAT32;
+        default:
+            return NPY_INT16;
+    }
+}
+
+void FrameDecoder_dealloc(FrameDecoderObject* self) {
+    delete self->decoder;
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+int FrameDecoder_init(FrameDecoderObject* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"channel_enable", "num_spi_ports", "order", "output", nullptr};
+    unsigned int channel_enable;
+    unsigned int num_spi_ports = 1;
+    const char* order = "amplifier";
+    const char* output = "signed";
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "I|Iss", const_cast<char**>(keywords), &channel_enable,
+                                     &num_spi_ports, &order, &output)) {
+        return -1;
+    }
+    if (num_spi_ports < 1 || num_spi_ports > MAX_SPI_PORTS) {
+        PyErr_SetString(PyExc_ValueError, "num_spi_ports must be 1-8");
+        return -1;
+    }
+
+    DecodeOrder decode_order;
+    if (!std::strcmp(order, "amplifier")) {
+        decode_order = DecodeOrder::Amplifiers;
+    } else if (!std::strcmp(order, "slot")) {
+        decode_order = DecodeOrder::Slots;
+    } else {
+        PyErr_SetString(PyExc_ValueError, "order must be 'amplifier' or 'slot'");
+        return -1;
+    }
+    if (!std::strcmp(output, "signed")) {
+        self->output = OUTPUT_SIGNED;
+    } else if (!std::strcmp(output, "raw")) {
+        self->output = OUTPUT_RAW;
+    } else if (!std::strcmp(output, "microvolts")) {
+        self->output = OUTPUT_MICROVOLTS;
+    } else {
+        PyErr_SetString(PyExc_ValueError, "output must be 'signed', 'raw' or 'microvolts'");
+        return -1;
+    }
+
+    delete self->decoder;
+    self->decoder = new Decoder(channel_enable, num_spi_ports, decode_order);
+    self->has_last_timestamp = 0;
+    self->frames = self->magic_errors = self->size_errors = self->timestamp_errors = self->frames_lost = 0;
+    return 0;
+}
+
+// `out` if it is a usable output array with room for `frames` columns, else a new one
+PyArrayObject* output_array(PyObject* out, int ndim, npy_intp rows, npy_intp frames, int type, const char* name) {
+    if (out && out != Py_None) {
+        if (!PyArray_Check(out)) {
+            PyErr_Format(PyExc_TypeError, "%s must be a numpy array", name);
+            return nullptr;
+        }
+        PyArrayObject* array = reinterpret_cast<PyArrayObject*>(out);
+        const bool shape_ok = PyArray_NDIM(array) == ndim &&
+                              (ndim == 1 || PyArray_DIM(array, 0) == rows) &&
+                              PyArray_DIM(array, ndim - 1) >= frames;
+        if (PyArray_TYPE(array) != type || !PyArray_IS_C_CONTIGUOUS(array) || !PyArray_ISWRITEABLE(array) ||
+            !shape_ok) {
+            PyErr_Format(PyExc_ValueError, "%s must be a writable C-contiguous %s array with room for %zd frames",
+                         name, ndim == 1 ? "1-D" : "(rows, n)", static_cast<Py_ssize_t>(frames));
+            return nullptr;
+        }
+        Py_INCREF(out);
+        return array;
+    }
+    npy_intp dims[2] = {rows, frames};
+    return reinterpret_cast<PyArrayObject*>(
+        PyArray_SimpleNew(ndim, ndim == 1 ? &dims[1] : dims, type));
+}
+
+// View of the first `frames` columns of `array`
+PyObject* leading_view(PyArrayObject* array, npy_intp frames) {
+    const int ndim = PyArray_NDIM(array);
+    npy_intp dims[2];
+    for (int i = 0; i < ndim; i++) {
+        dims[i] = PyArray_DIM(array, i);
+    }
+    dims[ndim - 1] = frames;
+    Py_INCREF(PyArray_DESCR(array));
+    PyObject* view = PyArray_NewFromDescr(&PyArray_Type, PyArray_DESCR(array), ndim, dims, PyArray_STRIDES(array),
+                                          PyArray_DATA(array), NPY_ARRAY_WRITEABLE, nullptr);
+    if (!view) {
+        return nullptr;
+    }
+    Py_INCREF(array);
+    if (PyArray_SetBaseObject(reinterpret_cast<PyArrayObject*>(view), reinterpret_cast<PyObject*>(array)) < 0) {
+        Py_DECREF(view);
+        return nullptr;
+    }
+    return view;
+}
+
+PyObject* FrameDecoder_process(FrameDecoderObject* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"data", "timestamps", "samples", nullptr};
+    Py_buffer buffer;
+    PyObject* timestamps_out = nullptr;
+    PyObject* samples_out = nullptr;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*|OO", const_cast<char**>(keywords), &buffer,
+                                     &timestamps_out, &samples_out)) {
+        return nullptr;
+    }
+    if (!self->decoder) {
+        PyBuffer_Release(&buffer);
+        PyErr_SetString(PyExc_RuntimeError, "FrameDecoder not initialized");
+        return nullptr;
+    }
+
+    const Decoder& decoder = *self->decoder;
+    const size_t packet_words = decoder.packet_words();
+    const size_t packet_bytes = packet_words * 4;
+    const npy_intp num_packets = static_cast<npy_intp>(buffer.len / packet_bytes);
+    const npy_intp rows = decoder.num_rows();
+    const int type = output_numpy_type(self->output);
+
+    PyArrayObject* timestamps = output_array(timestamps_out, 1, 1, num_packets, NPY_UINT64, "timestamps");
+    PyArrayObject* samples = timestamps ? output_array(samples_out, 2, rows, num_packets, type, "samples") : nullptr;
+    std::vector<int64_t> gaps;
+    if (!samples) {
+        Py_XDECREF(timestamps);
+        PyBuffer_Release(&buffer);
+        return nullptr;
+    }
+
+    // Packets are copied once if the buffer is not word aligned
+    std::vector<uint32_t> aligned;
+    const uint32_t* packets = static_cast<const uint32_t*>(buffer.buf);
+    if (reinterpret_cast<uintptr_t>(buffer.buf) % alignof(uint32_t)) {
+        aligned.resize(num_packets * packet_words);
+        std::memcpy(aligned.data(), buffer.buf, aligned.size() * 4);
+        packets = aligned.data();
+    }
+
+    uint64_t* ts_out = static_cast<uint64_t*>(PyArray_DATA(timestamps));
+    char* samples_data = static_cast<char*>(PyArray_DATA(samples));
+    const size_t out_stride = static_cast<size_t>(PyArray_DIM(samples, 1));
+    const OutputType output = self->output;
+    npy_intp valid = 0;
+
+    Py_BEGIN_ALLOW_THREADS
+    if (buffer.len % packet_bytes) {
+        self->size_errors++;    // Trailing partial packet
+    }
+    npy_intp run_start = 0;
+    npy_intp run_valid_start = 0;
+    auto flush_run = [&](npy_intp end) {
+        const size_t n = static_cast<size_t>(end - run_start);
+        if (n == 0) {
+            return;
+        }
+        const uint32_t* first = packets + run_start * packet_words;
+        switch (output) {
+            case OUTPUT_RAW:
+                decoder.decode_raw(first, packet_words, n, reinterpret_cast<uint16_t*>(samples_data) + run_valid_start,
+                                   out_stride);
+                break;
+            case OUTPUT_MICROVOLTS:
+                decoder.decode_scaled(first, packet_words, n, reinterpret_cast<float*>(samples_data) + run_valid_start,
+                                      out_stride);
+                break;
+            default:
+                decoder.decode_signed(first, packet_words, n, reinterpret_cast<int16_t*>(samples_data) + run_valid_start,
+                                      out_stride);
+                break;
+        }
+    };
+
+    for (npy_intp i = 0; i < num_packets; i++) {
+        const uint32_t* p = packets + i * packet_words;
+        if (p[0] != MAGIC_NUMBER_LOW || p[1] != MAGIC_NUMBER_HIGH) {
+            // Decode the run of good packets before this one and start a new run after it
+            flush_run(i);
+            run_start = i + 1;
+            run_valid_start = valid;
+            self->magic_errors++;
+            continue;
+        }
+        const unsigned long long timestamp = (static_cast<uint64_t>(p[3]) << 32) | p[2];
+        if (self->has_last_timestamp && timestamp != self->last_timestamp + 1) {
+            self->timestamp_errors++;
+            if (timestamp > self->last_timestamp) {
+                self->frames_lost += timestamp - self->last_timestamp - 1;
+            }
+            gaps.push_back(valid);
+        }
+        self->has_last_timestamp = 1;
+        self->last_timestamp = timestamp;
+        ts_out[valid++] = timestamp;
+        self->frames++;
+    }
+    flush_run(num_packets);
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&buffer);
+
+    PyObject* ts_view = leading_view(timestamps, valid);
+    PyObject* samples_view = ts_view ? leading_view(samples, valid) : nullptr;
+    Py_DECREF(timestamps);
+    Py_DECREF(samples);
+    npy_intp num_gaps = static_cast<npy_intp>(gaps.size());
+    PyObject* gap_array = samples_view ? PyArray_SimpleNew(1, &num_gaps, NPY_INT64) : nullptr;
+    if (!gap_array) {
+        Py_XDECREF(ts_view);
+        Py_XDECREF(samples_view);
+        return nullptr;
+    }
+    if (num_gaps) {
+        std::memcpy(PyArray_DATA(reinterpret_cast<PyArrayObject*>(gap_array)), gaps.data(), gaps.size() * sizeof(int64_t));
+    }
+    return Py_BuildValue("(NNN)", ts_view, samples_view, gap_array);
+}
+
+PyObject* FrameDecoder_reset(FrameDecoderObject* self, PyObject*) {
+    self->has_last_timestamp = 0;
+    self->frames = self->magic_errors = self->size_errors = self->timestamp_errors = self->frames_lost = 0;
+    Py_RETURN_NONE;
+}
+
+PyObject* FrameDecoder_get_last_timestamp(FrameDecoderObject* self, void*) {
+    if (!self->has_last_timestamp) {
+        Py_RETURN_NONE;
+    }
+    return PyLong_FromUnsignedLongLong(self->last_timestamp);
+}
+
+// Continue timestamp continuity from another validator (None forgets it)
+int FrameDecoder_set_last_timestamp(FrameDecoderObject* self, PyObject* value, void*) {
+    if (!value || value == Py_None) {
+        self->has_last_timestamp = 0;
+        return 0;
+    }
+    const unsigned long long timestamp = PyLong_AsUnsignedLongLong(value);
+    if (PyErr_Occurred()) {
+        return -1;
+    }
+    self->has_last_timestamp = 1;
+    self->last_timestamp = timestamp;
+    return 0;
+}
+
+PyObject* FrameDecoder_get_num_rows(FrameDecoderObject* self, void*) {
+    return PyLong_FromUnsignedLong(self->decoder ? self->decoder->num_rows() : 0);
+}
+
+PyObject* FrameDecoder_get_num_streams(FrameDecoderObject* self, void*) {
+    return PyLong_FromUnsignedLong(self->decoder ? self->decoder->num_streams() : 0);
+}
+
+PyObject* FrameDecoder_get_packet_bytes(FrameDecoderObject* self, void*) {
+    return PyLong_FromUnsignedLong(self->decoder ? self->decoder->packet_words() * 4 : 0);
+}
+
+PyObject* FrameDecoder_get_kernel(FrameDecoderObject* self, void*) {
+    return PyUnicode_FromString(self->decoder ? kernel_name(self->decoder->kernel()) : "");
+}
+
+PyMethodDef FrameDecoder_methods[] = {
+    {"process", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(FrameDecoder_process)),
+     METH_VARARGS | METH_KEYWORDS,
+     "process(data, timestamps=None, samples=None) -> (timestamps, samples, gaps)\n\n"
+     "Validate and decode the back-to-back packets in `data`. Packets with a bad magic\n"
+     "number are skipped; `gaps` holds the output indices that do not follow the\n"
+     "previous timestamp."},
+    {"reset", reinterpret_cast<PyCFunction>(FrameDecoder_reset), METH_NOARGS,
+     "Clear the counters and the timestamp continuity state."},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+PyMemberDef FrameDecoder_members[] = {
+    {"frames", T_ULONGLONG, offsetof(FrameDecoderObject, frames), READONLY, "Valid packets processed"},
+    {"magic_errors", T_ULONGLONG, offsetof(FrameDecoderObject, magic_errors), READONLY, "Packets with a bad magic number"},
+    {"size_errors", T_ULONGLONG, offsetof(FrameDecoderObject, size_errors), READONLY, "Buffers with a partial packet"},
+    {"timestamp_errors", T_ULONGLONG, offsetof(FrameDecoderObject, timestamp_errors), READONLY,
+     "Timestamp discontinuities"},
+    {"frames_lost", T_ULONGLONG, offsetof(FrameDecoderObject, frames_lost), READONLY, "Frames missing in forward gaps"},
+    {nullptr, 0, 0, 0, nullptr},
+};
+
+PyGetSetDef FrameDecoder_getset[] = {
+    {"last_timestamp", reinterpret_cast<getter>(FrameDecoder_get_last_timestamp),
+     reinterpret_cast<setter>(FrameDecoder_set_last_timestamp), "Last valid timestamp", nullptr},
+    {"num_rows", reinterpret_cast<getter>(FrameDecoder_get_num_rows), nullptr, "Rows of the sample arrays", nullptr},
+    {"num_streams", reinterpret_cast<getter>(FrameDecoder_get_num_streams), nullptr, "Enabled 16-bit streams", nullptr},
+    {"packet_bytes", reinterpret_cast<getter>(FrameDecoder_get_packet_bytes), nullptr, "Bytes per packet", nullptr},
+    {"kernel", reinterpret_cast<getter>(FrameDecoder_get_kernel), nullptr, "SIMD kernel in use", nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr},
+};
+
+PyTypeObject FrameDecoderType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+// ============================================================================
+// Receiver
+// ============================================================================
+
+struct ReceiverObject {
+    PyObject_HEAD
+    UdpReceiver* receiver;
+};
+
+void Receiver_dealloc(ReceiverObject* self) {
+    if (self->receiver) {
+        Py_BEGIN_ALLOW_THREADS
+        delete self->receiver;
+        Py_END_ALLOW_THREADS
+    }
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+int Receiver_init(ReceiverObject* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"port", "bind", "cpu", "busy_poll", "rcvbuf", "drop_invalid", nullptr};
+    ReceiverConfig config;
+    unsigned int port = UDP_PORT;
+    const char* bind = "";
+    int busy_poll = 0;
+    int drop_invalid = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|Isipip", const_cast<char**>(keywords), &port, &bind, &config.cpu,
+                                     &busy_poll, &config.receive_buffer_bytes, &drop_invalid)) {
+        return -1;
+    }
+    config.port = static_cast<uint16_t>(port);
+    config.bind_address = bind;
+    config.busy_poll = busy_poll != 0;
+    config.drop_invalid = drop_invalid != 0;
+
+    delete self->receiver;
+    self->receiver = new UdpReceiver(config);
+    if (!self->receiver->start()) {
+        PyErr_SetString(PyExc_OSError, self->receiver->error().c_str());
+        delete self->receiver;
+        self->receiver = nullptr;
+        return -1;
+    }
+    return 0;
+}
+
+PyObject* Receiver_read(ReceiverObject* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"max_frames", "timeout", nullptr};
+    Py_ssize_t max_frames = 4096;
+    double timeout = 1.0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|nd", const_cast<char**>(keywords), &max_frames, &timeout)) {
+        return nullptr;
+    }
+    if (!self->receiver) {
+        PyErr_SetString(PyExc_RuntimeError, "receiver is closed");
+        return nullptr;
+    }
+
+    SpscRing<Frame>& ring = self->receiver->frames();
+    std::vector<uint32_t> words;
+    std::vector<uint32_t> sizes;
+
+    Py_BEGIN_ALLOW_THREADS
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeout);
+    size_t n = ring.readable();
+    while (n == 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        n = ring.readable();
+    }
+    n = std::min(n, static_cast<size_t>(max_frames));
+    for (size_t i = 0; i < n; i++) {
+        const Frame& frame = ring.read_slot(i);
+        words.insert(words.end(), frame.words, frame.words + frame.size_words);
+        sizes.push_back(frame.size_words * 4);
+    }
+    ring.release(n);
+    Py_END_ALLOW_THREADS
+
+    PyObject* data = PyBytes_FromStringAndSize(reinterpret_cast<const char*>(words.data()),
+                                               static_cast<Py_ssize_t>(words.size() * 4));
+    npy_intp count = static_cast<npy_intp>(sizes.size());
+    PyObject* size_array = data ? PyArray_SimpleNew(1, &count, NPY_UINT32) : nullptr;
+    if (!size_array) {
+        Py_XDECREF(data);
+        return nullptr;
+    }
+    if (count) {
+        std::memcpy(PyArray_DATA(reinterpret_cast<PyArrayObject*>(size_array)), sizes.data(), sizes.size() * 4);
+    }
+    return Py_BuildValue("(NN)", data, size_array);
+}
+
+PyObject* Receiver_stats(ReceiverObject* self, PyObject*) {
+    if (!self->receiver) {
+        PyErr_SetString(PyExc_RuntimeError, "receiver is closed");
+        return nullptr;
+    }
+    const ReceiverStats s = self->receiver->stats();
+    return Py_BuildValue("{s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:I}",
+                         "packets", s.packets, "bytes", s.bytes, "magic_errors", s.magic_errors,
+                         "size_errors", s.size_errors, "timestamp_errors", s.timestamp_errors,
+                         "frames_lost", s.frames_lost, "out_of_order", s.out_of_order,
+                         "kernel_drops", s.kernel_drops, "ring_full_waits", s.ring_full_waits,
+                         "fec_parity_packets", s.fec_parity_packets, "frames_recovered", s.frames_recovered,
+                         "sources", s.sources);
+}
+
+PyObject* Receiver_close(ReceiverObject* self, PyObject*) {
+    if (self->receiver) {
+        UdpReceiver* receiver = self->receiver;
+        self->receiver = nullptr;
+        Py_BEGIN_ALLOW_THREADS
+        delete receiver;
+        Py_END_ALLOW_THREADS
+    }
+    Py_RETURN_NONE;
+}
+
+PyMethodDef Receiver_methods[] = {
+    {"read", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(Receiver_read)),
+     METH_VARARGS | METH_KEYWORDS,
+     "read(max_frames=4096, timeout=1.0) -> (bytes, sizes)\n\n"
+     "Wait up to `timeout` seconds for packets and return up to `max_frames` of them\n"
+     "back to back, with the size in bytes of each."},
+    {"stats", reinterpret_cast<PyCFunction>(Receiver_stats), METH_NOARGS, "Receive counters as a dict."},
+    {"close", reinterpret_cast<PyCFunction>(Receiver_close), METH_NOARGS, "Stop the receive thread."},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+PyTypeObject ReceiverType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+PyModuleDef module_def = {
+    PyModuleDef_HEAD_INIT, "intan_native",
+    "Native receiver and decoder for the Intan interface board data stream.", -1, nullptr,
+    nullptr, nullptr, nullptr, nullptr,
+};
+
+} // namespace
+
+PyMODINIT_FUNC PyInit_intan_native(void) {
+    import_array();
+
+    FrameDecoderType.tp_name = "intan_native.FrameDecoder";
+    FrameDecoderType.tp_basicsize = sizeof(FrameDecoderObject);
+    FrameDecoderType.tp_flags = Py_TPFLAGS_DEFAULT;
+    FrameDecoderType.tp_doc = "FrameDecoder(channel_enable, num_spi_ports=1, order='amplifier', output='signed')";
+    FrameDecoderType.tp_new = PyType_GenericNew;
+    FrameDecoderType.tp_init = reinterpret_cast<initproc>(FrameDecoder_init);
+    FrameDecoderType.tp_dealloc = reinterpret_cast<destructor>(FrameDecoder_dealloc);
+    FrameDecoderType.tp_methods = FrameDecoder_methods;
+    FrameDecoderType.tp_members = FrameDecoder_members;
+    FrameDecoderType.tp_getset = FrameDecoder_getset;
+
+    ReceiverType.tp_name = "intan_native.Receiver";
+    ReceiverType.tp_basicsize = sizeof(ReceiverObject);
+    ReceiverType.tp_flags = Py_TPFLAGS_DEFAULT;
+    ReceiverType.tp_doc = "Receiver(port=5000, bind='', cpu=-1, busy_poll=False, rcvbuf=64 MiB, drop_invalid=True)";
+    ReceiverType.tp_new = PyType_GenericNew;
+    ReceiverType.tp_init = reinterpret_cast<initproc>(Receiver_init);
+    ReceiverType.tp_dealloc = reinterpret_cast<destructor>(Receiver_dealloc);
+    ReceiverType.tp_methods = Receiver_methods;
+
+    if (PyType_Ready(&FrameDecoderType) < 0 || PyType_Ready(&ReceiverType) < 0) {
+        return nullptr;
+    }
+
+    PyObject* module = PyModule_Create(&module_def);
+    if (!module) {
+        return nullptr;
+    }
+    Py_INCREF(&FrameDecoderType);
+    Py_INCREF(&ReceiverType);
+    if (PyModule_AddObject(module, "FrameDecoder", reinterpret_cast<PyObject*>(&FrameDecoderType)) < 0 ||
+        PyModule_AddObject(module, "Receiver", reinterpret_cast<PyObject*>(&ReceiverType)) < 0) {
+        Py_DECREF(module);
+        return nullptr;
+    }
+    return module;
+}
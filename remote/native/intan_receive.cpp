@@ -0,0 +1,165 @@
+// intan_receive.cpp
+// Command-line front end of UdpReceiver: receives the data stream and reports rates
+// and errors once per second, like udp_listener() in remote/net.py but without
+// dropping packets at 30 kS/s.
+//
+// Build: g++ -O2 -std=c++17 -pthread -o intan_receive intan_receive.cpp udp_receiver.cpp
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <thread>
+
+#include "udp_receiver.h"
+
+using namespace intan;
+
+namespace {
+
+volatile std::sig_atomic_t running = 1;
+
+void handle_signal(int) {
+    running = 0;
+}
+
+void print_usage(const char* program) {
+    std::printf("Usage: %s [options]\n", program);
+    std::printf("  --port <port>        UDP port (default %u)\n", UDP_PORT);
+    std::printf("  --bind <ip>          Local address to bind (default all)\n");
+    std::printf("  --cpu <n>            Pin the receive thread to CPU n\n");
+    std::printf("  --busy-poll          Spin instead of blocking in recvmmsg\n");
+    std::printf("  --batch <n>          Datagrams per recvmmsg (default 64)\n");
+    std::printf("  --rcvbuf <bytes>     Socket receive buffer (default 64 MiB)\n");
+    std::printf("  --packet-words <n>   Expected packet size (default any valid size)\n");
+    std::printf("  --no-timestamps      Do not capture kernel receive timestamps\n");
+    std::printf("  --duration <s>       Stop after s seconds\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    ReceiverConfig config;
+    double duration = 0.0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (!std::strcmp(arg, "--busy-poll")) {
+            config.busy_poll = true;
+            continue;
+        }
+        if (!std::strcmp(arg, "--no-timestamps")) {
+            config.kernel_timestamps = false;
+            continue;
+        }
+        if (!value) {
+            print_usage(argv[0]);
+            return 2;
+        }
+        if (!std::strcmp(arg, "--port")) {
+            config.port = static_cast<uint16_t>(std::atoi(value));
+        } else if (!std::strcmp(arg, "--bind")) {
+            config.bind_address = value;
+        } else if (!std::strcmp(arg, "--cpu")) {
+            config.cpu = std::atoi(value);
+        } else if (!std::strcmp(arg, "--batch")) {
+            config.batch_size = std::strtoul(value, nullptr, 0);
+        } else if (!std::strcmp(arg, "--rcvbuf")) {
+            config.receive_buffer_bytes = std::atoi(value);
+        } else if (!std::strcmp(arg, "--packet-words")) {
+            config.expected_packet_words = std::strtoul(value, nullptr, 0);
+        } else if (!std::strcmp(arg, "--duration")) {
+            duration = std::strtod(value, nullptr);
+        } else {
+            print_usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+
+    std::signal(SIGINT, handle_signal);
+    std::signal(SIGTERM, handle_signal);
+
+    UdpReceiver receiver(config);
+    if (!receiver.start()) {
+        std::fprintf(stderr, "[UDP] %s\n", receiver.error().c_str());
+        return 1;
+    }
+    std::printf("[UDP] Listening on port %u...\n", config.port);
+
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    auto last_report = start;
+    uint64_t consumed = 0;
+    uint64_t consumed_at_report = 0;
+    uint64_t last_timestamp = 0;
+    int64_t max_latency_ns = 0;
+
+    SpscRing<Frame>& frames = receiver.frames();
+    while (running) {
+        const size_t n = frames.readable();
+        for (size_t i = 0; i < n; i++) {
+            const Frame& frame = frames.read_slot(i);
+            last_timestamp = frame.timestamp;
+            if (frame.rx_time_ns) {
+                timespec now;
+                clock_gettime(CLOCK_REALTIME, &now);
+                const int64_t latency = static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec - frame.rx_time_ns;
+                max_latency_ns = std::max(max_latency_ns, latency);
+            }
+        }
+        frames.release(n);
+        consumed += n;
+        if (n == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+
+        const auto now = clock::now();
+        if (now - last_report >= std::chrono::seconds(1)) {
+            const double interval = std::chrono::duration<double>(now - last_report).count();
+            const ReceiverStats s = receiver.stats();
+            std::printf("[INFO] Packet %llu: Timestamp %llu, Rate: %.1f pkt/s, Errors: %llu "
+                        "(magic %llu, size %llu, timestamp %llu), lost %llu, kernel drops %llu, "
+                        "max latency %.0f us\n",
+                        static_cast<unsigned long long>(s.packets),
+                        static_cast<unsigned long long>(last_timestamp),
+                        (consumed - consumed_at_report) / interval,
+                        static_cast<unsigned long long>(s.magic_errors + s.size_errors + s.timestamp_errors),
+                        static_cast<unsigned long long>(s.magic_errors),
+                        static_cast<unsigned long long>(s.size_errors),
+                        static_cast<unsigned long long>(s.timestamp_errors),
+                        static_cast<unsigned long long>(s.frames_lost),
+                        static_cast<unsigned long long>(s.kernel_drops),
+                        max_latency_ns / 1000.0);
+            std::fflush(stdout);
+            consumed_at_report = consumed;
+            max_latency_ns = 0;
+            last_report = now;
+        }
+        if (duration > 0.0 && std::chrono::duration<double>(now - start).count() >= duration) {
+            break;
+        }
+    }
+
+    receiver.stop();
+    const ReceiverStats s = receiver.stats();
+    const double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    std::printf("\n=== STATISTICS ===\n");
+    std::printf("Total packets: %llu from %u device(s)\n", static_cast<unsigned long long>(s.packets), s.sources);
+    std::printf("Total errors: %llu\n",
+                static_cast<unsigned long long>(s.magic_errors + s.size_errors + s.timestamp_errors));
+    std::printf("Frames lost: %llu, out of order: %llu, kernel drops: %llu\n",
+                static_cast<unsigned long long>(s.frames_lost),
+                static_cast<unsigned long long>(s.out_of_order),
+                static_cast<unsigned long long>(s.kernel_drops));
+    if (s.fec_parity_packets) {
+        std::printf("FEC: %llu parity datagrams, %llu frames recovered\n",
+                    static_cast<unsigned long long>(s.fec_parity_packets),
+                    static_cast<unsigned long long>(s.frames_recovered));
+    }
+    std::printf("Elapsed time: %.1fs\n", elapsed);
+    std::printf("Data rate: %.1f Mbps\n", elapsed > 0 ? s.bytes * 8 / elapsed / 1e6 : 0.0);
+    return 0;
+}
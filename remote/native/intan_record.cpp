@@ -0,0 +1,199 @@
+// intan_record.cpp
+// Records the board's data stream to a recording file (see recording.h).
+//
+// The device configuration for the file header is read with CMD_GET_STATUS when
+// --device is given; otherwise --channels/--ports/--rate describe the stream. Frames
+// come from UdpReceiver and are written by RecordingWriter's writer thread.
+//
+// Build: g++ -O2 -std=c++17 -pthread -o intan_record intan_record.cpp udp_receiver.cpp recording.cpp
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "recording.h"
+#include "udp_receiver.h"
+
+using namespace intan;
+
+namespace {
+
+volatile std::sig_atomic_t running = 1;
+
+void handle_signal(int) {
+    running = 0;
+}
+
+bool receive_exact(int fd, void* data, size_t bytes) {
+    uint8_t* out = static_cast<uint8_t*>(data);
+    while (bytes) {
+        const ssize_t n = recv(fd, out, bytes, 0);
+        if (n <= 0) {
+            return false;
+        }
+        out += n;
+        bytes -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool fetch_status(const char* ip, StatusResponse& status) {
+    const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    timeval timeout = {2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(TCP_PORT);
+    bool ok = inet_pton(AF_INET, ip, &addr.sin_addr) == 1 &&
+              connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+
+    const CommandPacket cmd = {CMD_MAGIC, CMD_GET_STATUS, 1, 0, 0};
+    uint8_t header[RESPONSE_HEADER_SIZE];
+    ok = ok && send(fd, &cmd, sizeof(cmd), 0) == static_cast<ssize_t>(sizeof(cmd)) &&
+         receive_exact(fd, header, sizeof(header)) && header[2] == ACK_SUCCESS &&
+         ((header[3] << 8) | header[4]) == sizeof(StatusResponse) &&
+         receive_exact(fd, &status, sizeof(status));
+    ::close(fd);
+    return ok;
+}
+
+void print_usage(const char* program) {
+    std::printf("Usage: %s --out <file> [options]\n", program);
+    std::printf("  --device <ip>          Read the configuration from the board (CMD_GET_STATUS)\n");
+    std::printf("  --channels <mask>      Channel enable when no device is given (default 0xF)\n");
+    std::printf("  --ports <n>            SPI ports when no device is given (default 1)\n");
+    std::printf("  --rate <hz>            Sample rate when no device is given (default %u)\n", MAX_SAMPLE_RATE_HZ);
+    std::printf("  --port <port>          UDP port (default %u)\n", UDP_PORT);
+    std::printf("  --cpu <n>              Pin the receive thread to CPU n\n");
+    std::printf("  --frames-per-block <n> Frames per data block (default %u)\n", DEFAULT_FRAMES_PER_BLOCK);
+    std::printf("  --direct-io            Write with O_DIRECT\n");
+    std::printf("  --duration <s>         Stop after s seconds\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    ReceiverConfig receiver_config;
+    RecordingWriter::Options writer_options;
+    RecordingInfo info;
+    const char* device = nullptr;
+    const char* out_path = nullptr;
+    double duration = 0.0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (!std::strcmp(arg, "--direct-io")) {
+            writer_options.direct_io = true;
+            continue;
+        }
+        if (!value) {
+            print_usage(argv[0]);
+            return 2;
+        }
+        if (!std::strcmp(arg, "--out")) {
+            out_path = value;
+        } else if (!std::strcmp(arg, "--device")) {
+            device = value;
+        } else if (!std::strcmp(arg, "--channels")) {
+            info.channel_enable = std::strtoul(value, nullptr, 0);
+        } else if (!std::strcmp(arg, "--ports")) {
+            info.num_spi_ports = std::strtoul(value, nullptr, 0);
+        } else if (!std::strcmp(arg, "--rate")) {
+            info.sample_rate = std::strtoul(value, nullptr, 0);
+        } else if (!std::strcmp(arg, "--port")) {
+            receiver_config.port = static_cast<uint16_t>(std::atoi(value));
+        } else if (!std::strcmp(arg, "--cpu")) {
+            receiver_config.cpu = std::atoi(value);
+        } else if (!std::strcmp(arg, "--frames-per-block")) {
+            writer_options.frames_per_block = std::strtoul(value, nullptr, 0);
+        } else if (!std::strcmp(arg, "--duration")) {
+            duration = std::strtod(value, nullptr);
+        } else {
+            print_usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+    if (!out_path || info.num_spi_ports < 1 || info.num_spi_ports > MAX_SPI_PORTS) {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    if (device) {
+        StatusResponse status;
+        if (!fetch_status(device, status)) {
+            std::fprintf(stderr, "[TCP] Failed to get status from %s\n", device);
+            return 1;
+        }
+        info = RecordingInfo::from_status(status);
+    }
+    receiver_config.expected_packet_words = calculate_packet_size(info.channel_enable, info.num_spi_ports);
+
+    RecordingWriter writer;
+    if (!writer.open(out_path, info, writer_options)) {
+        std::fprintf(stderr, "[REC] %s\n", writer.error().c_str());
+        return 1;
+    }
+    UdpReceiver receiver(receiver_config);
+    if (!receiver.start()) {
+        std::fprintf(stderr, "[UDP] %s\n", receiver.error().c_str());
+        return 1;
+    }
+    std::signal(SIGINT, handle_signal);
+    std::signal(SIGTERM, handle_signal);
+    std::printf("[REC] Recording channel enable 0x%X (%u port(s), %u Hz) to %s\n",
+                info.channel_enable, info.num_spi_ports, info.sample_rate, out_path);
+
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    auto last_report = start;
+    SpscRing<Frame>& frames = receiver.frames();
+    bool ok = true;
+
+    while (running && ok) {
+        const size_t n = frames.readable();
+        for (size_t i = 0; i < n && ok; i++) {
+            const Frame& frame = frames.read_slot(i);
+            ok = writer.append(frame.words, frame.size_words, frame.rx_time_ns);
+        }
+        frames.release(n);
+        if (n == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+
+        const auto now = clock::now();
+        if (now - last_report >= std::chrono::seconds(1)) {
+            const ReceiverStats s = receiver.stats();
+            std::printf("[REC] %llu frames written, %llu lost, %llu kernel drops, %llu disk waits\n",
+                        static_cast<unsigned long long>(writer.frames_written()),
+                        static_cast<unsigned long long>(s.frames_lost),
+                        static_cast<unsigned long long>(s.kernel_drops),
+                        static_cast<unsigned long long>(writer.waits()));
+            std::fflush(stdout);
+            last_report = now;
+        }
+        if (duration > 0.0 && std::chrono::duration<double>(now - start).count() >= duration) {
+            break;
+        }
+    }
+
+    receiver.stop();
+    const uint64_t frames_written = writer.frames_written();
+    if (!ok || !writer.close()) {
+        std::fprintf(stderr, "[REC] Recording failed: %s\n", writer.error().c_str());
+        return 1;
+    }
+    std::printf("[REC] %llu frames in %s\n", static_cast<unsigned long long>(frames_written), out_path);
+    return 0;
+}
@@ -0,0 +1,428 @@
+// protocol.h
+// Wire formats of the Intan interface board, shared by the host-side native tools.
+// Mirrors firmware/include/main.h, firmware/src-core0/network.c and the packet
+// layout written by programmable_logic/src/data_generator_core.sv - keep in sync.
+
+#ifndef INTAN_PROTOCOL_H
+#define INTAN_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace intan {
+
+// ============================================================================
+// NETWORK
+// ============================================================================
+constexpr uint16_t UDP_PORT = 5000;
+constexpr uint16_t TCP_PORT = 6000;
+constexpr uint16_t STREAM_TCP_PORT = 6001;     // Lossless frame stream, back-to-back packets
+constexpr uint16_t TELEMETRY_PORT = 5001;      // Default destination port of SET_TELEMETRY
+
+// ============================================================================
+// UDP DATA PACKETS (one packet per datagram)
+// ============================================================================
+// [magic low][magic high][timestamp low][timestamp high][data...]
+// Data: 35 cycles x enabled 16-bit segments, little-endian, padded to 32 bits.
+// Segment order per port: CIPO0 regular, CIPO0 DDR, CIPO1 regular, CIPO1 DDR.
+constexpr uint32_t MAGIC_NUMBER_LOW = 0xDEADBEEF;
+constexpr uint32_t MAGIC_NUMBER_HIGH = 0xCAFEBABE;
+constexpr uint32_t PACKET_HEADER_WORDS = 4;
+constexpr uint32_t CYCLES_PER_FRAME = 35;
+constexpr uint32_t CHANNELS_PER_PORT = 4;
+constexpr uint32_t MAX_SPI_PORTS = 8;
+
+// Largest packet: every channel of every port enabled
+constexpr uint32_t MAX_PACKET_WORDS = PACKET_HEADER_WORDS + (CYCLES_PER_FRAME * CHANNELS_PER_PORT * MAX_SPI_PORTS + 1) / 2;
+
+// FEC parity datagrams (SET_FEC) share the stream: [magic low][FEC_MAGIC_HIGH]
+// [first timestamp low][first timestamp high][group size][frame mask][XOR of the data
+// words of the frames in the mask]. The group covers timestamps first .. first + size - 1.
+constexpr uint32_t FEC_MAGIC_HIGH = 0xCAFEFEC0;
+constexpr uint32_t FEC_HEADER_WORDS = 6;
+constexpr uint32_t FEC_MAX_GROUP_SIZE = 32;
+constexpr uint32_t MAX_DATAGRAM_WORDS = MAX_PACKET_WORDS - PACKET_HEADER_WORDS + FEC_HEADER_WORDS;
+
+// Transmit pacing (SET_PACING): a backlog in BRAM goes out at up to rate percent of
+// the sample rate in bursts of up to burst frames, until BRAM is half full
+constexpr uint32_t PACING_RATE_PERCENT = 300;
+constexpr uint32_t PACING_BURST_FRAMES = 8;
+constexpr uint32_t PACING_MIN_RATE_PERCENT = 110;
+constexpr uint32_t PACING_MAX_BURST_FRAMES = 256;
+
+// Main loop tasks of firmware/src-core0/scheduler.c, in status order
+constexpr uint32_t SCHED_NUM_TASKS = 5;
+
+// Drain backlog histogram of firmware/src-core0/headroom.c: bin 0 is below
+// BACKLOG_HIST_MIN_WORDS, bin n starts at BACKLOG_HIST_MIN_WORDS << (n - 1)
+constexpr uint32_t BACKLOG_HIST_BINS = 12;
+constexpr uint32_t BACKLOG_HIST_MIN_WORDS = 64;
+
+inline uint32_t backlog_hist_bin(uint64_t backlog_words) {
+    uint32_t bin = 0;
+    for (uint64_t words = backlog_words / BACKLOG_HIST_MIN_WORDS; words > 0 && bin < BACKLOG_HIST_BINS - 1; words >>= 1) {
+        bin++;
+    }
+    return bin;
+}
+
+inline uint32_t channel_enable_all(uint32_t num_spi_ports) {
+    return 0xFFFFFFFFu >> (32 - CHANNELS_PER_PORT * num_spi_ports);
+}
+
+inline uint32_t count_channels(uint32_t channel_enable) {
+    uint32_t n = 0;
+    for (; channel_enable; channel_enable &= channel_enable - 1) {
+        n++;
+    }
+    return n;
+}
+
+// Data words per packet (the PS falls back to all channels when none are enabled)
+inline uint32_t calculate_data_words(uint32_t channel_enable, uint32_t num_spi_ports) {
+    uint32_t num_channels = count_channels(channel_enable & channel_enable_all(num_spi_ports));
+    if (num_channels == 0) {
+        num_channels = CHANNELS_PER_PORT * num_spi_ports;
+    }
+    return (CYCLES_PER_FRAME * num_channels + 1) / 2;
+}
+
+inline uint32_t calculate_packet_size(uint32_t channel_enable, uint32_t num_spi_ports) {
+    return PACKET_HEADER_WORDS + calculate_data_words(channel_enable, num_spi_ports);
+}
+
+// Number of enabled 16-bit streams for a packet of `packet_words`, 0 if no mask fits
+inline uint32_t channels_from_packet_size(uint32_t packet_words) {
+    if (packet_words <= PACKET_HEADER_WORDS || packet_words > MAX_PACKET_WORDS) {
+        return 0;
+    }
+    const uint32_t num_channels = (2 * (packet_words - PACKET_HEADER_WORDS)) / CYCLES_PER_FRAME;
+    return (PACKET_HEADER_WORDS + (CYCLES_PER_FRAME * num_channels + 1) / 2 == packet_words) ? num_channels : 0;
+}
+
+// ============================================================================
+// PL TIMING
+// ============================================================================
+constexpr uint32_t PL_CLOCK_HZ = 84000000;
+constexpr uint32_t PL_CLOCKS_PER_FRAME = 80 * CYCLES_PER_FRAME;            // 2800 clocks
+constexpr uint32_t MAX_SAMPLE_RATE_HZ = PL_CLOCK_HZ / PL_CLOCKS_PER_FRAME; // 30 kS/s
+constexpr uint32_t MIN_SAMPLE_RATE_HZ = 1000;
+constexpr uint32_t NUM_FINE_PHASES = 24;
+constexpr uint32_t BRAM_SIZE_WORDS = 65536;                // Default build, reported in StatusResponse
+constexpr uint32_t HISTORY_SIZE_WORDS = 16 * 1024 * 1024;  // Rolling frame history in DDR
+
+inline bool is_valid_sample_rate(uint32_t sample_rate_hz) {
+    return sample_rate_hz >= MIN_SAMPLE_RATE_HZ && sample_rate_hz <= MAX_SAMPLE_RATE_HZ &&
+           (PL_CLOCK_HZ % sample_rate_hz) == 0;
+}
+
+// ============================================================================
+// TCP COMMAND PROTOCOL
+// ============================================================================
+// Command: [magic:u32][cmd_id:u32][ack_id:u32][param1:u32][param2:u32], little-endian
+// ACK:     [ack_id high][ack_id low][status]
+// Response with data: [ack_id high][ack_id low][status][len high][len low][data...]
+constexpr uint32_t CMD_MAGIC = 0xDEADBEEF;
+constexpr size_t CMD_PACKET_SIZE = 20;
+constexpr size_t ACK_PACKET_SIZE = 3;
+constexpr size_t RESPONSE_HEADER_SIZE = 5;
+
+constexpr uint32_t CMD_START = 0x01;
+constexpr uint32_t CMD_STOP = 0x02;
+constexpr uint32_t CMD_RESET_TIMESTAMP = 0x03;
+constexpr uint32_t CMD_SET_LOOP_COUNT = 0x10;
+constexpr uint32_t CMD_SET_PHASE = 0x11;
+constexpr uint32_t CMD_SET_DEBUG_MODE = 0x12;
+constexpr uint32_t CMD_SET_CHANNEL_ENABLE = 0x13;
+constexpr uint32_t CMD_SET_SAMPLE_RATE = 0x14;
+constexpr uint32_t CMD_SET_FINE_PHASE = 0x15;
+constexpr uint32_t CMD_SET_PORT_FINE_PHASE = 0x16;
+constexpr uint32_t CMD_LOAD_CONVERT = 0x20;
+constexpr uint32_t CMD_LOAD_INIT = 0x21;
+constexpr uint32_t CMD_LOAD_CABLE_TEST = 0x22;
+constexpr uint32_t CMD_FULL_CABLE_TEST = 0x30;
+constexpr uint32_t CMD_GET_STATUS = 0x40;
+constexpr uint32_t CMD_DUMP_BRAM = 0x41;
+constexpr uint32_t CMD_READ_BRAM = 0x42;       // param2 = word_count | BRAM_READ_SNAPSHOT
+constexpr uint32_t CMD_TRIGGER_CAPTURE = 0x43; // param1 = pre_frames, param2 = post_frames
+constexpr uint32_t CMD_RESEND_FRAMES = 0x44;   // param1 = first timestamp (low 32 bits), param2 = count
+constexpr uint32_t CMD_RUN_BENCHMARK = 0x45;   // Stream stopped; completed with the results
+constexpr uint32_t CMD_SET_UDP_DEST = 0x50;
+constexpr uint32_t CMD_SET_UDP_STREAM = 0x51;  // param1 = 0: frames only go to the history
+constexpr uint32_t CMD_SET_FEC = 0x52;         // param1 = frames per parity datagram, 0 = off
+constexpr uint32_t CMD_SET_PACING = 0x53;      // param1 = rate percent (0 = off), param2 = burst (0 = default)
+constexpr uint32_t CMD_SET_TELEMETRY = 0x54;   // param1 = ip (0 = stream host), param2 = port | rate_hz << 16
+constexpr uint32_t CMD_TRANSACTION = 0x60;     // param1 sub-commands follow, applied all or none
+
+constexpr uint32_t MAX_TRANSACTION_COMMANDS = 16;
+constexpr uint32_t MAX_RESEND_FRAMES = 4096;
+
+constexpr uint8_t ACK_SUCCESS = 0x06;
+constexpr uint8_t ACK_ERROR = 0x15;
+constexpr uint8_t ACK_COMPLETE = 0x04;      // Completion notification (response header + CompletionResponse)
+
+struct CommandPacket {
+    uint32_t magic;
+    uint32_t cmd_id;
+    uint32_t ack_id;
+    uint32_t param1;
+    uint32_t param2;
+};
+static_assert(sizeof(CommandPacket) == CMD_PACKET_SIZE, "command packet is 20 bytes");
+
+// ============================================================================
+// STATUS RESPONSE (CMD_GET_STATUS)
+// ============================================================================
+constexpr uint16_t PROTOCOL_VERSION = 1;
+constexpr uint16_t DEVICE_TYPE_INTAN_INTERFACE = 0x1000;
+constexpr uint16_t UDP_PACKET_FORMAT_V1 = 0x0001;
+
+constexpr uint8_t STATUS_PL_TRANSMISSION_ACTIVE = 1 << 0;
+constexpr uint8_t STATUS_PL_LOOP_LIMIT_REACHED = 1 << 1;
+constexpr uint8_t STATUS_PS_STREAM_ENABLED = 1 << 0;
+
+#pragma pack(push, 1)
+struct StatusResponse {
+    // Version and identification (8 bytes)
+    uint16_t version;
+    uint16_t device_type;
+    uint32_t firmware_version;
+
+    // PL Hardware Status (22 bytes)
+    uint64_t timestamp;
+    uint32_t packets_sent;
+    uint32_t bram_write_addr;
+    uint16_t fifo_count;
+    uint8_t state_counter;
+    uint8_t cycle_counter;
+    uint8_t flags_pl;
+    uint8_t phase_half_steps;   // Bit 0 = phase0 half step, bit 1 = phase1 half step
+
+    // PS Software Status (28 bytes)
+    uint32_t packets_received;
+    uint32_t error_count;
+    uint32_t udp_packets_sent;
+    uint32_t udp_send_errors;
+    uint32_t ps_read_addr;
+    uint32_t packet_size;
+    uint8_t flags_ps;
+    uint8_t num_spi_ports;
+    uint8_t reserved2[2];
+
+    // Current Configuration (16 bytes)
+    uint32_t loop_count;
+    uint8_t phase0;
+    uint8_t phase1;
+    uint8_t channel_enable;     // Port 0 only
+    uint8_t debug_mode;
+    uint32_t sample_rate;       // Frames per second
+    uint32_t channel_enable_all; // All ports, 4 bits per port
+
+    // UDP Stream Information (12 bytes)
+    uint32_t udp_dest_ip;       // Network byte order
+    uint16_t udp_dest_port;
+    uint16_t udp_packet_format;
+    uint32_t udp_bytes_sent;
+
+    // TCP Frame Stream (12 bytes)
+    uint32_t tcp_stream_frames_sent;
+    uint32_t tcp_stream_frames_dropped;     // Skipped because the client fell too far behind
+    uint32_t tcp_stream_buffered_bytes;     // Written, not yet acknowledged
+
+    // Frame Resend (8 bytes)
+    uint32_t udp_frames_resent;
+    uint32_t udp_resend_misses;     // Requested frames no longer (or never) in the history
+
+    // Forward Error Correction (8 bytes)
+    uint32_t fec_group_size;        // Frames per parity datagram, 0 = off
+    uint32_t fec_parity_sent;
+
+    // Transmit Pacing (16 bytes)
+    uint16_t pacing_rate_percent;   // Peak send rate in percent of the sample rate, 0 = off
+    uint16_t pacing_burst_frames;
+    uint32_t pacing_delays;         // Times the pacer started holding frames back
+    uint32_t pacing_overrides;      // Frames sent early because BRAM was close to overrun
+    uint32_t max_burst_frames;      // Most frames sent back to back in one main loop pass
+
+    // Transmit Flow Control (8 bytes)
+    uint32_t udp_tx_waits;          // Frames held in BRAM until the TX ring had room
+    uint32_t udp_tx_forced_drops;   // Frames dropped to avoid a BRAM overrun (also in udp_send_errors)
+
+    // Main Loop Scheduler (22 bytes)
+    uint32_t sched_max_pass_us;     // Longest pass through all tasks
+    uint32_t sched_deadline_misses; // Times the backlog reached 3/4 of BRAM
+    uint32_t sched_budget_overruns; // Task turns longer than their time budget
+    uint16_t sched_task_max_us[SCHED_NUM_TASKS];    // Drain, ethernet RX, lwIP timers, commands, telemetry
+
+    // Telemetry (12 bytes)
+    uint32_t telemetry_dest_ip;     // Network byte order
+    uint16_t telemetry_dest_port;
+    uint16_t telemetry_rate_hz;     // 0 = off
+    uint32_t telemetry_sent;
+
+    // Buffer Headroom (60 bytes)
+    uint32_t bram_backlog_max;      // Most BRAM words unread by the PS since START (PL high-water mark)
+    uint16_t fifo_count_max;        // Most PL FIFO entries since START
+    uint16_t reserved3;
+    uint32_t backlog_histogram[BACKLOG_HIST_BINS];  // Drain turns by the backlog they found
+    uint32_t bram_size_words;       // BRAM ring depth of the device build
+};
+#pragma pack(pop)
+static_assert(sizeof(StatusResponse) == 232, "status response is 232 bytes");
+
+// ============================================================================
+// TELEMETRY DATAGRAM (SET_TELEMETRY)
+// ============================================================================
+// Pushed rate_hz times a second. Totals are cumulative, the errors count what
+// happened since the previous datagram and the maxima cover the same interval.
+constexpr uint32_t TELEMETRY_MAGIC_HIGH = 0xCAFE7E1E;
+constexpr uint32_t TELEMETRY_MAX_RATE_HZ = 100;
+
+#pragma pack(push, 1)
+struct TelemetryDatagram {
+    uint32_t magic_low;             // MAGIC_NUMBER_LOW
+    uint32_t magic_high;            // TELEMETRY_MAGIC_HIGH
+    uint32_t sequence;              // Datagrams sent since SET_TELEMETRY
+    uint32_t interval_us;
+    uint64_t timestamp;             // PL timestamp
+    uint8_t flags_pl;
+    uint8_t flags_ps;
+    uint16_t reserved;
+
+    // Totals (16 bytes)
+    uint32_t packets_received;
+    uint32_t udp_packets_sent;
+    uint32_t udp_bytes_sent;
+    uint32_t udp_frames_resent;
+
+    // Rates over the interval (8 bytes)
+    uint32_t rx_frames_per_s;       // Frames read from BRAM
+    uint32_t tx_frames_per_s;       // Frames sent over UDP
+
+    // High-water marks over the interval (24 bytes)
+    uint32_t max_backlog_words;     // Words in BRAM waiting for the PS
+    uint16_t max_fifo_count;
+    uint16_t reserved2;
+    uint32_t max_pass_us;
+    uint16_t task_max_us[SCHED_NUM_TASKS];
+    uint16_t reserved3;
+
+    // Errors during the interval (28 bytes)
+    uint32_t errors;
+    uint32_t udp_send_errors;
+    uint32_t udp_tx_forced_drops;
+    uint32_t udp_resend_misses;
+    uint32_t tcp_stream_frames_dropped;
+    uint32_t deadline_misses;
+    uint32_t budget_overruns;
+};
+#pragma pack(pop)
+static_assert(sizeof(TelemetryDatagram) == 104, "telemetry datagram is 104 bytes");
+
+// Sent with the ack_id of a deferred command (START, STOP, RESET_TIMESTAMP, DUMP_BRAM,
+// FULL_CABLE_TEST) once the device has carried it out
+#pragma pack(push, 1)
+struct CompletionResponse {
+    uint32_t cmd_id;
+    uint8_t status;             // ACK_SUCCESS, or ACK_ERROR if there was nothing to do
+    uint8_t stream_enabled;
+    uint16_t reserved;
+    uint64_t timestamp;         // START/FULL_CABLE_TEST: first timestamp of the new stream
+    uint32_t packets_received;
+    uint32_t detail;            // DUMP_BRAM: words dumped, RUN_BENCHMARK: copy method selected
+};
+#pragma pack(pop)
+static_assert(sizeof(CompletionResponse) == 24, "completion response is 24 bytes");
+
+// READ_BRAM: a response header carrying BramReadResponse, then word_count raw words
+constexpr uint32_t BRAM_READ_COUNT_MASK = 0x0003FFFF;
+constexpr uint32_t BRAM_READ_SNAPSHOT = 1u << 31;
+
+#pragma pack(push, 1)
+struct BramReadResponse {
+    uint32_t start_addr;
+    uint32_t word_count;
+    uint32_t write_addr_before; // PL write address before and after the range was read
+    uint32_t write_addr_after;
+    uint64_t timestamp;         // PL timestamp when the read started
+};
+#pragma pack(pop)
+static_assert(sizeof(BramReadResponse) == 24, "BRAM read response header is 24 bytes");
+
+// TRIGGER_CAPTURE completion: CompletionResponse (timestamp = trigger frame, detail =
+// frames) and the capture layout, then detail * packet_words raw words
+#pragma pack(push, 1)
+struct CaptureResponse {
+    CompletionResponse completion;
+    uint64_t first_timestamp;
+    uint32_t packet_words;
+    uint32_t pre_frames;        // Captured frames before the trigger frame
+};
+#pragma pack(pop)
+static_assert(sizeof(CaptureResponse) == 40, "capture response is 40 bytes");
+
+// RUN_BENCHMARK completion: BenchmarkHeader, then uint16_t frame_words[num_sizes],
+// uint32_t copy_ticks[num_sizes][num_methods], pbuf_ticks[num_sizes] and
+// send_ticks[num_sizes]. Times are ticks of timer_hz summed over the repeats; copy
+// method = mapping (0 strongly ordered, 1 cached) * num_routines + routine.
+constexpr uint32_t BRAM_COPY_NUM_ROUTINES = 4;     // in32, memcpy, ldm, neon
+constexpr uint32_t BRAM_COPY_NUM_METHODS = 2 * BRAM_COPY_NUM_ROUTINES;
+constexpr uint32_t BENCH_COPY_REPEATS = 64;
+constexpr uint32_t BENCH_NET_REPEATS = 32;
+constexpr uint32_t BENCH_REG_REPEATS = 1024;
+
+#pragma pack(push, 1)
+struct BenchmarkHeader {
+    CompletionResponse completion;
+    uint32_t timer_hz;
+    uint8_t num_sizes;          // One per channel count
+    uint8_t num_methods;
+    uint8_t num_routines;
+    uint8_t selected_method;
+    uint16_t copy_repeats;
+    uint16_t net_repeats;
+    uint32_t reg_repeats;
+    uint32_t reg_read_ticks;    // AXI-Lite status register reads
+    uint32_t bram_read_ticks;   // Single BRAM word reads
+    uint32_t send_failures;
+};
+#pragma pack(pop)
+static_assert(sizeof(BenchmarkHeader) == 52, "benchmark response header is 52 bytes");
+
+inline bool is_deferred_command(uint32_t cmd_id) {
+    return cmd_id == CMD_START || cmd_id == CMD_STOP || cmd_id == CMD_RESET_TIMESTAMP ||
+           cmd_id == CMD_DUMP_BRAM || cmd_id == CMD_FULL_CABLE_TEST;
+}
+
+// ============================================================================
+// COPI COMMAND SEQUENCES (firmware/src-core0/pl_control.c)
+// ============================================================================
+inline constexpr uint16_t convert_cmd_sequence[CYCLES_PER_FRAME] = {
+    0x0000, 0x0100, 0x0200, 0x0300, 0x0400, 0x0500, 0x0600, 0x0700,  // Channels 0-7
+    0x0800, 0x0900, 0x0A00, 0x0B00, 0x0C00, 0x0D00, 0x0E00, 0x0F00,  // Channels 8-15
+    0x1000, 0x1100, 0x1200, 0x1300, 0x1400, 0x1500, 0x1600, 0x1700,  // Channels 16-23
+    0x1800, 0x1900, 0x1A00, 0x1B00, 0x1C00, 0x1D00, 0x1E00, 0x1F00,  // Channels 24-31
+    0x0000, 0x0000, 0x0000
+};
+
+inline constexpr uint16_t initialization_cmd_sequence[CYCLES_PER_FRAME] = {
+    0xFF00, 0xFF00,                                                  // Dummy reads
+    0x80DE, 0x8142, 0x8204, 0x8302, 0x849C, 0x8500, 0x8680, 0x8700,  // Registers 0-7
+    0x8811, 0x8980, 0x8A10, 0x8B80, 0x8C2C, 0x8D86, 0x8EFF, 0x8FFF,  // Registers 8-15
+    0x90FF, 0x91FF, 0x92FF, 0x93FF, 0x94FF, 0x95FF,                  // Registers 16-21
+    0x5500,                                                          // Calibrate
+    0xFF00, 0xFF00, 0xFF00, 0xFF00, 0xFF00,
+    0xFF00, 0xFF00, 0xFF00, 0xFF00, 0xFF00
+};
+
+inline constexpr uint16_t cable_length_cmd_sequence[CYCLES_PER_FRAME] = {
+    0xE800, 0xE900, 0xEA00, 0xEB00, 0xEC00, 0xFF00, 0xFB00,  // "INTAN", chip ID, MISO marker
+    0xE800, 0xE900, 0xEA00, 0xEB00, 0xEC00, 0xFF00, 0xFB00,
+    0xE800, 0xE900, 0xEA00, 0xEB00, 0xEC00, 0xFF00, 0xFB00,
+    0xE800, 0xE900, 0xEA00, 0xEB00, 0xEC00, 0xFF00, 0xFB00,
+    0xE800, 0xE900, 0xEA00, 0xEB00, 0xEC00, 0xFF00, 0xFB00
+};
+
+} // namespace intan
+
+#endif // INTAN_PROTOCOL_H
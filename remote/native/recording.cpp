@@ -0,0 +1,409 @@
+// recording.cpp
+// RecordingWriter and RecordingReader (see recording.h).
+
+#include "recording.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+namespace intan {
+
+namespace {
+
+uint32_t streams_for(uint32_t channel_enable, uint32_t num_spi_ports) {
+    const uint32_t n = count_channels(channel_enable & channel_enable_all(num_spi_ports));
+    return n ? n : CHANNELS_PER_PORT * num_spi_ports;
+}
+
+uint8_t* allocate_aligned(size_t bytes) {
+    return static_cast<uint8_t*>(std::aligned_alloc(RECORDING_ALIGNMENT, bytes));
+}
+
+size_t round_up(size_t bytes) {
+    return (bytes + RECORDING_ALIGNMENT - 1) / RECORDING_ALIGNMENT * RECORDING_ALIGNMENT;
+}
+
+} // namespace
+
+RecordingInfo RecordingInfo::from_status(const StatusResponse& status) {
+    RecordingInfo info;
+    info.num_spi_ports = status.num_spi_ports ? status.num_spi_ports : 1;
+    info.channel_enable = status.num_spi_ports ? status.channel_enable_all : status.channel_enable;
+    info.sample_rate = status.sample_rate;
+    info.firmware_version = status.firmware_version;
+    info.device_type = status.device_type;
+    info.protocol_version = status.version;
+    return info;
+}
+
+// ============================================================================
+// WRITER
+// ============================================================================
+
+RecordingWriter::RecordingWriter() = default;
+
+RecordingWriter::~RecordingWriter() {
+    close();
+}
+
+bool RecordingWriter::open(const std::string& path, const RecordingInfo& info, const Options& options) {
+    options_ = options;
+    if (options_.frames_per_block == 0 || options_.queued_blocks == 0) {
+        error_ = "frames_per_block and queued_blocks must be non-zero";
+        return false;
+    }
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    if (options_.direct_io) {
+        flags |= O_DIRECT;
+    }
+    fd_ = ::open(path.c_str(), flags, 0644);
+    if (fd_ < 0) {
+        error_ = path + ": " + std::strerror(errno);
+        return false;
+    }
+
+    const uint32_t num_streams = streams_for(info.channel_enable, info.num_spi_ports);
+    block_bytes_ = block_size_bytes(options_.frames_per_block, num_streams);
+    packet_words_ = PACKET_HEADER_WORDS + (CYCLES_PER_FRAME * num_streams + 1) / 2;
+
+    std::memset(&header_, 0, sizeof(header_));
+    std::memcpy(header_.magic, RECORDING_MAGIC, sizeof(header_.magic));
+    header_.version = RECORDING_VERSION;
+    header_.header_bytes = RECORDING_ALIGNMENT;
+    header_.block_bytes = static_cast<uint32_t>(block_bytes_);
+    header_.frames_per_block = options_.frames_per_block;
+    header_.num_streams = num_streams;
+    header_.cycles_per_frame = CYCLES_PER_FRAME;
+    header_.channel_enable = info.channel_enable;
+    header_.num_spi_ports = info.num_spi_ports;
+    header_.sample_rate = info.sample_rate;
+    header_.firmware_version = info.firmware_version;
+    header_.device_type = info.device_type;
+    header_.protocol_version = info.protocol_version;
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    header_.start_time_ns = static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+
+    if (!write_all(&header_, sizeof(header_), 0)) {
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+
+    for (uint32_t i = 0; i < options_.queued_blocks; i++) {
+        uint8_t* buffer = allocate_aligned(block_bytes_);
+        if (!buffer) {
+            error_ = "out of memory for block buffers";
+            close();
+            return false;
+        }
+        buffers_.push_back(buffer);
+        free_buffers_.push_back(buffer);
+    }
+
+    stopping_ = false;
+    write_failed_ = false;
+    thread_ = std::thread(&RecordingWriter::writer_loop, this);
+    return true;
+}
+
+bool RecordingWriter::append(const uint32_t* words, uint32_t size_words, int64_t rx_time_ns) {
+    if (fd_ < 0 || write_failed_ || size_words != packet_words_) {
+        return false;
+    }
+    if (!current_) {
+        start_block();
+        if (!current_) {
+            return false;
+        }
+    }
+
+    const uint32_t frames_per_block = options_.frames_per_block;
+    const uint32_t num_streams = header_.num_streams;
+    const uint32_t f = current_header_->frame_count;
+    const uint64_t timestamp = (static_cast<uint64_t>(words[3]) << 32) | words[2];
+
+    if (f == 0) {
+        current_header_->first_timestamp = timestamp;
+        current_header_->first_rx_time_ns = rx_time_ns;
+    }
+    if (header_.frame_count == 0) {
+        header_.first_timestamp = timestamp;
+    } else if (timestamp != last_timestamp_ + 1) {
+        current_header_->gap_count++;
+        header_.gap_count++;
+    }
+    current_timestamps_[f] = timestamp;
+
+    // Wire order is cycle-major (cycle c, stream s at lane c * num_streams + s)
+    const uint16_t* lanes = reinterpret_cast<const uint16_t*>(words + PACKET_HEADER_WORDS);
+    for (uint32_t s = 0; s < num_streams; s++) {
+        uint16_t* out = current_samples_ + static_cast<size_t>(s) * CYCLES_PER_FRAME * frames_per_block + f;
+        for (uint32_t c = 0; c < CYCLES_PER_FRAME; c++) {
+            out[static_cast<size_t>(c) * frames_per_block] = lanes[c * num_streams + s];
+        }
+    }
+
+    current_header_->frame_count = f + 1;
+    current_header_->last_timestamp = timestamp;
+    header_.frame_count++;
+    header_.last_timestamp = timestamp;
+    last_timestamp_ = timestamp;
+
+    if (f + 1 == frames_per_block) {
+        finish_block();
+    }
+    return true;
+}
+
+bool RecordingWriter::close() {
+    if (fd_ < 0) {
+        return false;
+    }
+    if (current_ && current_header_->frame_count > 0) {
+        finish_block();
+    } else if (current_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_buffers_.push_back(current_);
+        current_ = nullptr;
+    }
+
+    if (thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        queue_changed_.notify_all();
+        thread_.join();
+    }
+
+    bool ok = !write_failed_;
+    if (ok) {
+        header_.block_count = index_.size();
+        header_.index_offset = header_.header_bytes + header_.block_count * block_bytes_;
+        ok = write_all(index_.data(), index_.size() * sizeof(BlockIndexEntry), header_.index_offset) &&
+             write_all(&header_, sizeof(header_), 0);
+    }
+
+    ::close(fd_);
+    fd_ = -1;
+    for (uint8_t* buffer : buffers_) {
+        std::free(buffer);
+    }
+    buffers_.clear();
+    free_buffers_.clear();
+    index_.clear();
+    return ok;
+}
+
+void RecordingWriter::start_block() {
+    current_ = take_buffer();
+    if (!current_) {
+        return;
+    }
+    std::memset(current_, 0, block_bytes_);
+    current_header_ = reinterpret_cast<BlockHeader*>(current_);
+    current_header_->magic = BLOCK_MAGIC;
+    current_timestamps_ = reinterpret_cast<uint64_t*>(current_ + sizeof(BlockHeader));
+    current_samples_ = reinterpret_cast<uint16_t*>(current_ + block_samples_offset(options_.frames_per_block));
+}
+
+void RecordingWriter::finish_block() {
+    const uint64_t offset = header_.header_bytes + index_.size() * block_bytes_;
+    index_.push_back({current_header_->first_timestamp, current_header_->last_timestamp});
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back({current_, offset});
+    }
+    queue_changed_.notify_all();
+    current_ = nullptr;
+}
+
+uint8_t* RecordingWriter::take_buffer() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (free_buffers_.empty()) {
+        waits_++;   // The disk is behind: wait rather than drop frames
+        queue_changed_.wait(lock, [this] { return !free_buffers_.empty() || write_failed_; });
+    }
+    if (write_failed_) {
+        return nullptr;
+    }
+    uint8_t* buffer = free_buffers_.back();
+    free_buffers_.pop_back();
+    return buffer;
+}
+
+void RecordingWriter::writer_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        queue_changed_.wait(lock, [this] { return !queue_.empty() || stopping_; });
+        if (queue_.empty()) {
+            break;
+        }
+        const PendingBlock block = queue_.front();
+        queue_.pop_front();
+
+        lock.unlock();
+        const bool ok = write_all(block.data, block_bytes_, block.offset);
+        lock.lock();
+
+        if (!ok) {
+            write_failed_ = true;
+        }
+        free_buffers_.push_back(block.data);
+        queue_changed_.notify_all();
+    }
+}
+
+// Writes are padded to whole RECORDING_ALIGNMENT units so O_DIRECT works everywhere
+bool RecordingWriter::write_all(const void* data, size_t bytes, uint64_t offset) {
+    const uint8_t* source = static_cast<const uint8_t*>(data);
+    uint8_t* bounce = nullptr;
+    size_t total = bytes;
+    if (bytes % RECORDING_ALIGNMENT || reinterpret_cast<uintptr_t>(data) % RECORDING_ALIGNMENT) {
+        total = round_up(bytes);
+        bounce = allocate_aligned(total ? total : RECORDING_ALIGNMENT);
+        if (!bounce) {
+            error_ = "out of memory";
+            return false;
+        }
+        std::memset(bounce, 0, total);
+        std::memcpy(bounce, data, bytes);
+        source = bounce;
+    }
+
+    size_t done = 0;
+    while (done < total) {
+        const ssize_t n = ::pwrite(fd_, source + done, total - done, static_cast<off_t>(offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            error_ = std::string("write: ") + std::strerror(errno);
+            std::free(bounce);
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    std::free(bounce);
+    return true;
+}
+
+// ============================================================================
+// READER
+// ============================================================================
+
+RecordingReader::~RecordingReader() {
+    close();
+}
+
+bool RecordingReader::open(const std::string& path) {
+    close();
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error_ = path + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(RecordingHeader)) {
+        error_ = path + ": not a recording";
+        ::close(fd);
+        return false;
+    }
+    map_bytes_ = static_cast<size_t>(st.st_size);
+    void* map = mmap(nullptr, map_bytes_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        error_ = std::string("mmap: ") + std::strerror(errno);
+        map_bytes_ = 0;
+        return false;
+    }
+    map_ = static_cast<const uint8_t*>(map);
+    header_ = reinterpret_cast<const RecordingHeader*>(map_);
+
+    if (std::memcmp(header_->magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC)) != 0 ||
+        header_->version != RECORDING_VERSION || header_->block_bytes == 0 ||
+        header_->cycles_per_frame != CYCLES_PER_FRAME) {
+        error_ = path + ": not a recording";
+        close();
+        return false;
+    }
+
+    const size_t index_bytes = header_->block_count * sizeof(BlockIndexEntry);
+    if (header_->index_offset && header_->index_offset + index_bytes <= map_bytes_) {
+        const BlockIndexEntry* entries = reinterpret_cast<const BlockIndexEntry*>(map_ + header_->index_offset);
+        index_.assign(entries, entries + header_->block_count);
+    } else {
+        // Not closed (e.g. the recorder was killed): rebuild the index from the blocks
+        for (uint64_t b = 0;; b++) {
+            const uint64_t offset = header_->header_bytes + b * header_->block_bytes;
+            if (offset + header_->block_bytes > map_bytes_) {
+                break;
+            }
+            const BlockHeader* block = reinterpret_cast<const BlockHeader*>(map_ + offset);
+            if (block->magic != BLOCK_MAGIC || block->frame_count == 0) {
+                break;
+            }
+            index_.push_back({block->first_timestamp, block->last_timestamp});
+        }
+    }
+    return true;
+}
+
+void RecordingReader::close() {
+    if (map_) {
+        munmap(const_cast<uint8_t*>(map_), map_bytes_);
+    }
+    map_ = nullptr;
+    map_bytes_ = 0;
+    header_ = nullptr;
+    index_.clear();
+}
+
+const uint8_t* RecordingReader::block_data(uint64_t b) const {
+    return map_ + header_->header_bytes + b * header_->block_bytes;
+}
+
+const BlockHeader& RecordingReader::block(uint64_t b) const {
+    return *reinterpret_cast<const BlockHeader*>(block_data(b));
+}
+
+const uint64_t* RecordingReader::timestamps(uint64_t b) const {
+    return reinterpret_cast<const uint64_t*>(block_data(b) + sizeof(BlockHeader));
+}
+
+const uint16_t* RecordingReader::samples(uint64_t b, uint32_t stream, uint32_t cycle) const {
+    const size_t frames_per_block = header_->frames_per_block;
+    const size_t slot = static_cast<size_t>(stream) * CYCLES_PER_FRAME + cycle;
+    return reinterpret_cast<const uint16_t*>(block_data(b) + block_samples_offset(header_->frames_per_block)) +
+           slot * frames_per_block;
+}
+
+uint64_t RecordingReader::find_block(uint64_t timestamp) const {
+    const auto it = std::lower_bound(index_.begin(), index_.end(), timestamp,
+                                     [](const BlockIndexEntry& e, uint64_t t) { return e.last_timestamp < t; });
+    return static_cast<uint64_t>(it - index_.begin());
+}
+
+bool RecordingReader::seek(uint64_t timestamp, uint64_t& block_index, uint32_t& frame) const {
+    block_index = find_block(timestamp);
+    if (block_index >= index_.size()) {
+        return false;
+    }
+    const uint64_t* first = timestamps(block_index);
+    const uint64_t* last = first + block(block_index).frame_count;
+    frame = static_cast<uint32_t>(std::lower_bound(first, last, timestamp) - first);
+    return true;
+}
+
+} // namespace intan
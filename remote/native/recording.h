@@ -0,0 +1,226 @@
+// recording.h
+// Recording file format for the board's data stream, with a streaming writer and an
+// mmap-based reader.
+//
+// File layout (little-endian):
+//   [RecordingHeader, padded to RECORDING_ALIGNMENT]
+//   [block 0][block 1]...          fixed size, RECORDING_ALIGNMENT multiples
+//   [BlockIndexEntry x block_count] written on close
+//
+// A block holds up to frames_per_block frames in channel-major order:
+//   [BlockHeader][uint64 timestamp x F][uint16 sample x F for every (stream, cycle)]
+// Slot (stream s, cycle c) is the time series of whatever the COPI sequence read in
+// cycle c on enabled stream s (for the convert sequence: amplifier channel c - 2), so
+// one channel is a contiguous array. Blocks are self-describing, so a recording that
+// was never closed is indexed by scanning the block headers instead.
+
+#ifndef INTAN_RECORDING_H
+#define INTAN_RECORDING_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "protocol.h"
+
+namespace intan {
+
+constexpr char RECORDING_MAGIC[8] = {'I', 'N', 'T', 'A', 'N', 'R', 'E', 'C'};
+constexpr uint32_t RECORDING_VERSION = 1;
+constexpr uint32_t RECORDING_ALIGNMENT = 4096;
+constexpr uint32_t BLOCK_MAGIC = 0x4B4C4249;        // "IBLK"
+constexpr uint32_t DEFAULT_FRAMES_PER_BLOCK = 1024;
+
+#pragma pack(push, 1)
+struct RecordingHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_bytes;          // Offset of block 0
+    uint32_t block_bytes;
+    uint32_t frames_per_block;
+    uint32_t num_streams;           // Enabled 16-bit streams per cycle
+    uint32_t cycles_per_frame;
+
+    // Device configuration (from the status response)
+    uint32_t channel_enable;        // All ports, 4 bits per port
+    uint32_t num_spi_ports;
+    uint32_t sample_rate;
+    uint32_t firmware_version;
+    uint16_t device_type;
+    uint16_t protocol_version;
+    uint32_t reserved0;
+
+    int64_t start_time_ns;          // Wall clock (CLOCK_REALTIME) when the writer opened
+    uint64_t first_timestamp;
+    uint64_t last_timestamp;
+
+    // Filled in on close; 0 in a recording that was not closed
+    uint64_t index_offset;
+    uint64_t block_count;
+    uint64_t frame_count;
+    uint64_t gap_count;             // Timestamp discontinuities
+};
+
+struct BlockHeader {
+    uint32_t magic;
+    uint32_t frame_count;           // Valid frames (the last block may be partial)
+    uint64_t first_timestamp;
+    uint64_t last_timestamp;
+    int64_t first_rx_time_ns;       // Host receive time of the first frame, 0 if unknown
+    uint32_t gap_count;
+    uint32_t reserved[7];
+};
+
+struct BlockIndexEntry {
+    uint64_t first_timestamp;
+    uint64_t last_timestamp;
+};
+#pragma pack(pop)
+static_assert(sizeof(BlockHeader) == 64, "block header is 64 bytes");
+
+// Device description written into the header
+struct RecordingInfo {
+    uint32_t channel_enable = 0x0F;
+    uint32_t num_spi_ports = 1;
+    uint32_t sample_rate = MAX_SAMPLE_RATE_HZ;
+    uint32_t firmware_version = 0;
+    uint16_t device_type = DEVICE_TYPE_INTAN_INTERFACE;
+    uint16_t protocol_version = PROTOCOL_VERSION;
+
+    static RecordingInfo from_status(const StatusResponse& status);
+};
+
+inline size_t block_samples_offset(uint32_t frames_per_block) {
+    return sizeof(BlockHeader) + sizeof(uint64_t) * frames_per_block;
+}
+
+inline size_t block_size_bytes(uint32_t frames_per_block, uint32_t num_streams) {
+    const size_t bytes = block_samples_offset(frames_per_block) +
+                         sizeof(uint16_t) * frames_per_block * num_streams * CYCLES_PER_FRAME;
+    return (bytes + RECORDING_ALIGNMENT - 1) / RECORDING_ALIGNMENT * RECORDING_ALIGNMENT;
+}
+
+// ============================================================================
+// WRITER
+// ============================================================================
+
+// Frames are transposed into a block buffer on the caller's thread; full blocks are
+// handed to a writer thread that issues one large aligned write per block. When all
+// buffers are queued, append() waits instead of dropping data.
+class RecordingWriter {
+public:
+    struct Options {
+        uint32_t frames_per_block = DEFAULT_FRAMES_PER_BLOCK;
+        uint32_t queued_blocks = 32;    // Buffers in flight between caller and writer thread
+        bool direct_io = false;         // O_DIRECT: bypass the page cache
+    };
+
+    RecordingWriter();
+    ~RecordingWriter();
+
+    RecordingWriter(const RecordingWriter&) = delete;
+    RecordingWriter& operator=(const RecordingWriter&) = delete;
+
+    bool open(const std::string& path, const RecordingInfo& info, const Options& options);
+
+    // Append one packet; false if its size does not match the channel enable
+    bool append(const uint32_t* words, uint32_t size_words, int64_t rx_time_ns = 0);
+
+    // Flush the last partial block, write the index and the final header
+    bool close();
+
+    const std::string& error() const { return error_; }
+    uint64_t frames_written() const { return header_.frame_count; }
+    uint64_t waits() const { return waits_; }
+
+private:
+    struct PendingBlock {
+        uint8_t* data;
+        uint64_t offset;
+    };
+
+    void start_block();
+    void finish_block();
+    void writer_loop();
+    uint8_t* take_buffer();
+    bool write_all(const void* data, size_t bytes, uint64_t offset);
+
+    int fd_ = -1;
+    Options options_;
+    std::string error_;
+    RecordingHeader header_ = {};
+    size_t block_bytes_ = 0;
+    uint32_t packet_words_ = 0;
+
+    // Block being filled by append()
+    uint8_t* current_ = nullptr;
+    BlockHeader* current_header_ = nullptr;
+    uint64_t* current_timestamps_ = nullptr;
+    uint16_t* current_samples_ = nullptr;
+    uint64_t last_timestamp_ = 0;
+    std::vector<BlockIndexEntry> index_;
+
+    // Buffer pool and write queue
+    std::vector<uint8_t*> buffers_;
+    std::vector<uint8_t*> free_buffers_;
+    std::deque<PendingBlock> queue_;
+    std::mutex mutex_;
+    std::condition_variable queue_changed_;
+    std::thread thread_;
+    bool stopping_ = false;
+    bool write_failed_ = false;
+    uint64_t waits_ = 0;
+};
+
+// ============================================================================
+// READER
+// ============================================================================
+
+// Maps the whole file read-only; all accessors return pointers into the mapping.
+class RecordingReader {
+public:
+    RecordingReader() = default;
+    ~RecordingReader();
+
+    RecordingReader(const RecordingReader&) = delete;
+    RecordingReader& operator=(const RecordingReader&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    const std::string& error() const { return error_; }
+    const RecordingHeader& header() const { return *header_; }
+    uint32_t num_streams() const { return header_->num_streams; }
+    uint64_t block_count() const { return index_.size(); }
+
+    const BlockHeader& block(uint64_t b) const;
+    const uint64_t* timestamps(uint64_t b) const;
+
+    // Samples of (stream, cycle) in block b, block(b).frame_count of them
+    const uint16_t* samples(uint64_t b, uint32_t stream, uint32_t cycle) const;
+
+    // First block whose last timestamp is >= timestamp (block_count() if none);
+    // binary search over the index
+    uint64_t find_block(uint64_t timestamp) const;
+
+    // Block and frame position of the first frame with timestamp >= `timestamp`
+    bool seek(uint64_t timestamp, uint64_t& block, uint32_t& frame) const;
+
+private:
+    const uint8_t* block_data(uint64_t b) const;
+
+    std::string error_;
+    const uint8_t* map_ = nullptr;
+    size_t map_bytes_ = 0;
+    const RecordingHeader* header_ = nullptr;
+    std::vector<BlockIndexEntry> index_;
+};
+
+} // namespace intan
+
+#endif // INTAN_RECORDING_H
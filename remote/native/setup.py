@@ -0,0 +1,21 @@
+"""Builds the intan_native extension (receiver and decoder bindings for net.py).
+
+    cd remote/native && python3 setup.py build_ext --inplace
+"""
+
+import numpy
+from setuptools import Extension, setup
+
+setup(
+    name="intan_native",
+    version="1.0",
+    ext_modules=[
+        Extension(
+            "intan_native",
+            sources=["intan_native.cpp", "decoder.cpp", "udp_receiver.cpp"],
+            include_dirs=[numpy.get_include()],
+            extra_compile_args=["-std=c++17", "-O2"],
+            language="c++",
+        )
+    ],
+)
@@ -0,0 +1,94 @@
+// spsc_ring.h
+// Lock-free single-producer single-consumer ring of fixed-size slots.
+//
+// The producer fills slots in place (e.g. recvmmsg writes straight into them) and
+// publishes them in batches; the consumer reads them in place and releases them. Head
+// and tail live on separate cache lines and each side keeps a cached copy of the
+// other side's index, so the shared lines are only touched when the cache runs out.
+
+#ifndef INTAN_SPSC_RING_H
+#define INTAN_SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace intan {
+
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+template <typename T>
+class SpscRing {
+public:
+    // Capacity is rounded up to a power of two
+    explicit SpscRing(size_t capacity) {
+        capacity_ = 1;
+        while (capacity_ < capacity) {
+            capacity_ <<= 1;
+        }
+        mask_ = capacity_ - 1;
+        slots_.reset(new T[capacity_]);
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    size_t capacity() const { return capacity_; }
+
+    // ---- Producer side ----
+
+    // Number of slots that can be filled without overwriting unread ones. The consumer
+    // position is only re-read when fewer than `wanted` slots are known to be free.
+    size_t writable(size_t wanted = 1) {
+        const uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head - cached_tail_ + wanted > capacity_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+        }
+        return capacity_ - static_cast<size_t>(head - cached_tail_);
+    }
+
+    // The i-th free slot after the last published one (i < writable())
+    T& write_slot(size_t i) {
+        return slots_[(head_.load(std::memory_order_relaxed) + i) & mask_];
+    }
+
+    // Hand the next n filled slots to the consumer
+    void publish(size_t n) {
+        head_.store(head_.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+    // ---- Consumer side ----
+
+    size_t readable() {
+        const uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if (cached_head_ == tail) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+        }
+        return static_cast<size_t>(cached_head_ - tail);
+    }
+
+    // The i-th unread slot (i < readable())
+    const T& read_slot(size_t i) const {
+        return slots_[(tail_.load(std::memory_order_relaxed) + i) & mask_];
+    }
+
+    // Return the next n read slots to the producer
+    void release(size_t n) {
+        tail_.store(tail_.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+private:
+    size_t capacity_;
+    size_t mask_;
+    std::unique_ptr<T[]> slots_;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head_{0};   // Written by the producer
+    uint64_t cached_tail_ = 0;
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> tail_{0};   // Written by the consumer
+    uint64_t cached_head_ = 0;
+};
+
+} // namespace intan
+
+#endif // INTAN_SPSC_RING_H
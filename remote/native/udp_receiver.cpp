@@ -0,0 +1,425 @@
+// udp_receiver.cpp
+// recvmmsg receive loop of UdpReceiver (see udp_receiver.h).
+
+#include "udp_receiver.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+namespace intan {
+
+namespace {
+
+// Control buffer room for SCM_TIMESTAMPNS and SO_RXQ_OVFL
+constexpr size_t CONTROL_BUFFER_SIZE = CMSG_SPACE(sizeof(timespec)) + CMSG_SPACE(sizeof(uint32_t));
+
+// Frames held back behind a hole are released after this even if neither the parity
+// nor a frame of a later group arrives (the stream stopped)
+constexpr auto HOLE_TIMEOUT = std::chrono::milliseconds(100);
+constexpr uint32_t MAX_GROUPS_WITHOUT_PARITY = 2;
+
+// Counters have a single writer, so a plain load/store avoids a locked instruction
+inline void bump(std::atomic<uint64_t>& counter, uint64_t n = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline void unbump(std::atomic<uint64_t>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+}
+
+inline bool is_parity(const Frame& frame, uint32_t bytes) {
+    return bytes > FEC_HEADER_WORDS * 4 && frame.words[0] == MAGIC_NUMBER_LOW && frame.words[1] == FEC_MAGIC_HIGH;
+}
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+}
+
+} // namespace
+
+UdpReceiver::UdpReceiver(const ReceiverConfig& config)
+    : config_(config), ring_(config.ring_frames) {
+    if (config_.batch_size == 0) {
+        config_.batch_size = 1;
+    }
+}
+
+UdpReceiver::~UdpReceiver() {
+    stop();
+}
+
+bool UdpReceiver::start() {
+    if (running_) {
+        return true;
+    }
+
+    socket_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (socket_ < 0) {
+        error_ = std::string("socket: ") + std::strerror(errno);
+        return false;
+    }
+
+    const int one = 1;
+    setsockopt(socket_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(socket_, SOL_SOCKET, SO_RCVBUF, &config_.receive_buffer_bytes, sizeof(config_.receive_buffer_bytes));
+    setsockopt(socket_, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one));
+    if (config_.kernel_timestamps) {
+        setsockopt(socket_, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+    }
+    if (!config_.busy_poll) {
+        // Blocking receives wake up regularly so stop() is noticed
+        timeval timeout = {0, 100000};
+        setsockopt(socket_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config_.port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (!config_.bind_address.empty() && inet_pton(AF_INET, config_.bind_address.c_str(), &addr.sin_addr) != 1) {
+        error_ = "invalid bind address " + config_.bind_address;
+        ::close(socket_);
+        socket_ = -1;
+        return false;
+    }
+    if (bind(socket_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        error_ = std::string("bind: ") + std::strerror(errno);
+        ::close(socket_);
+        socket_ = -1;
+        return false;
+    }
+
+    running_ = true;
+    thread_ = std::thread(&UdpReceiver::receive_loop, this);
+    return true;
+}
+
+void UdpReceiver::stop() {
+    if (!running_) {
+        return;
+    }
+    running_ = false;
+    thread_.join();
+    ::close(socket_);
+    socket_ = -1;
+}
+
+ReceiverStats UdpReceiver::stats() const {
+    ReceiverStats s;
+    s.packets = packets_.load(std::memory_order_relaxed);
+    s.bytes = bytes_.load(std::memory_order_relaxed);
+    s.magic_errors = magic_errors_.load(std::memory_order_relaxed);
+    s.size_errors = size_errors_.load(std::memory_order_relaxed);
+    s.timestamp_errors = timestamp_errors_.load(std::memory_order_relaxed);
+    s.frames_lost = frames_lost_.load(std::memory_order_relaxed);
+    s.out_of_order = out_of_order_.load(std::memory_order_relaxed);
+    s.kernel_drops = kernel_drops_.load(std::memory_order_relaxed);
+    s.ring_full_waits = ring_full_waits_.load(std::memory_order_relaxed);
+    s.fec_parity_packets = fec_parity_packets_.load(std::memory_order_relaxed);
+    s.frames_recovered = frames_recovered_.load(std::memory_order_relaxed);
+    s.sources = source_count_.load(std::memory_order_relaxed);
+    return s;
+}
+
+void UdpReceiver::receive_loop() {
+    if (config_.cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(config_.cpu, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+
+    const uint32_t batch = config_.batch_size;
+    std::vector<mmsghdr> messages(batch);
+    std::vector<iovec> iovs(batch);
+    std::vector<sockaddr_in> addresses(batch);
+    std::vector<char> control(batch * CONTROL_BUFFER_SIZE);
+    const int flags = config_.busy_poll ? MSG_DONTWAIT : MSG_WAITFORONE;
+
+    while (running_.load(std::memory_order_relaxed)) {
+        if (hole_ && std::chrono::steady_clock::now() - hole_opened_ > HOLE_TIMEOUT) {
+            size_t filled = held_;
+            close_hole(filled);
+            ring_.publish(filled);
+            held_ = 0;
+        }
+
+        // One slot beyond the held frames stays free, so a hole can open in place
+        const size_t reserve = held_ + 1;
+        const size_t writable = ring_.writable(reserve + 1);
+        if (writable <= reserve) {
+            // Leave the datagrams in the socket buffer until the consumer catches up
+            bump(ring_full_waits_);
+            if (config_.busy_poll) {
+                cpu_relax();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+            continue;
+        }
+
+        // Receive straight into the free ring slots
+        const uint32_t n = static_cast<uint32_t>(std::min<size_t>(writable - reserve, batch));
+        for (uint32_t i = 0; i < n; i++) {
+            Frame& frame = ring_.write_slot(reserve + i);
+            iovs[i].iov_base = frame.words;
+            iovs[i].iov_len = sizeof(frame.words);
+            msghdr& header = messages[i].msg_hdr;
+            header.msg_name = &addresses[i];
+            header.msg_namelen = sizeof(sockaddr_in);
+            header.msg_iov = &iovs[i];
+            header.msg_iovlen = 1;
+            header.msg_control = &control[i * CONTROL_BUFFER_SIZE];
+            header.msg_controllen = CONTROL_BUFFER_SIZE;
+            header.msg_flags = 0;
+        }
+
+        const int received = recvmmsg(socket_, messages.data(), n, flags, nullptr);
+        if (received <= 0) {
+            if (config_.busy_poll) {
+                cpu_relax();
+            }
+            continue;
+        }
+
+        // Frames move down to `filled`, behind the held ones, closing the slots of
+        // dropped and parity datagrams
+        size_t filled = held_;
+        for (int i = 0; i < received; i++) {
+            Frame& frame = ring_.write_slot(reserve + i);
+            msghdr& header = messages[i].msg_hdr;
+
+            frame.rx_time_ns = 0;
+            for (cmsghdr* c = CMSG_FIRSTHDR(&header); c; c = CMSG_NXTHDR(&header, c)) {
+                if (c->cmsg_level != SOL_SOCKET) {
+                    continue;
+                }
+                if (c->cmsg_type == SCM_TIMESTAMPNS) {
+                    timespec ts;
+                    std::memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+                    frame.rx_time_ns = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+                } else if (c->cmsg_type == SO_RXQ_OVFL) {
+                    uint32_t drops;
+                    std::memcpy(&drops, CMSG_DATA(c), sizeof(drops));
+                    kernel_drops_.store(drops, std::memory_order_relaxed);
+                }
+            }
+
+            const uint32_t bytes = (header.msg_flags & MSG_TRUNC) ? 0 : messages[i].msg_len;
+            const uint32_t address = ntohl(addresses[i].sin_addr.s_addr);
+            const uint16_t port = ntohs(addresses[i].sin_port);
+            if (is_parity(frame, bytes)) {
+                fec_parity(frame, bytes, address, port, filled);
+                continue;
+            }
+            const uint64_t lost = check_frame(frame, bytes, address, port);
+            if (!(frame.flags & FRAME_VALID) && config_.drop_invalid) {
+                continue;
+            }
+
+            FecGroup& fec = fec_[frame.source];
+            if ((frame.flags & FRAME_VALID) && fec.group_size) {
+                // The hole's parity would have come before a frame of a later group
+                if (hole_ && hole_source_ == frame.source &&
+                    (frame.timestamp < hole_timestamp_ ||
+                     frame.timestamp >= hole_timestamp_ - hole_timestamp_ % fec.group_size + fec.group_size)) {
+                    close_hole(filled);
+                }
+                fec_add(frame);
+                // A single frame missing earlier in this group can still be rebuilt
+                if (lost == 1 && !hole_ && fec.group_size && frame.timestamp - 1 >= fec.first) {
+                    hole_ = true;
+                    hole_slot_ = filled++;
+                    hole_source_ = frame.source;
+                    hole_timestamp_ = frame.timestamp - 1;
+                    hole_opened_ = std::chrono::steady_clock::now();
+                    ring_.write_slot(hole_slot_).flags = 0;
+                }
+            }
+
+            Frame& target = ring_.write_slot(filled);
+            if (&target != &frame) {
+                target = frame;
+            }
+            filled++;
+        }
+
+        // Publish up to the hole; the frames after it wait for the parity
+        const size_t ready = hole_ ? hole_slot_ : filled;
+        ring_.publish(ready);
+        held_ = filled - ready;
+        hole_slot_ = 0;
+    }
+}
+
+// Returns the number of frames missing right before this one
+uint64_t UdpReceiver::check_frame(Frame& frame, uint32_t bytes, uint32_t address, uint16_t port) {
+    bump(packets_);
+    bump(bytes_, bytes);
+
+    frame.size_words = bytes / 4;
+    frame.flags = 0;
+    frame.timestamp = 0;
+    frame.source = 0;
+
+    const bool size_ok = (bytes % 4) == 0 &&
+        (config_.expected_packet_words ? frame.size_words == config_.expected_packet_words
+                                       : channels_from_packet_size(frame.size_words) != 0);
+    if (!size_ok) {
+        bump(size_errors_);
+        return 0;
+    }
+    if (frame.words[0] != MAGIC_NUMBER_LOW || frame.words[1] != MAGIC_NUMBER_HIGH) {
+        bump(magic_errors_);
+        return 0;
+    }
+
+    frame.timestamp = (static_cast<uint64_t>(frame.words[3]) << 32) | frame.words[2];
+    frame.source = find_source(address, port);
+    frame.flags = FRAME_VALID;
+
+    SourceState& source = sources_[frame.source];
+    uint64_t lost = 0;
+    if (source.has_timestamp && frame.timestamp != source.last_timestamp + 1) {
+        bump(timestamp_errors_);
+        frame.flags |= FRAME_GAP_BEFORE;
+        if (frame.timestamp > source.last_timestamp) {
+            lost = frame.timestamp - source.last_timestamp - 1;
+            bump(frames_lost_, lost);
+        } else {
+            bump(out_of_order_);
+        }
+    }
+    source.has_timestamp = true;
+    source.last_timestamp = frame.timestamp;
+    return lost;
+}
+
+// XOR a frame into the parity group of its source
+void UdpReceiver::fec_add(const Frame& frame) {
+    FecGroup& fec = fec_[frame.source];
+    const uint64_t first = frame.timestamp - frame.timestamp % fec.group_size;
+    const uint32_t data_words = frame.size_words - PACKET_HEADER_WORDS;
+    const uint32_t* data = frame.words + PACKET_HEADER_WORDS;
+    if (fec.received == 0 || fec.first != first || fec.packet_words != frame.size_words) {
+        if (fec.received != 0 && ++fec.groups_without_parity > MAX_GROUPS_WITHOUT_PARITY) {
+            fec.group_size = 0;     // The board stopped sending parity
+            fec.received = 0;
+            return;
+        }
+        fec.first = first;
+        fec.packet_words = frame.size_words;
+        fec.received = 0;
+        std::memcpy(fec.parity, data, data_words * 4);
+    } else {
+        for (uint32_t i = 0; i < data_words; i++) {
+            fec.parity[i] ^= data[i];
+        }
+    }
+    fec.received |= 1u << (frame.timestamp - first);
+}
+
+// Rebuild the one frame of the group that did not arrive: into the hole held open for
+// it, or after the frames received so far when it was the last of the group
+void UdpReceiver::fec_parity(const Frame& parity, uint32_t bytes, uint32_t address, uint16_t port, size_t& filled) {
+    bump(fec_parity_packets_);
+    bump(bytes_, bytes);
+    const uint32_t group_size = parity.words[4];
+    const uint32_t mask = parity.words[5];
+    const uint32_t data_words = bytes / 4 - FEC_HEADER_WORDS;
+    if (bytes % 4 || group_size < 2 || group_size > FEC_MAX_GROUP_SIZE ||
+        data_words > MAX_PACKET_WORDS - PACKET_HEADER_WORDS) {
+        bump(size_errors_);
+        return;
+    }
+
+    const uint16_t index = find_source(address, port);
+    FecGroup& fec = fec_[index];
+    const uint64_t first = (static_cast<uint64_t>(parity.words[3]) << 32) | parity.words[2];
+    const int64_t rx_time_ns = parity.rx_time_ns;
+    const uint32_t missing = mask & ~fec.received;
+    const bool usable = fec.group_size == group_size && fec.first == first && fec.received != 0 &&
+        fec.packet_words == data_words + PACKET_HEADER_WORDS && (fec.received & ~mask) == 0 &&
+        missing != 0 && (missing & (missing - 1)) == 0;
+    fec.group_size = group_size;
+    fec.groups_without_parity = 0;
+
+    if (usable) {
+        const uint64_t timestamp = first + __builtin_ctz(missing);
+        SourceState& source = sources_[index];
+        Frame* target = nullptr;
+        if (hole_ && hole_source_ == index && hole_timestamp_ == timestamp) {
+            target = &ring_.write_slot(hole_slot_);
+            ring_.write_slot(hole_slot_ + 1).flags &= ~FRAME_GAP_BEFORE;
+            hole_ = false;
+            unbump(timestamp_errors_);
+            unbump(frames_lost_);
+        } else if (source.has_timestamp && timestamp == source.last_timestamp + 1) {
+            // May be the slot the parity itself arrived in; its header was read above
+            target = &ring_.write_slot(filled++);
+            source.last_timestamp = timestamp;
+        }
+        if (target) {
+            for (uint32_t i = 0; i < data_words; i++) {
+                fec.parity[i] ^= parity.words[FEC_HEADER_WORDS + i];
+            }
+            target->words[0] = MAGIC_NUMBER_LOW;
+            target->words[1] = MAGIC_NUMBER_HIGH;
+            target->words[2] = static_cast<uint32_t>(timestamp);
+            target->words[3] = static_cast<uint32_t>(timestamp >> 32);
+            std::memcpy(target->words + PACKET_HEADER_WORDS, fec.parity, data_words * 4);
+            target->rx_time_ns = rx_time_ns;
+            target->timestamp = timestamp;
+            target->size_words = data_words + PACKET_HEADER_WORDS;
+            target->source = index;
+            target->flags = FRAME_VALID | FRAME_RECOVERED;
+            bump(frames_recovered_);
+        }
+    }
+    fec.received = 0;
+
+    // More than one frame of the hole's group was lost
+    if (hole_ && hole_source_ == index && hole_timestamp_ >= first && hole_timestamp_ - first < group_size) {
+        close_hole(filled);
+    }
+}
+
+// Give up on the hole and move the frames held behind it down over it
+void UdpReceiver::close_hole(size_t& filled) {
+    for (size_t i = hole_slot_ + 1; i < filled; i++) {
+        ring_.write_slot(i - 1) = ring_.write_slot(i);
+    }
+    filled--;
+    hole_ = false;
+}
+
+uint16_t UdpReceiver::find_source(uint32_t address, uint16_t port) {
+    for (uint32_t i = 0; i < num_sources_; i++) {
+        if (sources_[i].address == address && sources_[i].port == port) {
+            return static_cast<uint16_t>(i);
+        }
+    }
+    if (num_sources_ == MAX_SOURCES) {
+        return MAX_SOURCES - 1;     // Further devices share the last slot
+    }
+    sources_[num_sources_] = {address, port, false, 0};
+    source_count_.store(num_sources_ + 1, std::memory_order_relaxed);
+    return static_cast<uint16_t>(num_sources_++);
+}
+
+} // namespace intan
@@ -0,0 +1,156 @@
+// udp_receiver.h
+// High-rate receiver for the board's UDP data stream.
+//
+// One thread drains the socket with recvmmsg straight into the slots of an SPSC
+// ring, so each datagram is copied once (kernel to ring). Frames are checked on the
+// receive thread - magic, plausible size, timestamp continuity per sending device -
+// and counted the way DataValidator in remote/net.py counts them. Consumers read
+// the ring in place from their own thread.
+//
+// When the board sends FEC parity datagrams (SET_FEC), a single frame missing from
+// a parity group is rebuilt in place: the frames after it are held back until the
+// group's parity arrives, so the consumer still sees timestamps in order, with the
+// rebuilt frame flagged FRAME_RECOVERED. Parity datagrams never enter the ring.
+
+#ifndef INTAN_UDP_RECEIVER_H
+#define INTAN_UDP_RECEIVER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "protocol.h"
+#include "spsc_ring.h"
+
+namespace intan {
+
+constexpr uint32_t MAX_SOURCES = 16;    // Devices tracked separately for continuity
+
+// One received datagram
+struct Frame {
+    int64_t rx_time_ns;         // Kernel receive time (SO_TIMESTAMPNS), 0 if disabled
+    uint64_t timestamp;         // Device frame counter from the header
+    uint32_t size_words;        // Packet size including the header
+    uint16_t source;            // Index of the sending device (order of first packet)
+    uint16_t flags;             // FRAME_* below
+    alignas(16) uint32_t words[MAX_DATAGRAM_WORDS];   // Room for a parity datagram
+};
+
+constexpr uint16_t FRAME_VALID = 1 << 0;          // Magic and size are correct
+constexpr uint16_t FRAME_GAP_BEFORE = 1 << 1;     // Timestamp did not follow the previous frame
+constexpr uint16_t FRAME_RECOVERED = 1 << 2;      // Rebuilt from FEC parity
+
+struct ReceiverConfig {
+    uint16_t port = UDP_PORT;
+    std::string bind_address;               // Empty = all interfaces
+    int receive_buffer_bytes = 64 << 20;    // SO_RCVBUF (capped by net.core.rmem_max)
+    uint32_t batch_size = 64;               // Datagrams per recvmmsg call
+    uint32_t ring_frames = 1 << 14;         // About half a second at 30 kS/s
+    uint32_t expected_packet_words = 0;     // 0 = any size some channel mask produces
+    bool busy_poll = false;                 // Spin on non-blocking receives instead of sleeping
+    int cpu = -1;                           // Pin the receive thread to this CPU
+    bool kernel_timestamps = true;          // Capture SO_TIMESTAMPNS per datagram
+    bool drop_invalid = true;               // Keep bad datagrams out of the ring
+};
+
+struct ReceiverStats {
+    uint64_t packets = 0;                   // Datagrams received
+    uint64_t bytes = 0;
+    uint64_t magic_errors = 0;
+    uint64_t size_errors = 0;
+    uint64_t timestamp_errors = 0;          // Discontinuities (as DataValidator counts them)
+    uint64_t frames_lost = 0;               // Frames missing in forward timestamp gaps (after FEC)
+    uint64_t out_of_order = 0;              // Timestamps at or behind the previous one
+    uint64_t kernel_drops = 0;              // Socket buffer overflows (SO_RXQ_OVFL)
+    uint64_t ring_full_waits = 0;           // Times the consumer was too slow
+    uint64_t fec_parity_packets = 0;        // Parity datagrams received
+    uint64_t frames_recovered = 0;          // Frames rebuilt from parity
+    uint32_t sources = 0;
+};
+
+class UdpReceiver {
+public:
+    explicit UdpReceiver(const ReceiverConfig& config);
+    ~UdpReceiver();
+
+    UdpReceiver(const UdpReceiver&) = delete;
+    UdpReceiver& operator=(const UdpReceiver&) = delete;
+
+    // Open the socket and start the receive thread; false (with error()) on failure
+    bool start();
+    void stop();
+
+    const std::string& error() const { return error_; }
+
+    // Frames for the consumer thread (read_slot / release)
+    SpscRing<Frame>& frames() { return ring_; }
+
+    // Snapshot of the counters, safe from any thread
+    ReceiverStats stats() const;
+
+private:
+    struct SourceState {
+        uint32_t address;
+        uint16_t port;
+        bool has_timestamp;
+        uint64_t last_timestamp;
+    };
+
+    // XOR of the data words of the current parity group of one source
+    struct FecGroup {
+        uint32_t group_size;            // From the last parity datagram, 0 = no FEC seen
+        uint64_t first;                 // First timestamp of the group
+        uint32_t packet_words;
+        uint32_t received;              // Mask of the frames XORed in, 0 = none since the last parity
+        uint32_t groups_without_parity; // FEC is taken as off after a few
+        uint32_t parity[MAX_PACKET_WORDS - PACKET_HEADER_WORDS];
+    };
+
+    void receive_loop();
+    uint64_t check_frame(Frame& frame, uint32_t bytes, uint32_t address, uint16_t port);
+    uint16_t find_source(uint32_t address, uint16_t port);
+    void fec_add(const Frame& frame);
+    void fec_parity(const Frame& parity, uint32_t bytes, uint32_t address, uint16_t port, size_t& filled);
+    void close_hole(size_t& filled);
+
+    ReceiverConfig config_;
+    SpscRing<Frame> ring_;
+    int socket_ = -1;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    std::string error_;
+
+    SourceState sources_[MAX_SOURCES] = {};
+    uint32_t num_sources_ = 0;
+
+    // Write slots 0 .. held_ - 1 are received frames not published yet. With hole_ set,
+    // slot hole_slot_ (0 between batches) waits for frame hole_timestamp_ of source
+    // hole_source_ and everything from it on is held back.
+    FecGroup fec_[MAX_SOURCES] = {};
+    size_t held_ = 0;
+    bool hole_ = false;
+    size_t hole_slot_ = 0;
+    uint16_t hole_source_ = 0;
+    uint64_t hole_timestamp_ = 0;
+    std::chrono::steady_clock::time_point hole_opened_;
+
+    // Written by the receive thread only
+    std::atomic<uint64_t> packets_{0};
+    std::atomic<uint64_t> bytes_{0};
+    std::atomic<uint64_t> magic_errors_{0};
+    std::atomic<uint64_t> size_errors_{0};
+    std::atomic<uint64_t> timestamp_errors_{0};
+    std::atomic<uint64_t> frames_lost_{0};
+    std::atomic<uint64_t> out_of_order_{0};
+    std::atomic<uint64_t> kernel_drops_{0};
+    std::atomic<uint64_t> ring_full_waits_{0};
+    std::atomic<uint64_t> fec_parity_packets_{0};
+    std::atomic<uint64_t> frames_recovered_{0};
+    std::atomic<uint32_t> source_count_{0};
+};
+
+} // namespace intan
+
+#endif // INTAN_UDP_RECEIVER_H
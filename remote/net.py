@@ -1,20 +1,45 @@
+import os
+import sys
 import socket
 import threading
 import struct
 import time
-import random
 import queue
 import ipaddress
 from typing import Dict, List, Tuple, Optional
 from dataclasses import dataclass
 
-ZYNQ_IP = "192.168.18.10"  # IP of the Zynq board
+from command_client import CommandClient, BRAM_SIZE_WORDS, MAX_RESEND_FRAMES, BRAM_COPY_METHODS
+
+# Optional native receiver/decoder (build with: cd remote/native && python3 setup.py build_ext --inplace)
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "native"))
+try:
+    import intan_native
+except ImportError:
+    intan_native = None
+
+ZYNQ_IP = os.environ.get("ZYNQ_IP", "192.168.18.10")  # IP of the Zynq board (or an emulator)
 TCP_PORT = 6000  # Must match your board's TCP_PORT
+STREAM_PORT = 6001  # Must match your board's STREAM_TCP_PORT
+TCP_STREAM = bool(os.environ.get("INTAN_TCP_STREAM"))  # Record over the TCP frame stream instead of UDP
+UDP_RESEND = not os.environ.get("INTAN_NO_RESEND")  # NACK lost datagrams (RESEND_FRAMES)
 UDP_PORT = 5000  # Must match your board's UDP_PORT
+TELEMETRY_PORT = 5001  # Where SET_TELEMETRY datagrams are sent unless told otherwise
 
 # Updated data generator constants
 MAGIC_NUMBER_LOW = 0xDEADBEEF
 MAGIC_NUMBER_HIGH = 0xCAFEBABE
+FEC_MAGIC_HIGH = 0xCAFEFEC0  # Parity datagrams of SET_FEC (rebuilt from by the native receiver)
+TELEMETRY_MAGIC_HIGH = 0xCAFE7E1E  # Telemetry datagrams of SET_TELEMETRY
+TELEMETRY_MAX_RATE_HZ = 100
+
+# Main loop tasks in the order of sched_task_max_us in the status response
+SCHED_TASKS = ("drain", "ethernet rx", "lwip timers", "commands", "telemetry")
+
+# Drain backlog histogram: bin 0 is below BACKLOG_HIST_MIN_WORDS, bin n starts at
+# BACKLOG_HIST_MIN_WORDS << (n - 1)
+BACKLOG_HIST_BINS = 12
+BACKLOG_HIST_MIN_WORDS = 64
 
 # Binary command protocol constants
 CMD_MAGIC = 0xDEADBEEF
@@ -29,13 +54,36 @@ CMD_SET_LOOP_COUNT = 0x10
 CMD_SET_PHASE = 0x11
 CMD_SET_DEBUG_MODE = 0x12
 CMD_SET_CHANNEL_ENABLE = 0x13
+CMD_SET_SAMPLE_RATE = 0x14
+CMD_SET_FINE_PHASE = 0x15
+CMD_SET_PORT_FINE_PHASE = 0x16
 CMD_LOAD_CONVERT = 0x20
 CMD_LOAD_INIT = 0x21
 CMD_LOAD_CABLE_TEST = 0x22
 CMD_FULL_CABLE_TEST = 0x30
 CMD_GET_STATUS = 0x40
 CMD_DUMP_BRAM = 0x41
+CMD_READ_BRAM = 0x42
+CMD_TRIGGER_CAPTURE = 0x43
+CMD_RESEND_FRAMES = 0x44
 CMD_SET_UDP_DEST = 0x50
+CMD_SET_UDP_STREAM = 0x51
+CMD_SET_FEC = 0x52
+CMD_SET_PACING = 0x53
+CMD_SET_TELEMETRY = 0x54
+CMD_TRANSACTION = 0x60
+
+# Sample rates (frames per second) - must divide the 84 MHz PL clock evenly
+MAX_SAMPLE_RATE = 30000
+SUPPORTED_SAMPLE_RATES = [1000, 2500, 5000, 10000, 20000, 30000]
+
+# CIPO is 8x oversampled - fine phases are in 1/8 bit steps (fine phase 2k == phase k)
+NUM_FINE_PHASES = 24
+
+# Headstage ports - 4 channel enable bits per port (CIPO0/CIPO1 x regular/DDR).
+# Updated from the device status.
+CHANNELS_PER_PORT = 4
+num_spi_ports = 1
 
 # ACK status codes
 ACK_SUCCESS = 0x06
@@ -199,18 +247,21 @@ class DetectionResult:
             channels.append(f"CIPO1 ({'DDR' if self.cipo1_has_ddr else 'Regular only'})")
         
         return (f" Chips detected!\n"
-                f"  Phase: {self.best_phase}\n"
+                f"  Fine phase: {self.best_phase}\n"
                 f"  Channels: {', '.join(channels)}\n"
                 f"  Channel mask: 0x{self.optimal_channel_mask:X}")
 
 
 class CableDetection:
-    def __init__(self, send_tcp_command_func):
+    def __init__(self, send_tcp_command_func, send_tcp_batch_func=None):
         """
         Initialize with a command function that takes (cmd_id, param1, param2)
-        and returns (success: bool, data: Optional[bytes])
+        and returns (success: bool, data: Optional[bytes]), and optionally a batch
+        function that takes a list of (cmd_id, param1, param2) tuples, applies them
+        together (as one transaction) and returns True if all succeeded
         """
         self.send_cmd = send_tcp_command_func
+        self.send_batch = send_tcp_batch_func or self._send_sequential
         self.packet_queue = queue.Queue()
         self.capturing = False
     
@@ -239,9 +290,9 @@ class CableDetection:
             if not self._initialize_chips(verbose):
                 return result
             
-            # Test all phases
+            # Test all fine phases
             best_score = -1000
-            for phase in range(16):
+            for phase in range(NUM_FINE_PHASES):
                 if verbose:
                     print(f"[Detection] Testing phase {phase}...")
                 
@@ -291,11 +342,15 @@ class CableDetection:
         if not result.success:
             return False
         
-        CMD_SET_PHASE = 0x11
+        CMD_SET_FINE_PHASE = 0x15
         CMD_SET_CHANNEL_ENABLE = 0x13
         
-        return (self.send_cmd(CMD_SET_PHASE, result.best_phase, result.best_phase)[0] and
-                self.send_cmd(CMD_SET_CHANNEL_ENABLE, result.optimal_channel_mask)[0])
+        return self.send_batch([(CMD_SET_FINE_PHASE, result.best_phase, result.best_phase),
+                                (CMD_SET_CHANNEL_ENABLE, result.optimal_channel_mask)])
+    
+    def _send_sequential(self, commands) -> bool:
+        """Batch fallback: one command at a time, stopping at the first failure"""
+        return all(self.send_cmd(*command)[0] for command in commands)
     
     def _initialize_chips(self, verbose) -> bool:
         """Initialize chips for testing"""
@@ -309,27 +364,22 @@ class CableDetection:
         if verbose:
             print("[Detection] Initializing chips...")
         
-        # Stop, set loop count, enable all channels
-        if not (self.send_cmd(CMD_STOP)[0] and
-                self.send_cmd(CMD_SET_LOOP_COUNT, 1)[0] and
-                self.send_cmd(CMD_SET_CHANNEL_ENABLE, CABLE_TEST_CHANNEL_ENABLE)[0]):
+        # Stop, set loop count, enable all channels, then load and run the
+        # initialization sequence - the device applies them in order
+        if not self.send_batch([(CMD_STOP,),
+                                (CMD_SET_LOOP_COUNT, 1),
+                                (CMD_SET_CHANNEL_ENABLE, CABLE_TEST_CHANNEL_ENABLE),
+                                (CMD_LOAD_INIT,),
+                                (CMD_START,)]):
             return False
         
-        # Load and run initialization sequence
-        if not self.send_cmd(CMD_LOAD_INIT)[0]:
-            return False
-        
-        if not self.send_cmd(CMD_START)[0]:
-            return False
-        time.sleep(0.1)
-        self.send_cmd(CMD_STOP)
-        
+        # The batch completes once the single init frame has begun; STOP lets it finish.
         # Load cable test sequence
-        return self.send_cmd(CMD_LOAD_CABLE_TEST)[0]
+        return self.send_batch([(CMD_STOP,), (CMD_LOAD_CABLE_TEST,)])
     
     def _test_phase(self, phase: int, verbose: bool) -> PhaseResult:
-        """Test a single phase configuration"""
-        CMD_SET_PHASE = 0x11
+        """Test a single fine phase configuration"""
+        CMD_SET_FINE_PHASE = 0x15
         CMD_START = 0x01
         CMD_STOP = 0x02
         
@@ -340,9 +390,8 @@ class CableDetection:
         
         try:
             # Set phase
-            if not self.send_cmd(CMD_SET_PHASE, phase, phase)[0]:
+            if not self.send_cmd(CMD_SET_FINE_PHASE, phase, phase)[0]:
                 return result
-            time.sleep(0.01)
             
             # Capture packet
             self.capturing = True
@@ -436,11 +485,15 @@ class CableDetection:
         
         return score, has_ddr
 
+def channel_enable_all():
+    """Channel enable mask with every channel of every port enabled"""
+    return (1 << (CHANNELS_PER_PORT * num_spi_ports)) - 1
+
 def calculate_data_words(channel_enable):
     """Calculate number of 32-bit data words based on channel enable setting"""
-    num_channels = bin(channel_enable & 0x0F).count('1')
+    num_channels = bin(channel_enable & channel_enable_all()).count('1')
     if num_channels == 0:
-        return 70
+        num_channels = CHANNELS_PER_PORT * num_spi_ports
     total_16bit_words = 35 * num_channels
     return (total_16bit_words + 1) // 2
 
@@ -450,11 +503,13 @@ def calculate_packet_size(channel_enable):
 
 def channel_enable_to_string(channel_enable):
     """Convert channel enable bits to human readable string"""
+    names = ["CIPO0_REG", "CIPO0_DDR", "CIPO1_REG", "CIPO1_DDR"]
     channels = []
-    if channel_enable & 0x01: channels.append("CIPO0_REG")
-    if channel_enable & 0x02: channels.append("CIPO0_DDR")
-    if channel_enable & 0x04: channels.append("CIPO1_REG")
-    if channel_enable & 0x08: channels.append("CIPO1_DDR")
+    for port in range(num_spi_ports):
+        prefix = f"P{port}_" if num_spi_ports > 1 else ""
+        for bit, name in enumerate(names):
+            if channel_enable & (1 << (CHANNELS_PER_PORT * port + bit)):
+                channels.append(prefix + name)
     return ", ".join(channels) if channels else "NONE"
 
 def get_local_ip():
@@ -485,12 +540,22 @@ class DataValidator:
         self.current_channel_enable = 0x0F
         self.expected_packet_size_bytes = calculate_packet_size(0x0F) * 4
         self.expected_packet_size_words = calculate_packet_size(0x0F)
+        self.sample_rate = MAX_SAMPLE_RATE
         self._manual_queue = queue.Queue()
         self._manual_lock = threading.Lock()
         
         # Cable detection integration
         self.cable_detector = None
 
+        # Batch validation with the native extension, if built
+        self.native_decoder = intan_native.FrameDecoder(0x0F, num_spi_ports) if intan_native else None
+
+        # Gaps are NACKed through request_resend(first_timestamp, count) when it is set
+        self.request_resend = None
+        self.missing = {}               # Timestamps asked for and not received yet, oldest first
+        self.frames_requested = 0
+        self.frames_recovered = 0
+
     def set_cable_detector(self, detector):
         """Set cable detector for packet capture integration"""
         self.cable_detector = detector
@@ -500,10 +565,18 @@ class DataValidator:
         self.current_channel_enable = channel_enable
         self.expected_packet_size_words = calculate_packet_size(channel_enable)
         self.expected_packet_size_bytes = self.expected_packet_size_words * 4
+        if intan_native:
+            self.native_decoder = intan_native.FrameDecoder(channel_enable, num_spi_ports)
         print(f"[INFO] Channel enable updated to 0x{channel_enable:X}")
         print(f"[INFO] Enabled channels: {channel_enable_to_string(channel_enable)}")
         print(f"[INFO] Expected packet size: {self.expected_packet_size_words} words ({self.expected_packet_size_bytes} bytes)")
 
+    def set_sample_rate(self, sample_rate):
+        """Update the expected frame rate (frames per second)"""
+        self.sample_rate = sample_rate
+        print(f"[INFO] Sample rate updated to {sample_rate} Hz")
+        print(f"[INFO] Expected data rate: {(sample_rate * self.expected_packet_size_bytes * 8 / 1000000):.1f} Mbps")
+
     def start_cable_test_capture(self):
         global cable_test_mode, cable_test_packets_captured
         cable_test_mode = True
@@ -546,7 +619,7 @@ class DataValidator:
         self.last_packet_raw = data
 
         if cable_test_mode:
-            if cable_test_packets_captured < 17:
+            if cable_test_packets_captured < 1 + NUM_FINE_PHASES:
                 if len(data) == CABLE_TEST_PACKET_SIZE_BYTES:
                     words = struct.unpack(f'<{CABLE_TEST_PACKET_SIZE_WORDS}I', data)
                     self.last_packet_words = words
@@ -556,7 +629,7 @@ class DataValidator:
                         phase1 = cable_test_packets_captured - 1
                         print(f"Packet {cable_test_packets_captured + 1} (Phase1={phase1}): Word 8: 0x{words[8]:08X}, Word 9: 0x{words[9]:08X}")
                 cable_test_packets_captured += 1
-                if cable_test_packets_captured >= 17:
+                if cable_test_packets_captured >= 1 + NUM_FINE_PHASES:
                     cable_test_mode = False
                     print("Cable test capture complete.")
                 return None
@@ -601,7 +674,7 @@ class DataValidator:
             timestamp = (words[3] << 32) | words[2]
 
             now = time.time()
-            if self.packet_count % 30000 == 0 or (now - self.last_stats_time) >= 5.0:
+            if self.packet_count % self.sample_rate == 0 or (now - self.last_stats_time) >= 5.0:
                 elapsed = now - self.start_time
                 total_rate = self.packet_count / elapsed if elapsed > 0 else 0
                 inst_rate = (self.packet_count - self.last_packet_count) / (now - self.last_stats_time) if (now - self.last_stats_time) > 0 else 0
@@ -626,6 +699,94 @@ class DataValidator:
             print(f"[ERROR] Packet {self.packet_count}: Failed to unpack: {e}")
             return None
 
+    def check_continuity(self, timestamp):
+        """Count a timestamp error if timestamp does not follow the previous packet"""
+        if self.follow(timestamp):
+            self.timestamp_errors += 1
+            self.error_count += 1
+
+    def follow(self, timestamp):
+        """Advance to timestamp; True if it breaks the sequence. A gap is NACKed, and
+        the resent frames that fill it later are not errors."""
+        if self.last_timestamp is None or timestamp == self.last_timestamp + 1:
+            self.last_timestamp = timestamp
+            return False
+        if timestamp in self.missing:
+            del self.missing[timestamp]
+            self.frames_recovered += 1
+            return False
+        if timestamp > self.last_timestamp + 1:
+            self.nack(self.last_timestamp + 1, timestamp - self.last_timestamp - 1)
+        self.last_timestamp = timestamp
+        return True
+
+    def nack(self, first_timestamp, count):
+        # Longer gaps are device overruns or restarts - nothing the history can fill
+        if self.request_resend is None or count > MAX_RESEND_FRAMES:
+            return
+        self.missing.update(dict.fromkeys(range(first_timestamp, first_timestamp + count)))
+        while len(self.missing) > 4 * MAX_RESEND_FRAMES:
+            del self.missing[next(iter(self.missing))]
+        self.frames_requested += count
+        try:
+            self.request_resend(first_timestamp, count)
+        except (ConnectionError, OSError, RuntimeError):
+            self.request_resend = None
+
+    def can_validate_batch(self, sizes):
+        """True if a batch can go through validate_batch() instead of packet by packet"""
+        capturing = self.cable_detector is not None and self.cable_detector.capturing
+        return (self.native_decoder is not None and not cable_test_mode and not manual_cable_test_mode
+                and not capturing and bool((sizes == self.expected_packet_size_bytes).all()))
+
+    def validate_batch(self, data, count):
+        """Validate `count` back-to-back packets in one native call (same counters as validate_packet)"""
+        decoder = self.native_decoder
+        magic_errors = decoder.magic_errors
+        timestamp_errors = decoder.timestamp_errors
+        decoder.last_timestamp = self.last_timestamp
+        decoder.process(data)
+
+        new_magic_errors = decoder.magic_errors - magic_errors
+        new_timestamp_errors = decoder.timestamp_errors - timestamp_errors
+        if new_timestamp_errors and (self.request_resend is not None or self.missing):
+            # The decoder only counts breaks; find the gaps and resent frames here
+            new_timestamp_errors = 0
+            for offset in range(0, count * self.expected_packet_size_bytes, self.expected_packet_size_bytes):
+                magic_low, magic_high, timestamp = struct.unpack_from('<IIQ', data, offset)
+                if magic_low == MAGIC_NUMBER_LOW and magic_high == MAGIC_NUMBER_HIGH:
+                    new_timestamp_errors += self.follow(timestamp)
+            decoder.last_timestamp = self.last_timestamp
+        previous_count = self.packet_count
+        self.packet_count += count
+        self.magic_errors += new_magic_errors
+        self.timestamp_errors += new_timestamp_errors
+        self.error_count += new_magic_errors + new_timestamp_errors
+        self.last_timestamp = decoder.last_timestamp
+        if new_magic_errors:
+            print(f"[ERROR] {new_magic_errors} packets with magic number mismatch")
+
+        last = data[-self.expected_packet_size_bytes:]
+        self.last_packet_raw = last
+        self.last_packet_words = struct.unpack(f'<{self.expected_packet_size_words}I', last)
+
+        now = time.time()
+        if self.start_time is None:
+            self.start_time = now
+            self.last_stats_time = now
+        crossed = self.packet_count // self.sample_rate != previous_count // self.sample_rate
+        if crossed or (now - self.last_stats_time) >= 5.0:
+            words = self.last_packet_words
+            elapsed = now - self.start_time
+            total_rate = self.packet_count / elapsed if elapsed > 0 else 0
+            inst_rate = (self.packet_count - self.last_packet_count) / (now - self.last_stats_time) if (now - self.last_stats_time) > 0 else 0
+            print(f"[INFO] Packet {self.packet_count}: Timestamp {self.last_timestamp}, "
+                  f"Rate: {total_rate:.1f} pkt/s (avg), {inst_rate:.1f} pkt/s (inst), "
+                  f"Errors: {self.error_count}")
+            print(f"       Data: [0x{words[4]:08X}, 0x{words[5]:08X}, 0x{words[6]:08X}, 0x{words[7]:08X}]")
+            self.last_stats_time = now
+            self.last_packet_count = self.packet_count
+
     def print_last_packet_hex(self, words_per_line=8):
         if self.last_packet_words is None:
             print("[INFO] No packets received yet")
@@ -648,33 +809,66 @@ class DataValidator:
         print(f"Total packets: {self.packet_count}")
         print(f"Total errors: {self.error_count}")
         print(f"Elapsed time: {elapsed:.1f}s")
-        print(f"Average rate: {rate:.1f} packets/second")
+        print(f"Average rate: {rate:.1f} packets/second (device: {self.sample_rate} Hz)")
         if rate > 0:
             print(f"Data rate: {(rate * self.expected_packet_size_bytes * 8 / 1000000):.1f} Mbps")
+        if self.frames_requested:
+            print(f"Resent frames: {self.frames_recovered} of {self.frames_requested} requested recovered")
 
 validator = DataValidator()
 
+def udp_listener_native():
+    """udp_listener() on the native receiver: packets arrive in batches and are
+    validated in one call unless a cable test needs them one by one"""
+    receiver = intan_native.Receiver(port=UDP_PORT, drop_invalid=False)
+    print(f"[UDP] Listening on port {UDP_PORT} (native receiver)...")
+    try:
+        while True:
+            data, sizes = receiver.read(timeout=1.0)
+            if not len(sizes):
+                continue
+            if validator.can_validate_batch(sizes):
+                validator.validate_batch(data, len(sizes))
+                continue
+            offset = 0
+            for size in sizes:
+                timestamp = validator.validate_packet(data[offset:offset + size])
+                offset += int(size)
+                if timestamp is not None:
+                    validator.check_continuity(timestamp)
+    except KeyboardInterrupt:
+        print("\n[UDP] Stopping UDP listener")
+    finally:
+        stats = receiver.stats()
+        receiver.close()
+        validator.print_statistics()
+        print(f"Kernel drops: {stats['kernel_drops']}")
+        if stats['fec_parity_packets']:
+            print(f"FEC: {stats['frames_recovered']} frames rebuilt from "
+                  f"{stats['fec_parity_packets']} parity datagrams")
+
 def udp_listener():
+    if intan_native and not os.environ.get("INTAN_NO_NATIVE"):
+        return udp_listener_native()
+
     sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
     sock.bind(("", UDP_PORT))
     sock.settimeout(1.0)
     print(f"[UDP] Listening on port {UDP_PORT}...")
 
-    last_timestamp = None
     try:
         while True:
             try:
                 data, addr = sock.recvfrom(4096)
                 total_len = len(data)
+                if total_len >= 8 and struct.unpack_from('<I', data, 4)[0] == FEC_MAGIC_HIGH:
+                    continue  # Only the native receiver rebuilds lost frames from parity
 
                 for offset in range(0, total_len - validator.expected_packet_size_bytes + 1, validator.expected_packet_size_bytes):
                     chunk = data[offset:offset + validator.expected_packet_size_bytes]
                     timestamp = validator.validate_packet(chunk)
                     if timestamp is not None:
-                        if last_timestamp is not None and timestamp != last_timestamp + 1:
-                            validator.timestamp_errors += 1
-                            validator.error_count += 1
-                        last_timestamp = timestamp
+                        validator.check_continuity(timestamp)
             except socket.timeout:
                 continue
             except KeyboardInterrupt:
@@ -685,85 +879,151 @@ def udp_listener():
         sock.close()
         validator.print_statistics()
 
-def send_binary_command(sock, cmd_id, param1=0, param2=0, timeout=2.0):
-    """Send a binary command and wait for ACK or data response"""
-    try:
-        ack_id = random.randint(1, 65535)
-        command_data = struct.pack('<IIIII', CMD_MAGIC, cmd_id, ack_id, param1, param2)
-        sock.sendall(command_data)
-        
-        sock.settimeout(timeout)
-        
-        # Read initial response (at least 3 bytes for ACK)
-        response = sock.recv(5)
-        
-        if len(response) >= 3:
-            recv_ack_id = (response[0] << 8) | response[1]
-            status = response[2]
-            
-            if recv_ack_id != ack_id:
-                print(f"[TCP] ACK ID mismatch: sent {ack_id}, got {recv_ack_id}")
-                return (False, None)
-            
-            if status != ACK_SUCCESS:
-                print(f"[TCP] Command failed (status: 0x{status:02X})")
-                return (False, None)
-            
-            # Check if there's data (5-byte header)
-            if len(response) == 5:
-                data_len = (response[3] << 8) | response[4]
-                if data_len > 0:
-                    # Read the data
-                    data = sock.recv(data_len)
-                    return (True, data)
-            
-            return (True, None)
-        
-        return (False, None)
+def tcp_stream_listener():
+    """udp_listener() over the device's TCP frame stream: packets arrive back to back,
+    so a recording has no gaps unless the device reports dropped frames"""
+    magic = struct.pack('<II', MAGIC_NUMBER_LOW, MAGIC_NUMBER_HIGH)
+    np = None
+    if intan_native and not os.environ.get("INTAN_NO_NATIVE"):
+        import numpy as np
+    while True:
+        try:
+            sock = socket.create_connection((ZYNQ_IP, STREAM_PORT), timeout=2.0)
+            break
+        except OSError:
+            time.sleep(1.0)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4 * 1024 * 1024)
+    sock.settimeout(1.0)
+    print(f"[TCP-STREAM] Receiving from {ZYNQ_IP}:{STREAM_PORT}...")
 
-    except socket.timeout:
-        print(f"[TCP] Timeout waiting for response")
-        return (False, None)
-    except Exception as e:
-        print(f"[TCP] Error: {e}")
-        return (False, None)
+    buffer = bytearray()
+    try:
+        while True:
+            try:
+                data = sock.recv(256 * 1024)
+            except socket.timeout:
+                continue
+            if not data:
+                print("[TCP-STREAM] Connection closed by the device")
+                break
+            buffer += data
+
+            size = validator.expected_packet_size_bytes
+            # Resynchronise after a packet size change (new channel mask)
+            if len(buffer) >= len(magic) and buffer[:len(magic)] != magic:
+                start = buffer.find(magic)
+                del buffer[:start if start >= 0 else len(buffer) - len(magic) + 1]
+            count = len(buffer) // size
+            if count == 0:
+                continue
+            if np is not None and validator.can_validate_batch(np.full(count, size)):
+                validator.validate_batch(bytes(buffer[:count * size]), count)
+            else:
+                for offset in range(0, count * size, size):
+                    timestamp = validator.validate_packet(bytes(buffer[offset:offset + size]))
+                    if timestamp is not None:
+                        validator.check_continuity(timestamp)
+            del buffer[:count * size]
+    except KeyboardInterrupt:
+        print("\n[TCP-STREAM] Stopping stream listener")
     finally:
-        sock.settimeout(None)
+        sock.close()
+        validator.print_statistics()
 
-def get_status(sock):
+def send_binary_command(client, cmd_id, param1=0, param2=0, timeout=2.0):
+    """Send a binary command and wait for ACK or data response"""
+    return client.command(cmd_id, param1, param2, timeout=timeout)
+
+def send_binary_commands(client, commands, timeout=2.0):
+    """Send (cmd_id[, param1[, param2]]) commands pipelined; True if all succeeded"""
+    return all(success for success, _ in client.pipeline(commands, timeout=timeout))
+
+def send_transaction(client, commands, timeout=2.0):
+    """Apply (cmd_id[, param1[, param2]]) commands atomically; True if all were applied"""
+    success, statuses = client.transaction(commands, timeout=timeout)
+    if statuses and not success:
+        for command, status in zip(commands, statuses):
+            if status == ACK_ERROR:
+                print(f"[TCP] Transaction: command 0x{command[0]:02X} {command[1:]} rejected")
+    return success
+
+def get_status(client):
     """Get full status from device"""
-    success, data = send_binary_command(sock, CMD_GET_STATUS)
+    success, data = send_binary_command(client, CMD_GET_STATUS)
     
     if not success or data is None:
         print("[TCP] Failed to get status")
         return None
     
-    if len(data) != 86:
+    if len(data) < 86:
         print(f"[TCP] Invalid status response length: {len(data)}")
         return None
     
-    # Parse status_response_t structure (86 bytes)
+    # Parse status_response_t structure (232 bytes; older firmware sends the first 86, 98, 106, 114, 130, 138, 160, 172 or 228)
     # Version and identification (8 bytes)
     version, device_type, firmware_version = struct.unpack('<HHI', data[0:8])
     
     # PL Hardware Status (22 bytes)
-    timestamp, packets_sent, bram_write_addr, fifo_count, state_counter, cycle_counter, flags_pl, _ = \
+    timestamp, packets_sent, bram_write_addr, fifo_count, state_counter, cycle_counter, flags_pl, phase_half_steps = \
         struct.unpack('<QIIHBBBB', data[8:30])
     
     # PS Software Status (28 bytes)
-    # Format: 6 uint32_t + 1 uint8_t + 3 reserved bytes
-    packets_received, error_count, udp_packets_sent, udp_send_errors, ps_read_addr, packet_size, flags_ps = \
-        struct.unpack('<IIIIIIB3x', data[30:58])
+    # Format: 6 uint32_t + 2 uint8_t + 2 reserved bytes
+    packets_received, error_count, udp_packets_sent, udp_send_errors, ps_read_addr, packet_size, flags_ps, spi_ports = \
+        struct.unpack('<IIIIIIBB2x', data[30:58])
     
     # Current Configuration (16 bytes)
-    # Format: 1 uint32_t + 4 uint8_t + 8 reserved bytes
-    loop_count, phase0, phase1, channel_enable, debug_mode = \
-        struct.unpack('<IBBBB8x', data[58:74])
+    # Format: 1 uint32_t + 4 uint8_t + 2 uint32_t
+    loop_count, phase0, phase1, channel_enable, debug_mode, sample_rate, channel_enable_all_ports = \
+        struct.unpack('<IBBBBII', data[58:74])
+    
+    # Older firmware reports no port count - treat as a single port
+    global num_spi_ports
+    num_spi_ports = max(spi_ports, 1)
+    if spi_ports:
+        channel_enable = channel_enable_all_ports
     
     # UDP Stream Information (12 bytes)
     udp_dest_ip, udp_dest_port, udp_packet_format, udp_bytes_sent = \
         struct.unpack('<IHHi', data[74:86])
     
+    # TCP Frame Stream (12 bytes)
+    tcp_stream_frames_sent, tcp_stream_frames_dropped, tcp_stream_buffered_bytes = \
+        struct.unpack('<III', data[86:98]) if len(data) >= 98 else (0, 0, 0)
+    
+    # Frame Resend (8 bytes)
+    udp_frames_resent, udp_resend_misses = \
+        struct.unpack('<II', data[98:106]) if len(data) >= 106 else (0, 0)
+    
+    # Forward Error Correction (8 bytes)
+    fec_group_size, fec_parity_sent = \
+        struct.unpack('<II', data[106:114]) if len(data) >= 114 else (0, 0)
+    
+    # Transmit Pacing (16 bytes)
+    pacing_rate_percent, pacing_burst_frames, pacing_delays, pacing_overrides, max_burst_frames = \
+        struct.unpack('<HHIII', data[114:130]) if len(data) >= 130 else (0, 0, 0, 0, 0)
+    
+    # Transmit Flow Control (8 bytes)
+    udp_tx_waits, udp_tx_forced_drops = \
+        struct.unpack('<II', data[130:138]) if len(data) >= 138 else (0, 0)
+    
+    # Main Loop Scheduler (22 bytes)
+    sched_max_pass_us, sched_deadline_misses, sched_budget_overruns = \
+        struct.unpack('<III', data[138:150]) if len(data) >= 160 else (0, 0, 0)
+    sched_task_max_us = list(struct.unpack('<5H', data[150:160])) if len(data) >= 160 else [0] * 5
+    
+    # Telemetry (12 bytes)
+    telemetry_dest_port, telemetry_rate_hz, telemetry_sent = \
+        struct.unpack('<HHI', data[164:172]) if len(data) >= 172 else (0, 0, 0)
+    telemetry_dest_ip = ipaddress.IPv4Address(data[160:164]) if len(data) >= 172 else None
+    
+    # Buffer Headroom (60 bytes)
+    bram_backlog_max, fifo_count_max = \
+        struct.unpack('<IH2x', data[172:180]) if len(data) >= 228 else (0, 0)
+    backlog_histogram = list(struct.unpack(f'<{BACKLOG_HIST_BINS}I', data[180:228])) \
+        if len(data) >= 228 else [0] * BACKLOG_HIST_BINS
+    bram_size_words = struct.unpack('<I', data[228:232])[0] if len(data) >= 232 else BRAM_SIZE_WORDS
+    
     status = {
         'version': version,
         'device_type': device_type,
@@ -786,12 +1046,42 @@ def get_status(sock):
         'loop_count': loop_count,
         'phase0': phase0,
         'phase1': phase1,
+        'fine_phase0': (phase0 << 1) | (phase_half_steps & 0x01),
+        'fine_phase1': (phase1 << 1) | ((phase_half_steps >> 1) & 0x01),
+        'num_spi_ports': num_spi_ports,
         'channel_enable': channel_enable,
         'debug_mode': debug_mode,
+        'sample_rate': sample_rate,
         'udp_dest_ip': ipaddress.IPv4Address(udp_dest_ip),
         'udp_dest_port': udp_dest_port,
         'udp_packet_format': udp_packet_format,
-        'udp_bytes_sent': udp_bytes_sent
+        'udp_bytes_sent': udp_bytes_sent,
+        'tcp_stream_frames_sent': tcp_stream_frames_sent,
+        'tcp_stream_frames_dropped': tcp_stream_frames_dropped,
+        'tcp_stream_buffered_bytes': tcp_stream_buffered_bytes,
+        'udp_frames_resent': udp_frames_resent,
+        'udp_resend_misses': udp_resend_misses,
+        'fec_group_size': fec_group_size,
+        'fec_parity_sent': fec_parity_sent,
+        'pacing_rate_percent': pacing_rate_percent,
+        'pacing_burst_frames': pacing_burst_frames,
+        'pacing_delays': pacing_delays,
+        'pacing_overrides': pacing_overrides,
+        'max_burst_frames': max_burst_frames,
+        'udp_tx_waits': udp_tx_waits,
+        'udp_tx_forced_drops': udp_tx_forced_drops,
+        'sched_max_pass_us': sched_max_pass_us,
+        'sched_deadline_misses': sched_deadline_misses,
+        'sched_budget_overruns': sched_budget_overruns,
+        'sched_task_max_us': dict(zip(SCHED_TASKS, sched_task_max_us)),
+        'telemetry_dest_ip': telemetry_dest_ip,
+        'telemetry_dest_port': telemetry_dest_port,
+        'telemetry_rate_hz': telemetry_rate_hz,
+        'telemetry_sent': telemetry_sent,
+        'bram_backlog_max': bram_backlog_max,
+        'fifo_count_max': fifo_count_max,
+        'backlog_histogram': backlog_histogram,
+        'bram_size_words': bram_size_words
     }
     
     return status
@@ -829,21 +1119,145 @@ def print_status(status):
     
     print("\n--- Configuration ---")
     print(f"Loop Count: {status['loop_count']}")
-    print(f"Phase0: {status['phase0']}, Phase1: {status['phase1']}")
+    print(f"Phase0: {status['phase0']}, Phase1: {status['phase1']} "
+          f"(fine: {status['fine_phase0']}, {status['fine_phase1']})")
+    print(f"SPI Ports: {status['num_spi_ports']}")
     print(f"Channel Enable: 0x{status['channel_enable']:X} ({channel_enable_to_string(status['channel_enable'])})")
     print(f"Debug Mode: {status['debug_mode']}")
+    print(f"Sample Rate: {status['sample_rate']} Hz")
     
     print("\n--- UDP Stream ---")
     print(f"Destination: {status['udp_dest_ip']}:{status['udp_dest_port']}")
     print(f"Packet Format: 0x{status['udp_packet_format']:04X}")
     print(f"Bytes Sent: {status['udp_bytes_sent']}")
+    print(f"Frames Resent: {status['udp_frames_resent']} ({status['udp_resend_misses']} no longer available)")
+    if status['fec_group_size']:
+        print(f"FEC: 1 parity per {status['fec_group_size']} frames ({status['fec_parity_sent']} sent)")
+    else:
+        print("FEC: off")
+    if status['pacing_rate_percent']:
+        print(f"Pacing: {status['pacing_rate_percent']}% of the sample rate, bursts of "
+              f"{status['pacing_burst_frames']} ({status['pacing_delays']} delays, "
+              f"{status['pacing_overrides']} overrides)")
+    else:
+        print("Pacing: off")
+    print(f"Largest Burst: {status['max_burst_frames']} frames")
+    print(f"TX Waits: {status['udp_tx_waits']} ({status['udp_tx_forced_drops']} frames dropped to keep up)")
+    
+    print("\n--- Main Loop ---")
+    print(f"Longest Pass: {status['sched_max_pass_us']} us")
+    print(f"Deadline Misses: {status['sched_deadline_misses']}, "
+          f"Budget Overruns: {status['sched_budget_overruns']}")
+    print("Longest Turn: " + ", ".join(f"{task} {us} us" for task, us in status['sched_task_max_us'].items()))
+    if status['telemetry_rate_hz']:
+        print(f"Telemetry: {status['telemetry_rate_hz']} Hz to {status['telemetry_dest_ip']}:"
+              f"{status['telemetry_dest_port']} ({status['telemetry_sent']} sent)")
+    else:
+        print("Telemetry: off")
+    
+    print("\n--- Buffer Headroom ---")
+    print(f"BRAM Backlog Max: {status['bram_backlog_max']} of {status['bram_size_words']} words "
+          f"({100.0 * status['bram_backlog_max'] / status['bram_size_words']:.1f}%)")
+    print(f"FIFO Count Max: {status['fifo_count_max']}")
+    turns = sum(status['backlog_histogram'])
+    if turns:
+        print("Drain Backlog (words: turns):")
+        for n, count in enumerate(status['backlog_histogram']):
+            if count:
+                low = 0 if n == 0 else BACKLOG_HIST_MIN_WORDS << (n - 1)
+                high = f"{(BACKLOG_HIST_MIN_WORDS << n) - 1}" if n < BACKLOG_HIST_BINS - 1 else ""
+                print(f"  {low:>6}-{high:<6} {count:10d} ({100.0 * count / turns:.2f}%)")
+    
+    print("\n--- TCP Frame Stream ---")
+    print(f"Frames Sent: {status['tcp_stream_frames_sent']}")
+    print(f"Frames Dropped: {status['tcp_stream_frames_dropped']}")
+    print(f"Buffered Bytes: {status['tcp_stream_buffered_bytes']}")
     print("=" * 50)
 
-def set_udp_dest(sock, ip_str, port):
+def parse_telemetry(data):
+    """Decode a telemetry_datagram_t (104 bytes), None if it is not one"""
+    if len(data) < 104 or struct.unpack_from('<II', data, 0) != (MAGIC_NUMBER_LOW, TELEMETRY_MAGIC_HIGH):
+        return None
+    sequence, interval_us, timestamp, flags_pl, flags_ps = struct.unpack_from('<IIQBB2x', data, 8)
+    totals = struct.unpack_from('<IIII', data, 28)
+    rx_rate, tx_rate = struct.unpack_from('<II', data, 44)
+    max_backlog_words, max_fifo_count, max_pass_us = struct.unpack_from('<IH2xI', data, 52)
+    task_max_us = struct.unpack_from('<5H', data, 64)
+    errors = struct.unpack_from('<7I', data, 76)
+    return {
+        'sequence': sequence,
+        'interval_us': interval_us,
+        'timestamp': timestamp,
+        'transmission_active': bool(flags_pl & 0x01),
+        'stream_enabled': bool(flags_ps & 0x01),
+        **dict(zip(('packets_received', 'udp_packets_sent', 'udp_bytes_sent', 'udp_frames_resent'), totals)),
+        'rx_frames_per_s': rx_rate,
+        'tx_frames_per_s': tx_rate,
+        'max_backlog_words': max_backlog_words,
+        'max_fifo_count': max_fifo_count,
+        'max_pass_us': max_pass_us,
+        'task_max_us': dict(zip(SCHED_TASKS, task_max_us)),
+        **dict(zip(('errors', 'udp_send_errors', 'udp_tx_forced_drops', 'udp_resend_misses',
+                    'tcp_stream_frames_dropped', 'deadline_misses', 'budget_overruns'), errors)),
+    }
+
+class TelemetryMonitor:
+    """Receives telemetry datagrams in the background, keeping the newest one and
+    the datagrams lost on the way (gaps in the sequence)"""
+    def __init__(self, port=TELEMETRY_PORT):
+        self.port = port
+        self.latest = None
+        self.received = 0
+        self.lost = 0
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.bind(("", port))
+        self.sock.settimeout(1.0)
+        threading.Thread(target=self._run, daemon=True).start()
+    
+    def _run(self):
+        while True:
+            try:
+                data, _ = self.sock.recvfrom(2048)
+            except socket.timeout:
+                continue
+            except OSError:
+                return
+            telemetry = parse_telemetry(data)
+            if telemetry is None:
+                continue
+            if self.latest and telemetry['sequence'] > self.latest['sequence'] + 1:
+                self.lost += telemetry['sequence'] - self.latest['sequence'] - 1
+            self.latest = telemetry
+            self.received += 1
+
+def print_telemetry(monitor):
+    t = monitor.latest if monitor else None
+    if not t:
+        print("[TELEMETRY] Nothing received yet")
+        return
+    print(f"[TELEMETRY] #{t['sequence']} ({monitor.received} received, {monitor.lost} lost), "
+          f"timestamp {t['timestamp']}, interval {t['interval_us'] / 1000:.1f} ms")
+    print(f"  Frames: {t['packets_received']} read, {t['udp_packets_sent']} sent, "
+          f"{t['rx_frames_per_s']}/s in, {t['tx_frames_per_s']}/s out")
+    print(f"  Peaks: backlog {t['max_backlog_words']} words, FIFO {t['max_fifo_count']}, "
+          f"pass {t['max_pass_us']} us (" + ", ".join(f"{task} {us}" for task, us in t['task_max_us'].items()) + ")")
+    print(f"  Errors: {t['errors']} frame, {t['udp_send_errors']} send, {t['udp_tx_forced_drops']} forced drops, "
+          f"{t['udp_resend_misses']} resend misses, {t['tcp_stream_frames_dropped']} stream drops, "
+          f"{t['deadline_misses']} deadline misses, {t['budget_overruns']} overruns")
+
+def set_telemetry(client, rate_hz, port=TELEMETRY_PORT):
+    """Have telemetry pushed to this machine (rate 0 = off)"""
+    ip_int = int(ipaddress.IPv4Address(get_local_ip()))
+    success, _ = send_binary_command(client, CMD_SET_TELEMETRY, ip_int, port | (rate_hz << 16))
+    if success:
+        print(f"[TCP] Telemetry {'off' if rate_hz == 0 else f'at {rate_hz} Hz to port {port}'}")
+    return success
+
+def set_udp_dest(client, ip_str, port):
     """Configure UDP destination"""
     try:
         ip_int = int(ipaddress.IPv4Address(ip_str))
-        success, _ = send_binary_command(sock, CMD_SET_UDP_DEST, ip_int, port)
+        success, _ = send_binary_command(client, CMD_SET_UDP_DEST, ip_int, port)
         if success:
             print(f"[TCP] UDP destination set to {ip_str}:{port}")
             return True
@@ -854,34 +1268,122 @@ def set_udp_dest(sock, ip_str, port):
         print(f"[TCP] Error setting UDP destination: {e}")
         return False
 
-def manual_cable_test(sock):
-    """Manual cable test using existing UDP infrastructure"""
+def read_bram(client, start_addr=0, word_count=None, snapshot=False, path=None, words_per_line=8):
+    """Read BRAM in binary over TCP (by default all of it); print a summary and the first
+    words, or save the raw little-endian words to `path`"""
+    start = time.time()
+    success, bram = client.read_bram(start_addr, word_count, snapshot, timeout=5.0)
+    if not success or bram is None:
+        print("[TCP] BRAM read failed")
+        return None
+    elapsed = time.time() - start
+
+    words = struct.unpack(f'<{bram.word_count}I', bram.words)
+    headers = sum(1 for i in range(len(words) - 1)
+                  if words[i] == 0xDEADBEEF and words[i + 1] == 0xCAFEBABE)
+    print(f"[TCP] Read {bram.word_count} words at {bram.start_addr} in {elapsed * 1000:.1f} ms"
+          f"{' (snapshot)' if snapshot else ''}, timestamp {bram.timestamp}")
+    print(f"[TCP] PL write address {bram.write_addr_before}"
+          f"{f' -> {bram.write_addr_after}' if bram.write_addr_after != bram.write_addr_before else ''}"
+          f", {headers} packet headers in range")
+    if path:
+        with open(path, 'wb') as f:
+            f.write(bram.words)
+        print(f"[TCP] Saved to {path}")
+    else:
+        for i in range(0, min(len(words), 64), words_per_line):
+            hex_words = ' '.join(f'{w:08X}' for w in words[i:i + words_per_line])
+            print(f"{(bram.start_addr + i) % client.bram_size_words():6d}: {hex_words}")
+    return bram
+
+def trigger_capture(client, pre_ms, post_ms, sample_rate, path=None):
+    """Capture pre_ms before to post_ms after now from the device's frame history and
+    check that the frames are contiguous; save the raw little-endian words to `path`"""
+    pre_frames = int(pre_ms * sample_rate / 1000)
+    post_frames = int(post_ms * sample_rate / 1000)
+    start = time.time()
+    success, capture = client.trigger_capture(pre_frames, post_frames)
+    if not success or capture is None:
+        print("[TCP] Capture failed (not streaming, window too long, or a capture is already armed)")
+        return None
+    elapsed = time.time() - start
+
+    words = capture.packet_words
+    timestamps = [struct.unpack_from('<Q', capture.words, (i * words + 2) * 4)[0]
+                  for i in range(capture.frame_count)]
+    gaps = sum(1 for a, b in zip(timestamps, timestamps[1:]) if b != a + 1)
+    print(f"[TCP] Captured {capture.frame_count} frames ({capture.pre_frames} before the trigger) "
+          f"in {elapsed:.2f} s: timestamps {capture.first_timestamp}..{timestamps[-1] if timestamps else '-'}, "
+          f"trigger {capture.trigger_timestamp}, {gaps} gaps")
+    if path:
+        with open(path, 'wb') as f:
+            f.write(capture.words)
+        print(f"[TCP] Saved to {path} ({words} words per frame)")
+    return capture
+
+def run_benchmark(client, path=None):
+    """Run the device benchmark (stream stopped) and print ns per operation; save the
+    per-frame-size figures to `path` as CSV"""
+    print("[TCP] Running benchmark...")
+    success, bench = client.run_benchmark()
+    if not success or bench is None:
+        print("[TCP] Benchmark failed (stop the stream first)")
+        return None
+
+    def ns(ticks, count):
+        return ticks * 1e9 / bench.timer_hz / count
+
+    methods = [BRAM_COPY_METHODS[m] if m < len(BRAM_COPY_METHODS) else f"method{m}"
+               for m in range(len(bench.copy_ticks[0]))]
+    print("  BRAM copy, ns per frame:")
+    print("  words " + ''.join(f"{name:>14}" for name in methods))
+    for words, ticks in zip(bench.frame_words, bench.copy_ticks):
+        print(f"  {words:5d} " + ''.join(f"{ns(t, bench.copy_repeats):14.0f}" for t in ticks))
+    print("  Send path, ns per frame:")
+    print("  words          pbuf    udp_sendto")
+    for words, pbuf, send in zip(bench.frame_words, bench.pbuf_ticks, bench.send_ticks):
+        print(f"  {words:5d} {ns(pbuf, bench.net_repeats):13.0f} {ns(send, bench.net_repeats):13.0f}")
+    print(f"  Send failures: {bench.send_failures}")
+    print(f"  Register read: {ns(bench.reg_read_ticks, bench.reg_repeats):.0f} ns, "
+          f"BRAM word read: {ns(bench.bram_read_ticks, bench.reg_repeats):.0f} ns")
+    print(f"  Copy method now in use: {methods[bench.selected_method]}")
+
+    if path:
+        with open(path, 'w') as f:
+            f.write("frame_words," + ','.join(f"{name}_ns" for name in methods) + ",pbuf_ns,udp_sendto_ns\n")
+            for words, ticks, pbuf, send in zip(bench.frame_words, bench.copy_ticks,
+                                                bench.pbuf_ticks, bench.send_ticks):
+                row = [ns(t, bench.copy_repeats) for t in ticks]
+                row += [ns(pbuf, bench.net_repeats), ns(send, bench.net_repeats)]
+                f.write(f"{words}," + ','.join(f"{v:.1f}" for v in row) + "\n")
+        print(f"[TCP] Saved to {path}")
+    return bench
+
+def manual_cable_test(client):
+    """Manual cable test using existing UDP infrastructure. START returns once the
+    device has begun the frame (completion notification), so no guard sleeps."""
     print("Manual cable test starting...")
 
-    if not send_binary_command(sock, CMD_SET_CHANNEL_ENABLE, CABLE_TEST_CHANNEL_ENABLE)[0]:
+    if not send_binary_command(client, CMD_SET_CHANNEL_ENABLE, CABLE_TEST_CHANNEL_ENABLE)[0]:
         print("Failed to set channel enable")
         return
-    time.sleep(0.1)
     
     validator.start_manual_cable_test()
     collected_packets = []
     
     try:
-        if not send_binary_command(sock, CMD_SET_LOOP_COUNT, 1)[0]:
+        if not send_binary_command(client, CMD_SET_LOOP_COUNT, 1)[0]:
             print("Failed to set loop count")
             return
-        time.sleep(0.1)
         
         print("Running initialization...")
-        if not send_binary_command(sock, CMD_LOAD_INIT)[0]:
+        if not send_binary_command(client, CMD_LOAD_INIT)[0]:
             return
-        time.sleep(0.1)
         
-        if not send_binary_command(sock, CMD_START)[0]:
+        if not send_binary_command(client, CMD_START)[0]:
             return
-        time.sleep(0.1)
         
-        if not send_binary_command(sock, CMD_STOP)[0]:
+        if not send_binary_command(client, CMD_STOP)[0]:
             return
         
         init_words = validator.wait_for_manual_packet(timeout=5.0)
@@ -891,22 +1393,19 @@ def manual_cable_test(sock):
         collected_packets.append(init_words)
         print("Collected init packet")
         
-        if not send_binary_command(sock, CMD_LOAD_CABLE_TEST)[0]:
+        if not send_binary_command(client, CMD_LOAD_CABLE_TEST)[0]:
             return
-        time.sleep(0.1)
         
-        for phase in range(16):
-            print(f"Testing phase {phase}...")
+        for phase in range(NUM_FINE_PHASES):
+            print(f"Testing fine phase {phase}...")
             
-            if not send_binary_command(sock, CMD_SET_PHASE, phase, phase)[0]:
+            if not send_binary_command(client, CMD_SET_FINE_PHASE, phase, phase)[0]:
                 continue
-            time.sleep(0.1)
             
-            if not send_binary_command(sock, CMD_START)[0]:
+            if not send_binary_command(client, CMD_START)[0]:
                 continue
-            time.sleep(0.1)
             
-            if not send_binary_command(sock, CMD_STOP)[0]:
+            if not send_binary_command(client, CMD_STOP)[0]:
                 continue
             
             words = validator.wait_for_manual_packet(timeout=5.0)
@@ -934,13 +1433,16 @@ def manual_cable_test(sock):
 # AUTOMATED CABLE DETECTION FUNCTION
 # ============================================================================
 
-def run_detection(sock, verbose=True):
+def run_detection(client, verbose=True):
 
     # Create cable detector using our send_binary_command function
     def command_wrapper(cmd_id, param1=0, param2=0):
-        return send_binary_command(sock, cmd_id, param1, param2)
+        return send_binary_command(client, cmd_id, param1, param2)
 
-    detector = CableDetection(command_wrapper)
+    def batch_wrapper(commands):
+        return send_transaction(client, commands)
+
+    detector = CableDetection(command_wrapper, batch_wrapper)
     
     # Hook into UDP validator
     validator.set_cable_detector(detector)
@@ -955,7 +1457,7 @@ def run_detection(sock, verbose=True):
         
         if result.success:
             print("\nPhase Analysis:")
-            print("Phase  CIPO0  CIPO1  DDR0  DDR1")
+            print("Fine   CIPO0  CIPO1  DDR0  DDR1")
             print("-----  -----  -----  ----  ----")
             for pr in result.all_phases:
                 marker = "*" if pr.phase == result.best_phase else " "
@@ -975,9 +1477,12 @@ def run_detection(sock, verbose=True):
 
 
 def tcp_control():
-    sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
     try:
-        sock.connect((ZYNQ_IP, TCP_PORT))
+        client = CommandClient(ZYNQ_IP, TCP_PORT)
+    except OSError:
+        print(f"[TCP] Could not connect to {ZYNQ_IP}:{TCP_PORT}")
+        return
+    try:
         print(f"[TCP] Connected to {ZYNQ_IP}:{TCP_PORT}")
         
         # Auto-configure UDP destination
@@ -985,95 +1490,140 @@ def tcp_control():
         print(f"[TCP] Detected local IP: {local_ip}")
         print(f"[TCP] Configuring device to send UDP to this machine...")
         
-        if set_udp_dest(sock, local_ip, UDP_PORT):
+        if set_udp_dest(client, local_ip, UDP_PORT):
             print(f"[TCP] Device configured to send UDP packets here")
         else:
             print(f"[TCP] Failed to configure UDP destination")
             print(f"[TCP] Device may still be sending to default: 192.168.18.100:{UDP_PORT}")
         
+        if TCP_STREAM and send_binary_command(client, CMD_SET_UDP_STREAM, 0)[0]:
+            print(f"[TCP] Recording over the TCP frame stream, UDP datagrams off")
+        elif UDP_RESEND:
+            validator.request_resend = client.resend_frames
+            print(f"[TCP] Lost datagrams will be requested again (INTAN_NO_RESEND=1 to disable)")
+        
         # Get and display initial status
         print("\n[TCP] Getting initial device status...")
-        status = get_status(sock)
+        status = get_status(client)
         if status:
             print_status(status)
             validator.set_channel_enable(status['channel_enable'])
+            validator.set_sample_rate(status['sample_rate'])
         
         print(f"\n[TCP] Available commands:")
         print(f"  Basic: start, stop, reset_timestamp, loop <count>")
         print(f"  COPI: convert, init, cable_test, full_cable_test, manual_cable_test")
-        print(f"  Config: set_phase <p0> <p1>, set_debug <0|1>, set_channels <0x0-0xF>")
-        print(f"  Network: set_udp <ip> <port>, get_status")
-        print(f"  Debug: dump_bram [start] [count], stats, hex")
+        print(f"  Config: set_phase <p0> <p1>, set_fine_phase <p0> <p1>, set_port_phase <port> <p0> <p1>, set_debug <0|1>, set_channels <mask>, set_rate <hz>")
+        print(f"  Network: set_udp <ip> <port>, udp_stream <0|1>, fec <K>, pacing <pct> [burst], get_status")
+        print(f"  Monitor: telemetry <hz> [port], telemetry")
+        print(f"  Capture: trigger <pre_ms> <post_ms> [file]")
+        print(f"  Debug: dump_bram [start] [count], read_bram [start] [count] [snapshot], save_bram <file>, benchmark [file], stats, hex")
         print(f"  auto_cable_detect - Automated cable detection!")
         print(f"  Utility: help, quit")
         
+        telemetry_monitor = None
         while True:
-            cmd = input("\n[TCP] Command: ").strip().lower()
+            line = input("\n[TCP] Command: ").strip()
+            cmd = line.lower()
             
             if cmd == "quit":
                 break
             elif cmd == "auto_cable_detect":
-                run_detection(sock, verbose=True)
+                run_detection(client, verbose=True)
             elif cmd == "start":
-                send_binary_command(sock, CMD_START)
+                success, completion = send_binary_command(client, CMD_START)
+                if success and completion:
+                    if completion.status == ACK_SUCCESS:
+                        print(f"[TCP] Streaming from timestamp {completion.timestamp}")
+                    else:
+                        print("[TCP] Streaming was already enabled")
             elif cmd == "stop":
-                send_binary_command(sock, CMD_STOP)
+                send_binary_command(client, CMD_STOP)
             elif cmd == "reset_timestamp":
-                send_binary_command(sock, CMD_RESET_TIMESTAMP)
+                send_binary_command(client, CMD_RESET_TIMESTAMP)
                 validator.last_timestamp = None
             elif cmd == "convert":
-                send_binary_command(sock, CMD_LOAD_CONVERT)
+                send_binary_command(client, CMD_LOAD_CONVERT)
             elif cmd == "init":
-                send_binary_command(sock, CMD_LOAD_INIT)
+                send_binary_command(client, CMD_LOAD_INIT)
             elif cmd == "cable_test":
-                send_binary_command(sock, CMD_LOAD_CABLE_TEST)
+                send_binary_command(client, CMD_LOAD_CABLE_TEST)
             elif cmd == "full_cable_test":
-                if send_binary_command(sock, CMD_SET_CHANNEL_ENABLE, CABLE_TEST_CHANNEL_ENABLE)[0]:
+                if send_binary_command(client, CMD_SET_CHANNEL_ENABLE, CABLE_TEST_CHANNEL_ENABLE)[0]:
                     validator.start_cable_test_capture()
-                    send_binary_command(sock, CMD_FULL_CABLE_TEST)
+                    send_binary_command(client, CMD_FULL_CABLE_TEST)
             elif cmd == "manual_cable_test":
-                manual_cable_test(sock)
+                manual_cable_test(client)
             elif cmd == "get_status":
-                status = get_status(sock)
+                status = get_status(client)
                 if status:
                     print_status(status)
             elif cmd.startswith("loop "):
                 try:
                     loop_count = int(cmd.split()[1])
-                    send_binary_command(sock, CMD_SET_LOOP_COUNT, loop_count)
+                    send_binary_command(client, CMD_SET_LOOP_COUNT, loop_count)
                 except (ValueError, IndexError):
                     print("Usage: loop <count>")
             elif cmd.startswith("set_phase "):
                 try:
                     parts = cmd.split()
                     if len(parts) == 3:
-                        send_binary_command(sock, CMD_SET_PHASE, int(parts[1]), int(parts[2]))
+                        send_binary_command(client, CMD_SET_PHASE, int(parts[1]), int(parts[2]))
                     else:
                         print("Usage: set_phase <phase0> <phase1>")
                 except ValueError:
                     print("Invalid phase values")
+            elif cmd.startswith("set_fine_phase "):
+                try:
+                    parts = cmd.split()
+                    if len(parts) == 3:
+                        send_binary_command(client, CMD_SET_FINE_PHASE, int(parts[1]), int(parts[2]))
+                    else:
+                        print(f"Usage: set_fine_phase <phase0> <phase1> (0-{NUM_FINE_PHASES - 1})")
+                except ValueError:
+                    print("Invalid phase values")
+            elif cmd.startswith("set_port_phase "):
+                try:
+                    parts = cmd.split()
+                    if len(parts) == 4:
+                        port, p0, p1 = int(parts[1]), int(parts[2]), int(parts[3])
+                        send_binary_command(client, CMD_SET_PORT_FINE_PHASE, port, p0 | (p1 << 8))
+                    else:
+                        print(f"Usage: set_port_phase <port> <phase0> <phase1> (fine phases 0-{NUM_FINE_PHASES - 1})")
+                except ValueError:
+                    print("Invalid port/phase values")
             elif cmd.startswith("set_debug "):
                 try:
                     debug_mode = int(cmd.split()[1])
-                    send_binary_command(sock, CMD_SET_DEBUG_MODE, debug_mode)
+                    send_binary_command(client, CMD_SET_DEBUG_MODE, debug_mode)
                 except (ValueError, IndexError):
                     print("Usage: set_debug <0|1>")
             elif cmd.startswith("set_channels "):
                 try:
                     val = cmd.split()[1]
                     channel_enable = int(val, 16) if val.startswith('0x') else int(val)
-                    if 0 <= channel_enable <= 15:
-                        if send_binary_command(sock, CMD_SET_CHANNEL_ENABLE, channel_enable)[0]:
+                    if 0 <= channel_enable <= channel_enable_all():
+                        if send_binary_command(client, CMD_SET_CHANNEL_ENABLE, channel_enable)[0]:
                             validator.set_channel_enable(channel_enable)
                     else:
-                        print("Channel enable must be 0-15")
+                        print(f"Channel enable must be 0-0x{channel_enable_all():X} (4 bits per port)")
+                except (ValueError, IndexError):
+                    print(f"Usage: set_channels <0x0-0x{channel_enable_all():X}>")
+            elif cmd.startswith("set_rate "):
+                try:
+                    sample_rate = int(cmd.split()[1])
+                    if sample_rate in SUPPORTED_SAMPLE_RATES:
+                        if send_binary_command(client, CMD_SET_SAMPLE_RATE, sample_rate)[0]:
+                            validator.set_sample_rate(sample_rate)
+                    else:
+                        print(f"Sample rate must be one of {SUPPORTED_SAMPLE_RATES}")
                 except (ValueError, IndexError):
-                    print("Usage: set_channels <0x0-0xF>")
+                    print("Usage: set_rate <hz>")
             elif cmd.startswith("set_udp "):
                 try:
                     parts = cmd.split()
                     if len(parts) == 3:
-                        set_udp_dest(sock, parts[1], int(parts[2]))
+                        set_udp_dest(client, parts[1], int(parts[2]))
                     else:
                         print("Usage: set_udp <ip> <port>")
                 except (ValueError, IndexError):
@@ -1083,9 +1633,63 @@ def tcp_control():
                     parts = cmd.split()
                     start_addr = int(parts[1]) if len(parts) > 1 else 0
                     word_count = int(parts[2]) if len(parts) > 2 else 10
-                    send_binary_command(sock, CMD_DUMP_BRAM, start_addr, word_count)
+                    send_binary_command(client, CMD_DUMP_BRAM, start_addr, word_count)
                 except (ValueError, IndexError):
-                    send_binary_command(sock, CMD_DUMP_BRAM, 0, 10)
+                    send_binary_command(client, CMD_DUMP_BRAM, 0, 10)
+            elif cmd.startswith("read_bram"):
+                try:
+                    parts = cmd.split()
+                    start_addr = int(parts[1]) if len(parts) > 1 else 0
+                    word_count = int(parts[2]) if len(parts) > 2 else None
+                    read_bram(client, start_addr, word_count, snapshot="snapshot" in parts[3:])
+                except ValueError:
+                    print("Usage: read_bram [start] [count] [snapshot]")
+            elif cmd.startswith("save_bram "):
+                read_bram(client, 0, None, snapshot=True, path=line.split(maxsplit=1)[1])
+            elif cmd.startswith("udp_stream "):
+                try:
+                    send_binary_command(client, CMD_SET_UDP_STREAM, int(cmd.split()[1]))
+                except (ValueError, IndexError):
+                    print("Usage: udp_stream <0|1>")
+            elif cmd.startswith("fec "):
+                try:
+                    send_binary_command(client, CMD_SET_FEC, int(cmd.split()[1]))
+                except (ValueError, IndexError):
+                    print("Usage: fec <frames per parity, 0 = off>")
+            elif cmd.startswith("pacing "):
+                try:
+                    parts = cmd.split()
+                    send_binary_command(client, CMD_SET_PACING, int(parts[1]),
+                                        int(parts[2]) if len(parts) > 2 else 0)
+                except (ValueError, IndexError):
+                    print("Usage: pacing <percent of sample rate, 0 = off> [burst frames]")
+            elif cmd == "telemetry":
+                print_telemetry(telemetry_monitor)
+            elif cmd.startswith("telemetry "):
+                try:
+                    parts = cmd.split()
+                    rate_hz = int(parts[1])
+                    port = int(parts[2]) if len(parts) > 2 else TELEMETRY_PORT
+                    if not 0 <= rate_hz <= TELEMETRY_MAX_RATE_HZ:
+                        print(f"Telemetry rate must be 0-{TELEMETRY_MAX_RATE_HZ} Hz")
+                        continue
+                    if rate_hz and (telemetry_monitor is None or telemetry_monitor.port != port):
+                        telemetry_monitor = TelemetryMonitor(port)
+                    set_telemetry(client, rate_hz, port)
+                except (ValueError, IndexError):
+                    print("Usage: telemetry <hz, 0 = off> [port], or telemetry to show the latest")
+                except OSError as e:
+                    print(f"[TELEMETRY] Cannot listen on port {port}: {e}")
+            elif cmd.startswith("trigger "):
+                try:
+                    parts = line.split()
+                    trigger_capture(client, float(parts[1]), float(parts[2]), validator.sample_rate,
+                                    path=parts[3] if len(parts) > 3 else None)
+                except (ValueError, IndexError):
+                    print("Usage: trigger <pre_ms> <post_ms> [file]")
+            elif cmd == "benchmark" or cmd.startswith("benchmark "):
+                parts = line.split()
+                run_benchmark(client, path=parts[1] if len(parts) > 1 else None)
             elif cmd == "stats":
                 validator.print_statistics()             
             elif cmd == "hex":
@@ -1093,31 +1697,33 @@ def tcp_control():
             elif cmd == "help":
                 print("Commands:")
                 print("  start, stop, reset_timestamp")
-                print("  loop <count>, set_phase <p0> <p1>")
-                print("  set_debug <0|1>, set_channels <0x0-0xF>")
+                print("  loop <count>, set_phase <p0> <p1>, set_fine_phase <p0> <p1>")
+                print("  set_port_phase <port> <p0> <p1>, set_debug <0|1>, set_channels <mask>, set_rate <hz>")
                 print("  convert, init, cable_test")
                 print("  full_cable_test, manual_cable_test")
                 print("  auto_cable_detect - NEW: Automated detection!")
-                print("  set_udp <ip> <port>, get_status")
+                print("  set_udp <ip> <port>, udp_stream <0|1>, fec <K>, pacing <pct> [burst], get_status")
+                print("  telemetry <hz> [port], telemetry")
+                print("  trigger <pre_ms> <post_ms> [file]")
                 print("  dump_bram [start] [count]")
+                print("  read_bram [start] [count] [snapshot], save_bram <file>")
+                print("  benchmark [file]")
                 print("  stats, hex, quit")
             else:
                 print(f"Unknown command: '{cmd}'. Type 'help' for list.")
                 
-    except ConnectionRefusedError:
-        print(f"[TCP] Could not connect to {ZYNQ_IP}:{TCP_PORT}")
     except KeyboardInterrupt:
         print("\n[TCP] Closing connection")
     finally:
-        sock.close()
+        client.close()
 
 if __name__ == "__main__":
     print("=== Zynq BRAM Data Generator Validator ===")
     print(f"Device: {ZYNQ_IP}:{TCP_PORT}")
-    print(f"UDP Port: {UDP_PORT}")
+    print(f"UDP Port: {UDP_PORT}" + (f" (recording from TCP port {STREAM_PORT})" if TCP_STREAM else ""))
     print("Press Ctrl+C to stop.\n")
     
-    udp_thread = threading.Thread(target=udp_listener, daemon=True)
+    udp_thread = threading.Thread(target=tcp_stream_listener if TCP_STREAM else udp_listener, daemon=True)
     udp_thread.start()
     
     tcp_control()
@@ -0,0 +1,125 @@
+"""
+Reader for recordings written by remote/native/intan_record (format in
+remote/native/recording.h). The file is memory-mapped; channel() and timestamps()
+return numpy views or concatenations of the mapped blocks, so slicing a multi-hour
+recording only touches the blocks that are asked for.
+
+    rec = Recording("session.irec")
+    start = rec.seek(timestamp)                   # frame number, O(log n)
+    samples = rec.channel(stream=0, cycle=10, start=start, count=30000)
+"""
+
+import numpy as np
+
+RECORDING_MAGIC = b"INTANREC"
+RECORDING_VERSION = 1
+BLOCK_MAGIC = 0x4B4C4249
+
+HEADER_DTYPE = np.dtype([
+    ("magic", "S8"), ("version", "<u4"), ("header_bytes", "<u4"), ("block_bytes", "<u4"),
+    ("frames_per_block", "<u4"), ("num_streams", "<u4"), ("cycles_per_frame", "<u4"),
+    ("channel_enable", "<u4"), ("num_spi_ports", "<u4"), ("sample_rate", "<u4"),
+    ("firmware_version", "<u4"), ("device_type", "<u2"), ("protocol_version", "<u2"),
+    ("reserved0", "<u4"), ("start_time_ns", "<i8"), ("first_timestamp", "<u8"),
+    ("last_timestamp", "<u8"), ("index_offset", "<u8"), ("block_count", "<u8"),
+    ("frame_count", "<u8"), ("gap_count", "<u8"),
+])
+
+BLOCK_HEADER_DTYPE = np.dtype([
+    ("magic", "<u4"), ("frame_count", "<u4"), ("first_timestamp", "<u8"),
+    ("last_timestamp", "<u8"), ("first_rx_time_ns", "<i8"), ("gap_count", "<u4"),
+    ("reserved", "<u4", (7,)),
+])
+
+INDEX_DTYPE = np.dtype([("first_timestamp", "<u8"), ("last_timestamp", "<u8")])
+
+
+class Recording:
+    def __init__(self, path):
+        self._map = np.memmap(path, dtype=np.uint8, mode="r")
+        self.header = self._map[:HEADER_DTYPE.itemsize].view(HEADER_DTYPE)[0]
+        if bytes(self.header["magic"]) != RECORDING_MAGIC or self.header["version"] != RECORDING_VERSION:
+            raise ValueError(f"{path}: not a recording")
+
+        self.num_streams = int(self.header["num_streams"])
+        self.cycles_per_frame = int(self.header["cycles_per_frame"])
+        self.frames_per_block = int(self.header["frames_per_block"])
+        self.sample_rate = int(self.header["sample_rate"])
+        self.channel_enable = int(self.header["channel_enable"])
+        self._block_bytes = int(self.header["block_bytes"])
+        self._first_block = int(self.header["header_bytes"])
+        self._samples_offset = BLOCK_HEADER_DTYPE.itemsize + 8 * self.frames_per_block
+
+        index_offset = int(self.header["index_offset"])
+        block_count = int(self.header["block_count"])
+        if index_offset and index_offset + block_count * INDEX_DTYPE.itemsize <= len(self._map):
+            self._index = self._map[index_offset:index_offset + block_count * INDEX_DTYPE.itemsize].view(INDEX_DTYPE)
+        else:
+            self._index = self._scan_blocks()
+
+        # Frame number of the first frame of every block (blocks may be partial)
+        counts = np.array([self._block_header(b)["frame_count"] for b in range(len(self._index))], dtype=np.int64)
+        self._block_start = np.concatenate(([0], np.cumsum(counts)))
+        self.frame_count = int(self._block_start[-1])
+
+    def _scan_blocks(self):
+        """Rebuild the index of a recording that was not closed"""
+        entries = []
+        offset = self._first_block
+        while offset + self._block_bytes <= len(self._map):
+            header = self._map[offset:offset + BLOCK_HEADER_DTYPE.itemsize].view(BLOCK_HEADER_DTYPE)[0]
+            if header["magic"] != BLOCK_MAGIC or header["frame_count"] == 0:
+                break
+            entries.append((header["first_timestamp"], header["last_timestamp"]))
+            offset += self._block_bytes
+        return np.array(entries, dtype=INDEX_DTYPE)
+
+    def _block_offset(self, block):
+        return self._first_block + block * self._block_bytes
+
+    def _block_header(self, block):
+        offset = self._block_offset(block)
+        return self._map[offset:offset + BLOCK_HEADER_DTYPE.itemsize].view(BLOCK_HEADER_DTYPE)[0]
+
+    def _block_timestamps(self, block):
+        offset = self._block_offset(block) + BLOCK_HEADER_DTYPE.itemsize
+        count = int(self._block_header(block)["frame_count"])
+        return self._map[offset:offset + 8 * count].view("<u8")
+
+    def _block_samples(self, block, stream, cycle):
+        slot = stream * self.cycles_per_frame + cycle
+        offset = self._block_offset(block) + self._samples_offset + 2 * slot * self.frames_per_block
+        count = int(self._block_header(block)["frame_count"])
+        return self._map[offset:offset + 2 * count].view("<u2")
+
+    def _gather(self, getter, start, count):
+        end = self.frame_count if count is None else min(start + count, self.frame_count)
+        if start >= end:
+            return getter(0)[:0] if len(self._index) else np.empty(0)
+        first = int(np.searchsorted(self._block_start, start, side="right")) - 1
+        last = int(np.searchsorted(self._block_start, end, side="left")) - 1
+        parts = []
+        for block in range(first, last + 1):
+            lo = max(start - self._block_start[block], 0)
+            hi = min(end - self._block_start[block], self._block_start[block + 1] - self._block_start[block])
+            parts.append(getter(block)[lo:hi])
+        return parts[0] if len(parts) == 1 else np.concatenate(parts)
+
+    def timestamps(self, start=0, count=None):
+        """Device timestamps of frames [start, start + count)"""
+        return self._gather(self._block_timestamps, start, count)
+
+    def channel(self, stream, cycle, start=0, count=None):
+        """Samples of one (stream, cycle) slot - with the convert sequence, amplifier
+        channel cycle - 2 of enabled stream `stream` - for frames [start, start + count)"""
+        if not (0 <= stream < self.num_streams and 0 <= cycle < self.cycles_per_frame):
+            raise IndexError("stream or cycle out of range")
+        return self._gather(lambda b: self._block_samples(b, stream, cycle), start, count)
+
+    def seek(self, timestamp):
+        """Frame number of the first frame with a device timestamp >= timestamp"""
+        block = int(np.searchsorted(self._index["last_timestamp"], timestamp, side="left"))
+        if block >= len(self._index):
+            return self.frame_count
+        offset = int(np.searchsorted(self._block_timestamps(block), timestamp, side="left"))
+        return int(self._block_start[block]) + offset
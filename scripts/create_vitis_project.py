@@ -20,6 +20,11 @@ domain = platform.get_domain(name='standalone_ps7_cortexa9_0')
 domain.set_config('lib', lib_name='xiltimer', param='XILTIMER_tick_timer', value='ps7_scutimer_0')
 domain.set_lib('lwip220')
 domain.set_config('lib', lib_name='lwip220', param='lwip220_no_sys_no_timers', value='false')
+# Room for a full 64 KB send window on the TCP frame stream (port 6001)
+domain.set_config('lib', lib_name='lwip220', param='lwip220_tcp_snd_buf', value='65535')
+domain.set_config('lib', lib_name='lwip220', param='lwip220_memp_n_tcp_seg', value='1024')
+domain.set_config('lib', lib_name='lwip220', param='lwip220_mem_size', value='524288')
+domain.set_config('lib', lib_name='lwip220', param='lwip220_memp_n_pbuf', value='1024')
 
 
 domain = platform.add_domain(cpu = "ps7_cortexa9_1",os = "standalone",
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""Build and run the Verilator testbench of the data generator.
+
+Verilates programmable_logic/src (data_generator wrapper, core, FIFO/BRAM interface
+and CIPO phase selector) together with the IDDR simulation model and the C++
+testbench in programmable_logic/sim, then runs it. Arguments after '--' go to the
+testbench, e.g.
+
+    python3 scripts/run_simulation.py
+    python3 scripts/run_simulation.py -- --delay-ns 40 --frames 300 --channels 0x5
+    python3 scripts/run_simulation.py --ports 2 -- --sequence init
+    python3 scripts/run_simulation.py --bram-words 16384 -- --frames 1000
+
+Without a configuration (no --ports, --bram-words or testbench arguments) it runs
+DEFAULT_RUNS: one port with all channels, and two ports with an uneven port 0 mask,
+where a packet can end with the lane packer's overflow word completely full.
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+
+REPO_ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+SRC_DIR = os.path.join(REPO_ROOT, "programmable_logic", "src")
+SIM_DIR = os.path.join(REPO_ROOT, "programmable_logic", "sim")
+
+RTL_SOURCES = [
+    os.path.join(SIM_DIR, "IDDR.v"),
+    os.path.join(SRC_DIR, "CIPO_phase_selector.v"),
+    os.path.join(SRC_DIR, "fifo_bram_interface.sv"),
+    os.path.join(SRC_DIR, "data_generator_core.sv"),
+    os.path.join(SRC_DIR, "data_generator_wrapper.v"),
+]
+
+TB_SOURCES = [
+    os.path.join(SIM_DIR, "tb_data_generator.cpp"),
+    os.path.join(SIM_DIR, "rhd2164_model.cpp"),
+]
+
+# (ports, bram_words, testbench arguments)
+DEFAULT_RUNS = [
+    (1, 65536, []),
+    (2, 65536, ["--channels", "0xF1"]),
+]
+
+
+def build_and_run(args, ports, bram_words, tb_args):
+    bram_addr_width = (bram_words * 4 - 1).bit_length()
+    build_dir = os.path.join(REPO_ROOT, "sim_build", "ports%d_bram%d%s" % (
+        ports, bram_words, "_trace" if args.trace else ""))
+    command = [
+        args.verilator, "--cc", "--exe", "--build", "-j", "0",
+        "--top-module", "data_generator",
+        "-GN_SPI_PORTS=%d" % ports,
+        "-GBRAM_DEPTH_WORDS=%d" % bram_words,
+        "-GBRAM_ADDR_WIDTH=%d" % bram_addr_width,
+        "-Wno-fatal", "-Wno-lint", "-Wno-style",
+        "--Mdir", build_dir,
+        "-o", "tb_data_generator",
+        "-CFLAGS", "-O2 -DN_SPI_PORTS=%d -DBRAM_DEPTH_WORDS=%d -I%s" % (ports, bram_words, SIM_DIR),
+    ]
+    if args.trace:
+        command.append("--trace")
+    command += RTL_SOURCES + TB_SOURCES
+
+    print(" ".join(command))
+    result = subprocess.run(command)
+    if result.returncode != 0:
+        return result.returncode
+    if args.build_only:
+        return 0
+    return subprocess.run([os.path.join(build_dir, "tb_data_generator")] + tb_args).returncode
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--ports", type=int, help="N_SPI_PORTS of the wrapper (1-8, default 1)")
+    parser.add_argument("--bram-words", type=int,
+                        help="BRAM_DEPTH_WORDS of the wrapper (power of 2, 1024-131072, default 65536)")
+    parser.add_argument("--trace", action="store_true", help="Build with VCD tracing (use --vcd <file>)")
+    parser.add_argument("--build-only", action="store_true", help="Build the testbench without running it")
+    parser.add_argument("--verilator", default="verilator", help="Verilator executable")
+    parser.add_argument("tb_args", nargs=argparse.REMAINDER, help="Arguments for the testbench")
+    args = parser.parse_args()
+    tb_args = args.tb_args
+    if tb_args and tb_args[0] == "--":
+        tb_args = tb_args[1:]
+
+    if args.ports is None and args.bram_words is None and not tb_args:
+        runs = DEFAULT_RUNS
+    else:
+        runs = [(args.ports or 1, args.bram_words or 65536, tb_args)]
+    for ports, bram_words, _ in runs:
+        if not 1024 <= bram_words <= 131072 or bram_words & (bram_words - 1):
+            parser.error("--bram-words must be a power of 2 from 1024 to 131072")
+
+    failed = []
+    for ports, bram_words, run_args in runs:
+        if build_and_run(args, ports, bram_words, run_args) != 0:
+            failed.append("--ports %d --bram-words %d -- %s" % (ports, bram_words, " ".join(run_args)))
+    for run in failed:
+        print("FAILED: %s" % run)
+    return 1 if failed else 0
+
+if __name__ == "__main__":
+    sys.exit(main())